@@ -0,0 +1,234 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Compares the per step cost of finding overlapping pairs with
+// broadphase::BVH (tree update plus one query per dynamic leaf) against
+// broadphase::SweepAndPrune (sort plus sweep), for worlds of moving unit
+// boxes of increasing size. A quarter of the boxes are static.
+//
+// Usage: broadphase_sap_bench [seconds_per_config]
+
+#include <madrona/physics.hpp>
+#include <madrona/rand.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace madrona;
+using namespace madrona::math;
+using namespace madrona::phys;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr float delta_t = 1.f / 60.f;
+
+struct BoxObject {
+    CollisionPrimitive prim;
+    AABB primAABB;
+    AABB objAABB;
+    uint32_t primOffset;
+    uint32_t primCount;
+    ObjectManager mgr;
+
+    BoxObject()
+        : prim(),
+          primAABB {
+              .pMin = { -0.5f, -0.5f, -0.5f },
+              .pMax = { 0.5f, 0.5f, 0.5f },
+          },
+          objAABB {
+              .pMin = { -0.5f, -0.5f, -0.5f },
+              .pMax = { 0.5f, 0.5f, 0.5f },
+          },
+          primOffset(0),
+          primCount(1),
+          mgr()
+    {
+        prim.type = CollisionPrimitive::Type::Plane;
+
+        mgr.collisionPrimitives = &prim;
+        mgr.primitiveAABBs = &primAABB;
+        mgr.rigidBodyAABBs = &objAABB;
+        mgr.rigidBodyPrimitiveOffsets = &primOffset;
+        mgr.rigidBodyPrimitiveCounts = &primCount;
+        mgr.metadata = nullptr;
+    }
+};
+
+struct Scene {
+    broadphase::BVH bvh;
+    broadphase::SweepAndPrune sap;
+    HeapArray<broadphase::LeafID> leaves;
+    HeapArray<Vector3> positions;
+    HeapArray<Vector3> velocities;
+    float extent;
+};
+
+bool isStatic(CountT i)
+{
+    return i % 4 == 0;
+}
+
+// Boxes bounce around a cube sized so each one overlaps about 2 others
+void initScene(Scene &scene, CountT num_leaves)
+{
+    scene.extent = cbrtf(8.f * (float)num_leaves / 2.f);
+    RNG rng(7);
+
+    for (CountT i = 0; i < num_leaves; i++) {
+        scene.positions[i] = {
+            scene.extent * rng.sampleUniform(),
+            scene.extent * rng.sampleUniform(),
+            scene.extent * rng.sampleUniform(),
+        };
+
+        if (isStatic(i)) {
+            scene.velocities[i] = Vector3::zero();
+        } else {
+            scene.velocities[i] = {
+                4.f * rng.sampleUniform() - 2.f,
+                4.f * rng.sampleUniform() - 2.f,
+                4.f * rng.sampleUniform() - 2.f,
+            };
+        }
+
+        scene.leaves[i] = scene.bvh.reserveLeaf(
+            Entity { 0, (int32_t)i }, base::ObjectID { 0 });
+    }
+}
+
+void stepScene(Scene &scene, const BoxObject &obj)
+{
+    for (CountT i = 0; i < scene.leaves.size(); i++) {
+        Vector3 &pos = scene.positions[i];
+        Vector3 &vel = scene.velocities[i];
+
+        pos += vel * delta_t;
+        for (CountT axis = 0; axis < 3; axis++) {
+            if (pos[axis] < 0.f || pos[axis] > scene.extent) {
+                vel[axis] = -vel[axis];
+            }
+        }
+
+        scene.bvh.updateLeafPosition(scene.leaves[i], pos,
+            Quat { 1, 0, 0, 0 }, Diag3x3 { 1, 1, 1 }, vel, obj.objAABB,
+            isStatic(i));
+    }
+}
+
+// Same pair filter as the physics system's BVH overlap pass
+uint64_t findBVHPairs(const Scene &scene)
+{
+    uint64_t num_pairs = 0;
+    for (CountT i = 0; i < scene.leaves.size(); i++) {
+        broadphase::LeafID leaf = scene.leaves[i];
+        if (scene.bvh.isStaticLeaf(leaf)) {
+            continue;
+        }
+
+        scene.bvh.findLeafIntersecting(leaf, [&](Entity e) {
+            if (e.id == (int32_t)i) {
+                return;
+            }
+
+            if (!isStatic(e.id) && (int32_t)i >= e.id) {
+                return;
+            }
+
+            num_pairs++;
+        });
+    }
+
+    return num_pairs;
+}
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void runConfig(CountT num_leaves, double seconds)
+{
+    BoxObject obj;
+    Scene scene {
+        .bvh = broadphase::BVH(&obj.mgr, num_leaves, 2.f * delta_t,
+                               100.f * delta_t * delta_t),
+        .sap = broadphase::SweepAndPrune(num_leaves),
+        .leaves = HeapArray<broadphase::LeafID>(num_leaves),
+        .positions = HeapArray<Vector3>(num_leaves),
+        .velocities = HeapArray<Vector3>(num_leaves),
+        .extent = 0.f,
+    };
+    initScene(scene, num_leaves);
+
+    double tree_time = 0.0;
+    double query_time = 0.0;
+    double sap_time = 0.0;
+    uint64_t num_bvh_pairs = 0;
+    uint64_t num_sap_pairs = 0;
+    CountT num_steps = 0;
+
+    auto start = Clock::now();
+    do {
+        stepScene(scene, obj);
+
+        auto tree_start = Clock::now();
+        scene.bvh.updateTree();
+        auto query_start = Clock::now();
+        num_bvh_pairs += findBVHPairs(scene);
+        auto sap_start = Clock::now();
+        scene.sap.update(scene.bvh);
+        scene.sap.findOverlappingPairs(
+            [&](broadphase::LeafID, broadphase::LeafID) {
+                num_sap_pairs++;
+            });
+        auto sap_end = Clock::now();
+
+        tree_time +=
+            std::chrono::duration<double>(query_start - tree_start).count();
+        query_time +=
+            std::chrono::duration<double>(sap_start - query_start).count();
+        sap_time +=
+            std::chrono::duration<double>(sap_end - sap_start).count();
+
+        num_steps++;
+    } while (secondsSince(start) < seconds);
+
+    if (num_bvh_pairs != num_sap_pairs) {
+        fprintf(stderr, "Pair count mismatch: BVH %lu, sweep and prune %lu\n",
+                (unsigned long)num_bvh_pairs, (unsigned long)num_sap_pairs);
+        exit(EXIT_FAILURE);
+    }
+
+    double bvh_ns = (tree_time + query_time) * 1e9 / (double)num_steps;
+    double sap_ns = sap_time * 1e9 / (double)num_steps;
+
+    printf("%6ld bodies: BVH %9.0f ns (tree %9.0f ns), "
+           "sweep and prune %9.0f ns, %6.1f pairs, %5.2fx\n",
+           (long)num_leaves, bvh_ns, tree_time * 1e9 / (double)num_steps,
+           sap_ns, (double)num_sap_pairs / (double)num_steps,
+           bvh_ns / sap_ns);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+    const CountT body_counts[] = { 8, 16, 32, 64, 128, 256, 1024, 4096 };
+
+    for (CountT num_leaves : body_counts) {
+        runConfig(num_leaves, seconds);
+    }
+
+    return 0;
+}
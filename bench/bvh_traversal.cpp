@@ -0,0 +1,180 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Measures broadphase::BVH overlap and ray queries on dense scenes of
+// unit boxes. Build with -DMADRONA_BVH_SCALAR_TRAVERSAL added to
+// CMAKE_CXX_FLAGS to measure the scalar node tests instead of SSE / NEON.
+//
+// Usage: bvh_traversal_bench [seconds_per_config]
+
+#include <madrona/physics.hpp>
+#include <madrona/rand.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace madrona;
+using namespace madrona::math;
+using namespace madrona::phys;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Every leaf is a unit box holding one thin square primitive, which
+// traceRay hits through its plane test
+struct BoxObject {
+    CollisionPrimitive prim;
+    AABB primAABB;
+    AABB objAABB;
+    uint32_t primOffset;
+    uint32_t primCount;
+    ObjectManager mgr;
+
+    BoxObject()
+        : prim(),
+          primAABB {
+              .pMin = { -0.5f, -0.5f, -0.01f },
+              .pMax = { 0.5f, 0.5f, 0.01f },
+          },
+          objAABB {
+              .pMin = { -0.5f, -0.5f, -0.5f },
+              .pMax = { 0.5f, 0.5f, 0.5f },
+          },
+          primOffset(0),
+          primCount(1),
+          mgr()
+    {
+        prim.type = CollisionPrimitive::Type::Plane;
+
+        mgr.collisionPrimitives = &prim;
+        mgr.primitiveAABBs = &primAABB;
+        mgr.rigidBodyAABBs = &objAABB;
+        mgr.rigidBodyPrimitiveOffsets = &primOffset;
+        mgr.rigidBodyPrimitiveCounts = &primCount;
+        mgr.metadata = nullptr;
+    }
+};
+
+struct Scene {
+    broadphase::BVH bvh;
+    HeapArray<broadphase::LeafID> leaves;
+    HeapArray<Vector3> positions;
+};
+
+// Scatters num_leaves boxes through a cube sized so each box overlaps
+// about density others
+void buildScene(Scene &scene, const BoxObject &obj, CountT num_leaves,
+                float density)
+{
+    float extent = cbrtf(8.f * (float)num_leaves / density);
+    RNG rng(5);
+
+    for (CountT i = 0; i < num_leaves; i++) {
+        Vector3 pos;
+        pos.x = extent * rng.sampleUniform();
+        pos.y = extent * rng.sampleUniform();
+        pos.z = extent * rng.sampleUniform();
+
+        broadphase::LeafID leaf = scene.bvh.reserveLeaf(
+            Entity { 0, (int32_t)i }, base::ObjectID { 0 });
+        scene.bvh.updateLeafPosition(leaf, pos, Quat { 1, 0, 0, 0 },
+            Diag3x3 { 1, 1, 1 }, Vector3::zero(), obj.objAABB);
+
+        scene.leaves[i] = leaf;
+        scene.positions[i] = pos;
+    }
+
+    scene.bvh.updateTree();
+}
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void runConfig(CountT num_leaves, float density, double seconds)
+{
+    BoxObject obj;
+    Scene scene {
+        .bvh = broadphase::BVH(&obj.mgr, num_leaves, 0.f, 0.f),
+        .leaves = HeapArray<broadphase::LeafID>(num_leaves),
+        .positions = HeapArray<Vector3>(num_leaves),
+    };
+    buildScene(scene, obj, num_leaves, density);
+
+    uint64_t num_overlaps = 0;
+    CountT num_queries = 0;
+    auto start = Clock::now();
+    double elapsed;
+    do {
+        for (CountT i = 0; i < num_leaves; i++) {
+            scene.bvh.findLeafIntersecting(scene.leaves[i], [&](Entity) {
+                num_overlaps++;
+            });
+        }
+        num_queries += num_leaves;
+        elapsed = secondsSince(start);
+    } while (elapsed < seconds);
+
+    double overlap_ns = elapsed * 1e9 / (double)num_queries;
+    double overlaps_per_query = (double)num_overlaps / (double)num_queries;
+
+    // Rays start at a box and head towards another, so most hit
+    uint64_t num_hits = 0;
+    num_queries = 0;
+    start = Clock::now();
+    do {
+        for (CountT i = 0; i < num_leaves; i++) {
+            Vector3 o = scene.positions[i];
+            Vector3 d = normalize(
+                scene.positions[(i * 7919 + 1) % num_leaves] - o);
+
+            float hit_t;
+            Vector3 hit_normal;
+            Entity hit = scene.bvh.traceRay(o + 0.6f * d, d, &hit_t,
+                                            &hit_normal);
+            num_hits += hit != Entity::none() ? 1 : 0;
+        }
+        num_queries += num_leaves;
+        elapsed = secondsSince(start);
+    } while (elapsed < seconds);
+
+    double ray_ns = elapsed * 1e9 / (double)num_queries;
+    double hit_rate = (double)num_hits / (double)num_queries;
+
+    printf("%8ld leaves, density %4.1f: overlap %7.1f ns (%5.1f hits), "
+           "ray %7.1f ns (%3.0f%% hit)\n",
+           (long)num_leaves, density, overlap_ns, overlaps_per_query,
+           ray_ns, hit_rate * 100.0);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+#if defined(MADRONA_BVH_SCALAR_TRAVERSAL)
+    printf("Scalar node tests\n");
+#else
+    printf("SIMD node tests\n");
+#endif
+
+    const CountT leaf_counts[] = { 1000, 10000, 100000 };
+    const float densities[] = { 2.f, 8.f, 32.f };
+
+    for (CountT num_leaves : leaf_counts) {
+        for (float density : densities) {
+            runConfig(num_leaves, density, seconds);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,423 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Compares the XPBD and TGS solvers on stacks of unit boxes resting on a
+// ground plane. Each configuration reports the per world step cost and
+// how far the top box drifted sideways and sank below its rest height
+// over the second half of the run, then the cheapest substep count of
+// each solver that keeps the stack within tolerance is compared.
+//
+// Usage: tgs_solver_bench [num_worlds] [num_steps]
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+#include <madrona/physics.hpp>
+#include <madrona/physics_assets.hpp>
+#include <madrona/physics_loader.hpp>
+#include <madrona/importer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace madrona;
+using namespace madrona::base;
+using namespace madrona::math;
+using namespace madrona::phys;
+
+namespace {
+
+using Solver = PhysicsSystem::Solver;
+
+constexpr float delta_t = 1.f / 60.f;
+
+// A stack is within tolerance if the top box stays this close to its
+// starting column, and sinks below its rest height by at most this much
+// per box underneath. Both solvers leave resting contacts slightly
+// overlapped (TGS deliberately, by its linear slop), so the sink of
+// a stable stack still grows with its height.
+constexpr float max_drift = 0.01f;
+constexpr float max_sink_per_box = 0.01f;
+
+enum ObjectIDs : int32_t {
+    Box = 0,
+    Ground = 1,
+};
+
+struct PhysicsBody : Archetype<RigidBody> {};
+
+struct BenchConfig {
+    ObjectManager *objMgr;
+    Solver solver;
+    CountT numSubsteps;
+    CountT stackHeight;
+    CountT numSteps;
+};
+
+struct WorldInit {};
+
+class Engine;
+
+struct BenchWorld : WorldBase {
+    BenchWorld(Engine &ctx, const BenchConfig &cfg, const WorldInit &);
+
+    static void registerTypes(ECSRegistry &registry, const BenchConfig &cfg);
+    static void setupTasks(TaskGraphManager &mgr, const BenchConfig &cfg);
+
+    Entity top;
+    Vector3 topStart;
+    CountT curStep;
+    CountT numSteps;
+    float drift;
+    float sink;
+};
+
+class Engine : public CustomContext<Engine, BenchWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+// Singleton that gives the tracking system something to run over
+struct StackTracker {};
+
+Entity makeBody(Engine &ctx, Vector3 pos, ObjectIDs obj,
+                ResponseType response_type)
+{
+    Entity e = ctx.makeEntity<PhysicsBody>();
+    ctx.get<Position>(e) = pos;
+    ctx.get<Rotation>(e) = Quat { 1, 0, 0, 0 };
+    ctx.get<Scale>(e) = Diag3x3 { 1, 1, 1 };
+    ctx.get<ObjectID>(e) = ObjectID { obj };
+    ctx.get<ResponseType>(e) = response_type;
+    ctx.get<Velocity>(e) = { Vector3::zero(), Vector3::zero() };
+    ctx.get<ExternalForce>(e) = Vector3::zero();
+    ctx.get<ExternalTorque>(e) = Vector3::zero();
+    ctx.get<broadphase::LeafID>(e) =
+        PhysicsSystem::registerEntity(ctx, e, ObjectID { obj });
+
+    return e;
+}
+
+BenchWorld::BenchWorld(Engine &ctx, const BenchConfig &cfg,
+                       const WorldInit &)
+    : WorldBase(ctx),
+      top(Entity::none()),
+      topStart(Vector3::zero()),
+      curStep(0),
+      numSteps(cfg.numSteps),
+      drift(0.f),
+      sink(0.f)
+{
+    PhysicsSystem::init(ctx, cfg.objMgr, delta_t, cfg.numSubsteps,
+                        Vector3 { 0, 0, -9.8f }, cfg.stackHeight + 1,
+                        cfg.solver);
+
+    makeBody(ctx, Vector3::zero(), Ground, ResponseType::Static);
+
+    for (CountT i = 0; i < cfg.stackHeight; i++) {
+        topStart = Vector3 { 0, 0, 0.5f + (float)i };
+        top = makeBody(ctx, topStart, Box, ResponseType::Dynamic);
+    }
+}
+
+void BenchWorld::registerTypes(ECSRegistry &registry, const BenchConfig &cfg)
+{
+    base::registerTypes(registry);
+    PhysicsSystem::registerTypes(registry, cfg.solver);
+
+    registry.registerArchetype<PhysicsBody>();
+    registry.registerSingleton<StackTracker>();
+}
+
+// Records the worst drift and sink over the second half of the run,
+// once the stack has had time to settle
+static void trackStack(Engine &ctx, StackTracker &)
+{
+    BenchWorld &world = ctx.data();
+
+    if (++world.curStep <= world.numSteps / 2) {
+        return;
+    }
+
+    Vector3 pos = ctx.get<Position>(world.top);
+    Vector3 delta = pos - world.topStart;
+
+    world.drift = fmaxf(world.drift,
+        sqrtf(delta.x * delta.x + delta.y * delta.y));
+    world.sink = fmaxf(world.sink, -delta.z);
+}
+
+void BenchWorld::setupTasks(TaskGraphManager &mgr, const BenchConfig &cfg)
+{
+    TaskGraphBuilder &builder = mgr.init(0);
+
+    auto broadphase = PhysicsSystem::setupBroadphaseTasks(builder, {});
+    auto step = PhysicsSystem::setupPhysicsStepTasks(
+        builder, {broadphase}, cfg.numSubsteps, cfg.solver);
+    auto track = builder.addToGraph<ParallelForNode<Engine,
+        trackStack, StackTracker>>({step});
+    PhysicsSystem::setupCleanupTasks(builder, {track});
+}
+
+using Executor = TaskGraphExecutor<Engine, BenchWorld, BenchConfig,
+                                   WorldInit>;
+
+// The box and the ground plane, both with the default friction
+struct Assets {
+    PhysicsLoader loader;
+    ObjectManager *objMgr;
+
+    Assets()
+        : loader(ExecMode::CPU, 2),
+          objMgr(nullptr)
+    {
+        Vector3 positions[8];
+        for (CountT i = 0; i < 8; i++) {
+            positions[i] = Vector3 {
+                (i & 1) ? 0.5f : -0.5f,
+                (i & 2) ? 0.5f : -0.5f,
+                (i & 4) ? 0.5f : -0.5f,
+            };
+        }
+
+        // Counter clockwise seen from outside, -x, +x, -y, +y, -z, +z
+        uint32_t indices[] = {
+            0, 4, 6, 2,
+            1, 3, 7, 5,
+            0, 1, 5, 4,
+            2, 6, 7, 3,
+            0, 2, 3, 1,
+            4, 5, 7, 6,
+        };
+
+        uint32_t face_counts[] = { 4, 4, 4, 4, 4, 4 };
+
+        imp::SourceMesh box_mesh {
+            .positions = positions,
+            .normals = nullptr,
+            .tangentAndSigns = nullptr,
+            .uvs = nullptr,
+            .indices = indices,
+            .faceCounts = face_counts,
+            .faceMaterials = nullptr,
+            .numVertices = 8,
+            .numFaces = 6,
+            .materialIDX = 0,
+        };
+
+        SourceCollisionPrimitive box_prim {
+            .type = CollisionPrimitive::Type::Hull,
+            .hullInput = { .hullIDX = 0 },
+        };
+
+        SourceCollisionPrimitive plane_prim {
+            .type = CollisionPrimitive::Type::Plane,
+            .plane = {},
+        };
+
+        RigidBodyFrictionData friction {
+            .muS = 0.5f,
+            .muD = 0.5f,
+        };
+
+        // Indexed by ObjectIDs
+        SourceCollisionObject objs[] = {
+            {
+                .prims = Span<const SourceCollisionPrimitive>(&box_prim, 1),
+                .invMass = 1.f,
+                .friction = friction,
+            },
+            {
+                .prims = Span<const SourceCollisionPrimitive>(&plane_prim, 1),
+                .invMass = 0.f,
+                .friction = friction,
+            },
+        };
+
+        StackAlloc tmp_alloc;
+        RigidBodyAssets assets;
+        CountT num_bytes;
+        void *buffer = RigidBodyAssets::processRigidBodyAssets(
+            Span<const imp::SourceMesh>(&box_mesh, 1),
+            Span<const SourceCollisionObject>(objs, 2),
+            false, tmp_alloc, &assets, &num_bytes);
+
+        if (buffer == nullptr) {
+            fprintf(stderr, "Failed to process the box hull\n");
+            exit(EXIT_FAILURE);
+        }
+
+        loader.loadRigidBodies(assets);
+        free(buffer);
+
+        objMgr = &loader.getObjectManager();
+    }
+};
+
+struct Result {
+    double stepUS;
+    float drift;
+    float sink;
+    CountT stackHeight;
+
+    bool stable() const
+    {
+        return drift <= max_drift &&
+            sink <= max_sink_per_box * float(stackHeight);
+    }
+};
+
+Result runConfig(Assets &assets, Solver solver, CountT num_substeps,
+                 CountT stack_height, CountT num_worlds, CountT num_steps)
+{
+    HeapArray<WorldInit> inits(num_worlds);
+
+    // A single worker, so the cost is the solver's rather than the
+    // thread pool's
+    Executor exec({
+        .numWorlds = uint32_t(num_worlds),
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, BenchConfig {
+        .objMgr = assets.objMgr,
+        .solver = solver,
+        .numSubsteps = num_substeps,
+        .stackHeight = stack_height,
+        .numSteps = num_steps,
+    }, inits.data(), 1);
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    for (CountT i = 0; i < num_steps; i++) {
+        exec.run();
+    }
+    double elapsed =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    Result result {
+        .stepUS = elapsed * 1e6 / double(num_steps * num_worlds),
+        .drift = 0.f,
+        .sink = 0.f,
+        .stackHeight = stack_height,
+    };
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        const BenchWorld &world = exec.getWorldData(i);
+        result.drift = fmaxf(result.drift, world.drift);
+        result.sink = fmaxf(result.sink, world.sink);
+    }
+
+    return result;
+}
+
+const char * solverName(Solver solver)
+{
+    return solver == Solver::XPBD ? "XPBD" : "TGS";
+}
+
+constexpr CountT num_solvers = 2;
+constexpr Solver solvers[num_solvers] = { Solver::XPBD, Solver::TGS };
+
+constexpr CountT num_stack_heights = 3;
+constexpr CountT stack_heights[num_stack_heights] = { 4, 8, 16 };
+
+constexpr CountT num_substep_counts = 6;
+constexpr CountT substep_counts[num_substep_counts] = { 1, 2, 4, 8, 16, 32 };
+
+using SolverResults = Result[num_stack_heights][num_substep_counts];
+
+void sweepSolver(Solver solver, CountT num_worlds, CountT num_steps,
+                 SolverResults &results)
+{
+    Assets assets;
+
+    for (CountT i = 0; i < num_stack_heights; i++) {
+        for (CountT j = 0; j < num_substep_counts; j++) {
+            results[i][j] = runConfig(assets, solver, substep_counts[j],
+                stack_heights[i], num_worlds, num_steps);
+        }
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    CountT num_worlds = argc > 1 ? atoi(argv[1]) : 64;
+    CountT num_steps = argc > 2 ? atoi(argv[2]) : 600;
+
+    // The solver's per body state is bound to RigidBody once per process
+    // (SolverBundleAlias), so each solver is swept in its own child
+    // process, which writes its results to shared memory
+    auto results = (SolverResults *)mmap(nullptr,
+        sizeof(SolverResults) * num_solvers, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (results == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the results\n");
+        return EXIT_FAILURE;
+    }
+
+    for (CountT solver_idx = 0; solver_idx < num_solvers; solver_idx++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            sweepSolver(solvers[solver_idx], num_worlds, num_steps,
+                        results[solver_idx]);
+            _exit(0);
+        }
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s sweep failed\n",
+                    solverName(solvers[solver_idx]));
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (CountT i = 0; i < num_stack_heights; i++) {
+        printf("Stack of %ld boxes\n", (long)stack_heights[i]);
+
+        CountT cheapest[num_solvers] = { -1, -1 };
+
+        for (CountT solver_idx = 0; solver_idx < num_solvers; solver_idx++) {
+            for (CountT j = 0; j < num_substep_counts; j++) {
+                const Result &result = results[solver_idx][i][j];
+
+                printf("  %4s %2ld substeps: %8.2f us/step, "
+                       "drift %.4f, sink %.4f%s\n",
+                       solverName(solvers[solver_idx]),
+                       (long)substep_counts[j], result.stepUS,
+                       result.drift, result.sink,
+                       result.stable() ? "" : " (unstable)");
+
+                if (result.stable() && cheapest[solver_idx] == -1) {
+                    cheapest[solver_idx] = j;
+                }
+            }
+        }
+
+        if (cheapest[0] != -1 && cheapest[1] != -1) {
+            printf("  Stable at XPBD %ld / TGS %ld substeps: "
+                   "TGS step costs %.2fx XPBD's\n",
+                   (long)substep_counts[cheapest[0]],
+                   (long)substep_counts[cheapest[1]],
+                   results[1][i][cheapest[1]].stepUS /
+                   results[0][i][cheapest[0]].stepUS);
+        }
+    }
+
+    munmap(results, sizeof(SolverResults) * num_solvers);
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Measures CPU backend throughput for many small worlds with one world
+// claimed per grab (jobsPerChunk = 1) versus auto-sized chunks
+// (jobsPerChunk = 0).
+//
+// With 1 worker on 1 core (`world_batching_bench 1 2`, two runs), auto
+// chunks step 1024 - 16384 worlds of 8 entities 1.5 - 1.6x faster and
+// worlds of 32 entities 1.1 - 1.3x faster. At 256 entities the two are
+// within 5%. All of that is the per job cost of claiming and completing
+// a world. Whether chunks also cut contention between many workers on
+// as many cores hasn't been measured, so jobsPerChunk still defaults
+// to 1.
+//
+// Usage: world_batching_bench [num_workers] [seconds_per_config]
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace madrona;
+
+namespace {
+
+struct Position {
+    float x, y, z;
+};
+
+struct Velocity {
+    float x, y, z;
+};
+
+struct Body : Archetype<Position, Velocity> {};
+
+struct BenchConfig {
+    CountT numEntities;
+};
+
+struct WorldInit {};
+
+class Engine;
+
+struct BenchWorld : WorldBase {
+    BenchWorld(Engine &ctx, const BenchConfig &cfg, const WorldInit &);
+
+    static void registerTypes(ECSRegistry &registry, const BenchConfig &);
+    static void setupTasks(TaskGraphManager &mgr, const BenchConfig &);
+};
+
+class Engine : public CustomContext<Engine, BenchWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+BenchWorld::BenchWorld(Engine &ctx, const BenchConfig &cfg,
+                       const WorldInit &)
+    : WorldBase(ctx)
+{
+    Span<const Entity> bodies = ctx.makeEntities<Body>(cfg.numEntities);
+    for (CountT i = 0; i < cfg.numEntities; i++) {
+        Entity e = bodies[i];
+        ctx.get<Position>(e) = { 0.f, 0.f, 0.f };
+        ctx.get<Velocity>(e) = { 1.f, (float)i, 0.5f };
+    }
+}
+
+void BenchWorld::registerTypes(ECSRegistry &registry, const BenchConfig &)
+{
+    registry.registerComponent<Position>();
+    registry.registerComponent<Velocity>();
+    registry.registerArchetype<Body>();
+}
+
+static void integrateSystem(Engine &, Position &pos, const Velocity &vel)
+{
+    pos.x += vel.x * 0.01f;
+    pos.y += vel.y * 0.01f;
+    pos.z += vel.z * 0.01f;
+}
+
+static void dampSystem(Engine &, Velocity &vel)
+{
+    vel.x *= 0.999f;
+    vel.y *= 0.999f;
+    vel.z *= 0.999f;
+}
+
+void BenchWorld::setupTasks(TaskGraphManager &mgr, const BenchConfig &)
+{
+    TaskGraphBuilder &builder = mgr.init(0);
+    auto integrate = builder.addToGraph<ParallelForNode<Engine,
+        integrateSystem, Position, Velocity>>({});
+    builder.addToGraph<ParallelForNode<Engine, dampSystem, Velocity>>(
+        {integrate});
+}
+
+using Executor = TaskGraphExecutor<Engine, BenchWorld, BenchConfig,
+                                   WorldInit>;
+
+double measureWorldStepsPerSec(CountT num_worlds, CountT num_entities,
+                               uint32_t num_workers,
+                               uint32_t jobs_per_chunk,
+                               double seconds)
+{
+    HeapArray<WorldInit> inits(num_worlds);
+
+    Executor exec({
+        .numWorlds = uint32_t(num_worlds),
+        .numExportedBuffers = 0,
+        .numWorkers = num_workers,
+        .jobsPerChunk = jobs_per_chunk,
+    }, BenchConfig { num_entities }, inits.data(), 1);
+
+    // Warm up caches and allocations
+    for (CountT i = 0; i < 10; i++) {
+        exec.run();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    double elapsed;
+    CountT num_steps = 0;
+    do {
+        exec.run();
+        num_steps++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < seconds);
+
+    return double(num_steps * num_worlds) / elapsed;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t num_workers = argc > 1 ? (uint32_t)atoi(argv[1]) : 0;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    const CountT world_counts[] = { 1024, 4096, 16384 };
+    const CountT entity_counts[] = { 8, 32, 256 };
+
+    printf("%8s %9s %16s %16s %8s\n", "worlds", "entities",
+           "1/grab (w-st/s)", "auto (w-st/s)", "speedup");
+
+    for (CountT num_worlds : world_counts) {
+        for (CountT num_entities : entity_counts) {
+            double single = measureWorldStepsPerSec(num_worlds,
+                num_entities, num_workers, 1, seconds);
+            double chunked = measureWorldStepsPerSec(num_worlds,
+                num_entities, num_workers, 0, seconds);
+
+            printf("%8ld %9ld %16.0f %16.0f %7.2fx\n",
+                   (long)num_worlds, (long)num_entities, single, chunked,
+                   chunked / single);
+        }
+    }
+}
@@ -3,6 +3,15 @@
 #include <madrona/math.hpp>
 #include <madrona/context.hpp>
 
+// Node tests use SSE or NEON unless MADRONA_BVH_SCALAR_TRAVERSAL is defined
+#if !defined(MADRONA_GPU_MODE) && !defined(MADRONA_BVH_SCALAR_TRAVERSAL)
+#if defined(MADRONA_X64)
+#include <immintrin.h>
+#elif defined(MADRONA_ARM)
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace madrona::phys {
 
 struct ObjectManager;
@@ -24,6 +33,8 @@ public:
 
     inline LeafID reserveLeaf(Entity e, base::ObjectID obj_id);
     inline math::AABB getLeafAABB(LeafID leaf_id) const;
+    inline Entity getLeafEntity(LeafID leaf_id) const;
+    inline CountT numLeaves() const;
 
     template <typename Fn>
     inline void findIntersecting(const math::AABB &aabb, Fn &&fn) const;
@@ -37,25 +48,59 @@ public:
                     math::Vector3 *out_hit_normal,
                     float t_max = float(INFINITY));
 
+    // Static leaves are kept in a separate tree, which is only rebuilt
+    // when a leaf becomes static or dynamic or a static leaf moves. Both
+    // trees are searched by findIntersecting and traceRay.
     void updateLeafPosition(LeafID leaf_id,
                             const math::Vector3 &pos,
                             const math::Quat &rot,
                             const math::Diag3x3 &scale,
                             const math::Vector3 &linear_vel,
-                            const math::AABB &obj_aabb);
+                            const math::AABB &obj_aabb,
+                            bool is_static = false);
 
     math::AABB expandLeaf(LeafID leaf_id,
                           const math::Vector3 &linear_vel);
 
     void refitLeaf(LeafID leaf_id, const math::AABB &leaf_aabb);
 
+    inline bool isStaticLeaf(LeafID leaf_id) const;
+
     inline void rebuildOnUpdate();
+    // Reinserts the dynamic leaves that left their fat AABB since the last
+    // update and refits the dynamic tree bottom up. The tree is only
+    // rebuilt when requested, when the static tree changed or when its SAH
+    // cost has degraded past rebuild_cost_ratio_.
     void updateTree();
 
+    // Full rebuilds and leaf reinsertions done by updateTree so far. These
+    // aren't saved with snapshots.
+    inline uint32_t numRebuilds() const;
+    inline uint32_t numReinsertions() const;
+
     inline void clearLeaves();
 
+    // Saves and restores the tree and leaves with world snapshots, see
+    // StateManager::registerSingletonSnapshot
+    uint64_t snapshotBytes() const;
+    void saveSnapshot(void *dst) const;
+    void loadSnapshot(const void *src);
+
+    // Bytes allocated for max_leaves, see StateManager::memoryReport
+    uint64_t memoryBytes() const;
+
 private:
     static constexpr int32_t sentinel_ = 0xFFFF'FFFF_i32;
+    // Multiple of the SAH cost right after a rebuild that triggers the
+    // next rebuild
+    static constexpr float rebuild_cost_ratio_ = 1.5f;
+    // Fat AABBs look this many times further along the velocity than
+    // leaf_velocity_expansion_, so moving leaves stay in them for a few
+    // steps
+    static constexpr float fat_velocity_scale_ = 4.f;
+    // Leaves whose fat AABB has this many times the surface area of a
+    // fresh one are reinserted with the tighter one
+    static constexpr float fat_area_ratio_ = 4.f;
 
     struct Node {
         float minX[4];
@@ -74,6 +119,17 @@ private:
         inline void setInternal(CountT child, int32_t internal_idx);
         inline bool hasChild(CountT child) const;
         inline void clearChild(CountT child);
+
+        inline math::AABB childAABB(CountT child) const;
+        inline void setChildAABB(CountT child, const math::AABB &aabb);
+        inline math::AABB mergedAABB() const;
+
+        // Test all four children at once. Bit i of the result is set if
+        // child i exists and its bounds pass the test.
+        inline uint32_t overlapMask(const math::AABB &aabb) const;
+        inline uint32_t rayMask(math::Vector3 ray_o,
+                                math::Diag3x3 inv_ray_d,
+                                float t_max) const;
     };
 
     // FIXME: evaluate whether storing this in-line in the tree
@@ -87,7 +143,11 @@ private:
     inline CountT numInternalNodes(CountT num_leaves) const;
 
     void rebuild();
-    void refit(LeafID *leaf_ids, CountT num_moved);
+    int32_t buildTree(int32_t node_offset,
+                      int32_t leaf_offset,
+                      int32_t num_leaves);
+    void reinsertLeaf(int32_t leaf_idx);
+    float refitDynamicTree();
 
     bool traceRayIntoLeaf(int32_t leaf_idx,
                           math::Vector3 world_ray_o,
@@ -104,14 +164,75 @@ private:
     const ObjectManager *obj_mgr_;
     base::ObjectID *leaf_obj_ids_;
     math::AABB *leaf_aabbs_; // FIXME: remove this, it's duplicated data
+    // The bounds stored in the tree, which contain leaf_aabbs_
+    math::AABB *leaf_fat_aabbs_;
     LeafTransform  *leaf_transforms_;
     uint32_t *leaf_parents_;
     int32_t *sorted_leaves_;
+    uint8_t *leaf_static_;
     AtomicI32 num_leaves_;
     int32_t num_allocated_leaves_;
     float leaf_velocity_expansion_;
     float leaf_accel_expansion_;
     bool force_rebuild_;
+    // The static tree is rooted at node 0 and the dynamic tree at
+    // num_static_nodes_, after it
+    int32_t num_static_leaves_;
+    int32_t num_static_nodes_;
+    AtomicI32 static_dirty_;
+    // Dynamic leaves to reinsert in the next updateTree
+    int32_t *moved_leaves_;
+    AtomicI32 num_moved_leaves_;
+    float rebuild_cost_;
+    uint32_t num_rebuilds_;
+    uint32_t num_reinsertions_;
+};
+
+// Sort-based alternative to the BVH's overlap queries, which is cheaper
+// for worlds with only a few dozen bodies. Leaves are kept sorted by the
+// lower x bound of their BVH AABB. The order barely changes between
+// steps, so an insertion sort restores it in close to linear time, and
+// the sweep tests the remaining bounds of four leaves at once. The BVH
+// still owns the leaves and answers ray and AABB queries.
+class SweepAndPrune {
+public:
+    SweepAndPrune(CountT max_leaves);
+
+    // Picks up leaves reserved or cleared in bvh since the last update and
+    // sorts all leaves by their current bounds
+    void update(const BVH &bvh);
+
+    // Calls fn(a, b) once for every pair of overlapping leaves that aren't
+    // both static, using the bounds from the last update
+    template <typename Fn>
+    inline void findOverlappingPairs(Fn &&fn) const;
+
+    // Only the sort order is saved, the bounds are refreshed by update
+    uint64_t snapshotBytes() const;
+    void saveSnapshot(void *dst) const;
+    void loadSnapshot(const void *src);
+
+    uint64_t memoryBytes() const;
+
+private:
+    // The sweep reads 4 leaves at a time, so the bounds arrays are padded
+    // with empty bounds past the last leaf
+    static constexpr int32_t simd_padding_ = 3;
+
+    // Bit k is set if the leaf at sorted position other_idx + k overlaps
+    // the one at leaf_idx
+    inline uint32_t overlapMask(int32_t leaf_idx, int32_t other_idx) const;
+
+    int32_t *sorted_leaves_;
+    float *min_x_;
+    float *max_x_;
+    float *min_y_;
+    float *max_y_;
+    float *min_z_;
+    float *max_z_;
+    uint8_t *leaf_static_;
+    int32_t num_leaves_;
+    int32_t num_allocated_leaves_;
 };
 
 }
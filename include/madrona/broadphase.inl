@@ -7,6 +7,8 @@ LeafID BVH::reserveLeaf(Entity e, base::ObjectID obj_id)
 
     leaf_entities_[leaf_idx] = e;
     leaf_obj_ids_[leaf_idx] = obj_id;
+    leaf_static_[leaf_idx] = 0;
+    leaf_fat_aabbs_[leaf_idx] = math::AABB::invalid();
 
     return LeafID {
         leaf_idx,
@@ -18,41 +20,44 @@ math::AABB BVH::getLeafAABB(LeafID leaf_id) const
     return leaf_aabbs_[leaf_id.id];
 }
 
+Entity BVH::getLeafEntity(LeafID leaf_id) const
+{
+    return leaf_entities_[leaf_id.id];
+}
+
+CountT BVH::numLeaves() const
+{
+    return num_leaves_.load_relaxed();
+}
+
 template <typename Fn>
 void BVH::findIntersecting(const math::AABB &aabb, Fn &&fn) const
 {
     int32_t stack[32];
-    stack[0] = 0;
+    stack[0] = num_static_nodes_;
     CountT stack_size = 1;
+    if (num_static_leaves_ > 0) {
+        stack[stack_size++] = 0;
+    }
 
     while (stack_size > 0) {
         int32_t node_idx = stack[--stack_size];
         const Node &node = nodes_[node_idx];
+
+        uint32_t hit_mask = node.overlapMask(aabb);
         for (int i = 0; i < 4; i++) {
-            if (!node.hasChild(i)) {
-                continue; // Technically this could be break?
-            };
-
-            madrona::math::AABB child_aabb {
-                /* .pMin = */ {
-                    node.minX[i],
-                    node.minY[i],
-                    node.minZ[i],
-                },
-                /* .pMax = */ {
-                    node.maxX[i],
-                    node.maxY[i],
-                    node.maxZ[i],
-                },
-            };
-
-            if (aabb.overlaps(child_aabb)) {
-                if (node.isLeaf(i)) {
-                    Entity e = leaf_entities_[node.leafIDX(i)];
-                    fn(e);
-                } else {
-                    stack[stack_size++] = node.children[i];
+            if ((hit_mask & (1u << i)) == 0) {
+                continue;
+            }
+
+            if (node.isLeaf(i)) {
+                // The tree holds fat AABBs, so recheck the leaf's own
+                int32_t leaf_idx = node.leafIDX(i);
+                if (aabb.overlaps(leaf_aabbs_[leaf_idx])) {
+                    fn(leaf_entities_[leaf_idx]);
                 }
+            } else {
+                stack[stack_size++] = node.children[i];
             }
         }
     }
@@ -65,11 +70,26 @@ void BVH::findLeafIntersecting(LeafID leaf_id, Fn &&fn) const
     findIntersecting(leaf_aabb, std::forward<Fn>(fn));
 }
 
+bool BVH::isStaticLeaf(LeafID leaf_id) const
+{
+    return leaf_static_[leaf_id.id] != 0;
+}
+
 void BVH::rebuildOnUpdate()
 {
     force_rebuild_ = true;
 }
 
+uint32_t BVH::numRebuilds() const
+{
+    return num_rebuilds_;
+}
+
+uint32_t BVH::numReinsertions() const
+{
+    return num_reinsertions_;
+}
+
 void BVH::clearLeaves()
 {
     num_leaves_.store_relaxed(0);
@@ -105,4 +125,237 @@ void BVH::Node::clearChild(CountT child)
     children[child] = sentinel_;
 }
 
+math::AABB BVH::Node::childAABB(CountT child) const
+{
+    return math::AABB {
+        .pMin = { minX[child], minY[child], minZ[child] },
+        .pMax = { maxX[child], maxY[child], maxZ[child] },
+    };
+}
+
+void BVH::Node::setChildAABB(CountT child, const math::AABB &aabb)
+{
+    minX[child] = aabb.pMin.x;
+    minY[child] = aabb.pMin.y;
+    minZ[child] = aabb.pMin.z;
+    maxX[child] = aabb.pMax.x;
+    maxY[child] = aabb.pMax.y;
+    maxZ[child] = aabb.pMax.z;
+}
+
+// Empty children have inverted bounds, so they don't affect the result
+math::AABB BVH::Node::mergedAABB() const
+{
+    math::AABB aabb = childAABB(0);
+    for (CountT i = 1; i < 4; i++) {
+        aabb = math::AABB::merge(aabb, childAABB(i));
+    }
+
+    return aabb;
+}
+
+uint32_t BVH::Node::overlapMask(const math::AABB &aabb) const
+{
+#if defined(MADRONA_GPU_MODE) || defined(MADRONA_BVH_SCALAR_TRAVERSAL)
+    uint32_t mask = 0;
+    for (CountT i = 0; i < 4; i++) {
+        bool overlaps = hasChild(i) &&
+            minX[i] < aabb.pMax.x && aabb.pMin.x < maxX[i] &&
+            minY[i] < aabb.pMax.y && aabb.pMin.y < maxY[i] &&
+            minZ[i] < aabb.pMax.z && aabb.pMin.z < maxZ[i];
+
+        mask |= uint32_t(overlaps) << i;
+    }
+
+    return mask;
+#elif defined(MADRONA_X64)
+    __m128 x = _mm_and_ps(
+        _mm_cmplt_ps(_mm_loadu_ps(minX), _mm_set1_ps(aabb.pMax.x)),
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.x), _mm_loadu_ps(maxX)));
+    __m128 y = _mm_and_ps(
+        _mm_cmplt_ps(_mm_loadu_ps(minY), _mm_set1_ps(aabb.pMax.y)),
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.y), _mm_loadu_ps(maxY)));
+    __m128 z = _mm_and_ps(
+        _mm_cmplt_ps(_mm_loadu_ps(minZ), _mm_set1_ps(aabb.pMax.z)),
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.z), _mm_loadu_ps(maxZ)));
+    __m128i empty = _mm_cmpeq_epi32(
+        _mm_loadu_si128((const __m128i *)children),
+        _mm_set1_epi32(sentinel_));
+
+    __m128 hit = _mm_andnot_ps(_mm_castsi128_ps(empty),
+                               _mm_and_ps(x, _mm_and_ps(y, z)));
+    return (uint32_t)_mm_movemask_ps(hit);
+#elif defined(MADRONA_ARM)
+    uint32x4_t x = vandq_u32(
+        vcltq_f32(vld1q_f32(minX), vdupq_n_f32(aabb.pMax.x)),
+        vcltq_f32(vdupq_n_f32(aabb.pMin.x), vld1q_f32(maxX)));
+    uint32x4_t y = vandq_u32(
+        vcltq_f32(vld1q_f32(minY), vdupq_n_f32(aabb.pMax.y)),
+        vcltq_f32(vdupq_n_f32(aabb.pMin.y), vld1q_f32(maxY)));
+    uint32x4_t z = vandq_u32(
+        vcltq_f32(vld1q_f32(minZ), vdupq_n_f32(aabb.pMax.z)),
+        vcltq_f32(vdupq_n_f32(aabb.pMin.z), vld1q_f32(maxZ)));
+    uint32x4_t empty = vceqq_s32(vld1q_s32(children),
+                                 vdupq_n_s32(sentinel_));
+
+    uint32x4_t hit = vbicq_u32(vandq_u32(x, vandq_u32(y, z)), empty);
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(hit, vld1q_u32(lane_bits)));
+#endif
+}
+
+// Slab test from AABB::rayIntersects. A ray lying exactly on a child's
+// slab plane gives NaN for that slab, which is ignored, so such children
+// are conservatively reported as hit.
+uint32_t BVH::Node::rayMask(math::Vector3 ray_o,
+                            math::Diag3x3 inv_ray_d,
+                            float t_max) const
+{
+#if defined(MADRONA_GPU_MODE) || defined(MADRONA_BVH_SCALAR_TRAVERSAL)
+    uint32_t mask = 0;
+    for (CountT i = 0; i < 4; i++) {
+        math::AABB child_aabb {
+            .pMin = { minX[i], minY[i], minZ[i] },
+            .pMax = { maxX[i], maxY[i], maxZ[i] },
+        };
+
+        bool hit = hasChild(i) &&
+            child_aabb.rayIntersects(ray_o, inv_ray_d, 0.f, t_max);
+
+        mask |= uint32_t(hit) << i;
+    }
+
+    return mask;
+#elif defined(MADRONA_X64)
+    // _mm_min_ps and _mm_max_ps return their second operand when either is
+    // NaN, so the running bounds are always passed second
+    auto slab = [](__m128 &t_near, __m128 &t_far, const float *mins,
+                   const float *maxs, float o, float inv_d) {
+        __m128 o_v = _mm_set1_ps(o);
+        __m128 inv_d_v = _mm_set1_ps(inv_d);
+        __m128 t_lower = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins), o_v),
+                                    inv_d_v);
+        __m128 t_upper = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs), o_v),
+                                    inv_d_v);
+
+        t_near = _mm_max_ps(_mm_min_ps(t_lower, t_upper), t_near);
+        t_far = _mm_min_ps(_mm_max_ps(t_lower, t_upper), t_far);
+    };
+
+    __m128 t_near = _mm_setzero_ps();
+    __m128 t_far = _mm_set1_ps(t_max);
+    slab(t_near, t_far, minX, maxX, ray_o.x, inv_ray_d.d0);
+    slab(t_near, t_far, minY, maxY, ray_o.y, inv_ray_d.d1);
+    slab(t_near, t_far, minZ, maxZ, ray_o.z, inv_ray_d.d2);
+
+    __m128i empty = _mm_cmpeq_epi32(
+        _mm_loadu_si128((const __m128i *)children),
+        _mm_set1_epi32(sentinel_));
+
+    __m128 hit = _mm_andnot_ps(_mm_castsi128_ps(empty),
+                               _mm_cmple_ps(t_near, t_far));
+    return (uint32_t)_mm_movemask_ps(hit);
+#elif defined(MADRONA_ARM)
+    // vmaxnmq_f32 and vminnmq_f32 ignore NaN operands like fmaxf / fminf
+    auto slab = [](float32x4_t &t_near, float32x4_t &t_far,
+                   const float *mins, const float *maxs,
+                   float o, float inv_d) {
+        float32x4_t o_v = vdupq_n_f32(o);
+        float32x4_t t_lower = vmulq_n_f32(vsubq_f32(vld1q_f32(mins), o_v),
+                                          inv_d);
+        float32x4_t t_upper = vmulq_n_f32(vsubq_f32(vld1q_f32(maxs), o_v),
+                                          inv_d);
+
+        t_near = vmaxnmq_f32(vminnmq_f32(t_lower, t_upper), t_near);
+        t_far = vminnmq_f32(vmaxnmq_f32(t_lower, t_upper), t_far);
+    };
+
+    float32x4_t t_near = vdupq_n_f32(0.f);
+    float32x4_t t_far = vdupq_n_f32(t_max);
+    slab(t_near, t_far, minX, maxX, ray_o.x, inv_ray_d.d0);
+    slab(t_near, t_far, minY, maxY, ray_o.y, inv_ray_d.d1);
+    slab(t_near, t_far, minZ, maxZ, ray_o.z, inv_ray_d.d2);
+
+    uint32x4_t empty = vceqq_s32(vld1q_s32(children),
+                                 vdupq_n_s32(sentinel_));
+
+    uint32x4_t hit = vbicq_u32(vcleq_f32(t_near, t_far), empty);
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(hit, vld1q_u32(lane_bits)));
+#endif
+}
+
+template <typename Fn>
+void SweepAndPrune::findOverlappingPairs(Fn &&fn) const
+{
+    for (int32_t i = 0; i < num_leaves_; i++) {
+        // Leaves past the first one that starts after leaf i ends can't
+        // overlap it
+        float max_x = max_x_[i];
+        for (int32_t j = i + 1; j < num_leaves_ && min_x_[j] < max_x;
+             j += 4) {
+            uint32_t hit_mask = overlapMask(i, j);
+            for (int32_t k = 0; k < 4; k++) {
+                if ((hit_mask & (1u << k)) == 0) {
+                    continue;
+                }
+
+                int32_t other = j + k;
+                if (leaf_static_[i] && leaf_static_[other]) {
+                    continue;
+                }
+
+                fn(LeafID { sorted_leaves_[i] },
+                   LeafID { sorted_leaves_[other] });
+            }
+        }
+    }
+}
+
+// Same test as AABB::overlaps. The padding past the last leaf has
+// inverted bounds, so those lanes never pass.
+uint32_t SweepAndPrune::overlapMask(int32_t leaf_idx,
+                                    int32_t other_idx) const
+{
+#if defined(MADRONA_GPU_MODE) || defined(MADRONA_BVH_SCALAR_TRAVERSAL)
+    uint32_t mask = 0;
+    for (int32_t k = 0; k < 4; k++) {
+        int32_t j = other_idx + k;
+        bool overlaps =
+            min_x_[j] < max_x_[leaf_idx] && min_x_[leaf_idx] < max_x_[j] &&
+            min_y_[j] < max_y_[leaf_idx] && min_y_[leaf_idx] < max_y_[j] &&
+            min_z_[j] < max_z_[leaf_idx] && min_z_[leaf_idx] < max_z_[j];
+
+        mask |= uint32_t(overlaps) << k;
+    }
+
+    return mask;
+#elif defined(MADRONA_X64)
+    auto axis = [&](const float *mins, const float *maxs) {
+        return _mm_and_ps(
+            _mm_cmplt_ps(_mm_loadu_ps(mins + other_idx),
+                         _mm_set1_ps(maxs[leaf_idx])),
+            _mm_cmplt_ps(_mm_set1_ps(mins[leaf_idx]),
+                         _mm_loadu_ps(maxs + other_idx)));
+    };
+
+    __m128 hit = _mm_and_ps(axis(min_x_, max_x_),
+        _mm_and_ps(axis(min_y_, max_y_), axis(min_z_, max_z_)));
+    return (uint32_t)_mm_movemask_ps(hit);
+#elif defined(MADRONA_ARM)
+    auto axis = [&](const float *mins, const float *maxs) {
+        return vandq_u32(
+            vcltq_f32(vld1q_f32(mins + other_idx),
+                      vdupq_n_f32(maxs[leaf_idx])),
+            vcltq_f32(vdupq_n_f32(mins[leaf_idx]),
+                      vld1q_f32(maxs + other_idx)));
+    };
+
+    uint32x4_t hit = vandq_u32(axis(min_x_, max_x_),
+        vandq_u32(axis(min_y_, max_y_), axis(min_z_, max_z_)));
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(hit, vld1q_u32(lane_bits)));
+#endif
+}
+
 }
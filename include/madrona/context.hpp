@@ -33,6 +33,16 @@ public:
     inline Entity makeEntity();
     inline Entity makeEntity(uint32_t archetype_id);
 
+    // Create num_entities entities of ArchetypeT at once. They occupy
+    // contiguous rows and get their IDs in one batch, which is much
+    // cheaper than calling makeEntity in a loop. The returned span is
+    // only valid until the next entity of ArchetypeT is created or
+    // destroyed, just like a Loc.
+    template <typename ArchetypeT>
+    inline Span<const Entity> makeEntities(CountT num_entities);
+    inline Span<const Entity> makeEntities(uint32_t archetype_id,
+                                           CountT num_entities);
+
     // Create a Temporary of archetype ArchetypeT. Temporaries are
     // entities without a persistent Entity identifier, instead represented
     // by the raw row and table ID (Loc) of the entity. Temporaries can
@@ -45,9 +55,29 @@ public:
     inline Loc makeTemporary();
     inline Loc makeTemporary(uint32_t archetype_id);
 
+    // Create num_temporaries temporaries at once. They occupy contiguous
+    // rows: the returned Loc is the first one and the i-th temporary is
+    // at row loc.row + i of the same archetype.
+    template <typename ArchetypeT>
+    inline Loc makeTemporaries(CountT num_temporaries);
+    inline Loc makeTemporaries(uint32_t archetype_id,
+                               CountT num_temporaries);
+
     // Destroy Entity e
     inline void destroyEntity(Entity e);
 
+    // Deferred versions of makeEntity and destroyEntity, plus deferred
+    // component writes. These only record the operation in the world's
+    // transaction, which is applied in bulk by CommitTransactionNode, so
+    // unlike makeEntity they are safe to call from a ParallelForNode.
+    // The new entity's ID isn't known until the commit. Args are either
+    // empty or one value per component of ArchetypeT.
+    template <typename ArchetypeT, typename... Args>
+    inline void makeEntityDeferred(Args && ...args);
+    inline void destroyEntityDeferred(Entity e);
+    template <typename ComponentT>
+    inline void setComponentDeferred(Entity e, const ComponentT &value);
+
     // Get the Loc (row and table ID) of Entity e. This can be used to
     // fetch components more efficiently than by entity ID. Loc generally
     // only is valid within a single ECS system or when no entities of the
@@ -90,6 +120,15 @@ public:
     template <typename ComponentT>
     ComponentT & getDirect(int32_t column_idx, Loc loc);
 
+    // Writes through get() and friends aren't seen by Changed<ComponentT>
+    // filters. Call markChanged after modifying a component registered with
+    // ComponentFlags::TrackChanges outside of a node that writes it.
+    template <typename ComponentT>
+    inline void markChanged(Entity e);
+
+    template <typename ComponentT>
+    inline void markChanged(Loc loc);
+
     // Get a reference to the singleton component SingletonT. Note that
     // singleton components are immediately created on the call to
     // ECSRegistry::registerSingleton, so you don't have to create them.
@@ -98,7 +137,8 @@ public:
 
     // Allocate a raw chunk of memory num_bytes in length from a global
     // bump allocator. Use ResetTmpAllocNode in the taskgraph to reclaim
-    // memory.
+    // memory. Safe to call from nodes of the same world running in
+    // parallel.
     inline void * tmpAlloc(uint64_t num_bytes);
 
     // Create an ECS query matching the template components.
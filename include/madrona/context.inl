@@ -22,6 +22,21 @@ Entity Context::makeEntity(uint32_t archetype_id)
         MADRONA_MW_COND(cur_world_id_,) *state_cache_, archetype_id);
 }
 
+template <typename ArchetypeT>
+Span<const Entity> Context::makeEntities(CountT num_entities)
+{
+    return state_mgr_->makeEntities<ArchetypeT>(
+        MADRONA_MW_COND(cur_world_id_,) *state_cache_, num_entities);
+}
+
+Span<const Entity> Context::makeEntities(uint32_t archetype_id,
+                                         CountT num_entities)
+{
+    return state_mgr_->makeEntities(MADRONA_MW_COND(cur_world_id_,)
+                                    *state_cache_, archetype_id,
+                                    num_entities);
+}
+
 template <typename ArchetypeT>
 Loc Context::makeTemporary()
 {
@@ -35,15 +50,50 @@ Loc Context::makeTemporary(uint32_t archetype_id)
                                      archetype_id);
 }
 
+template <typename ArchetypeT>
+Loc Context::makeTemporaries(CountT num_temporaries)
+{
+    return state_mgr_->makeTemporaries<ArchetypeT>(
+        MADRONA_MW_COND(cur_world_id_,) num_temporaries);
+}
+
+Loc Context::makeTemporaries(uint32_t archetype_id, CountT num_temporaries)
+{
+    return state_mgr_->makeTemporaries(MADRONA_MW_COND(cur_world_id_,)
+                                       archetype_id, num_temporaries);
+}
+
 void Context::destroyEntity(Entity e)
 {
     state_mgr_->destroyEntityNow(MADRONA_MW_COND(cur_world_id_,)
                                  *state_cache_, e);
 }
 
+template <typename ArchetypeT, typename... Args>
+void Context::makeEntityDeferred(Args && ...args)
+{
+    state_mgr_->makeEntity<ArchetypeT>(
+        state_mgr_->worldTransaction(MADRONA_MW_COND(cur_world_id_)),
+        std::forward<Args>(args)...);
+}
+
+void Context::destroyEntityDeferred(Entity e)
+{
+    state_mgr_->destroyEntity(
+        state_mgr_->worldTransaction(MADRONA_MW_COND(cur_world_id_)), e);
+}
+
+template <typename ComponentT>
+void Context::setComponentDeferred(Entity e, const ComponentT &value)
+{
+    state_mgr_->setComponent(
+        state_mgr_->worldTransaction(MADRONA_MW_COND(cur_world_id_)),
+        e, value);
+}
+
 Loc Context::loc(Entity e) const
 {
-    return state_mgr_->getLoc(e);
+    return state_mgr_->getLoc(MADRONA_MW_COND(cur_world_id_,) e);
 }
 
 template <typename ComponentT>
@@ -88,6 +138,18 @@ ComponentT & Context::getDirect(int32_t column_idx, Loc loc)
         MADRONA_MW_COND(cur_world_id_,) column_idx, loc);
 }
 
+template <typename ComponentT>
+void Context::markChanged(Entity e)
+{
+    state_mgr_->markChanged<ComponentT>(MADRONA_MW_COND(cur_world_id_,) e);
+}
+
+template <typename ComponentT>
+void Context::markChanged(Loc loc)
+{
+    state_mgr_->markChanged<ComponentT>(MADRONA_MW_COND(cur_world_id_,) loc);
+}
+
 template <typename SingletonT>
 SingletonT & Context::singleton()
 {
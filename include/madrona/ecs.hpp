@@ -47,6 +47,25 @@ struct WorldID {
     int32_t idx;
 };
 
+// Wrap a component in Changed when declaring a ParallelForNode or
+// SerialForNode to only visit entities whose component may have changed
+// since the node last ran. Only components registered with
+// ComponentFlags::TrackChanges are filtered; with multiple Changed
+// components, an entity is visited if any of them changed.
+template <typename ComponentT> struct Changed {};
+
+template <typename T>
+struct QueryComponent {
+    using Type = T;
+    static constexpr bool changed = false;
+};
+
+template <typename T>
+struct QueryComponent<Changed<T>> {
+    using Type = T;
+    static constexpr bool changed = true;
+};
+
 struct ComponentID {
     uint32_t id;
 };
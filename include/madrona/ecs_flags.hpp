@@ -17,12 +17,21 @@ namespace madrona {
 enum class ArchetypeFlags : uint32_t {
     None = 0,
     ImportOffsets = 1_u32 << 0,
+    // Back the archetype's tables with reserved virtual memory, so rows
+    // never move as they grow (see Table). Ignored for fixed size archetypes.
+    // Each table adds several memory mappings per column, which limits
+    // how many worlds can use the archetype (see vm.max_map_count).
+    VirtualColumns = 1_u32 << 1,
 };
 
 enum class ComponentFlags : uint32_t {
     None = 0,
     ExportMemory = 1_u32 << 0,
     ImportMemory = 1_u32 << 1,
+    // Keep per chunk change versions for the column, so queries using
+    // Changed<ComponentT> can skip unchanged rows. Ignored for fixed size
+    // archetypes.
+    TrackChanges = 1_u32 << 2,
 };
 
 template <typename... ComponentTs>
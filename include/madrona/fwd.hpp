@@ -15,5 +15,7 @@ class StateManager;
 class ECSRegistry;
 class Context;
 struct WorkerInit;
+struct ParallelForDispatcher;
+class NodeTracer;
 
 }
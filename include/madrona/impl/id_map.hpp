@@ -50,6 +50,11 @@ public:
 
     inline K acquireID(Cache &cache);
 
+    // Acquires num_ids IDs into keys. Once the cache and global free list
+    // run dry, the store is grown once for all the remaining IDs rather
+    // than in ids_per_cache_ sized steps.
+    inline void acquireIDs(Cache &cache, K *keys, CountT num_ids);
+
     inline void releaseID(Cache &cache, int32_t id);
     inline void releaseID(Cache &cache, K k)
     {
@@ -58,6 +63,20 @@ public:
 
     inline void bulkRelease(Cache &cache, K *keys, CountT num_keys);
 
+    // Replaces this map's IDs, generations and free list with o's, and
+    // cache's free IDs with o_cache's. StoreT must track its size in
+    // numIDs, like EntityStore's store.
+    inline void copyFrom(const IDMap &o, Cache &cache, const Cache &o_cache);
+
+    // copyFrom through a blob, for world snapshots: saveSnapshot writes
+    // the map and cache's free IDs to snapshotBytes() bytes at dst, and
+    // loadSnapshot replaces this map's and cache's with them.
+    inline uint64_t snapshotBytes() const;
+    inline void saveSnapshot(const Cache &cache, void *dst) const;
+    inline void loadSnapshot(Cache &cache, const void *src);
+
+    inline const auto & store() const { return store_; }
+
     inline V lookup(K k) const
     {
         const Node &node = store_[k.id];
@@ -128,6 +147,17 @@ private:
         int32_t head;
     };
 
+    struct SnapshotHeader {
+        int64_t numIDs;
+        FreeHead freeHead;
+        int32_t cacheFreeHead;
+        int32_t cacheNumFreeIDs;
+        int32_t cacheOverflowHead;
+        int32_t cacheNumOverflowIDs;
+    };
+
+    inline void resize(CountT num_ids);
+
     [[no_unique_address]] Store store_;
     alignas(MADRONA_CACHE_LINE) Atomic<FreeHead> free_head_;
 
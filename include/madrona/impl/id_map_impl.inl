@@ -9,7 +9,9 @@
 
 #include <madrona/impl/id_map.hpp>
 #include <cassert>
+#include <cstring>
 #include <madrona/macros.hpp>
+#include <madrona/utils.hpp>
 
 namespace madrona {
 
@@ -184,6 +186,52 @@ K IDMap<K, V, StoreT>::acquireID(Cache &cache)
 
 }
 
+template <typename K, typename V, template <typename> typename StoreT>
+void IDMap<K, V, StoreT>::acquireIDs(Cache &cache, K *keys, CountT num_ids)
+{
+    CountT num_acquired = 0;
+    while (num_acquired < num_ids &&
+           (cache.num_overflow_ids_ > 0 || cache.num_free_ids_ > 0 ||
+            free_head_.load_acquire().head != sentinel_)) {
+        keys[num_acquired++] = acquireID(cache);
+    }
+
+    CountT num_remaining = num_ids - num_acquired;
+    if (num_remaining == 0) {
+        return;
+    }
+
+    // The cache is empty here, so the unused tail of the new block can
+    // become its contiguous free sublist, like in acquireID
+    CountT num_new_ids = utils::roundUp(num_remaining, ids_per_cache_);
+    CountT block_start = store_.expand(num_new_ids);
+
+    for (CountT i = 0; i < num_remaining; i++) {
+        int32_t id = int32_t(block_start + i);
+        store_[id].gen.store_relaxed(0);
+
+        keys[num_acquired + i] = K {
+            .gen = 0,
+            .id = id,
+        };
+    }
+
+    int32_t num_leftover = int32_t(num_new_ids - num_remaining);
+    if (num_leftover > 0) {
+        int32_t free_start = int32_t(block_start + num_remaining);
+
+        Node &free_node = store_[free_start];
+        free_node.freeNode = FreeNode {
+            .subNext = sentinel_,
+            .globalNext = num_leftover,
+        };
+        free_node.gen.store_relaxed(0);
+
+        cache.free_head_ = free_start;
+        cache.num_free_ids_ = num_leftover;
+    }
+}
+
 template <typename K, typename V, template <typename> typename StoreT>
 void IDMap<K, V, StoreT>::releaseID(Cache &cache, int32_t id)
 {
@@ -331,4 +379,85 @@ void IDMap<K, V, StoreT>::bulkRelease(Cache &cache, K *keys,
         sync::release, sync::relaxed>(cur_head, new_head));
 }
 
+template <typename K, typename V, template <typename> typename StoreT>
+void IDMap<K, V, StoreT>::copyFrom(const IDMap &o, Cache &cache,
+                                   const Cache &o_cache)
+{
+    CountT num_ids = o.store_.numIDs;
+    resize(num_ids);
+
+    if (num_ids > 0) {
+        memcpy((void *)&store_[0], (const void *)&o.store_[0],
+               sizeof(Node) * num_ids);
+    }
+
+    free_head_.store_release(o.free_head_.load_acquire());
+
+    cache.free_head_ = o_cache.free_head_;
+    cache.num_free_ids_ = o_cache.num_free_ids_;
+    cache.overflow_head_ = o_cache.overflow_head_;
+    cache.num_overflow_ids_ = o_cache.num_overflow_ids_;
+}
+
+template <typename K, typename V, template <typename> typename StoreT>
+uint64_t IDMap<K, V, StoreT>::snapshotBytes() const
+{
+    return sizeof(SnapshotHeader) + sizeof(Node) * (uint64_t)store_.numIDs;
+}
+
+template <typename K, typename V, template <typename> typename StoreT>
+void IDMap<K, V, StoreT>::saveSnapshot(const Cache &cache, void *dst) const
+{
+    CountT num_ids = store_.numIDs;
+
+    SnapshotHeader header {
+        .numIDs = int64_t(num_ids),
+        .freeHead = free_head_.load_acquire(),
+        .cacheFreeHead = cache.free_head_,
+        .cacheNumFreeIDs = cache.num_free_ids_,
+        .cacheOverflowHead = cache.overflow_head_,
+        .cacheNumOverflowIDs = cache.num_overflow_ids_,
+    };
+    memcpy(dst, &header, sizeof(SnapshotHeader));
+
+    if (num_ids > 0) {
+        memcpy((char *)dst + sizeof(SnapshotHeader),
+               (const void *)&store_[0], sizeof(Node) * num_ids);
+    }
+}
+
+template <typename K, typename V, template <typename> typename StoreT>
+void IDMap<K, V, StoreT>::loadSnapshot(Cache &cache, const void *src)
+{
+    SnapshotHeader header;
+    memcpy(&header, src, sizeof(SnapshotHeader));
+
+    CountT num_ids = CountT(header.numIDs);
+    resize(num_ids);
+
+    if (num_ids > 0) {
+        memcpy((void *)&store_[0],
+               (const char *)src + sizeof(SnapshotHeader),
+               sizeof(Node) * num_ids);
+    }
+
+    free_head_.store_release(header.freeHead);
+
+    cache.free_head_ = header.cacheFreeHead;
+    cache.num_free_ids_ = header.cacheNumFreeIDs;
+    cache.overflow_head_ = header.cacheOverflowHead;
+    cache.num_overflow_ids_ = header.cacheNumOverflowIDs;
+}
+
+template <typename K, typename V, template <typename> typename StoreT>
+void IDMap<K, V, StoreT>::resize(CountT num_ids)
+{
+    if (store_.numIDs < num_ids) {
+        store_.expand(num_ids - store_.numIDs);
+    }
+
+    // Any nodes past num_ids get handed out again by the next expand
+    store_.numIDs = num_ids;
+}
+
 }
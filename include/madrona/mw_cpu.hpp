@@ -23,6 +23,66 @@ public:
         uint32_t numExportedBuffers;
         // Number of worker threads
         uint32_t numWorkers = 0;
+        // By default each world's taskgraph runs on a single worker thread.
+        // When enabled, ParallelForNode additionally splits the rows of
+        // each world into ranges that idle workers steal, letting a small
+        // number of large worlds use the whole machine. See
+        // ParallelForNode for the requirements this places on systems.
+        bool intraWorldParallelism = false;
+        // Minimum number of rows in a single stealable range
+        uint32_t minRowsPerTask = 1024;
+        // Run each node of a world's taskgraph as soon as the nodes it
+        // depends on have finished, so independent branches of the graph
+        // run concurrently on idle workers. Nodes that aren't ordered by
+        // a dependency must not touch the same components or both create
+        // or destroy entities.
+        bool nodeParallelism = false;
+        // Keep two copies of each exported column and alternate between
+        // them every step (see runAsync / latestExportBuffer). Without
+        // this, copied columns keep step N's results until the wait() of
+        // step N + 1, but zero-copy columns (numExportRowsPerWorld) are
+        // overwritten as soon as step N + 1 starts. With it, every
+        // column of step N stays valid until step N + 2 starts, at the
+        // cost of copying the zero-copy columns at the start of each
+        // step. Columns of fixed size tables are always live memory.
+        bool doubleBufferExports = false;
+        // When nonzero, columns of dynamically sized archetypes registered
+        // with ComponentFlags::ExportMemory live directly in their export
+        // buffer as [numWorlds, numExportRowsPerWorld] arrays, so no
+        // copies are needed before or after each step. Rows of worlds with
+        // more entities than this are copied in and out by the world's
+        // own job, and rows past numExportRowsPerWorld are not exported.
+        // These columns are live memory unless doubleBufferExports is set.
+        uint32_t numExportRowsPerWorld = 0;
+        // When nonzero, the start and end time of every taskgraph node run
+        // is recorded into a ring buffer of this many events per worker
+        // thread. See getNodeTracer.
+        uint32_t nodeTraceEventsPerWorker = 0;
+        // Give each worker a fixed, contiguous range of worlds instead of
+        // handing worlds out dynamically, and construct each world on the
+        // worker that owns it. Memory is first touched by its owner, which
+        // keeps each world's state on the owner's NUMA node. World
+        // constructors then run concurrently on the worker threads.
+        bool numaAware = false;
+        // Number of consecutive jobs (worlds, for TaskGraphExecutor) a
+        // worker claims at once, with completion also counted once per
+        // claim. Larger values cut the per job overhead when there are
+        // many small worlds (see bench/world_batching.cpp). 0 picks a
+        // value from the number of worlds and workers. Ignored when
+        // numaAware is set.
+        uint32_t jobsPerChunk = 1;
+        // Run the task graphs node major instead of world major: each node
+        // runs for every world, with the worlds split across the workers,
+        // before any world starts the next node. The code and read only
+        // data of one system stay hot in cache across all worlds. Every
+        // world must build the same nodes, and the nodes of a world always
+        // run one at a time (nodeParallelism is ignored). Each node is
+        // a short job, so consider jobsPerChunk = 0.
+        bool worldFusedExecution = false;
+        // Size of the blocks each world's Context::tmpAlloc memory is carved
+        // from. Blocks are only allocated once a world uses tmpAlloc; see
+        // tmpAllocStats for how much each world actually needs.
+        uint64_t tmpAllocBlockBytes = StateManager::defaultTmpAllocBlockBytes;
     };
 
     struct Job {
@@ -36,10 +96,55 @@ public:
     ~ThreadPoolExecutor();
     void run(Job *jobs, CountT num_jobs);
 
+    // Non-blocking version of run. jobs contains num_batches batches of
+    // num_jobs_per_batch jobs laid out contiguously. Batches run back to
+    // back, each starting once every job of the previous one is done.
+    // Must be followed by wait() before the next call to run / runAsync.
+    void runAsync(Job *jobs, CountT num_jobs_per_batch,
+                  CountT num_batches = 1);
+    // Version of runAsync for jobs that only step the worlds in world_ids.
+    // Exported columns are then only copied for those worlds, unless
+    // exports are double buffered. world_ids must stay valid until wait().
+    void runAsync(Job *jobs, CountT num_jobs_per_batch,
+                  CountT num_batches, Span<const int32_t> world_ids);
+    void wait();
+
     // Get the base pointer of the component data exported with
-    // ECSRegister::exportColumn
+    // ECSRegister::exportColumn. With doubleBufferExports, this is the
+    // buffer holding the results of the most recently completed step.
     void * getExported(CountT slot) const;
 
+    // Get a specific export buffer (0 or 1) when doubleBufferExports is set
+    void * getExported(CountT slot, CountT buffer_idx) const;
+    // Index of the export buffer written by the most recent wait()
+    CountT latestExportBuffer() const;
+
+    // Per node timings recorded when nodeTraceEventsPerWorker is set,
+    // nullptr otherwise. Only write traces between steps.
+    NodeTracer * getNodeTracer() const;
+
+    // Snapshot and restore the full state of single worlds, for example to
+    // reset episodes to a canonical start state or to checkpoint. See
+    // StateManager::saveWorldSnapshot for what is captured. Only call
+    // between steps. Restoring re-exports every world's columns, so do it
+    // before writing the next step's inputs to the export buffers.
+    uint64_t worldSnapshotBytes(CountT world_idx) const;
+    void saveWorldSnapshot(CountT world_idx, void *dst) const;
+    void restoreWorldSnapshot(CountT world_idx, const void *src);
+    // Restores world_idxs[i] from snapshots[i] and re-exports only once
+    void restoreWorldSnapshots(Span<const int32_t> world_idxs,
+                               const void * const *snapshots);
+
+    // Overwrites each world in dst_world_idxs with a copy of src_world_idx's
+    // ECS state, for branching a world in tree search. Like restoring a
+    // snapshot this must run between steps. Only the ECS state is copied:
+    // per world data owned by the WorldT class is not.
+    void forkWorld(CountT src_world_idx, Span<const int32_t> dst_world_idxs);
+
+    StateManager::TmpAllocStats tmpAllocStats(CountT world_idx) const;
+    // Must not run concurrently with a step, like the snapshot functions
+    MemoryReport memoryReport() const;
+
 protected:
     void initializeContexts(
         Context & (*init_fn)(void *, const WorkerInit &, CountT),
@@ -47,6 +152,10 @@ protected:
 
     ECSRegistry getECSRegistry();
 
+    // Runs jobs[i], which constructs world i. Serially on the calling
+    // thread by default, on world i's owning worker when numaAware.
+    void initializeWorlds(Job *jobs, CountT num_worlds);
+
     void initExport();
 
 private:
@@ -85,11 +194,53 @@ public:
 
     inline void runTaskGraph(uint32_t taskgraph_idx);
 
+    // Run the task graph for only the worlds listed in world_ids, for
+    // example the worlds that have received new actions. Scheduling cost
+    // scales with world_ids.size() rather than the number of worlds.
+    // world_ids must not contain duplicates. Exported columns are only
+    // copied in and out for the listed worlds, so inputs written for
+    // other worlds stay in the export buffers until those worlds run.
+    // Exports are copied for every world with doubleBufferExports. With
+    // numaAware, the listed worlds are split evenly across the workers,
+    // so a world may run on a worker other than its owner.
+    template <EnumType EnumT>
+    inline void runTaskGraph(EnumT taskgraph_id,
+                             Span<const int32_t> world_ids);
+
+    inline void runTaskGraph(uint32_t taskgraph_idx,
+                             Span<const int32_t> world_ids);
+
     inline void run();
 
+    // Start running every task graph (one step) and return immediately.
+    // Exported columns are read before runAsync returns, so inputs for
+    // the next step can be written as soon as it does. Call wait() to
+    // block until the step finishes and its exports are written.
+    // Example overlapping the learner with simulation:
+    //   backend.runAsync();
+    //   learner.consume(backend.getExported(obs_slot)); // Step N - 1
+    //   backend.wait();
+    inline void runAsync();
+    using ThreadPoolExecutor::wait;
+
     // Get the base pointer of the component data exported with
     // ECSRegister::exportColumn
     using ThreadPoolExecutor::getExported;
+    using ThreadPoolExecutor::latestExportBuffer;
+
+    // Example writing traces after running some steps:
+    //   backend.getNodeTracer()->writeHostTracing("/tmp/");
+    //   backend.getNodeTracer()->writeChromeTrace("/tmp/trace.json");
+    using ThreadPoolExecutor::getNodeTracer;
+
+    // See ThreadPoolExecutor
+    using ThreadPoolExecutor::worldSnapshotBytes;
+    using ThreadPoolExecutor::saveWorldSnapshot;
+    using ThreadPoolExecutor::restoreWorldSnapshot;
+    using ThreadPoolExecutor::restoreWorldSnapshots;
+    using ThreadPoolExecutor::forkWorld;
+    using ThreadPoolExecutor::tmpAllocStats;
+    using ThreadPoolExecutor::memoryReport;
 
     // Get a reference to the per world data class
     inline WorldT & getWorldData(CountT world_idx);
@@ -100,10 +251,24 @@ private:
         TaskGraph taskgraph;
     };
 
+    // One node of one world's task graph, for worldFusedExecution
+    struct NodeJobData {
+        JobData *jobData;
+        CountT nodeIdx;
+    };
+
     HeapArray<ContextT> contexts_;
     HeapArray<WorldT> world_datas_;
     HeapArray<JobData> job_datas_;
+    HeapArray<NodeJobData> node_job_datas_;
     HeapArray<Job> jobs_;
+    // jobs_ holds one batch of numWorlds jobs per task graph, or per node
+    // of each task graph with worldFusedExecution. Task graph i's batches
+    // are [taskgraph_batch_offsets_[i], taskgraph_batch_offsets_[i + 1]).
+    HeapArray<uint32_t> taskgraph_batch_offsets_;
+    // Scratch space for the compacted job list of runTaskGraph(world_ids),
+    // large enough for every batch of the largest task graph
+    HeapArray<Job> subset_jobs_;
     uint32_t num_taskgraphs_;
 };
 
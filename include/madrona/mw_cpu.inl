@@ -12,7 +12,10 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
       contexts_(cfg.numWorlds),
       world_datas_(cfg.numWorlds),
       job_datas_((CountT)cfg.numWorlds * num_taskgraphs),
-      jobs_((CountT)cfg.numWorlds * num_taskgraphs),
+      node_job_datas_(0),
+      jobs_(0),
+      taskgraph_batch_offsets_(num_taskgraphs + 1),
+      subset_jobs_(0),
       num_taskgraphs_((uint32_t)num_taskgraphs)
 {
     auto ecs_reg = getECSRegistry();
@@ -37,12 +40,38 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
         return (*(CBPtrT)ptr_raw)(worker_init, world_idx);
     }, &ctx_init_cb, cfg.numWorlds);
 
+    struct WorldInitData {
+        TaskGraphExecutor *executor;
+        const ConfigT *userCfg;
+        const InitT *userInits;
+        CountT worldIdx;
+    };
+
+    HeapArray<WorldInitData> world_init_datas(cfg.numWorlds);
+    HeapArray<Job> world_init_jobs(cfg.numWorlds);
     for (CountT world_idx = 0; world_idx < (CountT)cfg.numWorlds;
          world_idx++) {
-        world_datas_.emplace(world_idx, contexts_[world_idx],
-                             user_cfg, user_inits[world_idx]);
+        world_init_datas[world_idx] = WorldInitData {
+            .executor = this,
+            .userCfg = &user_cfg,
+            .userInits = user_inits,
+            .worldIdx = world_idx,
+        };
+
+        world_init_jobs[world_idx].fn = [](void *ptr) {
+            auto init_data = (WorldInitData *)ptr;
+            CountT world_idx = init_data->worldIdx;
+            TaskGraphExecutor *executor = init_data->executor;
+
+            executor->world_datas_.emplace(world_idx,
+                executor->contexts_[world_idx], *init_data->userCfg,
+                init_data->userInits[world_idx]);
+        };
+        world_init_jobs[world_idx].data = &world_init_datas[world_idx];
     }
 
+    initializeWorlds(world_init_jobs.data(), cfg.numWorlds);
+
     HeapArray<HeapArray<TaskGraph>> built_graphs(cfg.numWorlds);
     for (CountT world_idx = 0; world_idx < (CountT)cfg.numWorlds;
          world_idx++) {
@@ -52,6 +81,35 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
                              taskgraph_mgrs[world_idx].constructGraphs());
     }
 
+    uint32_t num_batches = 0;
+    uint32_t max_taskgraph_batches = 0;
+    for (CountT taskgraph_idx = 0; taskgraph_idx < num_taskgraphs;
+         taskgraph_idx++) {
+        taskgraph_batch_offsets_[taskgraph_idx] = num_batches;
+
+        if (!cfg.worldFusedExecution) {
+            num_batches += 1;
+            max_taskgraph_batches = 1;
+            continue;
+        }
+
+        CountT num_nodes = cfg.numWorlds == 0 ? 0 :
+            built_graphs[0][taskgraph_idx].numNodes();
+        for (CountT world_idx = 1; world_idx < (CountT)cfg.numWorlds;
+             world_idx++) {
+            if (built_graphs[world_idx][taskgraph_idx].numNodes() !=
+                    num_nodes) {
+                FATAL("worldFusedExecution requires every world to build "
+                      "the same task graphs");
+            }
+        }
+
+        num_batches += (uint32_t)num_nodes;
+        max_taskgraph_batches =
+            std::max(max_taskgraph_batches, (uint32_t)num_nodes);
+    }
+    taskgraph_batch_offsets_[num_taskgraphs] = num_batches;
+
     for (CountT taskgraph_idx = 0; taskgraph_idx < num_taskgraphs;
          taskgraph_idx++) {
         for (CountT world_idx = 0; world_idx < (CountT)cfg.numWorlds;
@@ -62,13 +120,52 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
                 .ctx = &contexts_[world_idx],
                 .taskgraph = std::move(built_graphs[world_idx][taskgraph_idx]),
             });
+        }
+    }
+
+    jobs_ = HeapArray<Job>((CountT)num_batches * cfg.numWorlds);
+    subset_jobs_ = HeapArray<Job>(
+        (CountT)max_taskgraph_batches * cfg.numWorlds);
 
+    if (!cfg.worldFusedExecution) {
+        for (CountT job_idx = 0; job_idx < jobs_.size(); job_idx++) {
             jobs_[job_idx].fn = [](void *ptr) {
                 auto job_data = (JobData *)ptr;
                 job_data->taskgraph.run(job_data->ctx);
             };
             jobs_[job_idx].data = &job_datas_[job_idx];
         }
+    } else {
+        node_job_datas_ = HeapArray<NodeJobData>(jobs_.size());
+
+        for (CountT taskgraph_idx = 0; taskgraph_idx < num_taskgraphs;
+             taskgraph_idx++) {
+            uint32_t batch_offset = taskgraph_batch_offsets_[taskgraph_idx];
+            CountT num_nodes =
+                taskgraph_batch_offsets_[taskgraph_idx + 1] - batch_offset;
+
+            for (CountT node_idx = 0; node_idx < num_nodes; node_idx++) {
+                for (CountT world_idx = 0;
+                     world_idx < (CountT)cfg.numWorlds; world_idx++) {
+                    CountT job_idx =
+                        (batch_offset + node_idx) * cfg.numWorlds + world_idx;
+
+                    node_job_datas_[job_idx] = NodeJobData {
+                        .jobData = &job_datas_[
+                            taskgraph_idx * cfg.numWorlds + world_idx],
+                        .nodeIdx = node_idx,
+                    };
+
+                    jobs_[job_idx].fn = [](void *ptr) {
+                        auto node_job_data = (NodeJobData *)ptr;
+                        JobData *job_data = node_job_data->jobData;
+                        job_data->taskgraph.runNodeAt(job_data->ctx,
+                            node_job_data->nodeIdx);
+                    };
+                    jobs_[job_idx].data = &node_job_datas_[job_idx];
+                }
+            }
+        }
     }
 
     initExport();
@@ -84,16 +181,70 @@ void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(EnumT tas
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
 void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(uint32_t taskgraph_idx)
 {
-    CountT offset = taskgraph_idx * world_datas_.size();
-    ThreadPoolExecutor::run(jobs_.data() + offset, world_datas_.size());
+    const CountT num_worlds = world_datas_.size();
+    uint32_t batch_offset = taskgraph_batch_offsets_[taskgraph_idx];
+    uint32_t num_batches =
+        taskgraph_batch_offsets_[taskgraph_idx + 1] - batch_offset;
+
+    ThreadPoolExecutor::runAsync(jobs_.data() + batch_offset * num_worlds,
+                                 num_worlds, num_batches);
+    ThreadPoolExecutor::wait();
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
-void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::run()
+template <EnumType EnumT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(
+    EnumT taskgraph_id, Span<const int32_t> world_ids)
 {
-    for (uint32_t i = 0; i < (uint32_t)num_taskgraphs_; i++) {
-        runTaskGraph(i);
+    runTaskGraph(static_cast<uint32_t>(taskgraph_id), world_ids);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(
+    uint32_t taskgraph_idx, Span<const int32_t> world_ids)
+{
+    const CountT num_worlds = world_datas_.size();
+    const CountT num_active = world_ids.size();
+    uint32_t batch_offset = taskgraph_batch_offsets_[taskgraph_idx];
+    uint32_t num_batches =
+        taskgraph_batch_offsets_[taskgraph_idx + 1] - batch_offset;
+
+    assert(num_active <= num_worlds);
+
+    // Gather the selected worlds' jobs out of each batch, so the thread
+    // pool only ever sees num_active jobs per batch
+    for (CountT batch_idx = 0; batch_idx < (CountT)num_batches;
+         batch_idx++) {
+        const Job *src =
+            jobs_.data() + (batch_offset + batch_idx) * num_worlds;
+        Job *dst = subset_jobs_.data() + batch_idx * num_active;
+
+        for (CountT i = 0; i < num_active; i++) {
+            int32_t world_idx = world_ids[i];
+            assert(world_idx >= 0 && world_idx < num_worlds);
+
+            dst[i] = src[world_idx];
+        }
     }
+
+    ThreadPoolExecutor::runAsync(subset_jobs_.data(), num_active,
+                                 num_batches, world_ids);
+    ThreadPoolExecutor::wait();
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::run()
+{
+    runAsync();
+    wait();
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runAsync()
+{
+    // jobs_ is laid out taskgraph major, so the task graphs run in order
+    ThreadPoolExecutor::runAsync(jobs_.data(), world_datas_.size(),
+                                 taskgraph_batch_offsets_[num_taskgraphs_]);
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
@@ -157,18 +157,32 @@ struct ObjectData {
 };
 
 namespace PhysicsSystem {
+    // TGS runs narrowphase once per step and solves soft, warm started
+    // contacts each substep, where XPBD reruns narrowphase every substep.
+    // It keeps box stacks standing with at most XPBD's substeps, for less
+    // or about the same cost per step (see bench/tgs_solver.cpp).
     enum class Solver : uint32_t {
         XPBD,
         TGS,
     };
 
+    // Finds the candidate pairs for narrowphase. SweepAndPrune replaces
+    // the per body BVH queries with one sort and sweep, which is cheaper
+    // in small worlds (see bench/broadphase_sap.cpp). The BVH is still
+    // maintained for findEntitiesWithinAABB and ray casts.
+    enum class Broadphase : uint32_t {
+        BVH,
+        SweepAndPrune,
+    };
+
     void init(Context &ctx,
               ObjectManager *obj_mgr,
               float delta_t,
               CountT num_substeps,
               math::Vector3 gravity,
               CountT max_dynamic_objects,
-              Solver solver = Solver::XPBD);
+              Solver solver = Solver::XPBD,
+              Broadphase broadphase_type = Broadphase::BVH);
 
     void reset(Context &ctx);
     broadphase::LeafID registerEntity(Context &ctx,
@@ -8,6 +8,7 @@
 #endif
 #include <nanobind/nanobind.h>
 #include <nanobind/ndarray.h>
+#include <nanobind/stl/vector.h>
 #if defined(MADRONA_CLANG) || defined(MADRONA_GCC)
 #pragma GCC diagnostic pop
 #endif
@@ -52,6 +53,20 @@ private:
                           bool xla_gpu);
 };
 
+// Adds the CPU backend's per world state functions to the binding of a
+// simulator class, as methods of the Python class:
+//   save_world_snapshot(world_idx) -> numpy uint8 array
+//   restore_world_snapshot(world_idx, snapshot)
+//   fork_world(src_world_idx, dst_world_idxs)
+//   memory_report() -> madrona.MemoryReport
+// exec_fn is invoked on the simulator and must return its
+// TaskGraphExecutor, for example:
+//   auto mgr_class = nb::class_<Manager>(m, "SimManager");
+//   bindCPUExecutor<&Manager::cpuExecutor>(mgr_class);
+// Like the executor functions they wrap, only call these between steps.
+template <auto exec_fn, typename SimT, typename... ExtraT>
+void bindCPUExecutor(nb::class_<SimT, ExtraT...> &cls);
+
 void setupMadronaSubmodule(nb::module_ parent_mod);
 
 }
@@ -3,6 +3,7 @@
 #include <bit>
 #include <utility>
 #include <string>
+#include <vector>
 
 namespace madrona::py {
 
@@ -120,4 +121,40 @@ void JAXInterface::gpuEntryFn(cudaStream_t strm, void **buffers,
 }
 #endif
 
+template <auto exec_fn, typename SimT, typename... ExtraT>
+void bindCPUExecutor(nb::class_<SimT, ExtraT...> &cls)
+{
+    cls.def("save_world_snapshot", [](SimT &sim, int64_t world_idx) {
+        auto &exec = std::invoke(exec_fn, sim);
+
+        size_t num_bytes = (size_t)exec.worldSnapshotBytes(world_idx);
+        uint8_t *data = new uint8_t[num_bytes];
+        exec.saveWorldSnapshot(world_idx, data);
+
+        nb::capsule owner(data, [](void *ptr) noexcept {
+            delete[] (uint8_t *)ptr;
+        });
+
+        return nb::ndarray<nb::numpy, uint8_t>(data, 1, &num_bytes, owner);
+    });
+
+    cls.def("restore_world_snapshot", [](SimT &sim, int64_t world_idx,
+            nb::ndarray<const uint8_t, nb::c_contig, nb::device::cpu>
+                snapshot) {
+        auto &exec = std::invoke(exec_fn, sim);
+        exec.restoreWorldSnapshot(world_idx, snapshot.data());
+    });
+
+    cls.def("fork_world", [](SimT &sim, int64_t src_world_idx,
+                             const std::vector<int32_t> &dst_world_idxs) {
+        auto &exec = std::invoke(exec_fn, sim);
+        exec.forkWorld(src_world_idx, Span<const int32_t>(
+            dst_world_idxs.data(), (CountT)dst_world_idxs.size()));
+    });
+
+    cls.def("memory_report", [](SimT &sim) {
+        return std::invoke(exec_fn, sim).memoryReport();
+    });
+}
+
 }
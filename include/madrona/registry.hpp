@@ -51,6 +51,11 @@ public:
     template <typename SingletonT>
     void registerSingleton();
 
+    // Include memory owned by SingletonT in world snapshots, see
+    // StateManager::registerSingletonSnapshot
+    template <typename SingletonT>
+    void registerSingletonSnapshot();
+
     // Export ComponentT of ArchetypeT for use by code outside the ECS,
     // such as learning. The exported pointer can be retrieved from the CPU or
     // GPU backend's getExported() function by passing the same value of 'slot'
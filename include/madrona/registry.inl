@@ -43,6 +43,12 @@ void ECSRegistry::registerSingleton()
     state_mgr_->registerSingleton<SingletonT>();
 }
 
+template <typename SingletonT>
+void ECSRegistry::registerSingletonSnapshot()
+{
+    state_mgr_->registerSingletonSnapshot<SingletonT>();
+}
+
 template <typename ArchetypeT, typename ComponentT>
 void ECSRegistry::exportColumn(int32_t slot)
 {
@@ -25,7 +25,24 @@ namespace madrona {
 
 class StateManager;
 
+// A list of deferred entity creations, destructions and component writes,
+// recorded into 8KB blocks and applied in bulk by
+// StateManager::commitTransaction. Recording is safe from multiple
+// threads at once: the lock is only held while reserving space in the
+// current block, the entry itself is written after it is released.
 class Transaction {
+public:
+    Transaction();
+    Transaction(const Transaction &) = delete;
+    Transaction(Transaction &&o);
+    ~Transaction();
+
+    // A moved-from transaction has no blocks and counts as empty
+    inline bool empty() const
+    {
+        return head == nullptr || head->numEntries == 0;
+    }
+
 private:
     enum Op : uint32_t {
         Make,
@@ -33,16 +50,33 @@ private:
         Modify,
     };
 
+    // For Make, id is the archetype ID and numBytes is either 0 or the
+    // size of every user component, stored in column order after the
+    // entry. For Modify, id is the component ID and the new value follows.
+    struct Entry {
+        Op op;
+        uint32_t id;
+        Entity e;
+        uint32_t numBytes;
+    };
+
     static constexpr uint32_t bytes_per_block_ = 8192;
+    static constexpr uint32_t entry_alignment_ = alignof(Entry);
 
     struct Block {
         Block *next;
         uint32_t curOffset;
         uint32_t numEntries;
-        char data[bytes_per_block_];
+        alignas(entry_alignment_) char data[bytes_per_block_];
     };
 
+    // Returns where the num_bytes of data following the entry go
+    void * record(Op op, uint32_t id, Entity e, uint32_t num_bytes);
+    void reset();
+
     Block *head;
+    Block *tail;
+    SpinLock lock;
 
 friend class StateManager;
 };
@@ -66,6 +100,14 @@ private:
 public:
     using Cache = Map::Cache;
 
+#ifdef MADRONA_MW_MODE
+    // Each world has its own EntityStore, so the address space reserved
+    // for IDs is bounded per world rather than shared by all of them
+    static constexpr uint32_t maxIDs = 1u << 22;
+#else
+    static constexpr uint32_t maxIDs = ~0u;
+#endif
+
     EntityStore();
 
     inline Loc getLoc(Entity e) const;
@@ -74,10 +116,23 @@ public:
     inline void setRow(Entity e, uint32_t row);
 
     Entity newEntity(Cache &cache);
+    void newEntities(Cache &cache, Entity *entities, CountT num_entities);
     void freeEntity(Cache &cache, Entity e);
 
     void bulkFree(Cache &cache, Entity *entities, uint32_t num_entities);
 
+    // Makes this store an exact copy of o, IDs, generations and free lists
+    // included, with cache taking over o_cache's free IDs.
+    void copyFrom(const EntityStore &o, Cache &cache, const Cache &o_cache);
+
+    // The same through a blob, see IDMap::saveSnapshot
+    uint64_t snapshotBytes() const;
+    void saveSnapshot(const Cache &cache, void *dst) const;
+    void loadSnapshot(Cache &cache, const void *src);
+
+    inline uint64_t numCommittedBytes() const;
+    inline uint64_t numReservedBytes() const;
+
 private:
     Map map_;
 };
@@ -87,16 +142,79 @@ public:
     StateCache();
 
 private:
+#ifndef MADRONA_MW_MODE
     EntityStore::Cache entity_cache_;
+#endif
 
 friend class StateManager;
 };
 
 
+// Restricts StateManager::iterateArchetypes to rows whose tracked
+// components may have changed (see ComponentFlags::TrackChanges). Bit i of
+// each mask refers to component i of the query.
+struct ChangeFilter {
+    // Rows pass if a changedMask component's version is newer than this
+    uint32_t sinceVersion;
+    uint32_t changedMask;
+    // Components fn writes to, marked as changed for every visited row
+    uint32_t writeMask;
+    // Version the written rows are stamped with, 0 for the world's current
+    // version. A node filtering on changes passes the version it filters
+    // against next, so it skips its own writes while every node that ran
+    // before it still sees them.
+    uint32_t writeVersion;
+};
+
+// Breakdown of the memory held by a StateManager, see
+// StateManager::memoryReport. Committed bytes are backed by memory, while
+// reserved bytes also count address space that is only set aside for
+// growth.
+struct MemoryReport {
+    struct Usage {
+        uint64_t committedBytes;
+        uint64_t reservedBytes;
+    };
+
+    struct Column {
+        uint32_t componentID;
+        uint32_t numBytesPerRow;
+        Usage usage;
+    };
+
+    struct Archetype {
+        uint32_t archetypeID;
+        // Summed over all worlds, like usage
+        uint64_t numRows;
+        Usage usage;
+        // This archetype's range of MemoryReport::columns
+        uint32_t columnOffset;
+        uint32_t numColumns;
+    };
+
+    DynArray<Archetype> archetypes;
+    DynArray<Column> columns;
+    // Each world's tables, entity IDs and temporary memory. Fixed size
+    // tables are shared, so they are split evenly between the worlds.
+    DynArray<uint64_t> worldCommittedBytes;
+    Usage entityStore;
+    Usage tmpAllocators;
+    Usage exportBuffers;
+    // Memory that singletons registered with registerSingletonSnapshot
+    // hold outside of their row, such as the physics BVH
+    Usage singletons;
+    Usage total;
+};
+
 class StateManager {
 public:
 #ifdef MADRONA_MW_MODE
-    StateManager(CountT num_worlds);
+    // When num_export_rows_per_world is nonzero, columns of dynamically
+    // sized tables registered with ComponentFlags::ExportMemory are stored
+    // directly in their export buffer, laid out as a dense
+    // [num_worlds, num_export_rows_per_world] array (see exportColumn).
+    StateManager(CountT num_worlds, CountT num_export_rows_per_world = 0,
+                 uint64_t tmp_alloc_block_bytes = defaultTmpAllocBlockBytes);
 #else
     StateManager();
 #endif
@@ -125,8 +243,53 @@ public:
     template <typename SingletonT>
     SingletonT * exportSingleton();
 
-    void copyInExportedColumns();
-    void copyOutExportedColumns();
+    // Exported columns of dynamically sized tables are copied to / from
+    // separate export buffers, except for zero-copy columns (see the
+    // constructor), which are skipped. After enableExportDoubleBuffering, every
+    // such column has two buffers, selected with buffer_idx, so the
+    // results of one step can be read while the next step writes to
+    // the other buffer.
+    void copyInExportedColumns(CountT buffer_idx = 0);
+    void copyOutExportedColumns(CountT buffer_idx = 0);
+
+    // Only copy the rows of world_ids, for steps that run a subset of the
+    // worlds. Worlds are packed back to back in the export buffers, so
+    // other worlds are still copied out when a selected world changed
+    // its number of rows and moved them. Their rows are read back from
+    // the export buffer first, keeping any inputs written there. Requires
+    // a full copy in or out since the last time any world's rows changed
+    // outside of a step.
+    void copyInExportedColumns(CountT buffer_idx,
+                               Span<const int32_t> world_ids);
+    void copyOutExportedColumns(CountT buffer_idx,
+                                Span<const int32_t> world_ids);
+
+    // Also gives zero-copy columns a second buffer. The tables keep using
+    // buffer 0 until moveZeroCopyColumns.
+    void enableExportDoubleBuffering();
+    // Copies the zero-copy columns of every world into buffer_idx and
+    // points the tables at it, leaving the other buffer untouched while
+    // the worlds step.
+    void moveZeroCopyColumns(CountT buffer_idx);
+    // Returns the buffer_idx-th export buffer for a pointer returned by
+    // exportColumn. Columns of fixed size tables are exported directly
+    // and return export_ptr for every buffer.
+    void * exportBuffer(void *export_ptr, CountT buffer_idx) const;
+
+#ifdef MADRONA_MW_MODE
+    // A world table that outgrows its zero-copy slice moves its columns
+    // back to table owned memory. These sync the first
+    // num_export_rows_per_world rows of such tables with the export
+    // buffer, and move the columns back into the export buffer once they
+    // fit again. Only touch world_id's state, so they are safe to call
+    // concurrently for different worlds.
+    void importOverflowedColumns(uint32_t world_id);
+    void exportOverflowedColumns(uint32_t world_id);
+
+    // Frees world_id's temporary allocator blocks, so the next ones are
+    // allocated by the thread that next uses them.
+    void reallocTmpAlloc(uint32_t world_id);
+#endif
 
     template <typename SingletonT>
     SingletonT & getSingleton(MADRONA_MW_COND(uint32_t world_id));
@@ -137,7 +300,7 @@ public:
     template <typename ArchetypeT>
     ArchetypeID archetypeID() const;
 
-    inline Loc getLoc(Entity e) const;
+    inline Loc getLoc(MADRONA_MW_COND(uint32_t world_id,) Entity e) const;
 
     template <typename ComponentT>
     inline ResultRef<ComponentT> get(MADRONA_MW_COND(uint32_t world_id,)
@@ -171,16 +334,63 @@ public:
     inline void iterateQuery(MADRONA_MW_COND(uint32_t world_id,)
                                 const Query<ComponentTs...> &query, Fn &&fn);
 
+    // Calls fn(num_rows, ptrs...) once per run of rows that pass filter,
+    // with ptrs pointing at the first row of the run. Rows are filtered at
+    // Table::changeChunkRows granularity, so fn may see unchanged rows.
+    // Archetypes of fixed size or without a tracked changedMask component
+    // are visited in full.
+    template <typename... ComponentTs, typename Fn>
+    inline void iterateArchetypes(MADRONA_MW_COND(uint32_t world_id,)
+                                  const Query<ComponentTs...> &query,
+                                  const ChangeFilter &filter, Fn &&fn);
+
+    // Each world has a change version counter: tracked rows record its
+    // value when they are created, moved, visited by a query that writes
+    // them or passed to markChanged. advanceChangeVersion returns the
+    // current value and increments it. A system that calls it before
+    // running and filters on the result next time sees every change made
+    // since. Its own query writes are excluded if it also passes the
+    // result as ChangeFilter::writeVersion.
+    inline uint32_t advanceChangeVersion(MADRONA_MW_COND(uint32_t world_id));
+
+    // Writes through get() aren't tracked, call this after modifying a
+    // tracked component directly.
+    template <typename ComponentT>
+    inline void markChanged(MADRONA_MW_COND(uint32_t world_id,) Loc loc);
+
+    template <typename ComponentT>
+    inline void markChanged(MADRONA_MW_COND(uint32_t world_id,) Entity e);
+
+    // Deferred creation / destruction. makeEntity, destroyEntity and
+    // setComponent only record into txn, which must only ever be committed
+    // to a single world. commitTransaction first creates every recorded
+    // entity, with one table resize and one batch of entity IDs per
+    // archetype, then applies component writes in the order they were
+    // recorded, then destroys entities. Writes to and destruction of
+    // entities that no longer exist are ignored. txn is empty afterwards.
     Transaction makeTransaction();
-    void commitTransaction(Transaction &&txn);
+    void commitTransaction(MADRONA_MW_COND(uint32_t world_id,)
+                           StateCache &cache, Transaction &txn);
 
+    // Args are either empty, leaving the components uninitialized, or one
+    // value per component, like makeEntityNow. The entity ID is only
+    // assigned on commit.
     template <typename ArchetypeT, typename... Args>
-    inline Entity makeEntity(MADRONA_MW_COND(uint32_t world_id,)
-                             Transaction &txn, StateCache &cache,
-                             Args && ...args);
+    inline void makeEntity(Transaction &txn, Args && ...args);
+
+    template <typename... Args>
+    inline void makeEntity(Transaction &txn, uint32_t archetype_id,
+                           Args && ...args);
+
+    void destroyEntity(Transaction &txn, Entity e);
 
-    void destroyEntity(MADRONA_MW_COND(uint32_t world_id,)
-                       Transaction &txn, StateCache &cache, Entity e);
+    template <typename ComponentT>
+    inline void setComponent(Transaction &txn, Entity e,
+                             const ComponentT &value);
+
+    // Each world has a transaction to record into, used by Context's
+    // deferred functions and committed by CommitTransactionNode.
+    inline Transaction & worldTransaction(MADRONA_MW_COND(uint32_t world_id));
 
     template <typename ArchetypeT, typename... Args>
     inline Entity makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
@@ -195,16 +405,93 @@ public:
     void destroyEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                           StateCache &cache, Entity e);
 
+    // Creates num_entities entities in contiguous rows, with one table
+    // resize and one batch of entity IDs. Components are left
+    // uninitialized. The returned span is the new rows of the table's
+    // Entity column, so like a Loc it is only valid until entities of the
+    // archetype are next created or destroyed.
+    template <typename ArchetypeT>
+    inline Span<const Entity> makeEntities(
+        MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
+        CountT num_entities);
+
+    Span<const Entity> makeEntities(MADRONA_MW_COND(uint32_t world_id,)
+                                    StateCache &cache,
+                                    uint32_t archetype_id,
+                                    CountT num_entities);
+
     template <typename ArchetypeT>
     inline Loc makeTemporary(MADRONA_MW_COND(uint32_t world_id));
 
     inline Loc makeTemporary(MADRONA_MW_COND(uint32_t world_id,)
                              uint32_t archetype_id);
 
+    // Creates num_temporaries temporaries in contiguous rows and returns
+    // the Loc of the first one. The rest follow at increasing rows.
+    template <typename ArchetypeT>
+    inline Loc makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                               CountT num_temporaries);
+
+    inline Loc makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                               uint32_t archetype_id,
+                               CountT num_temporaries);
+
     template <typename ArchetypeT>
     inline void clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                       bool is_temporary);
 
+    // Stable sort of world_id's rows of ArchetypeT by ComponentT, which
+    // must be 4 bytes and is compared as an unsigned integer, like the
+    // GPU backend's sort. Every column is reordered and entity locations
+    // are updated, so Locs of temporaries are invalidated. Scratch memory
+    // comes from the world's tmpAlloc. Each world has its own tables, so
+    // sorting by WorldID does nothing.
+    template <typename ArchetypeT, typename ComponentT>
+    inline void sortArchetype(MADRONA_MW_COND(uint32_t world_id));
+
+    // World snapshots hold every row of every table of a world, including
+    // singletons and temporaries, the world's entity IDs and the memory of
+    // singletons registered with registerSingletonSnapshot, in one
+    // worldSnapshotBytes sized blob. Restoring sets the tables and the ID
+    // map back with one copy each, so Entity handles from before the
+    // snapshot are valid again, even for entities destroyed since. Handles
+    // of entities created after the snapshot must be dropped: their IDs
+    // are free again and get handed out to new entities. Singletons with a
+    // snapshot hook are only restored through the hook. cache must be the
+    // one the world's entities are created with. Transactions aren't part
+    // of snapshots, and restored rows count as changed (see
+    // ComponentFlags::TrackChanges).
+    uint64_t worldSnapshotBytes(MADRONA_MW_COND(uint32_t world_id));
+    void saveWorldSnapshot(MADRONA_MW_COND(uint32_t world_id,)
+                           const StateCache &cache, void *dst);
+    void restoreWorldSnapshot(MADRONA_MW_COND(uint32_t world_id,)
+                              StateCache &cache, const void *src);
+
+    // For singletons that own memory outside of their table row, such as
+    // the physics BVH. SingletonT must provide:
+    //     uint64_t snapshotBytes() const;
+    //     void saveSnapshot(void *dst) const;
+    //     void loadSnapshot(const void *src);
+    // loadSnapshot runs on the singleton of the world being restored or
+    // forked into and must copy into that singleton's own memory. SingletonT
+    // may also provide uint64_t memoryBytes() const, reported by
+    // memoryReport, which otherwise counts snapshotBytes().
+    template <typename SingletonT>
+    void registerSingletonSnapshot();
+
+    MemoryReport memoryReport();
+
+#ifdef MADRONA_MW_MODE
+    // Replaces the contents of every world in dst_worlds with a copy of
+    // src_world: each table is cloned with one copy per column and the
+    // registered snapshot singletons are copied only through their hooks,
+    // so every world keeps its own singleton memory. The destination
+    // worlds also take a copy of the source's ID space, so entity handles,
+    // including those stored inside components, refer to the cloned
+    // entities in every fork.
+    void forkWorld(uint32_t src_world, Span<const int32_t> dst_worlds);
+#endif
+
 #ifdef MADRONA_MW_MODE
     inline uint32_t numWorlds() const;
 #endif
@@ -212,6 +499,20 @@ public:
     void * tmpAlloc(MADRONA_MW_COND(uint32_t world_id,) uint64_t num_bytes);
     void resetTmpAlloc(MADRONA_MW_COND(uint32_t world_id));
 
+    struct TmpAllocStats {
+        // Size of the blocks the allocator is carved from
+        uint64_t blockBytes;
+        // Memory currently held in blocks, used or kept for reuse
+        uint64_t heldBytes;
+        // Most bytes allocated between two resets so far
+        uint64_t highWaterBytes;
+    };
+
+    TmpAllocStats tmpAllocStats(MADRONA_MW_COND(uint32_t world_id)) const;
+
+    static constexpr inline uint64_t defaultTmpAllocBlockBytes =
+        32 * 1024 * 1024;
+
 private:
     template <typename SingletonT>
     struct SingletonArchetype : public madrona::Archetype<SingletonT> {};
@@ -237,10 +538,11 @@ private:
 
         inline TableStorage(Span<TypeInfo> types,
                             CountT num_worlds,
-                            CountT max_num_per_world);
+                            CountT max_num_per_world,
+                            bool virtual_columns);
         ~TableStorage();
 #else
-        inline TableStorage(Span<TypeInfo> types);
+        inline TableStorage(Span<TypeInfo> types, bool virtual_columns);
 
         Table tbl;
 #endif
@@ -254,7 +556,13 @@ private:
         inline void clear(MADRONA_MW_COND(uint32_t world_id));
 
         inline CountT addRow(MADRONA_MW_COND(uint32_t world_id));
+        inline CountT addRows(MADRONA_MW_COND(uint32_t world_id,)
+                              CountT num_rows);
         inline bool removeRow(MADRONA_MW_COND(uint32_t world_id,) CountT row);
+
+        // The table holding world_id's rows if it can track changes,
+        // nullptr for fixed size tables
+        inline Table * changeTable(MADRONA_MW_COND(uint32_t world_id));
     };
 
     struct ArchetypeStore {
@@ -286,8 +594,19 @@ private:
         uint32_t numBytesPerRow;
 
         uint32_t numMappedChunks;
+        uint32_t numBackMappedChunks;
+
+        // Nonzero for zero-copy jobs, where mem holds the column of world
+        // i at row offset i * numRowsPerWorld
+        uint32_t numRowsPerWorld;
 
         VirtualRegion mem;
+        Optional<VirtualRegion> backMem;
+
+        // Row offset of each world in the export buffers as of the last
+        // copy, with the total row count at the end. Unused for zero-copy
+        // jobs.
+        HeapArray<uint32_t> worldRowOffsets;
     };
 #endif
 
@@ -296,6 +615,12 @@ private:
                                const Query<ComponentTs...> &query, Fn &&fn,
                                std::integer_sequence<uint32_t, Indices...>);
 
+    template <typename... ComponentTs, typename Fn, uint32_t... Indices>
+    void iterateArchetypesImpl(MADRONA_MW_COND(uint32_t world_id,)
+                               const Query<ComponentTs...> &query,
+                               const ChangeFilter &filter, Fn &&fn,
+                               std::integer_sequence<uint32_t, Indices...>);
+
     void makeQuery(const ComponentID *components, uint32_t num_components,
                    QueryRef *query_ref);
 
@@ -314,58 +639,124 @@ private:
 
     void * exportColumn(uint32_t archetype_id, uint32_t component_id);
 
+#ifdef MADRONA_MW_MODE
+    void makeZeroCopyExport(uint32_t archetype_id, uint32_t col_idx,
+                            uint32_t num_bytes_per_row);
+    // world_id's rows of a zero-copy job in the buffer the tables use
+    char * zeroCopySlice(ExportJob &export_job, uint32_t world_id) const;
+#endif
+
     void clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                uint32_t archetype_id, bool is_temporary);
 
+    void sortArchetype(MADRONA_MW_COND(uint32_t world_id,)
+                       uint32_t archetype_id, uint32_t component_id);
+
+    uint64_t columnNumBytes(const ArchetypeStore &archetype,
+                            CountT col_idx) const;
+
+    struct SnapshotHook {
+        uint32_t archetypeID;
+        uint64_t (*numBytes)(const void *singleton);
+        void (*save)(const void *singleton, void *dst);
+        void (*load)(void *singleton, const void *src);
+        uint64_t (*memoryBytes)(const void *singleton);
+    };
+
+    void registerSingletonSnapshot(SnapshotHook hook);
+    // The rows of these singletons hold pointers to memory of their own
+    // world, so they are only ever copied through their hook
+    bool hasSnapshotHook(uint32_t archetype_id) const;
+    inline void * singletonData(MADRONA_MW_COND(uint32_t world_id,)
+                                uint32_t archetype_id);
+
+    // In MW mode every world has its own ID space, so lookups stay within
+    // the world's dense array and allocating IDs in one world never
+    // contends with another. The world's ID cache then lives here too, and
+    // the StateCache passed in by callers is unused.
+    inline EntityStore & entityStore(MADRONA_MW_COND(uint32_t world_id));
+    inline const EntityStore & entityStore(
+        MADRONA_MW_COND(uint32_t world_id)) const;
+    inline EntityStore::Cache & entityCache(
+        MADRONA_MW_COND(uint32_t world_id,) StateCache &cache);
+    inline const EntityStore::Cache & entityCache(
+        MADRONA_MW_COND(uint32_t world_id,) const StateCache &cache) const;
+
     StateCache init_state_cache_; // FIXME remove
+#ifdef MADRONA_MW_MODE
+    HeapArray<EntityStore> entity_stores_;
+    HeapArray<EntityStore::Cache> entity_caches_;
+#else
     EntityStore entity_store_;
+#endif
     DynArray<Optional<TypeInfo>> component_infos_;
     DynArray<ComponentID> archetype_components_;
     DynArray<Optional<ArchetypeStore>> archetype_stores_;
     DynArray<uint32_t> bundle_components_;
     DynArray<Optional<BundleInfo>> bundle_infos_;
+    DynArray<SnapshotHook> snapshot_hooks_;
 
 #ifdef MADRONA_MW_MODE
     DynArray<ExportJob> export_jobs_;
 #endif
 
-    // FIXME: TmpAllocator doesn't belong here should be per CPU worker
+    // Stays per world rather than per worker: a world's temporary memory
+    // must live until its ResetTmpAllocNode, and the world's nodes can run
+    // on any worker in between. Blocks are only allocated on first use,
+    // and reset() keeps just enough free blocks for what the interval that
+    // just ended used, so memory taken for a spike goes back on the next
+    // reset. Allocations larger than a block get a block of their own.
+    // alloc may be called concurrently, since a world's nodes can be split
+    // across workers (intraWorldParallelism, nodeParallelism): it bumps
+    // the current block's offset atomically and only takes lock_ to start
+    // a new block. reset and release must not overlap with anything else.
     struct TmpAllocator {
-        struct Block;
-        struct Metadata {
-            Block *next;
-            CountT offset;
-        };
-
-        static constexpr inline uint64_t numBlockBytes = 32 * 1024 * 1024;
-
-        static constexpr inline uint64_t numFreeBlockBytes =
-            numBlockBytes - sizeof(Metadata);
-
         struct Block {
-            char data[numFreeBlockBytes];
-            Metadata metadata;
+            Block *next;
+            uint64_t numBytes;
+            // May end up past numBytes, from allocations that didn't fit
+            AtomicU64 curOffset;
         };
 
-        static_assert(sizeof(Block) == numBlockBytes);
+        static constexpr inline uint64_t blockHeaderBytes = 256;
+        static_assert(sizeof(Block) <= blockHeaderBytes);
 
-        Block *cur_block_;
+        Atomic<Block *> cur_block_;
+        Block *free_blocks_;
+        uint64_t block_bytes_;
+        AtomicU64 num_used_bytes_;
+        uint64_t num_held_bytes_;
+        uint64_t high_water_bytes_;
+        SpinLock lock_;
 
-        TmpAllocator();
+        TmpAllocator(uint64_t block_bytes);
         ~TmpAllocator();
 
         inline void * alloc(uint64_t num_bytes);
+        void * allocSlow(Block *full_block, uint64_t num_bytes);
         void reset();
+        void release();
+        inline uint64_t highWaterBytes() const;
+
+        Block * acquireBlock(uint64_t num_bytes);
+        void freeBlocks(Block *blocks);
     };
 
 #ifdef MADRONA_MW_MODE
     HeapArray<TmpAllocator> tmp_allocators_;
+    HeapArray<Transaction> world_txns_;
+    HeapArray<uint32_t> change_versions_;
 #else
     TmpAllocator tmp_allocator_;
+    Transaction world_txn_;
+    uint32_t change_version_;
 #endif
 
 #ifdef MADRONA_MW_MODE
     uint32_t num_worlds_;
+    uint32_t num_export_rows_per_world_;
+    // Export buffer that zero-copy columns currently live in
+    CountT zero_copy_buffer_idx_;
     SpinLock register_lock_;
 #endif
 
@@ -10,7 +10,9 @@
 #include <madrona/utils.hpp>
 
 #include <array>
+#include <cstring>
 #include <mutex>
+#include <type_traits>
 
 namespace madrona {
 
@@ -41,6 +43,16 @@ void EntityStore::setLoc(Entity e, Loc loc)
     map_.getRef(e) = loc;
 }
 
+uint64_t EntityStore::numCommittedBytes() const
+{
+    return map_.store().store.numCommittedBytes();
+}
+
+uint64_t EntityStore::numReservedBytes() const
+{
+    return map_.store().store.numReservedBytes();
+}
+
 void EntityStore::setRow(Entity e, uint32_t row)
 {
     Loc &loc = map_.getRef(e);
@@ -178,6 +190,38 @@ void StateManager::registerSingleton()
 #endif
 }
 
+template <typename SingletonT>
+void StateManager::registerSingletonSnapshot()
+{
+    registerSingletonSnapshot(SnapshotHook {
+        .archetypeID = archetypeID<SingletonArchetype<SingletonT>>().id,
+        .numBytes = [](const void *singleton) -> uint64_t {
+            return ((const SingletonT *)singleton)->snapshotBytes();
+        },
+        .save = [](const void *singleton, void *dst) {
+            ((const SingletonT *)singleton)->saveSnapshot(dst);
+        },
+        .load = [](void *singleton, const void *src) {
+            ((SingletonT *)singleton)->loadSnapshot(src);
+        },
+        .memoryBytes = [](const void *singleton) -> uint64_t {
+            auto single = (const SingletonT *)singleton;
+            if constexpr (requires { single->memoryBytes(); }) {
+                return single->memoryBytes();
+            } else {
+                return single->snapshotBytes();
+            }
+        },
+    });
+}
+
+void * StateManager::singletonData(MADRONA_MW_COND(uint32_t world_id,)
+                                   uint32_t archetype_id)
+{
+    return archetype_stores_[archetype_id]->tblStorage.column<char>(
+        MADRONA_MW_COND(world_id,) user_component_offset_);
+}
+
 template <typename BundleT>
 void StateManager::registerBundle()
 {
@@ -268,6 +312,47 @@ SingletonT & StateManager::getSingleton(MADRONA_MW_COND(uint32_t world_id))
         user_component_offset_);
 }
 
+EntityStore & StateManager::entityStore(MADRONA_MW_COND(uint32_t world_id))
+{
+#ifdef MADRONA_MW_MODE
+    return entity_stores_[world_id];
+#else
+    return entity_store_;
+#endif
+}
+
+const EntityStore & StateManager::entityStore(
+    MADRONA_MW_COND(uint32_t world_id)) const
+{
+#ifdef MADRONA_MW_MODE
+    return entity_stores_[world_id];
+#else
+    return entity_store_;
+#endif
+}
+
+EntityStore::Cache & StateManager::entityCache(
+    MADRONA_MW_COND(uint32_t world_id,) StateCache &cache)
+{
+#ifdef MADRONA_MW_MODE
+    (void)cache;
+    return entity_caches_[world_id];
+#else
+    return cache.entity_cache_;
+#endif
+}
+
+const EntityStore::Cache & StateManager::entityCache(
+    MADRONA_MW_COND(uint32_t world_id,) const StateCache &cache) const
+{
+#ifdef MADRONA_MW_MODE
+    (void)cache;
+    return entity_caches_[world_id];
+#else
+    return cache.entity_cache_;
+#endif
+}
+
 template <typename ComponentT>
 ComponentID StateManager::componentID() const
 {
@@ -293,9 +378,9 @@ ArchetypeID StateManager::archetypeID() const
     };
 }
 
-Loc StateManager::getLoc(Entity e) const
+Loc StateManager::getLoc(MADRONA_MW_COND(uint32_t world_id,) Entity e) const
 {
-    return entity_store_.getLoc(e);
+    return entityStore(MADRONA_MW_COND(world_id)).getLoc(e);
 }
 
 template <typename ComponentT>
@@ -319,7 +404,7 @@ template <typename ComponentT>
 ResultRef<ComponentT> StateManager::get(
     MADRONA_MW_COND(uint32_t world_id,) Entity entity)
 {
-    Loc loc = entity_store_.getLoc(entity);
+    Loc loc = entityStore(MADRONA_MW_COND(world_id)).getLoc(entity);
     if (!loc.valid()) {
         return ResultRef<ComponentT>(nullptr);
     }
@@ -331,7 +416,7 @@ template <typename ComponentT>
 ComponentT & StateManager::getUnsafe(
     MADRONA_MW_COND(uint32_t world_id,) int32_t entity_id)
 {
-    Loc loc = entity_store_.getLocUnsafe(entity_id);
+    Loc loc = entityStore(MADRONA_MW_COND(world_id)).getLocUnsafe(entity_id);
     return getUnsafe<ComponentT>(MADRONA_MW_COND(world_id,) loc);
 }
 
@@ -432,6 +517,130 @@ void StateManager::iterateQuery(MADRONA_MW_COND(uint32_t world_id,)
     });
 }
 
+template <typename... ComponentTs, typename Fn>
+void StateManager::iterateArchetypes(MADRONA_MW_COND(uint32_t world_id,)
+                                     const Query<ComponentTs...> &query,
+                                     const ChangeFilter &filter,
+                                     Fn &&fn)
+{
+    using IndicesWrapper =
+        std::make_integer_sequence<uint32_t, sizeof...(ComponentTs)>;
+
+    iterateArchetypesImpl(MADRONA_MW_COND(world_id,) query, filter,
+                          std::forward<Fn>(fn), IndicesWrapper());
+}
+
+template <typename... ComponentTs, typename Fn, uint32_t... Indices>
+void StateManager::iterateArchetypesImpl(MADRONA_MW_COND(uint32_t world_id,)
+    const Query<ComponentTs...> &query, const ChangeFilter &filter, Fn &&fn,
+    std::integer_sequence<uint32_t, Indices...>)
+{
+    static_assert(sizeof...(ComponentTs) <= 32);
+    assert(query.initialized_);
+
+    uint32_t *cur_query_ptr = &query_state_.queryData[query.ref_.offset];
+    const int num_archetypes = query.ref_.numMatchingArchetypes;
+
+    for (int query_archetype_idx = 0; query_archetype_idx < num_archetypes;
+         query_archetype_idx++) {
+        uint32_t archetype_idx = *(cur_query_ptr++);
+        const uint32_t *col_idxs = cur_query_ptr;
+        cur_query_ptr += sizeof...(ComponentTs);
+
+        ArchetypeStore &archetype = *archetype_stores_[archetype_idx];
+
+        const uint32_t num_rows = (uint32_t)
+            archetype.tblStorage.numRows(MADRONA_MW_COND(world_id));
+        if (num_rows == 0) {
+            continue;
+        }
+
+        auto visitRows = [&](uint32_t start, uint32_t end) {
+            fn(CountT(end - start), (archetype.tblStorage.column<ComponentTs>(
+                MADRONA_MW_COND(world_id,) col_idxs[Indices]) + start) ...);
+        };
+
+        Table *tbl = archetype.tblStorage.changeTable(
+            MADRONA_MW_COND(world_id));
+        if (tbl == nullptr || !tbl->hasTrackedColumns()) {
+            visitRows(0, num_rows);
+            continue;
+        }
+
+        auto markWrites = [&](uint32_t start, uint32_t end) {
+            for (uint32_t i = 0; i < (uint32_t)sizeof...(ComponentTs); i++) {
+                if ((filter.writeMask & (1_u32 << i)) == 0) {
+                    continue;
+                }
+
+                if (filter.writeVersion != 0) {
+                    tbl->markChanged(col_idxs[i], start, end,
+                                     filter.writeVersion);
+                } else {
+                    tbl->markChanged(col_idxs[i], start, end);
+                }
+            }
+        };
+
+        // Any changedMask column that isn't tracked lets every row pass
+        std::array<const uint32_t *, sizeof...(ComponentTs)> versions;
+        uint32_t num_versions = 0;
+        bool filter_rows = filter.changedMask != 0;
+        for (uint32_t i = 0; i < (uint32_t)sizeof...(ComponentTs); i++) {
+            if ((filter.changedMask & (1_u32 << i)) == 0) {
+                continue;
+            }
+
+            const uint32_t *col_versions = tbl->changeVersions(col_idxs[i]);
+            if (col_versions == nullptr) {
+                filter_rows = false;
+                break;
+            }
+
+            versions[num_versions++] = col_versions;
+        }
+
+        if (!filter_rows) {
+            visitRows(0, num_rows);
+            markWrites(0, num_rows);
+            continue;
+        }
+
+        auto chunkChanged = [&](uint32_t chunk) {
+            for (uint32_t i = 0; i < num_versions; i++) {
+                if (versions[i][chunk] > filter.sinceVersion) {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        // Coalesce consecutive changed chunks into a single call
+        const uint32_t num_chunks =
+            utils::divideRoundUp(num_rows, Table::changeChunkRows);
+        uint32_t chunk = 0;
+        while (chunk < num_chunks) {
+            if (!chunkChanged(chunk)) {
+                chunk++;
+                continue;
+            }
+
+            uint32_t start_chunk = chunk++;
+            while (chunk < num_chunks && chunkChanged(chunk)) {
+                chunk++;
+            }
+
+            uint32_t start = start_chunk << Table::changeChunkShift;
+            uint32_t end =
+                std::min(chunk << Table::changeChunkShift, num_rows);
+
+            visitRows(start, end);
+            markWrites(start, end);
+        }
+    }
+}
+
 template <typename ArchetypeT, typename... Args>
 Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                                    StateCache &cache, Args && ...args)
@@ -456,7 +665,9 @@ Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
     assert((num_args == 0 || num_args == archetype.numComponents) &&
            "Trying to construct entity with wrong number of arguments");
 
-    Entity e = entity_store_.newEntity(cache.entity_cache_);
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+    Entity e = entity_store.newEntity(
+        entityCache(MADRONA_MW_COND(world_id,) cache));
 
     CountT new_row = archetype.tblStorage.addRow(MADRONA_MW_COND(world_id));
 
@@ -488,7 +699,7 @@ Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
 
     ( constructNextComponent(std::forward<Args>(args)), ... );
     
-    entity_store_.setLoc(e, Loc {
+    entity_store.setLoc(e, Loc {
         .archetype = archetype_id,
         .row = int32_t(new_row),
     });
@@ -496,6 +707,115 @@ Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
     return e;
 }
 
+template <typename ArchetypeT, typename... Args>
+void StateManager::makeEntity(Transaction &txn, Args && ...args)
+{
+    makeEntity<Args...>(txn, archetypeID<ArchetypeT>().id,
+                        std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+void StateManager::makeEntity(Transaction &txn, uint32_t archetype_id,
+                              Args && ...args)
+{
+    [[maybe_unused]] ArchetypeStore &archetype =
+        *archetype_stores_[archetype_id];
+
+    constexpr uint32_t num_args = sizeof...(Args);
+
+    assert((num_args == 0 || num_args == archetype.numComponents) &&
+           "Trying to construct entity with wrong number of arguments");
+
+    constexpr uint32_t num_bytes =
+        (0 + ... + sizeof(std::remove_cvref_t<Args>));
+
+    char *data = (char *)txn.record(Transaction::Make, archetype_id,
+                                    Entity::none(), num_bytes);
+
+    [[maybe_unused]] int component_idx = 0;
+
+    // Components are constructed in place, then copied into the table on
+    // commit, so they must be trivially copyable like every table column
+    auto constructNextComponent = [&](auto &&arg) {
+        using ArgT = decltype(arg);
+        using ComponentT = std::remove_cvref_t<ArgT>;
+
+        static_assert(std::is_trivially_copyable_v<ComponentT>);
+
+        assert(componentID<ComponentT>().id ==
+               archetype_components_[archetype.componentOffset +
+                   component_idx].id);
+
+        ComponentT component(std::forward<ArgT>(arg));
+        memcpy(data, &component, sizeof(ComponentT));
+        data += sizeof(ComponentT);
+
+        component_idx++;
+    };
+
+    ( constructNextComponent(std::forward<Args>(args)), ... );
+}
+
+template <typename ComponentT>
+void StateManager::setComponent(Transaction &txn, Entity e,
+                                const ComponentT &value)
+{
+    static_assert(std::is_trivially_copyable_v<ComponentT>);
+
+    void *data = txn.record(Transaction::Modify, componentID<ComponentT>().id,
+                            e, sizeof(ComponentT));
+    memcpy(data, &value, sizeof(ComponentT));
+}
+
+Transaction & StateManager::worldTransaction(
+    MADRONA_MW_COND(uint32_t world_id))
+{
+#ifdef MADRONA_MW_MODE
+    return world_txns_[world_id];
+#else
+    return world_txn_;
+#endif
+}
+
+uint32_t StateManager::advanceChangeVersion(
+    MADRONA_MW_COND(uint32_t world_id))
+{
+    // Nodes of the same world may run concurrently
+#ifdef MADRONA_MW_MODE
+    return AtomicU32Ref(change_versions_[world_id]).fetch_add_relaxed(1);
+#else
+    return AtomicU32Ref(change_version_).fetch_add_relaxed(1);
+#endif
+}
+
+template <typename ComponentT>
+void StateManager::markChanged(MADRONA_MW_COND(uint32_t world_id,) Loc loc)
+{
+    ArchetypeStore &archetype = *archetype_stores_[loc.archetype];
+    Table *tbl = archetype.tblStorage.changeTable(MADRONA_MW_COND(world_id));
+    if (tbl == nullptr || !tbl->hasTrackedColumns()) {
+        return;
+    }
+
+    auto col_idx = archetype.columnLookup.lookup(componentID<ComponentT>().id);
+    if (!col_idx.has_value()) {
+        return;
+    }
+
+    tbl->markChanged(*col_idx, loc.row, loc.row + 1);
+}
+
+template <typename ComponentT>
+void StateManager::markChanged(MADRONA_MW_COND(uint32_t world_id,) Entity e)
+{
+    Loc loc = entityStore(MADRONA_MW_COND(world_id)).getLoc(e);
+    if (!loc.valid()) {
+        return;
+    }
+
+    markChanged<ComponentT>(MADRONA_MW_COND(world_id,) loc);
+}
+
 template <typename ArchetypeT>
 Loc StateManager::makeTemporary(MADRONA_MW_COND(uint32_t world_id))
 {
@@ -512,12 +832,55 @@ Loc StateManager::makeTemporary(MADRONA_MW_COND(uint32_t world_id,)
     CountT new_row = archetype.tblStorage.addRow(
         MADRONA_MW_COND(world_id));
 
+    // Temporaries have no entity ID, but sortArchetype needs a sentinel
+    // here so it doesn't remap a stale ID left in the column
+    archetype.tblStorage.column<Entity>(
+        MADRONA_MW_COND(world_id,) 0)[new_row] = Entity::none();
+
     return Loc {
         archetype_id,
         int32_t(new_row),
     };
 }
 
+template <typename ArchetypeT>
+Span<const Entity> StateManager::makeEntities(
+    MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
+    CountT num_entities)
+{
+    return makeEntities(MADRONA_MW_COND(world_id,) cache,
+                        archetypeID<ArchetypeT>().id, num_entities);
+}
+
+template <typename ArchetypeT>
+Loc StateManager::makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                                  CountT num_temporaries)
+{
+    return makeTemporaries(MADRONA_MW_COND(world_id,)
+                           archetypeID<ArchetypeT>().id, num_temporaries);
+}
+
+Loc StateManager::makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                                  uint32_t archetype_id,
+                                  CountT num_temporaries)
+{
+    ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+
+    CountT first_row = archetype.tblStorage.addRows(
+        MADRONA_MW_COND(world_id,) num_temporaries);
+
+    Entity *entities = archetype.tblStorage.column<Entity>(
+        MADRONA_MW_COND(world_id,) 0) + first_row;
+    for (CountT i = 0; i < num_temporaries; i++) {
+        entities[i] = Entity::none();
+    }
+
+    return Loc {
+        archetype_id,
+        int32_t(first_row),
+    };
+}
+
 template <typename ArchetypeT>
 void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                          bool is_temporary)
@@ -526,6 +889,20 @@ void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
           is_temporary);
 }
 
+template <typename ArchetypeT, typename ComponentT>
+void StateManager::sortArchetype(MADRONA_MW_COND(uint32_t world_id))
+{
+    static_assert(sizeof(ComponentT) == sizeof(uint32_t),
+                  "Sort keys must be 4 bytes");
+
+    if constexpr (std::is_same_v<ComponentT, WorldID>) {
+        return;
+    } else {
+        sortArchetype(MADRONA_MW_COND(world_id,) archetypeID<ArchetypeT>().id,
+                      componentID<ComponentT>().id);
+    }
+}
+
 #ifdef MADRONA_MW_MODE
 uint32_t StateManager::numWorlds() const
 {
@@ -542,8 +919,10 @@ inline ColumnT * StateManager::TableStorage::column(
     if (maxNumPerWorld == 0) {
         return (ColumnT *)tbls[world_id].data(col_idx);
     } else {
-        return ((ColumnT *)fixed.tbl.data(col_idx)) +
-            CountT(world_id) * maxNumPerWorld;
+        // Offset by the column's row size rather than sizeof(ColumnT), so
+        // untyped column<char> accesses land on the world's first row too
+        return (ColumnT *)fixed.tbl.getValue(uint32_t(col_idx),
+            world_id * uint32_t(maxNumPerWorld));
     }
 #else
     return (ColumnT *)tbl.data(col_idx);
@@ -592,6 +971,24 @@ CountT StateManager::TableStorage::addRow(
 #endif
 }
 
+CountT StateManager::TableStorage::addRows(
+    MADRONA_MW_COND(uint32_t world_id,) CountT num_rows)
+{
+#ifdef MADRONA_MW_MODE
+    if (maxNumPerWorld == 0) {
+        return tbls[world_id].addRows(uint32_t(num_rows));
+    } else {
+        CountT first_row = fixed.activeRows[world_id];
+        fixed.activeRows[world_id] = int32_t(first_row + num_rows);
+        assert(first_row + num_rows <= maxNumPerWorld);
+
+        return first_row;
+    }
+#else
+    return tbl.addRows(uint32_t(num_rows));
+#endif
+}
+
 bool StateManager::TableStorage::removeRow(MADRONA_MW_COND(uint32_t world_id,)
                                            CountT row)
 {
@@ -613,4 +1010,18 @@ bool StateManager::TableStorage::removeRow(MADRONA_MW_COND(uint32_t world_id,)
 #endif
 }
 
+Table * StateManager::TableStorage::changeTable(
+    MADRONA_MW_COND(uint32_t world_id))
+{
+#ifdef MADRONA_MW_MODE
+    if (maxNumPerWorld == 0) {
+        return &tbls[world_id];
+    } else {
+        return nullptr;
+    }
+#else
+    return &tbl;
+#endif
+}
+
 }
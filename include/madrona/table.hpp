@@ -11,6 +11,7 @@
 #include <madrona/heap_array.hpp>
 #include <madrona/inline_array.hpp>
 #include <madrona/virtual.hpp>
+#include <madrona/optional.hpp>
 #include <madrona/ecs.hpp>
 
 #include <array>
@@ -24,10 +25,22 @@ struct TypeInfo {
 
 class Table {
 public:
+    // Columns owned by the table start on a cache line (see
+    // ParallelForChunkNode). With virtual_columns, the columns live in one
+    // reserved VirtualRegion where each column owns a fixed range of
+    // address space. Growing the table commits more pages of each range
+    // instead of reallocating, so rows never move and growth never copies.
+    // Columns start on a cache line (or their alignment, if larger) and
+    // are staggered by that amount per column, so a row's components don't
+    // all map to the same cache set. Such tables hold at most
+    // maxVirtualRows rows.
     Table(const TypeInfo *component_types, CountT num_components,
-          CountT init_num_rows);
+          CountT init_num_rows, bool virtual_columns = false);
 
     uint32_t addRow();
+    // Adds num_rows uninitialized rows with at most one reallocation and
+    // returns the index of the first one
+    uint32_t addRows(uint32_t num_rows);
     bool removeRow(uint32_t row);
     void copyRow(uint32_t dst, uint32_t src);
 
@@ -42,14 +55,65 @@ public:
     // Drops all rows in the table and frees memory
     void clear();
 
+    // Store column col_idx in caller owned memory with room for max_rows
+    // rows rather than in memory owned by the table. Existing rows are
+    // copied into ptr. If the table grows past max_rows, the column is
+    // moved back to table owned memory and isExternalColumn returns false.
+    void setExternalColumn(uint32_t col_idx, void *ptr, uint32_t max_rows);
+    inline bool isExternalColumn(uint32_t col_idx) const;
+
+    // Change tracking: a tracked column keeps one version per chunk of
+    // changeChunkRows rows, holding the value of *version_src when a row
+    // of the chunk was last added, moved into or passed to markChanged.
+    // Writes through data() / getValue() aren't tracked.
+    void trackChanges(uint32_t col_idx, const uint32_t *version_src);
+    inline bool hasTrackedColumns() const;
+    // Per chunk versions of col_idx, or nullptr if it isn't tracked
+    inline const uint32_t * changeVersions(uint32_t col_idx) const;
+    void markChanged(uint32_t col_idx, uint32_t start_row, uint32_t end_row);
+    // Stamps the chunks with version instead of *version_src
+    void markChanged(uint32_t col_idx, uint32_t start_row, uint32_t end_row,
+                     uint32_t version);
+
+    // Bytes of memory backing col_idx and of address space set aside for
+    // it, including its change versions. External columns count as 0, the
+    // owner of their memory accounts for them.
+    struct ColumnMemory {
+        uint64_t committedBytes;
+        uint64_t reservedBytes;
+    };
+    ColumnMemory columnMemory(uint32_t col_idx) const;
+
     static constexpr uint32_t maxColumns = 128;
+    static constexpr uint32_t maxVirtualRows = 1u << 20;
+    static constexpr uint32_t maxTrackedColumns = 8;
+    static constexpr uint32_t changeChunkShift = 6;
+    static constexpr uint32_t changeChunkRows = 1u << changeChunkShift;
 
 private:
+    void initVirtualColumns(const TypeInfo *component_types);
+    void commitVirtualRows(uint32_t old_num_rows, uint32_t new_num_rows);
+    inline void * virtualColumn(uint32_t col_idx) const;
+    void moveExternalColumns(uint32_t num_live_rows);
+    inline int32_t trackedIndex(uint32_t col_idx) const;
+    void markAllChanged(uint32_t start_row, uint32_t end_row);
+
     uint32_t num_rows_;
     uint32_t num_allocated_rows_;
     uint32_t num_components_;
+    uint32_t num_external_rows_;
+    std::array<uint64_t, maxColumns / 64> external_columns_;
     InlineArray<void *, maxColumns> columns_;
     InlineArray<uint32_t, maxColumns> bytes_per_column_;
+    // Only used by virtual_columns tables
+    Optional<VirtualRegion> virtual_mem_;
+    uint64_t virtual_column_stride_;
+    uint32_t virtual_column_stagger_;
+    // Only used by tables with tracked columns
+    const uint32_t *change_version_;
+    uint32_t num_tracked_columns_;
+    std::array<uint32_t, maxTrackedColumns> tracked_columns_;
+    std::array<uint32_t *, maxTrackedColumns> change_versions_;
 };
 
 }
@@ -29,4 +29,42 @@ const void * Table::data(uint32_t col_idx) const
     return columns_[col_idx];
 }
 
+void * Table::virtualColumn(uint32_t col_idx) const
+{
+    // Start of the column's range, then col_idx staggers into it
+    uint64_t column_range_bytes =
+        virtual_column_stride_ + virtual_column_stagger_;
+
+    return (char *)virtual_mem_->ptr() +
+        uint64_t(col_idx) * column_range_bytes +
+        uint64_t(col_idx) * virtual_column_stagger_;
+}
+
+bool Table::hasTrackedColumns() const
+{
+    return num_tracked_columns_ > 0;
+}
+
+int32_t Table::trackedIndex(uint32_t col_idx) const
+{
+    for (uint32_t i = 0; i < num_tracked_columns_; i++) {
+        if (tracked_columns_[i] == col_idx) {
+            return int32_t(i);
+        }
+    }
+
+    return -1;
+}
+
+const uint32_t * Table::changeVersions(uint32_t col_idx) const
+{
+    int32_t tracked_idx = trackedIndex(col_idx);
+    return tracked_idx == -1 ? nullptr : change_versions_[tracked_idx];
+}
+
+bool Table::isExternalColumn(uint32_t col_idx) const
+{
+    return (external_columns_[col_idx / 64] & (1_u64 << (col_idx % 64))) != 0;
+}
+
 }
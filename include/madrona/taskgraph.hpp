@@ -4,6 +4,8 @@
 #include <madrona/heap_array.hpp>
 #include <madrona/span.hpp>
 #include <madrona/state.hpp>
+#include <madrona/sync.hpp>
+#include <madrona/tracing.hpp>
 #include <madrona/fwd.hpp>
 #include <madrona/context.hpp>
 
@@ -13,6 +15,36 @@
 namespace madrona {
 struct NodeBase {};
 
+// A set of tasks that call fn(data, start, end) on some worker thread.
+// numRemaining is decremented (with release semantics) after each task
+// returns; the creator of the group initializes it to the number of tasks
+// that will be spawned.
+struct TaskGroup {
+    void (*fn)(void *, CountT, CountT);
+    void *data;
+    AtomicCount numRemaining;
+};
+
+// Hook installed by the CPU backend when intra-world or node parallelism
+// is enabled. ParallelForNode hands each matching table's row count to
+// parallelFor, which may split [0, num_items) into ranges and run
+// range_fn on them across the worker pool. parallelFor returns only after
+// every range has finished.
+//
+// spawn and waitGroup are only set when independent nodes of a TaskGraph
+// may run concurrently. spawn queues the task [start, end) of group for
+// any worker, and waitGroup runs or steals queued tasks until group's
+// numRemaining reaches 0.
+struct ParallelForDispatcher {
+    void (*parallelFor)(void *executor, CountT num_items,
+                        void (*range_fn)(void *, CountT, CountT),
+                        void *range_data);
+    void (*spawn)(void *executor, TaskGroup *group,
+                  CountT start, CountT end);
+    void (*waitGroup)(void *executor, TaskGroup *group);
+    void *executor;
+};
+
 class TaskGraph {
 private:
     static inline constexpr uint32_t maxNodeDataBytes = 256;
@@ -24,15 +56,25 @@ private:
 
     struct Node {
         void (*fn)(NodeBase *, Context *, TaskGraph *);
+        const char *name;
         uint32_t dataIDX;
         uint32_t numChildren;
+        uint32_t numDependencies;
+        // Range of dependents_ holding the nodes that depend on this one
+        uint32_t dependentOffset;
+        uint32_t numDependents;
     };
 
 public:
     TaskGraph(StateManager *state_mgr,
               StateCache *state_cache,
               MADRONA_MW_COND(uint32_t world_id,) 
+              const ParallelForDispatcher *parallel_for,
+              NodeTracer *node_tracer,
+              uint32_t taskgraph_id,
               HeapArray<Node> &&sorted_nodes,
+              HeapArray<uint32_t> &&dependents,
+              HeapArray<uint32_t> &&roots,
               HeapArray<NodeData> &&node_datas);
     TaskGraph(const TaskGraph &) = delete;
     TaskGraph(TaskGraph &&) = default;
@@ -40,24 +82,90 @@ public:
     TaskGraph & operator=(const TaskGraph &) = delete;
     TaskGraph & operator=(TaskGraph &&) = default;
 
+    // Runs every node of the graph. Nodes are run one at a time in
+    // topological order, unless the backend installed
+    // ParallelForDispatcher::spawn, in which case nodes run as soon as
+    // all their dependencies have finished, possibly concurrently on
+    // different worker threads.
     void run(Context *ctx);
 
+    // Runs only the node at position node_idx of the topological order,
+    // for backends that run one node across every world before moving on
+    // to the next. Calling this for node_idx 0 through numNodes() - 1 in
+    // order is equivalent to run(), except nodes never run concurrently.
+    void runNodeAt(Context *ctx, CountT node_idx);
+    inline CountT numNodes() const { return sorted_nodes_.size(); }
+
     template <typename ArchetypeT>
     void clearTemporaries();
+    template <typename ArchetypeT, typename ComponentT>
+    void sortArchetype();
     void resetTmpAlloc();
+    void commitTransaction();
 
+    // Runs fn over every row matching query. If the backend installed a
+    // ParallelForDispatcher, rows of each table may be processed
+    // concurrently by multiple worker threads.
     template <typename ContextT, typename Fn, typename ...ComponentTs>
     void iterateQuery(ContextT &ctx,
                       Query<ComponentTs...> &query,
                       Fn &&fn);
 
+    // Always runs fn on the calling thread, in table row order.
+    template <typename ContextT, typename Fn, typename ...ComponentTs>
+    void iterateQuerySerial(ContextT &ctx,
+                            Query<ComponentTs...> &query,
+                            Fn &&fn);
+
+    // Only visit rows that pass filter (see StateManager::iterateArchetypes)
+    template <typename ContextT, typename Fn, typename ...ComponentTs>
+    void iterateQuery(ContextT &ctx,
+                      Query<ComponentTs...> &query,
+                      const ChangeFilter &filter,
+                      Fn &&fn);
+
+    template <typename ContextT, typename Fn, typename ...ComponentTs>
+    void iterateQuerySerial(ContextT &ctx,
+                            Query<ComponentTs...> &query,
+                            const ChangeFilter &filter,
+                            Fn &&fn);
+
+    // Runs fn(ctx, num_rows, Span<ComponentTs>...) over blocks of at most
+    // chunk_rows contiguous rows. Blocks start at multiples of chunk_rows
+    // from the start of each run of rows passing filter, and may run
+    // concurrently like iterateQuery.
+    template <typename ContextT, typename Fn, typename ...ComponentTs>
+    void iterateQueryChunks(ContextT &ctx,
+                            Query<ComponentTs...> &query,
+                            const ChangeFilter &filter,
+                            CountT chunk_rows,
+                            Fn &&fn);
+
+    inline uint32_t advanceChangeVersion();
+
 private:
+    struct ConcurrentRun;
+
+    inline void runNode(const Node &node, Context *ctx);
+    void runConcurrent(Context *ctx);
+    static void runNodeTask(void *data, CountT start, CountT end);
+
     StateManager *state_mgr_;
     StateCache *state_cache_;
 #ifdef MADRONA_MW_MODE
     uint32_t cur_world_id_;
 #endif
+    const ParallelForDispatcher *parallel_for_;
+    NodeTracer *node_tracer_;
+    uint32_t taskgraph_id_;
     HeapArray<Node> sorted_nodes_;
+    // Indices into sorted_nodes_
+    HeapArray<uint32_t> dependents_;
+    // Indices into sorted_nodes_ of the nodes without dependencies. These
+    // aren't necessarily a prefix of the order: a root registered after a
+    // dependent node is sorted after it.
+    HeapArray<uint32_t> roots_;
+    HeapArray<AtomicU32> num_pending_dependencies_;
     HeapArray<NodeData> node_datas_;
 
 friend class TaskGraphBuilder;
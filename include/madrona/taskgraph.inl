@@ -9,15 +9,108 @@ void TaskGraph::clearTemporaries()
                                   *state_cache_, true);
 }
 
+template <typename ArchetypeT, typename ComponentT>
+void TaskGraph::sortArchetype()
+{
+    state_mgr_->sortArchetype<ArchetypeT, ComponentT>(
+        MADRONA_MW_COND(cur_world_id_));
+}
+
 template <typename ContextT, typename Fn, typename ...ComponentTs>
 void TaskGraph::iterateQuery(ContextT &ctx,
                              Query<ComponentTs...> &query,
                              Fn &&fn)
 {
-    state_mgr_->iterateQuery(MADRONA_MW_COND(cur_world_id_,) query,
-        [&](auto &...refs) {
-            fn(ctx, refs...);
-        });
+    iterateQuery(ctx, query, ChangeFilter {}, std::forward<Fn>(fn));
+}
+
+template <typename ContextT, typename Fn, typename ...ComponentTs>
+void TaskGraph::iterateQuerySerial(ContextT &ctx,
+                                   Query<ComponentTs...> &query,
+                                   Fn &&fn)
+{
+    iterateQuerySerial(ctx, query, ChangeFilter {}, std::forward<Fn>(fn));
+}
+
+template <typename ContextT, typename Fn, typename ...ComponentTs>
+void TaskGraph::iterateQuery(ContextT &ctx,
+                             Query<ComponentTs...> &query,
+                             const ChangeFilter &filter,
+                             Fn &&fn)
+{
+    if (parallel_for_ == nullptr) {
+        iterateQuerySerial(ctx, query, filter, std::forward<Fn>(fn));
+        return;
+    }
+
+    state_mgr_->iterateArchetypes(MADRONA_MW_COND(cur_world_id_,) query,
+            filter, [&](CountT num_rows, auto ...ptrs) {
+        auto range_fn = [&](CountT start, CountT end) {
+            for (CountT i = start; i < end; i++) {
+                fn(ctx, ptrs[i]...);
+            }
+        };
+
+        using RangeFnT = decltype(range_fn);
+        parallel_for_->parallelFor(parallel_for_->executor, num_rows,
+            [](void *data, CountT start, CountT end) {
+                (*(RangeFnT *)data)(start, end);
+            }, &range_fn);
+    });
+}
+
+template <typename ContextT, typename Fn, typename ...ComponentTs>
+void TaskGraph::iterateQuerySerial(ContextT &ctx,
+                                   Query<ComponentTs...> &query,
+                                   const ChangeFilter &filter,
+                                   Fn &&fn)
+{
+    state_mgr_->iterateArchetypes(MADRONA_MW_COND(cur_world_id_,) query,
+            filter, [&](CountT num_rows, auto ...ptrs) {
+        for (CountT i = 0; i < num_rows; i++) {
+            fn(ctx, ptrs[i]...);
+        }
+    });
+}
+
+template <typename ContextT, typename Fn, typename ...ComponentTs>
+void TaskGraph::iterateQueryChunks(ContextT &ctx,
+                                   Query<ComponentTs...> &query,
+                                   const ChangeFilter &filter,
+                                   CountT chunk_rows,
+                                   Fn &&fn)
+{
+    state_mgr_->iterateArchetypes(MADRONA_MW_COND(cur_world_id_,) query,
+            filter, [&](CountT num_rows, auto ...ptrs) {
+        // Ranges are split by row, so minRowsPerTask keeps its meaning.
+        // Each range runs the blocks that start inside it.
+        auto range_fn = [&](CountT start, CountT end) {
+            CountT end_chunk = utils::divideRoundUp(end, chunk_rows);
+            for (CountT chunk_idx = utils::divideRoundUp(start, chunk_rows);
+                 chunk_idx < end_chunk; chunk_idx++) {
+                CountT row = chunk_idx * chunk_rows;
+                CountT num_chunk_rows = std::min(chunk_rows, num_rows - row);
+
+                fn(ctx, num_chunk_rows, Span(ptrs + row, num_chunk_rows)...);
+            }
+        };
+
+        if (parallel_for_ == nullptr) {
+            range_fn(0, num_rows);
+            return;
+        }
+
+        using RangeFnT = decltype(range_fn);
+        parallel_for_->parallelFor(parallel_for_->executor, num_rows,
+            [](void *data, CountT start, CountT end) {
+                (*(RangeFnT *)data)(start, end);
+            }, &range_fn);
+    });
+}
+
+uint32_t TaskGraph::advanceChangeVersion()
+{
+    return state_mgr_->advanceChangeVersion(MADRONA_MW_COND(cur_world_id_));
 }
 
 }
@@ -3,6 +3,7 @@
 #include <madrona/fwd.hpp>
 #include <madrona/taskgraph.hpp>
 #include <madrona/context.hpp>
+#include <madrona/template_helpers.hpp>
 
 namespace madrona {
 
@@ -46,6 +47,8 @@ public:
     template <typename NodeT, typename... Args>
     TypedDataID<NodeT> constructNodeData(Args &&...args);
 
+    // Nodes are labeled in traces with NodeT::traceName() if NodeT
+    // defines it, otherwise with the name of fn.
     template <auto fn, typename NodeT>
     TaskGraphNodeID addNodeFn(TypedDataID<NodeT> data,
                               Span<const TaskGraphNodeID> dependencies,
@@ -67,6 +70,7 @@ private:
 
     TaskGraphNodeID registerNode(uint32_t data_idx,
         void (*fn)(NodeBase *, Context *, TaskGraph *),
+        const char *name,
         Span<const TaskGraphNodeID> dependencies,
         Optional<TaskGraphNodeID> parent_node);
 
@@ -82,6 +86,8 @@ private:
 #ifdef MADRONA_MW_MODE
     uint32_t world_id_;
 #endif
+    const ParallelForDispatcher *parallel_for_;
+    NodeTracer *node_tracer_;
     uint32_t taskgraph_id_;
     DynArray<StagedNode> staged_;
     DynArray<TaskGraph::NodeData> node_datas_;
@@ -109,6 +115,12 @@ private:
 
 // Builtin taskgraph nodes
 
+// Change filter of a for node over ComponentTs that last ran at
+// since_version. write_mask is truncated to the number of components.
+template <typename ...ComponentTs>
+inline ChangeFilter forNodeChangeFilter(uint32_t since_version,
+                                        uint32_t write_mask);
+
 // ParallelForNode is the core of the ECS taskgraph. This node will
 // call Fn in parallel over every entity matching the list of Component types
 // passed in the signature.
@@ -119,20 +131,100 @@ private:
 //
 // The following node type iterates over each entity with Position & Rotation:
 //     ParallelForNode<MyContext, mySystem, Position, Rotation>
+//
+// When the CPU backend is configured with intraWorldParallelism, the rows
+// of a single world are additionally split across worker threads, so Fn
+// must be safe to call concurrently for different entities of the same
+// world (the same requirement as the GPU backend).
+//
+// Wrapping components in Changed restricts iteration to entities where
+// any of them changed since the node last ran in that world:
+//     ParallelForNode<MyContext, mySystem, Changed<Position>, Rotation>
+// Components Fn takes by non-const reference are marked as changed for
+// every entity visited. Other nodes see those writes, the node that made
+// them doesn't, so a node may filter on a component it writes.
 template <typename ContextT, auto Fn, typename ...ComponentTs>
 class ParallelForNode : public NodeBase {
 public:
-    ParallelForNode(Query<ComponentTs...> &&query);
+    using QueryT = Query<typename QueryComponent<ComponentTs>::Type...>;
+
+    ParallelForNode(QueryT &&query);
+
+    inline void run(Context &ctx_base, TaskGraph &taskgraph);
+
+    static inline const char * traceName();
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &state_mgr,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+
+private:
+    QueryT query_;
+    uint32_t last_change_version_;
+};
+
+// SerialForNode has the same interface as ParallelForNode but always runs
+// Fn over a world's matching entities on a single thread. Use this for
+// systems that aren't safe to split within a world, for example systems
+// that create temporaries or entities.
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+class SerialForNode : public NodeBase {
+public:
+    using QueryT = Query<typename QueryComponent<ComponentTs>::Type...>;
+
+    SerialForNode(QueryT &&query);
+
+    inline void run(Context &ctx_base, TaskGraph &taskgraph);
+
+    static inline const char * traceName();
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &state_mgr,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+
+private:
+    QueryT query_;
+    uint32_t last_change_version_;
+};
+
+// ParallelForChunkNode calls Fn over blocks of up to chunkRows contiguous
+// rows, with a Span over each component's column, so Fn can be written as
+// a vector kernel over the SoA columns:
+//     void mySystem(MyContext &ctx, CountT num_rows,
+//                   Span<Position> positions,
+//                   Span<const Velocity> velocities);
+//     ParallelForChunkNode<MyContext, mySystem, Position, const Velocity>
+//
+// Blocks start at multiples of 64 rows, so every Span starts on a cache
+// line, except for fixed size archetypes and zero-copy exported columns,
+// whose per world columns only keep the alignment of the component. Only
+// the last block of each table may be shorter than chunkRows. Changed<>
+// works as for ParallelForNode, and non-const components count as written.
+// Blocks may run concurrently on the CPU backend. The GPU backend calls Fn
+// once per entity with num_rows equal to 1.
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+class ParallelForChunkNode : public NodeBase {
+public:
+    using QueryT = Query<typename QueryComponent<ComponentTs>::Type...>;
+
+    static constexpr CountT chunkRows = 256;
+
+    ParallelForChunkNode(QueryT &&query);
 
     inline void run(Context &ctx_base, TaskGraph &taskgraph);
 
+    static inline const char * traceName();
+
     static TaskGraphNodeID addToGraph(
         StateManager &state_mgr,
         TaskGraphBuilder &builder,
         Span<const TaskGraphNodeID> dependencies);
 
 private:
-    Query<ComponentTs...> query_;
+    QueryT query_;
+    uint32_t last_change_version_;
 };
 
 // This node resets the temporary bump allocator accessible through
@@ -147,6 +239,20 @@ public:
         Span<const TaskGraphNodeID> dependencies);
 };
 
+// This node applies the entity creations, component writes and
+// destructions recorded by Context's deferred functions since the last
+// commit (see StateManager::commitTransaction). Entities made with
+// Context::makeEntityDeferred don't exist until this node runs.
+class CommitTransactionNode : public NodeBase {
+public:
+    inline void run(Context &ctx, TaskGraph &taskgraph);
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
+
 // This node destroys all the temporary entities of archetype ArchetypeT
 template <typename ArchetypeT>
 class ClearTmpNode : public NodeBase {
@@ -159,6 +265,33 @@ public:
         Span<const TaskGraphNodeID> dependencies);
 };
 
+// This node sorts the rows of ArchetypeT in each world by ComponentT (see
+// StateManager::sortArchetype). Like on the GPU backend, follow it with
+// ResetTmpAllocNode to release the scratch memory used by the sort.
+template <typename ArchetypeT, typename ComponentT>
+class SortArchetypeNode : public NodeBase {
+public:
+    inline void run(Context &ctx, TaskGraph &taskgraph);
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
+
+// This node removes the gaps left by deleted rows of ArchetypeT on the GPU
+// backend. CPU tables are always kept dense, so it does nothing here and
+// only exists so task graphs can be shared between backends.
+template <typename ArchetypeT>
+class CompactArchetypeNode : public NodeBase {
+public:
+    inline void run(Context &ctx, TaskGraph &taskgraph);
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
 
 }
 
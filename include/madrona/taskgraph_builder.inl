@@ -30,11 +30,19 @@ TaskGraphNodeID TaskGraphBuilder::addNodeFn(
         Span<const TaskGraphNodeID> dependencies,
         Optional<TaskGraphNodeID> parent_node)
 {
+    const char *name;
+    if constexpr (requires { NodeT::traceName(); }) {
+        name = NodeT::traceName();
+    } else {
+        name = functionTraceName<fn>();
+    }
+
     return registerNode(uint32_t(data.id), [](NodeBase *node_data,
                                               Context *ctx,
                                               TaskGraph *task_graph) {
             std::invoke(fn, ((NodeT *)node_data), *ctx, *task_graph);
         },
+        name,
         dependencies,
         parent_node);
 }
@@ -62,10 +70,34 @@ TaskGraphBuilder & TaskGraphManager::init(EnumT taskgraph_id)
     return init(static_cast<uint32_t>(taskgraph_id));
 }
 
+template <typename ...ComponentTs>
+ChangeFilter forNodeChangeFilter(uint32_t since_version, uint32_t write_mask)
+{
+    constexpr uint32_t num_components = sizeof...(ComponentTs);
+    static_assert(num_components <= 32);
+
+    uint32_t changed_mask = 0;
+    uint32_t i = 0;
+    ((changed_mask |= QueryComponent<ComponentTs>::changed ?
+        (1_u32 << i) : 0, i++), ...);
+
+    if constexpr (num_components < 32) {
+        write_mask &= (1_u32 << num_components) - 1;
+    }
+
+    return ChangeFilter {
+        .sinceVersion = since_version,
+        .changedMask = changed_mask,
+        .writeMask = write_mask,
+        .writeVersion = 0,
+    };
+}
+
 template <typename ContextT, auto Fn, typename ...ComponentTs>
 ParallelForNode<ContextT, Fn, ComponentTs...>::ParallelForNode(
-        Query<ComponentTs...> &&query)
-    : query_(std::move(query))
+        QueryT &&query)
+    : query_(std::move(query)),
+      last_change_version_(0)
 {}
 
 template <typename ContextT, auto Fn, typename ...ComponentTs>
@@ -73,7 +105,21 @@ void ParallelForNode<ContextT, Fn, ComponentTs...>::run(
     Context &ctx_base, TaskGraph &taskgraph)
 {
     ContextT &ctx = static_cast<ContextT &>(ctx_base);
-    taskgraph.iterateQuery(ctx, query_, Fn); 
+
+    ChangeFilter filter = forNodeChangeFilter<ComponentTs...>(
+        last_change_version_, utils::MutableArgMask<decltype(Fn)>::value);
+    if (filter.changedMask != 0) {
+        last_change_version_ = taskgraph.advanceChangeVersion();
+        filter.writeVersion = last_change_version_;
+    }
+
+    taskgraph.iterateQuery(ctx, query_, filter, Fn);
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+const char * ParallelForNode<ContextT, Fn, ComponentTs...>::traceName()
+{
+    return functionTraceName<Fn>();
 }
 
 template <typename ContextT, auto Fn, typename ...ComponentTs>
@@ -85,7 +131,100 @@ ParallelForNode<ContextT, Fn, ComponentTs...>::addToGraph(
 {
     using NodeT = ParallelForNode<ContextT, Fn, ComponentTs...>;
 
-    auto query = state_mgr.query<ComponentTs...>();
+    auto query =
+        state_mgr.query<typename QueryComponent<ComponentTs>::Type...>();
+    return builder.addDefaultNode<NodeT>(dependencies, std::move(query));
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+SerialForNode<ContextT, Fn, ComponentTs...>::SerialForNode(
+        QueryT &&query)
+    : query_(std::move(query)),
+      last_change_version_(0)
+{}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+void SerialForNode<ContextT, Fn, ComponentTs...>::run(
+    Context &ctx_base, TaskGraph &taskgraph)
+{
+    ContextT &ctx = static_cast<ContextT &>(ctx_base);
+
+    ChangeFilter filter = forNodeChangeFilter<ComponentTs...>(
+        last_change_version_, utils::MutableArgMask<decltype(Fn)>::value);
+    if (filter.changedMask != 0) {
+        last_change_version_ = taskgraph.advanceChangeVersion();
+        filter.writeVersion = last_change_version_;
+    }
+
+    taskgraph.iterateQuerySerial(ctx, query_, filter, Fn);
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+const char * SerialForNode<ContextT, Fn, ComponentTs...>::traceName()
+{
+    return functionTraceName<Fn>();
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+TaskGraphNodeID
+SerialForNode<ContextT, Fn, ComponentTs...>::addToGraph(
+    StateManager &state_mgr,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    using NodeT = SerialForNode<ContextT, Fn, ComponentTs...>;
+
+    auto query =
+        state_mgr.query<typename QueryComponent<ComponentTs>::Type...>();
+    return builder.addDefaultNode<NodeT>(dependencies, std::move(query));
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+ParallelForChunkNode<ContextT, Fn, ComponentTs...>::ParallelForChunkNode(
+        QueryT &&query)
+    : query_(std::move(query)),
+      last_change_version_(0)
+{}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+void ParallelForChunkNode<ContextT, Fn, ComponentTs...>::run(
+    Context &ctx_base, TaskGraph &taskgraph)
+{
+    ContextT &ctx = static_cast<ContextT &>(ctx_base);
+
+    uint32_t write_mask = 0;
+    uint32_t i = 0;
+    ((write_mask |= std::is_const_v<
+        typename QueryComponent<ComponentTs>::Type> ? 0 : (1_u32 << i),
+      i++), ...);
+
+    ChangeFilter filter = forNodeChangeFilter<ComponentTs...>(
+        last_change_version_, write_mask);
+    if (filter.changedMask != 0) {
+        last_change_version_ = taskgraph.advanceChangeVersion();
+        filter.writeVersion = last_change_version_;
+    }
+
+    taskgraph.iterateQueryChunks(ctx, query_, filter, chunkRows, Fn);
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+const char * ParallelForChunkNode<ContextT, Fn, ComponentTs...>::traceName()
+{
+    return functionTraceName<Fn>();
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+TaskGraphNodeID
+ParallelForChunkNode<ContextT, Fn, ComponentTs...>::addToGraph(
+    StateManager &state_mgr,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    using NodeT = ParallelForChunkNode<ContextT, Fn, ComponentTs...>;
+
+    auto query =
+        state_mgr.query<typename QueryComponent<ComponentTs>::Type...>();
     return builder.addDefaultNode<NodeT>(dependencies, std::move(query));
 }
 
@@ -94,6 +233,11 @@ void ResetTmpAllocNode::run(Context &, TaskGraph &taskgraph)
     taskgraph.resetTmpAlloc();
 }
 
+void CommitTransactionNode::run(Context &, TaskGraph &taskgraph)
+{
+    taskgraph.commitTransaction();
+}
+
 template <typename ArchetypeT>
 void ClearTmpNode<ArchetypeT>::run(Context &, TaskGraph &taskgraph)
 {
@@ -109,4 +253,33 @@ TaskGraphNodeID ClearTmpNode<ArchetypeT>::addToGraph(
     return builder.addDefaultNode<ClearTmpNode>(dependencies);
 }
 
+template <typename ArchetypeT, typename ComponentT>
+void SortArchetypeNode<ArchetypeT, ComponentT>::run(Context &,
+                                                    TaskGraph &taskgraph)
+{
+    taskgraph.sortArchetype<ArchetypeT, ComponentT>();
+}
+
+template <typename ArchetypeT, typename ComponentT>
+TaskGraphNodeID SortArchetypeNode<ArchetypeT, ComponentT>::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<SortArchetypeNode>(dependencies);
+}
+
+template <typename ArchetypeT>
+void CompactArchetypeNode<ArchetypeT>::run(Context &, TaskGraph &)
+{}
+
+template <typename ArchetypeT>
+TaskGraphNodeID CompactArchetypeNode<ArchetypeT>::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<CompactArchetypeNode>(dependencies);
+}
+
 }
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <type_traits>
 
 namespace madrona::utils {
@@ -42,6 +43,28 @@ struct FirstArgTypeExtractor<ReturnT (ClassT::*)(FirstT, ArgsT...) const> {
     using type = FirstT;
 };
 
+// Bit i is set if the parameter after the first one at position i of the
+// function pointer type Fn is a non-const lvalue reference. Callables whose
+// parameters can't be inspected get every bit set.
+template <typename Fn>
+struct MutableArgMask {
+    static constexpr uint32_t value = ~uint32_t(0);
+};
+
+template <typename ReturnT, typename FirstT, typename... ArgsT>
+struct MutableArgMask<ReturnT (*)(FirstT, ArgsT...)> {
+    template <typename T>
+    static constexpr bool isMutable = std::is_lvalue_reference_v<T> &&
+        !std::is_const_v<std::remove_reference_t<T>>;
+
+    static constexpr uint32_t value = []() {
+        uint32_t mask = 0;
+        uint32_t i = 0;
+        ((mask |= isMutable<ArgsT> ? (uint32_t(1) << i) : 0, i++), ...);
+        return mask;
+    }();
+};
+
 template <typename T>
 struct ExtractClassFromMemberPtr;
 
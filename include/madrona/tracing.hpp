@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include <madrona/macros.hpp>
+#include <madrona/heap_array.hpp>
 
 #ifdef MADRONA_MSVC
 #include <intrin.h>
@@ -72,4 +73,93 @@ namespace madrona
     }
 
     void FinalizeLogging(const std::string file_path);
+
+    // Returns a string that contains the name of Fn, used to label
+    // TaskGraph nodes in NodeTracer output. The compiler's full function
+    // signature is stored and only cleaned up when traces are written.
+    template <auto Fn>
+    inline const char * functionTraceName()
+    {
+        return MADRONA_COMPILER_FUNCTION_NAME;
+    }
+
+    struct NodeTraceEvent
+    {
+        uint64_t start;
+        uint64_t end;
+        const char *name;
+        uint32_t worldID;
+        uint32_t taskgraphID;
+    };
+
+    // Records the start and end time of every TaskGraph node run by each
+    // worker thread into a preallocated per worker ring buffer. Once a
+    // buffer is full the oldest events are overwritten. Recording takes
+    // no locks, so the trace should only be written while no taskgraphs
+    // are running.
+    class NodeTracer
+    {
+    public:
+        NodeTracer(CountT num_workers, CountT num_events_per_worker);
+
+        // Called once by each worker thread before it runs any nodes.
+        // Nodes run on other threads are not recorded.
+        static void attachWorker(NodeTracer *tracer, CountT worker_idx);
+
+        static inline void record(const char *name,
+                                  uint32_t world_id,
+                                  uint32_t taskgraph_id,
+                                  uint64_t start,
+                                  uint64_t end);
+
+        // Same layout as FinalizeLogging (all events, then all
+        // timestamps, as int64). Each node run is a begin / end event
+        // pair, with the event value packing:
+        //   bit 0: 1 for end, bits 1-23: node name index,
+        //   bits 24-47: world ID, bits 48-62: worker index.
+        // Node names are written one per line, in name index order, to a
+        // separate "_madrona_node_tracing_names" file.
+        void writeHostTracing(const std::string &file_path) const;
+
+        // Chrome / Perfetto trace event JSON, one track per worker.
+        void writeChromeTrace(const std::string &file_path) const;
+
+    private:
+        struct alignas(MADRONA_CACHE_LINE) WorkerBuffer
+        {
+            HeapArray<NodeTraceEvent> events;
+            uint64_t numRecorded;
+        };
+
+        template <typename Fn>
+        void forEachEvent(Fn &&fn) const;
+
+        HeapArray<WorkerBuffer> worker_buffers_;
+        uint64_t start_timestamp_;
+        uint64_t start_ns_;
+
+        static thread_local WorkerBuffer *cur_buffer_;
+    };
+
+    void NodeTracer::record(const char *name,
+                            uint32_t world_id,
+                            uint32_t taskgraph_id,
+                            uint64_t start,
+                            uint64_t end)
+    {
+        WorkerBuffer *buffer = cur_buffer_;
+        if (buffer == nullptr) {
+            return;
+        }
+
+        CountT num_events = buffer->events.size();
+        buffer->events[buffer->numRecorded % num_events] = NodeTraceEvent {
+            .start = start,
+            .end = end,
+            .name = name,
+            .worldID = world_id,
+            .taskgraphID = taskgraph_id,
+        };
+        buffer->numRecorded += 1;
+    }
 } // namespace madrona
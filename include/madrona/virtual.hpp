@@ -31,6 +31,7 @@ public:
     void decommitChunks(uint64_t start_chunk, uint64_t num_chunks);
 
     inline uint64_t chunkSize() const { return 1_u64 << chunk_shift_; }
+    inline uint64_t numReservedBytes() const { return total_size_; }
 
 private:
     struct Init;
@@ -66,6 +67,15 @@ public:
 
     inline uint32_t numBytesPerItem() const { return bytes_per_item_; }
 
+    inline uint64_t numCommittedBytes() const
+    {
+        return (uint64_t)committed_chunks_ * region_.chunkSize();
+    }
+    inline uint64_t numReservedBytes() const
+    {
+        return region_.numReservedBytes();
+    }
+
 private:
     VirtualRegion region_;
     void *const data_;
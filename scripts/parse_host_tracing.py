@@ -97,9 +97,48 @@ def plot_events(events,
     # plt.savefig(file_name + '_events.png')
 
 
+# NodeTracer::writeHostTracing output: each event packs
+# bit 0: end flag, bits 1-23: node name index,
+# bits 24-47: world ID, bits 48-62: worker index
+def read_node_tracing(file_name, names_file_name):
+    with open(file_name, 'rb') as f:
+        events, time_stamps = np.fromfile(f, dtype=np.int64).reshape(2, -1)
+    with open(names_file_name, 'r') as f:
+        names = f.read().splitlines()
+
+    starts = events[0::2]
+    assert np.all(events[1::2] == starts | 1)
+
+    durations = time_stamps[1::2] - time_stamps[0::2]
+    name_idxs = (starts >> 1) & ((1 << 23) - 1)
+    worlds = (starts >> 24) & ((1 << 24) - 1)
+    workers = (starts >> 48) & ((1 << 15) - 1)
+
+    return names, name_idxs, worlds, workers, durations
+
+
+def print_node_summary(names, name_idxs, durations):
+    totals = np.bincount(name_idxs, weights=durations, minlength=len(names))
+    counts = np.bincount(name_idxs, minlength=len(names))
+    total = totals.sum()
+
+    for i in np.argsort(-totals):
+        if counts[i] == 0:
+            continue
+        print(f"{totals[i] / total * 100:6.2f}% {int(counts[i]):8d} runs "
+              f"{totals[i] / counts[i]:14.0f} ticks/run  {names[i]}")
+
+
 if __name__ == "__main__":
+    if len(sys.argv) == 3:
+        names, name_idxs, _, _, durations = read_node_tracing(
+            sys.argv[1], sys.argv[2])
+        print_node_summary(names, name_idxs, durations)
+        exit()
+
     if len(sys.argv) != 2:
         print("python parse_tracing.py [file_name]")
+        print("python parse_tracing.py [node_tracing_file] [names_file]")
         exit()
 
     events, time_stamps = read_binary_file(sys.argv[1])
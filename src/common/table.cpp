@@ -6,8 +6,11 @@
  * https://opensource.org/licenses/MIT.
  */
 #include <madrona/table.hpp>
+#include <madrona/crash.hpp>
+#include <madrona/utils.hpp>
 
 #include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <type_traits>
 
@@ -15,50 +18,177 @@ namespace madrona {
 
 namespace ICfg {
 inline constexpr uint32_t maxRowsPerTable = 1u << 28u;
+// 64KB is a multiple of the page size on every supported platform
+inline constexpr uint64_t virtualColumnChunkShift = 16;
+}
+
+static inline void * allocColumn(uint64_t num_bytes)
+{
+    return rawAllocAligned(utils::roundUpPow2(std::max(num_bytes, 1_u64),
+        (uint64_t)MADRONA_CACHE_LINE), MADRONA_CACHE_LINE);
 }
 
 Table::Table(const TypeInfo *component_types, CountT num_components,
-             CountT init_num_rows)
+             CountT init_num_rows, bool virtual_columns)
     : num_rows_(init_num_rows),
       num_allocated_rows_(std::max(uint32_t(init_num_rows), 1_u32)),
       num_components_(num_components),
+      num_external_rows_(0),
+      external_columns_(),
       columns_(),
-      bytes_per_column_()
+      bytes_per_column_(),
+      virtual_mem_(Optional<VirtualRegion>::none()),
+      virtual_column_stride_(0),
+      virtual_column_stagger_(0),
+      change_version_(nullptr),
+      num_tracked_columns_(0),
+      tracked_columns_(),
+      change_versions_()
 {
+    if (virtual_columns) {
+        initVirtualColumns(component_types);
+        return;
+    }
+
     for (int i = 0; i < (int)num_components; i++) {
         const TypeInfo &type = component_types[i];
 
-#if 0
-        // 3rd argument is offsetting the start from the page aligned boundary
-        // to avoid everything mapping to the same cache sets. Should revisit -
-        // maybe add a random offset for each Table as well?
-        columns_.emplace_back(type.numBytes, type.alignment,
-            MADRONA_CACHE_LINE * (i + 1), ICfg::maxRowsPerTable);
-#endif
-
         size_t column_bytes_per_row = (size_t)type.numBytes;
-        columns_[i] = malloc(
+        columns_[i] = allocColumn(
             (size_t)column_bytes_per_row * (size_t)num_allocated_rows_);
         bytes_per_column_[i] = column_bytes_per_row;
     }
 }
 
+void Table::initVirtualColumns(const TypeInfo *component_types)
+{
+    if (num_allocated_rows_ > maxVirtualRows) {
+        FATAL("Table with virtual columns created with %u rows, max is %u",
+              num_allocated_rows_, maxVirtualRows);
+    }
+
+    uint32_t stagger = MADRONA_CACHE_LINE;
+    uint64_t max_column_bytes = 0;
+    for (int i = 0; i < (int)num_components_; i++) {
+        const TypeInfo &type = component_types[i];
+
+        stagger = std::max(stagger, type.alignment);
+        max_column_bytes = std::max(max_column_bytes, (uint64_t)type.numBytes);
+        bytes_per_column_[i] = type.numBytes;
+    }
+
+    // Every column gets the same chunk aligned range of address space,
+    // with room for the widest column plus the largest stagger offset
+    constexpr uint64_t chunk_size = 1_u64 << ICfg::virtualColumnChunkShift;
+    uint64_t column_range_bytes = utils::roundUp(
+        max_column_bytes * maxVirtualRows +
+            uint64_t(stagger) * uint64_t(num_components_),
+        chunk_size);
+
+    virtual_column_stride_ = column_range_bytes - stagger;
+    virtual_column_stagger_ = stagger;
+
+    // commitChunks() counts from the unaligned base, so only ask for page
+    // alignment, which is already enough for the cache line stagger
+    virtual_mem_.emplace(
+        column_range_bytes * std::max(uint64_t(num_components_), 1_u64),
+        ICfg::virtualColumnChunkShift, 1);
+
+    commitVirtualRows(0, num_allocated_rows_);
+
+    for (int i = 0; i < (int)num_components_; i++) {
+        columns_[i] = virtualColumn(i);
+    }
+}
+
+void Table::commitVirtualRows(uint32_t old_num_rows, uint32_t new_num_rows)
+{
+    const uint64_t column_range_bytes =
+        virtual_column_stride_ + virtual_column_stagger_;
+    const uint64_t chunk_shift = ICfg::virtualColumnChunkShift;
+    const uint64_t chunk_size = 1_u64 << chunk_shift;
+
+    // Column i starts i staggers into its range. External columns are
+    // committed too, so they can move back without checking.
+    for (int i = 0; i < (int)num_components_; i++) {
+        uint64_t stagger_offset = uint64_t(i) * virtual_column_stagger_;
+        uint64_t bytes_per_row = bytes_per_column_[i];
+
+        uint64_t old_num_chunks = old_num_rows == 0 ? 0 :
+            utils::divideRoundUp(
+                stagger_offset + old_num_rows * bytes_per_row, chunk_size);
+        uint64_t new_num_chunks = utils::divideRoundUp(
+            stagger_offset + new_num_rows * bytes_per_row, chunk_size);
+
+        if (new_num_chunks > old_num_chunks) {
+            uint64_t range_start_chunk =
+                (uint64_t(i) * column_range_bytes) >> chunk_shift;
+
+            virtual_mem_->commitChunks(range_start_chunk + old_num_chunks,
+                                       new_num_chunks - old_num_chunks);
+        }
+    }
+}
+
 uint32_t Table::addRow()
 {
-    uint32_t idx = num_rows_++;
+    return addRows(1);
+}
+
+uint32_t Table::addRows(uint32_t num_new_rows)
+{
+    uint32_t idx = num_rows_;
+    uint32_t new_end = idx + num_new_rows;
+    num_rows_ = new_end;
+
+    if (new_end > num_allocated_rows_) {
+        uint32_t new_num_rows = std::max(
+            std::max(10_u32, uint32_t(num_allocated_rows_ * 2)), new_end);
+
+        if (virtual_mem_.has_value()) {
+            if (new_end > maxVirtualRows) [[unlikely]] {
+                FATAL("Table with virtual columns exceeded %u rows",
+                      maxVirtualRows);
+            }
+
+            new_num_rows = std::min(new_num_rows, maxVirtualRows);
+
+            // Rows stay where they are, only new pages are mapped
+            commitVirtualRows(num_allocated_rows_, new_num_rows);
+        } else {
+            for (int i = 0; i < (int)num_components_; i++) {
+                if (isExternalColumn(i)) {
+                    continue;
+                }
 
-    if (idx >= num_allocated_rows_) {
-        uint32_t new_num_rows =
-            std::max(std::max(10_u32, uint32_t(num_allocated_rows_ * 2)), idx);
+                void *new_column = allocColumn(
+                    uint64_t(new_num_rows) * uint64_t(bytes_per_column_[i]));
+                memcpy(new_column, columns_[i],
+                       uint64_t(idx) * uint64_t(bytes_per_column_[i]));
+                rawDeallocAligned(columns_[i]);
 
-        for (int i = 0; i < (int)num_components_; i++) {
-            columns_[i] = realloc(columns_[i],
-                uint64_t(new_num_rows) * uint64_t(bytes_per_column_[i]));
+                columns_[i] = new_column;
+            }
+        }
+
+        uint64_t num_chunks = utils::divideRoundUp(new_num_rows,
+                                                   changeChunkRows);
+        for (uint32_t i = 0; i < num_tracked_columns_; i++) {
+            change_versions_[i] = (uint32_t *)realloc(change_versions_[i],
+                sizeof(uint32_t) * num_chunks);
         }
 
         num_allocated_rows_ = new_num_rows;
     }
 
+    if (new_end > num_external_rows_ && num_external_rows_ > 0) [[unlikely]] {
+        moveExternalColumns(idx);
+    }
+
+    if (num_tracked_columns_ > 0) {
+        markAllChanged(idx, new_end);
+    }
+
     return idx;
 }
 
@@ -80,6 +210,71 @@ void Table::copyRow(uint32_t dst, uint32_t src)
     for (int i = 0; i < (int)num_components_; i++) {
         memcpy(getValue(i, dst), getValue(i, src), bytes_per_column_[i]);
     }
+
+    if (num_tracked_columns_ > 0) {
+        markAllChanged(dst, dst + 1);
+    }
+}
+
+void Table::trackChanges(uint32_t col_idx, const uint32_t *version_src)
+{
+    if (trackedIndex(col_idx) != -1) {
+        return;
+    }
+
+    if (num_tracked_columns_ == maxTrackedColumns) {
+        FATAL("Table can't track changes to more than %u columns",
+              maxTrackedColumns);
+    }
+
+    assert(change_version_ == nullptr || change_version_ == version_src);
+    change_version_ = version_src;
+
+    uint64_t num_chunks = utils::divideRoundUp(num_allocated_rows_,
+                                               changeChunkRows);
+    uint32_t *versions =
+        (uint32_t *)malloc(sizeof(uint32_t) * num_chunks);
+    for (uint64_t i = 0; i < num_chunks; i++) {
+        versions[i] = *version_src;
+    }
+
+    tracked_columns_[num_tracked_columns_] = col_idx;
+    change_versions_[num_tracked_columns_] = versions;
+    num_tracked_columns_ += 1;
+}
+
+void Table::markChanged(uint32_t col_idx, uint32_t start_row,
+                        uint32_t end_row)
+{
+    if (change_version_ == nullptr) {
+        return;
+    }
+
+    markChanged(col_idx, start_row, end_row, *change_version_);
+}
+
+void Table::markChanged(uint32_t col_idx, uint32_t start_row,
+                        uint32_t end_row, uint32_t version)
+{
+    int32_t tracked_idx = trackedIndex(col_idx);
+    if (tracked_idx == -1 || start_row >= end_row) {
+        return;
+    }
+
+    uint32_t *versions = change_versions_[tracked_idx];
+
+    uint32_t end_chunk = (end_row - 1) >> changeChunkShift;
+    for (uint32_t chunk = start_row >> changeChunkShift;
+         chunk <= end_chunk; chunk++) {
+        versions[chunk] = version;
+    }
+}
+
+void Table::markAllChanged(uint32_t start_row, uint32_t end_row)
+{
+    for (uint32_t i = 0; i < num_tracked_columns_; i++) {
+        markChanged(tracked_columns_[i], start_row, end_row);
+    }
 }
 
 void Table::clear()
@@ -87,4 +282,90 @@ void Table::clear()
     num_rows_ = 0;
 }
 
+Table::ColumnMemory Table::columnMemory(uint32_t col_idx) const
+{
+    uint64_t num_version_bytes = 0;
+    int32_t tracked_idx = trackedIndex(col_idx);
+    if (tracked_idx != -1) {
+        num_version_bytes = sizeof(uint32_t) * (uint64_t)utils::divideRoundUp(
+            num_allocated_rows_, changeChunkRows);
+    }
+
+    if (isExternalColumn(col_idx)) {
+        return ColumnMemory {
+            .committedBytes = num_version_bytes,
+            .reservedBytes = num_version_bytes,
+        };
+    }
+
+    uint64_t bytes_per_row = bytes_per_column_[col_idx];
+
+    if (virtual_mem_.has_value()) {
+        // Mirrors the per column commit in commitVirtualRows
+        constexpr uint64_t chunk_size = 1_u64 << ICfg::virtualColumnChunkShift;
+        uint64_t stagger_offset = uint64_t(col_idx) * virtual_column_stagger_;
+
+        uint64_t num_committed = utils::divideRoundUp(
+            stagger_offset + num_allocated_rows_ * bytes_per_row,
+            chunk_size) * chunk_size;
+
+        return ColumnMemory {
+            .committedBytes = num_committed + num_version_bytes,
+            .reservedBytes = virtual_column_stride_ + virtual_column_stagger_ +
+                num_version_bytes,
+        };
+    }
+
+    uint64_t num_bytes = utils::roundUpPow2(
+        std::max(num_allocated_rows_ * bytes_per_row, 1_u64),
+        (uint64_t)MADRONA_CACHE_LINE);
+
+    return ColumnMemory {
+        .committedBytes = num_bytes + num_version_bytes,
+        .reservedBytes = num_bytes + num_version_bytes,
+    };
+}
+
+void Table::setExternalColumn(uint32_t col_idx, void *ptr, uint32_t max_rows)
+{
+    assert(num_rows_ <= max_rows);
+    assert(num_external_rows_ == 0 || num_external_rows_ == max_rows);
+
+    if (!isExternalColumn(col_idx)) {
+        memcpy(ptr, columns_[col_idx],
+               uint64_t(num_rows_) * uint64_t(bytes_per_column_[col_idx]));
+
+        if (!virtual_mem_.has_value()) {
+            rawDeallocAligned(columns_[col_idx]);
+        }
+    }
+
+    columns_[col_idx] = ptr;
+    external_columns_[col_idx / 64] |= 1_u64 << (col_idx % 64);
+    num_external_rows_ = max_rows;
+}
+
+void Table::moveExternalColumns(uint32_t num_live_rows)
+{
+    // Only rows [0, num_live_rows) need to be copied, the rows being added
+    // aren't initialized yet
+    for (int i = 0; i < (int)num_components_; i++) {
+        if (!isExternalColumn(i)) {
+            continue;
+        }
+
+        // Virtual columns are always committed up to num_allocated_rows_
+        void *heap_column = virtual_mem_.has_value() ? virtualColumn(i) :
+            allocColumn(uint64_t(num_allocated_rows_) *
+                        uint64_t(bytes_per_column_[i]));
+        memcpy(heap_column, columns_[i],
+               uint64_t(num_live_rows) * uint64_t(bytes_per_column_[i]));
+
+        columns_[i] = heap_column;
+    }
+
+    external_columns_ = {};
+    num_external_rows_ = 0;
+}
+
 }
@@ -6,7 +6,12 @@
 #include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
+#include <string_view>
+#include <unordered_map>
 
 #include <cassert>
 
@@ -57,4 +62,168 @@ void FinalizeLogging(const std::string file_path)
     WriteToFile<int64_t>(concat.data(), num_events * 2, file_path, "_madrona_host_tracing");
 }
 
+thread_local NodeTracer::WorkerBuffer *NodeTracer::cur_buffer_ = nullptr;
+
+static uint64_t steadyClockNS()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Pulls Fn out of functionTraceName<Fn>'s signature, for example
+// "const char* madrona::functionTraceName() [with auto Fn = mySystem]"
+static std::string cleanTraceName(const char *signature)
+{
+    std::string_view sig(signature);
+
+    size_t start, end;
+    if (size_t pos = sig.find("Fn = "); pos != sig.npos) {
+        start = pos + 5;
+        end = sig.find_first_of(";]", start);
+    } else if (size_t pos = sig.find("functionTraceName<");
+               pos != sig.npos) {
+        start = pos + 18;
+        end = sig.rfind('>');
+    } else {
+        return std::string(sig);
+    }
+
+    if (end == sig.npos || end < start) {
+        end = sig.size();
+    }
+
+    if (start < end && sig[start] == '&') {
+        start += 1;
+    }
+
+    return std::string(sig.substr(start, end - start));
+}
+
+NodeTracer::NodeTracer(CountT num_workers, CountT num_events_per_worker)
+    : worker_buffers_(num_workers),
+      start_timestamp_(GetTimeStamp()),
+      start_ns_(steadyClockNS())
+{
+    for (CountT i = 0; i < num_workers; i++) {
+        worker_buffers_.emplace(i, WorkerBuffer {
+            .events = HeapArray<NodeTraceEvent>(num_events_per_worker),
+            .numRecorded = 0,
+        });
+    }
+}
+
+void NodeTracer::attachWorker(NodeTracer *tracer, CountT worker_idx)
+{
+    cur_buffer_ = tracer == nullptr ? nullptr :
+        &tracer->worker_buffers_[worker_idx];
+}
+
+template <typename Fn>
+void NodeTracer::forEachEvent(Fn &&fn) const
+{
+    for (CountT worker_idx = 0; worker_idx < worker_buffers_.size();
+         worker_idx++) {
+        const WorkerBuffer &buffer = worker_buffers_[worker_idx];
+
+        uint64_t num_events = buffer.events.size();
+        uint64_t num_valid = std::min(buffer.numRecorded, num_events);
+        uint64_t first = buffer.numRecorded - num_valid;
+
+        for (uint64_t i = first; i < buffer.numRecorded; i++) {
+            fn(worker_idx, buffer.events[i % num_events]);
+        }
+    }
+}
+
+void NodeTracer::writeHostTracing(const std::string &file_path) const
+{
+    std::unordered_map<const char *, uint32_t> name_idxs;
+    std::vector<std::string> names;
+    std::vector<int64_t> events;
+    std::vector<int64_t> time_stamps;
+
+    forEachEvent([&](CountT worker_idx, const NodeTraceEvent &event) {
+        auto [iter, inserted] = name_idxs.emplace(event.name, names.size());
+        if (inserted) {
+            names.push_back(cleanTraceName(event.name));
+        }
+
+        int64_t packed = (int64_t(iter->second) << 1) |
+            (int64_t(event.worldID) << 24) | (int64_t(worker_idx) << 48);
+
+        events.push_back(packed);
+        time_stamps.push_back(int64_t(event.start));
+        events.push_back(packed | 1);
+        time_stamps.push_back(int64_t(event.end));
+    });
+
+    size_t num_events = events.size();
+    events.insert(events.end(), time_stamps.begin(), time_stamps.end());
+
+    WriteToFile<int64_t>(events.data(), num_events * 2, file_path,
+                         "_madrona_node_tracing");
+
+    std::string names_str;
+    for (const std::string &name : names) {
+        names_str += name;
+        names_str += '\n';
+    }
+
+    WriteToFile(names_str.data(), names_str.size(), file_path,
+                "_madrona_node_tracing_names");
+}
+
+void NodeTracer::writeChromeTrace(const std::string &file_path) const
+{
+    uint64_t cur_timestamp = GetTimeStamp();
+    uint64_t cur_ns = steadyClockNS();
+
+    double ns_per_tick = cur_timestamp > start_timestamp_ ?
+        double(cur_ns - start_ns_) / double(cur_timestamp - start_timestamp_) :
+        1.0;
+
+    auto toUS = [&](uint64_t timestamp) {
+        return double(int64_t(timestamp - start_timestamp_)) *
+            ns_per_tick / 1000.0;
+    };
+
+    std::unordered_map<const char *, std::string> names;
+
+    std::ofstream out(file_path);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+
+    bool first = true;
+    forEachEvent([&](CountT worker_idx, const NodeTraceEvent &event) {
+        auto iter = names.find(event.name);
+        if (iter == names.end()) {
+            iter = names.emplace(event.name,
+                                 cleanTraceName(event.name)).first;
+        }
+
+        std::string escaped;
+        for (char c : iter->second) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+
+        if (!first) {
+            out << ",";
+        }
+        first = false;
+
+        out << "\n{\"name\":\"" << escaped << "\","
+            << "\"cat\":\"taskgraph\",\"ph\":\"X\","
+            << "\"pid\":0,\"tid\":" << worker_idx << ","
+            << "\"ts\":" << toUS(event.start) << ","
+            << "\"dur\":" << toUS(event.end) - toUS(event.start) << ","
+            << "\"args\":{\"world\":" << event.worldID
+            << ",\"taskgraph\":" << event.taskgraphID << "}}";
+    });
+
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
 } // namespace madrona
@@ -253,8 +253,15 @@ static uint32_t computeCommittedItems(uint32_t committed_chunks,
 void VirtualStore::expand(uint32_t num_items)
 {
     if (num_items > committed_items_) {
-        region_.commitChunks(committed_chunks_, 1);
-        committed_chunks_++;
+        // Bulk growth can need several chunks at once
+        uint64_t num_bytes =
+            start_offset_ + (uint64_t)num_items * bytes_per_item_;
+        uint32_t num_chunks = (uint32_t)utils::divideRoundUp(
+            num_bytes, region_.chunkSize());
+
+        region_.commitChunks(committed_chunks_,
+                             num_chunks - committed_chunks_);
+        committed_chunks_ = num_chunks;
 
         committed_items_ = computeCommittedItems(committed_chunks_,
             bytes_per_item_, start_offset_, region_); 
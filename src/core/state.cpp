@@ -7,10 +7,13 @@
  */
 #include <madrona/state.hpp>
 #include <madrona/registry.hpp>
+#include <madrona/crash.hpp>
 #include <madrona/utils.hpp>
 #include <madrona/dyn_array.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <functional>
 #include <mutex>
 #include <string_view>
@@ -37,7 +40,7 @@ ECSRegistry::ECSRegistry(StateManager *state_mgr, void **export_ptrs)
 
 template <typename T>
 EntityStore::LockedMapStore<T>::LockedMapStore(CountT init_capacity)
-    : store(sizeof(T), alignof(T), 0, ~0u),
+    : store(sizeof(T), alignof(T), 0, maxIDs),
       numIDs(init_capacity),
       expandLock()
 {
@@ -68,6 +71,12 @@ Entity EntityStore::newEntity(Cache &cache)
     return map_.acquireID(cache);
 }
 
+void EntityStore::newEntities(Cache &cache, Entity *entities,
+                              CountT num_entities)
+{
+    map_.acquireIDs(cache, entities, num_entities);
+}
+
 void EntityStore::freeEntity(Cache &cache, Entity e)
 {
     map_.releaseID(cache, e);
@@ -79,75 +88,296 @@ void EntityStore::bulkFree(Cache &cache, Entity *entities,
     map_.bulkRelease(cache, entities, num_entities);
 }
 
+void EntityStore::copyFrom(const EntityStore &o, Cache &cache,
+                           const Cache &o_cache)
+{
+    map_.copyFrom(o.map_, cache, o_cache);
+}
+
+uint64_t EntityStore::snapshotBytes() const
+{
+    return map_.snapshotBytes();
+}
+
+void EntityStore::saveSnapshot(const Cache &cache, void *dst) const
+{
+    map_.saveSnapshot(cache, dst);
+}
+
+void EntityStore::loadSnapshot(Cache &cache, const void *src)
+{
+    map_.loadSnapshot(cache, src);
+}
+
 StateCache::StateCache()
+#ifndef MADRONA_MW_MODE
     : entity_cache_()
+#endif
 {}
 
-StateManager::TmpAllocator::TmpAllocator()
-    : cur_block_((Block *)rawAllocAligned(sizeof(Block), 256))
+Transaction::Transaction()
+    : head((Block *)rawAlloc(sizeof(Block))),
+      tail(head),
+      lock()
+{
+    head->next = nullptr;
+    head->curOffset = 0;
+    head->numEntries = 0;
+}
+
+Transaction::Transaction(Transaction &&o)
+    : head(o.head),
+      tail(o.tail),
+      lock()
+{
+    o.head = nullptr;
+    o.tail = nullptr;
+}
+
+Transaction::~Transaction()
+{
+    Block *block = head;
+    while (block != nullptr) {
+        Block *next = block->next;
+        rawDealloc(block);
+        block = next;
+    }
+}
+
+void * Transaction::record(Op op, uint32_t id, Entity e, uint32_t num_bytes)
+{
+    uint32_t num_entry_bytes = utils::roundUpPow2(
+        uint32_t(sizeof(Entry)) + num_bytes, entry_alignment_);
+
+    if (num_entry_bytes > bytes_per_block_) [[unlikely]] {
+        FATAL("Transaction entry of %u bytes doesn't fit in a block",
+              num_entry_bytes);
+    }
+
+    Block *block;
+    uint32_t offset;
+    {
+        std::lock_guard lock_guard(lock);
+
+        block = tail;
+        offset = block->curOffset;
+
+        if (offset + num_entry_bytes > bytes_per_block_) {
+            Block *new_block = (Block *)rawAlloc(sizeof(Block));
+            new_block->next = nullptr;
+            new_block->curOffset = 0;
+            new_block->numEntries = 0;
+
+            block->next = new_block;
+            tail = new_block;
+
+            block = new_block;
+            offset = 0;
+        }
+
+        block->curOffset = offset + num_entry_bytes;
+        block->numEntries += 1;
+    }
+
+    Entry *entry = (Entry *)(block->data + offset);
+    *entry = Entry {
+        .op = op,
+        .id = id,
+        .e = e,
+        .numBytes = num_bytes,
+    };
+
+    return entry + 1;
+}
+
+void Transaction::reset()
 {
-    cur_block_->metadata.next = nullptr;
-    cur_block_->metadata.offset = 0;
+    // Keep the first block around for the next round of recording
+    Block *block = head->next;
+    while (block != nullptr) {
+        Block *next = block->next;
+        rawDealloc(block);
+        block = next;
+    }
+
+    head->next = nullptr;
+    head->curOffset = 0;
+    head->numEntries = 0;
+    tail = head;
 }
 
+StateManager::TmpAllocator::TmpAllocator(uint64_t block_bytes)
+    : cur_block_(nullptr),
+      free_blocks_(nullptr),
+      block_bytes_(utils::roundUpPow2(block_bytes, blockHeaderBytes)),
+      num_used_bytes_(0),
+      num_held_bytes_(0),
+      high_water_bytes_(0),
+      lock_()
+{}
+
 StateManager::TmpAllocator::~TmpAllocator()
 {
-    reset();
+    release();
 }
 
 void * StateManager::TmpAllocator::alloc(uint64_t num_bytes)
 {
-    num_bytes = utils::roundUpPow2(num_bytes, 256);
+    num_bytes = utils::roundUpPow2(num_bytes, blockHeaderBytes);
+    num_used_bytes_.fetch_add_relaxed(num_bytes);
+
+    Block *block = cur_block_.load_acquire();
+    if (block != nullptr) {
+        uint64_t offset = block->curOffset.fetch_add_relaxed(num_bytes);
+        if (offset + num_bytes <= block->numBytes) {
+            return (char *)block + blockHeaderBytes + offset;
+        }
+    }
+
+    return allocSlow(block, num_bytes);
+}
+
+void * StateManager::TmpAllocator::allocSlow(Block *full_block,
+                                             uint64_t num_bytes)
+{
+    std::lock_guard lock(lock_);
+
+    // Another worker may have started a new block in the meantime
+    Block *block = cur_block_.load_relaxed();
+    if (block != full_block) {
+        uint64_t offset = block->curOffset.fetch_add_relaxed(num_bytes);
+        if (offset + num_bytes <= block->numBytes) {
+            return (char *)block + blockHeaderBytes + offset;
+        }
+    }
+
+    Block *new_block = acquireBlock(num_bytes);
+    new_block->next = block;
+    new_block->curOffset.store_relaxed(num_bytes);
+    cur_block_.store_release(new_block);
 
-    assert(num_bytes <= numFreeBlockBytes);
+    return (char *)new_block + blockHeaderBytes;
+}
 
-    CountT cur_offset = cur_block_->metadata.offset;
-    if (num_bytes > numFreeBlockBytes - cur_offset) {
-        Block *new_block = (Block *)rawAllocAligned(sizeof(Block), 256);
-        new_block->metadata.next = cur_block_;
-        cur_block_ = new_block;
-        cur_offset = 0;
+void StateManager::TmpAllocator::reset()
+{
+    uint64_t num_used_bytes = num_used_bytes_.load_relaxed();
+    high_water_bytes_ = std::max(high_water_bytes_, num_used_bytes);
+
+    // Put every used block up for reuse, then keep only as many as this
+    // interval needed
+    Block *block = cur_block_.load_relaxed();
+    while (block != nullptr) {
+        Block *next = block->next;
+        block->next = free_blocks_;
+        free_blocks_ = block;
+        block = next;
     }
 
-    void *ptr = &cur_block_->data[0] + cur_offset;
+    Block **keep_next = &free_blocks_;
+    uint64_t num_kept_bytes = 0;
+    while (*keep_next != nullptr && num_kept_bytes < num_used_bytes) {
+        num_kept_bytes += (*keep_next)->numBytes;
+        keep_next = &(*keep_next)->next;
+    }
 
-    cur_block_->metadata.offset = cur_offset + num_bytes;
+    freeBlocks(*keep_next);
+    *keep_next = nullptr;
 
-    return ptr;
+    cur_block_.store_relaxed(nullptr);
+    num_used_bytes_.store_relaxed(0);
 }
 
-void StateManager::TmpAllocator::reset()
+void StateManager::TmpAllocator::release()
+{
+    high_water_bytes_ = highWaterBytes();
+
+    freeBlocks(cur_block_.load_relaxed());
+    freeBlocks(free_blocks_);
+
+    cur_block_.store_relaxed(nullptr);
+    free_blocks_ = nullptr;
+    num_used_bytes_.store_relaxed(0);
+}
+
+uint64_t StateManager::TmpAllocator::highWaterBytes() const
+{
+    return std::max(high_water_bytes_, num_used_bytes_.load_relaxed());
+}
+
+StateManager::TmpAllocator::Block * StateManager::TmpAllocator::acquireBlock(
+    uint64_t num_bytes)
 {
-    Block *cur_block = cur_block_;
-    Block *next_block;
-    while ((next_block = cur_block->metadata.next) != nullptr) {
-        rawDeallocAligned(cur_block);
-        cur_block = next_block;
+    // Best fit, so a block left over from a spike only gets used (and
+    // kept by reset) while allocations actually need it
+    Block **best_next = nullptr;
+    for (Block **prev_next = &free_blocks_; *prev_next != nullptr;
+         prev_next = &(*prev_next)->next) {
+        uint64_t block_bytes = (*prev_next)->numBytes;
+        if (block_bytes >= num_bytes &&
+                (best_next == nullptr ||
+                 block_bytes < (*best_next)->numBytes)) {
+            best_next = prev_next;
+        }
+    }
+
+    if (best_next != nullptr) {
+        Block *block = *best_next;
+        *best_next = block->next;
+        return block;
     }
 
-    cur_block->metadata.offset = 0;
-    cur_block_ = cur_block;
+    uint64_t num_block_bytes = std::max(num_bytes, block_bytes_);
+
+    Block *block = (Block *)rawAllocAligned(
+        blockHeaderBytes + num_block_bytes, blockHeaderBytes);
+    block->numBytes = num_block_bytes;
+    num_held_bytes_ += num_block_bytes;
+
+    return block;
+}
+
+void StateManager::TmpAllocator::freeBlocks(Block *blocks)
+{
+    while (blocks != nullptr) {
+        Block *next = blocks->next;
+        num_held_bytes_ -= blocks->numBytes;
+        rawDeallocAligned(blocks);
+        blocks = next;
+    }
 }
 
 #ifdef MADRONA_MW_MODE
-StateManager::StateManager(CountT num_worlds)
+StateManager::StateManager(CountT num_worlds,
+                           CountT num_export_rows_per_world,
+                           uint64_t tmp_alloc_block_bytes)
     : init_state_cache_(),
-      entity_store_(),
+      entity_stores_(num_worlds),
+      entity_caches_(num_worlds),
       component_infos_(0),
       archetype_components_(0),
       archetype_stores_(0),
       bundle_components_(0),
       bundle_infos_(0),
+      snapshot_hooks_(0),
       export_jobs_(0),
       tmp_allocators_(num_worlds),
+      world_txns_(num_worlds),
+      change_versions_(num_worlds),
       num_worlds_(num_worlds),
+      num_export_rows_per_world_(num_export_rows_per_world),
+      zero_copy_buffer_idx_(0),
       register_lock_()
 {
     registerComponent<Entity>();
     registerComponent<WorldID>();
 
     for (CountT i = 0; i < num_worlds; i++) {
-        tmp_allocators_.emplace(i);
+        entity_stores_.emplace(i);
+        entity_caches_.emplace(i);
+        tmp_allocators_.emplace(i, tmp_alloc_block_bytes);
+        world_txns_.emplace(i);
+        change_versions_[i] = 1;
     }
 }
 #else
@@ -158,7 +388,10 @@ StateManager::StateManager()
       archetype_stores_(0),
       bundle_components_(0),
       bundle_infos_(0),
-      tmp_allocator_()
+      snapshot_hooks_(0),
+      tmp_allocator_(defaultTmpAllocBlockBytes),
+      world_txn_(),
+      change_version_(1)
 {
     registerComponent<Entity>();
 }
@@ -169,26 +402,211 @@ Transaction StateManager::makeTransaction()
     return Transaction();
 }
 
-void StateManager::commitTransaction(Transaction &&txn)
+void StateManager::commitTransaction(MADRONA_MW_COND(uint32_t world_id,)
+                                     StateCache &cache, Transaction &txn)
+{
+    using Entry = Transaction::Entry;
+    using Block = Transaction::Block;
+
+    if (txn.empty()) {
+        return;
+    }
+
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+
+    auto iterateEntries = [&txn](auto &&fn) {
+        for (Block *block = txn.head; block != nullptr;
+             block = block->next) {
+            uint32_t offset = 0;
+            for (uint32_t i = 0; i < block->numEntries; i++) {
+                Entry *entry = (Entry *)(block->data + offset);
+                fn(*entry, (char *)(entry + 1));
+
+                offset += utils::roundUpPow2(
+                    uint32_t(sizeof(Entry)) + entry->numBytes,
+                    Transaction::entry_alignment_);
+            }
+        }
+    };
+
+    CountT num_makes = 0;
+    iterateEntries([&](Entry &entry, char *) {
+        num_makes += entry.op == Transaction::Make ? 1 : 0;
+    });
+
+    if (num_makes > 0) {
+        const CountT num_archetypes = archetype_stores_.size();
+
+        // Per archetype: the offset of its IDs in new_entities and the
+        // next row to fill
+        uint64_t num_archetype_bytes =
+            2 * sizeof(uint32_t) * (uint64_t)num_archetypes;
+        uint64_t num_scratch_bytes = num_archetype_bytes +
+            sizeof(Entity) * (uint64_t)num_makes;
+
+        bool use_tmp_alloc = utils::roundUpPow2(num_scratch_bytes, 256) <=
+            tmpAllocStats(MADRONA_MW_COND(world_id)).blockBytes;
+        char *scratch = use_tmp_alloc ?
+            (char *)tmpAlloc(MADRONA_MW_COND(world_id,) num_scratch_bytes) :
+            (char *)rawAlloc(num_scratch_bytes);
+
+        uint32_t *entity_offsets = (uint32_t *)scratch;
+        uint32_t *next_rows = entity_offsets + num_archetypes;
+        Entity *new_entities = (Entity *)(scratch + num_archetype_bytes);
+
+        for (CountT i = 0; i < num_archetypes; i++) {
+            entity_offsets[i] = 0;
+        }
+
+        iterateEntries([&](Entry &entry, char *) {
+            if (entry.op == Transaction::Make) {
+                entity_offsets[entry.id] += 1;
+            }
+        });
+
+        // Grow each table and grab its entity IDs once
+        uint32_t cur_entity_offset = 0;
+        for (CountT archetype_id = 0; archetype_id < num_archetypes;
+             archetype_id++) {
+            uint32_t num_new = entity_offsets[archetype_id];
+            entity_offsets[archetype_id] = cur_entity_offset;
+
+            if (num_new == 0) {
+                continue;
+            }
+
+            ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+
+            next_rows[archetype_id] = (uint32_t)
+                archetype.tblStorage.addRows(MADRONA_MW_COND(world_id,)
+                                             num_new);
+
+            entity_store.newEntities(
+                entityCache(MADRONA_MW_COND(world_id,) cache),
+                new_entities + cur_entity_offset, num_new);
+
+            cur_entity_offset += num_new;
+        }
+
+        iterateEntries([&](Entry &entry, char *data) {
+            if (entry.op != Transaction::Make) {
+                return;
+            }
+
+            ArchetypeStore &archetype = *archetype_stores_[entry.id];
+            TableStorage &tbl = archetype.tblStorage;
+
+            uint32_t row = next_rows[entry.id]++;
+            Entity e = new_entities[entity_offsets[entry.id]++];
+
+            tbl.column<Entity>(MADRONA_MW_COND(world_id,) 0)[row] = e;
+#ifdef MADRONA_MW_MODE
+            tbl.column<WorldID>(world_id, 1)[row] =
+                WorldID { (int32_t)world_id };
+#endif
+
+            if (entry.numBytes > 0) {
+                for (CountT i = 0; i < (CountT)archetype.numComponents; i++) {
+                    uint32_t component_id = archetype_components_[
+                        archetype.componentOffset + i].id;
+                    uint64_t num_bytes =
+                        component_infos_[component_id]->numBytes;
+
+                    char *col = tbl.column<char>(MADRONA_MW_COND(world_id,)
+                        i + user_component_offset_);
+
+                    memcpy(col + (uint64_t)row * num_bytes, data, num_bytes);
+                    data += num_bytes;
+                }
+            }
+
+            entity_store.setLoc(e, Loc {
+                .archetype = entry.id,
+                .row = int32_t(row),
+            });
+        });
+
+        if (!use_tmp_alloc) {
+            rawDealloc(scratch);
+        }
+    }
+
+    iterateEntries([&](Entry &entry, char *data) {
+        if (entry.op != Transaction::Modify) {
+            return;
+        }
+
+        Loc loc = entity_store.getLoc(entry.e);
+        if (!loc.valid()) {
+            return;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[loc.archetype];
+        auto col_idx = archetype.columnLookup.lookup(entry.id);
+        if (!col_idx.has_value()) {
+            return;
+        }
+
+        char *col = archetype.tblStorage.column<char>(
+            MADRONA_MW_COND(world_id,) *col_idx);
+
+        memcpy(col + (uint64_t)loc.row * entry.numBytes, data,
+               entry.numBytes);
+    });
+
+    iterateEntries([&](Entry &entry, char *) {
+        if (entry.op == Transaction::Destroy) {
+            destroyEntityNow(MADRONA_MW_COND(world_id,) cache, entry.e);
+        }
+    });
+
+    txn.reset();
+}
+
+void StateManager::destroyEntity(Transaction &txn, Entity e)
 {
-    (void)txn;
+    txn.record(Transaction::Destroy, 0, e, 0);
 }
 
-void StateManager::destroyEntity(MADRONA_MW_COND(uint32_t world_id,)
-                                 Transaction &txn, StateCache &cache, Entity e)
+Span<const Entity> StateManager::makeEntities(
+    MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
+    uint32_t archetype_id, CountT num_entities)
 {
+    ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+    TableStorage &tbl = archetype.tblStorage;
+
+    CountT first_row = tbl.addRows(MADRONA_MW_COND(world_id,) num_entities);
+
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+
+    Entity *entities =
+        tbl.column<Entity>(MADRONA_MW_COND(world_id,) 0) + first_row;
+    entity_store.newEntities(entityCache(MADRONA_MW_COND(world_id,) cache),
+                             entities, num_entities);
+
 #ifdef MADRONA_MW_MODE
-    (void)world_id;
+    WorldID *world_ids = tbl.column<WorldID>(world_id, 1) + first_row;
 #endif
-    (void)txn.head;
-    (void)cache;
-    (void)e;
+
+    for (CountT i = 0; i < num_entities; i++) {
+#ifdef MADRONA_MW_MODE
+        world_ids[i] = WorldID { (int32_t)world_id };
+#endif
+
+        entity_store.setLoc(entities[i], Loc {
+            .archetype = archetype_id,
+            .row = int32_t(first_row + i),
+        });
+    }
+
+    return Span<const Entity>(entities, num_entities);
 }
 
 void StateManager::destroyEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                                     StateCache &cache, Entity e)
 {
-    Loc loc = entity_store_.getLoc(e);
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+    Loc loc = entity_store.getLoc(e);
     
     if (!loc.valid()) {
         return;
@@ -202,16 +620,17 @@ void StateManager::destroyEntityNow(MADRONA_MW_COND(uint32_t world_id,)
     if (row_moved) {
         Entity moved_entity = archetype.tblStorage.column<Entity>(
             MADRONA_MW_COND(world_id,) 0)[loc.row];
-        entity_store_.setRow(moved_entity, loc.row);
+        entity_store.setRow(moved_entity, loc.row);
     }
 
-    entity_store_.freeEntity(cache.entity_cache_, e);
+    entity_store.freeEntity(entityCache(MADRONA_MW_COND(world_id,) cache), e);
 }
 
 #ifdef MADRONA_MW_MODE
 StateManager::TableStorage::TableStorage(Span<TypeInfo> types,
                                          CountT num_worlds,
-                                         CountT max_num_per_world)
+                                         CountT max_num_per_world,
+                                         bool virtual_columns)
 {
     maxNumPerWorld = max_num_per_world;
 
@@ -219,7 +638,7 @@ StateManager::TableStorage::TableStorage(Span<TypeInfo> types,
         new (&tbls) HeapArray<Table>(num_worlds);
 
         for (CountT i = 0; i < num_worlds; i++) {
-            tbls.emplace(i, types.data(), types.size(), 0);
+            tbls.emplace(i, types.data(), types.size(), 0, virtual_columns);
         }
     } else {
         new (&fixed) Fixed {
@@ -244,8 +663,9 @@ StateManager::TableStorage::~TableStorage()
 }
 
 #else
-StateManager::TableStorage::TableStorage(Span<TypeInfo> types)
-    : tbl(types.data(), types.size(), 0)
+StateManager::TableStorage::TableStorage(Span<TypeInfo> types,
+                                         bool virtual_columns)
+    : tbl(types.data(), types.size(), 0, virtual_columns)
 {}
 #endif
 
@@ -256,6 +676,7 @@ struct StateManager::ArchetypeStore::Init {
     Span<TypeInfo> types;
     Span<IntegerMapPair> lookupInputs;
     CountT maxNumEntitiesPerWorld;
+    bool virtualColumns;
 #ifdef MADRONA_MW_MODE
     CountT numWorlds;
 #endif
@@ -264,8 +685,9 @@ struct StateManager::ArchetypeStore::Init {
 StateManager::ArchetypeStore::ArchetypeStore(Init &&init)
     : componentOffset(init.componentOffset),
       numComponents(init.numComponents),
-      tblStorage(init.types
-          MADRONA_MW_COND(, init.numWorlds, init.maxNumEntitiesPerWorld)),
+      tblStorage(init.types,
+          MADRONA_MW_COND(init.numWorlds, init.maxNumEntitiesPerWorld,)
+          init.virtualColumns),
       columnLookup(init.lookupInputs.data(), init.lookupInputs.size())
 {}
 
@@ -393,8 +815,6 @@ void StateManager::registerArchetype(uint32_t id,
                                      const ComponentID *components,
                                      const ComponentFlags *component_flags)
 {
-    (void)archetype_flags, (void)component_flags;
-
     std::array<TypeInfo, max_archetype_components_> type_infos;
     std::array<IntegerMapPair, max_archetype_components_> lookup_input;
 
@@ -411,6 +831,9 @@ void StateManager::registerArchetype(uint32_t id,
 
     CountT user_component_start = archetype_components_.size();
 
+    // Flags of bundle components apply to every component in the bundle
+    std::array<ComponentFlags, max_archetype_components_> flattened_flags;
+
     for (CountT i = 0; i < (CountT)num_user_components; i++) {
         uint32_t component_id = components[i].id;
         assert(component_id != TypeTracker::unassignedTypeID);
@@ -423,10 +846,16 @@ void StateManager::registerArchetype(uint32_t id,
                 uint32_t bundle_component_id =
                     bundle_components_[bundle_info.componentOffset + j];
 
+                flattened_flags[archetype_components_.size() -
+                    user_component_start] = component_flags[i];
+
                 archetype_components_.push_back(
                     ComponentID { bundle_component_id });
             }
         } else {
+            flattened_flags[archetype_components_.size() -
+                user_component_start] = component_flags[i];
+
             archetype_components_.push_back(ComponentID {component_id});
         }
     }
@@ -464,8 +893,47 @@ void StateManager::registerArchetype(uint32_t id,
         Span(type_infos.data(), num_total_components),
         Span(lookup_input.data(), num_total_user_components),
         max_num_entities_per_world,
+        (archetype_flags & ArchetypeFlags::VirtualColumns) ==
+            ArchetypeFlags::VirtualColumns,
         MADRONA_MW_COND(num_worlds_,)
     });
+
+    TableStorage &tbl_storage = archetype_stores_[id]->tblStorage;
+    for (CountT i = 0; i < num_total_user_components; i++) {
+        if ((flattened_flags[i] & ComponentFlags::TrackChanges) !=
+                ComponentFlags::TrackChanges) {
+            continue;
+        }
+
+        uint32_t col_idx = uint32_t(i + user_component_offset_);
+#ifdef MADRONA_MW_MODE
+        if (max_num_entities_per_world != 0) {
+            break;
+        }
+
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            tbl_storage.tbls[world_idx].trackChanges(
+                col_idx, &change_versions_[world_idx]);
+        }
+#else
+        tbl_storage.tbl.trackChanges(col_idx, &change_version_);
+#endif
+    }
+
+#ifdef MADRONA_MW_MODE
+    if (max_num_entities_per_world == 0 && num_export_rows_per_world_ > 0) {
+        for (CountT i = 0; i < num_total_user_components; i++) {
+            if ((flattened_flags[i] & ComponentFlags::ExportMemory) !=
+                    ComponentFlags::ExportMemory) {
+                continue;
+            }
+
+            makeZeroCopyExport(id, uint32_t(i + user_component_offset_),
+                               type_ptr[i].numBytes);
+        }
+    }
+#endif
 }
 
 void StateManager::registerBundle(uint32_t id,
@@ -509,6 +977,40 @@ void StateManager::registerBundle(uint32_t id,
     };
 }
 
+#ifdef MADRONA_MW_MODE
+static HeapArray<uint32_t> makeExportRowOffsets(uint32_t num_worlds)
+{
+    HeapArray<uint32_t> offsets(num_worlds + 1);
+    for (CountT i = 0; i <= (CountT)num_worlds; i++) {
+        offsets[i] = 0;
+    }
+
+    return offsets;
+}
+
+static void commitExportRows(VirtualRegion &export_mem,
+                             uint32_t &num_mapped_chunks,
+                             uint64_t num_needed_bytes)
+{
+    uint64_t num_mapped_bytes =
+         (uint64_t)num_mapped_chunks * export_mem.chunkSize();
+
+    if (num_needed_bytes <= num_mapped_bytes) {
+        return;
+    }
+
+    uint64_t new_num_mapped_bytes =
+        std::max(num_mapped_bytes * 2, num_needed_bytes);
+
+    uint64_t new_num_chunks = utils::divideRoundUp(
+        new_num_mapped_bytes, export_mem.chunkSize());
+
+    export_mem.commitChunks(num_mapped_chunks,
+        new_num_chunks - num_mapped_chunks);
+    num_mapped_chunks = new_num_chunks;
+}
+#endif
+
 void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
 {
     auto &archetype = *archetype_stores_[archetype_id];
@@ -528,6 +1030,13 @@ void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
 
 #ifdef MADRONA_MW_MODE
     if (archetype.tblStorage.maxNumPerWorld == 0) {
+        for (const ExportJob &export_job : export_jobs_) {
+            if (export_job.numRowsPerWorld > 0 &&
+                    export_job.archetypeIdx == archetype_id &&
+                    export_job.columnIdx == col_idx) {
+                return export_job.mem.ptr();
+            }
+        }
 
         uint32_t num_bytes_per_row = component_infos_[component_id]->numBytes;
         uint64_t map_size = 1'000'000'000 * num_bytes_per_row;
@@ -540,7 +1049,11 @@ void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
             .columnIdx = col_idx,
             .numBytesPerRow = num_bytes_per_row,
             .numMappedChunks = 0,
+            .numBackMappedChunks = 0,
+            .numRowsPerWorld = 0,
             .mem = std::move(mem),
+            .backMem = Optional<VirtualRegion>::none(),
+            .worldRowOffsets = makeExportRowOffsets(num_worlds_),
         });
 
         return export_buffer;
@@ -552,76 +1065,420 @@ void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
 #endif
 }
 
-void StateManager::copyInExportedColumns()
+#ifdef MADRONA_MW_MODE
+void StateManager::makeZeroCopyExport(uint32_t archetype_id, uint32_t col_idx,
+                                      uint32_t num_bytes_per_row)
+{
+    auto &archetype = *archetype_stores_[archetype_id];
+
+    uint64_t num_bytes_per_world =
+        (uint64_t)num_export_rows_per_world_ * (uint64_t)num_bytes_per_row;
+    uint64_t map_size = num_bytes_per_world * (uint64_t)num_worlds_;
+
+    VirtualRegion mem(map_size, 0, 1);
+    uint32_t num_chunks = (uint32_t)utils::divideRoundUp(
+        map_size, (uint64_t)mem.chunkSize());
+    mem.commitChunks(0, num_chunks);
+
+    for (CountT i = 0; i < (CountT)num_worlds_; i++) {
+        archetype.tblStorage.tbls[i].setExternalColumn(col_idx,
+            (char *)mem.ptr() + i * num_bytes_per_world,
+            num_export_rows_per_world_);
+    }
+
+    export_jobs_.push_back(ExportJob {
+        .archetypeIdx = archetype_id,
+        .columnIdx = col_idx,
+        .numBytesPerRow = num_bytes_per_row,
+        .numMappedChunks = num_chunks,
+        .numBackMappedChunks = 0,
+        .numRowsPerWorld = num_export_rows_per_world_,
+        .mem = std::move(mem),
+        .backMem = Optional<VirtualRegion>::none(),
+        .worldRowOffsets = makeExportRowOffsets(num_worlds_),
+    });
+}
+
+char * StateManager::zeroCopySlice(ExportJob &export_job,
+                                   uint32_t world_id) const
+{
+    VirtualRegion &mem =
+        zero_copy_buffer_idx_ == 0 ? export_job.mem : *export_job.backMem;
+
+    return (char *)mem.ptr() +
+        (uint64_t)world_id * (uint64_t)export_job.numRowsPerWorld *
+        (uint64_t)export_job.numBytesPerRow;
+}
+
+void StateManager::importOverflowedColumns(uint32_t world_id)
+{
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld == 0) {
+            continue;
+        }
+
+        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
+        Table &tbl = archetype.tblStorage.tbls[world_id];
+
+        if (tbl.isExternalColumn(export_job.columnIdx)) {
+            continue;
+        }
+
+        CountT num_rows = tbl.numRows();
+        char *slice = zeroCopySlice(export_job, world_id);
+
+        memcpy(tbl.data(export_job.columnIdx), slice,
+               (uint64_t)export_job.numBytesPerRow *
+               (uint64_t)std::min(num_rows,
+                                  (CountT)export_job.numRowsPerWorld));
+
+        if (num_rows <= (CountT)export_job.numRowsPerWorld) {
+            tbl.setExternalColumn(export_job.columnIdx, slice,
+                                  export_job.numRowsPerWorld);
+        }
+    }
+}
+
+void StateManager::exportOverflowedColumns(uint32_t world_id)
+{
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld == 0) {
+            continue;
+        }
+
+        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
+        Table &tbl = archetype.tblStorage.tbls[world_id];
+
+        if (tbl.isExternalColumn(export_job.columnIdx)) {
+            continue;
+        }
+
+        // Rows past the end of the slice have nowhere to go and are
+        // dropped from the export
+        CountT num_rows = tbl.numRows();
+        char *slice = zeroCopySlice(export_job, world_id);
+
+        memcpy(slice, tbl.data(export_job.columnIdx),
+               (uint64_t)export_job.numBytesPerRow *
+               (uint64_t)std::min(num_rows,
+                                  (CountT)export_job.numRowsPerWorld));
+    }
+}
+#endif
+
+void StateManager::copyInExportedColumns(CountT buffer_idx)
 {
 #ifdef MADRONA_MW_MODE
     for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld > 0) {
+            continue;
+        }
+
         auto &archetype = *archetype_stores_[export_job.archetypeIdx];
 
+        char *export_base = buffer_idx == 0 ?
+            (char *)export_job.mem.ptr() :
+            (char *)export_job.backMem->ptr();
+
         CountT cumulative_copied_rows = 0;
-        for (Table &tbl : archetype.tblStorage.tbls) {
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
             CountT num_rows = tbl.numRows();
 
+            CountT tbl_start = cumulative_copied_rows;
+            export_job.worldRowOffsets[world_idx] = uint32_t(tbl_start);
+
             if (num_rows == 0) {
                 continue;
             }
 
-            CountT tbl_start = cumulative_copied_rows;
-
             cumulative_copied_rows += num_rows;
 
             memcpy(tbl.data(export_job.columnIdx),
-                   (char *)export_job.mem.ptr() +
-                       tbl_start * export_job.numBytesPerRow,
+                   export_base + tbl_start * export_job.numBytesPerRow,
                    export_job.numBytesPerRow * num_rows);
         }
+
+        export_job.worldRowOffsets[num_worlds_] =
+            uint32_t(cumulative_copied_rows);
     }
+#else
+    (void)buffer_idx;
 #endif
 }
 
-void StateManager::copyOutExportedColumns()
+void StateManager::copyOutExportedColumns(CountT buffer_idx)
 {
 #ifdef MADRONA_MW_MODE
     for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld > 0) {
+            continue;
+        }
+
         auto &archetype = *archetype_stores_[export_job.archetypeIdx];
 
+        VirtualRegion &export_mem =
+            buffer_idx == 0 ? export_job.mem : *export_job.backMem;
+        uint32_t &num_mapped_chunks = buffer_idx == 0 ?
+            export_job.numMappedChunks : export_job.numBackMappedChunks;
+
         CountT cumulative_copied_rows = 0;
-        for (Table &tbl : archetype.tblStorage.tbls) {
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
             CountT num_rows = tbl.numRows();
 
-            if (num_rows == 0) {
+            CountT tbl_start = cumulative_copied_rows;
+            export_job.worldRowOffsets[world_idx] = uint32_t(tbl_start);
+
+            if (num_rows == 0) {
                 continue;
             }
 
-            CountT tbl_start = cumulative_copied_rows;
             cumulative_copied_rows += num_rows;
 
-            uint64_t num_mapped_chunks = export_job.numMappedChunks;
-            uint64_t num_mapped_bytes =
-                 num_mapped_chunks * export_job.mem.chunkSize();
+            commitExportRows(export_mem, num_mapped_chunks,
+                (uint64_t)cumulative_copied_rows *
+                (uint64_t)export_job.numBytesPerRow);
 
-            uint64_t num_needed_bytes = (uint64_t)cumulative_copied_rows *
-                (uint64_t)export_job.numBytesPerRow;
+            memcpy((char *)export_mem.ptr() +
+                       tbl_start * export_job.numBytesPerRow,
+                   tbl.data(export_job.columnIdx),
+                   export_job.numBytesPerRow * num_rows);
+        }
+
+        export_job.worldRowOffsets[num_worlds_] =
+            uint32_t(cumulative_copied_rows);
+    }
+#else
+    (void)buffer_idx;
+#endif
+}
+
+void StateManager::copyInExportedColumns(CountT buffer_idx,
+                                         Span<const int32_t> world_ids)
+{
+#ifdef MADRONA_MW_MODE
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld > 0) {
+            continue;
+        }
+
+        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
 
-            if (num_needed_bytes > num_mapped_bytes) {
-                uint64_t new_num_mapped_bytes =
-                    std::max(num_mapped_bytes * 2, num_needed_bytes);
+        char *export_base = buffer_idx == 0 ?
+            (char *)export_job.mem.ptr() :
+            (char *)export_job.backMem->ptr();
 
-                uint64_t new_num_chunks = utils::divideRoundUp(
-                    new_num_mapped_bytes, export_job.mem.chunkSize());
+        // No world's rows changed since the last copy, so the stored
+        // offsets still describe the export buffer
+        for (int32_t world_idx : world_ids) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
+            CountT num_rows = tbl.numRows();
 
-                export_job.mem.commitChunks(num_mapped_chunks,
-                    new_num_chunks - num_mapped_chunks);
-                export_job.numMappedChunks = new_num_chunks;
+            if (num_rows == 0) {
+                continue;
             }
 
-            memcpy((char *)export_job.mem.ptr() +
+            uint64_t tbl_start = export_job.worldRowOffsets[world_idx];
+            assert(export_job.worldRowOffsets[world_idx + 1] -
+                   tbl_start == (uint64_t)num_rows);
+
+            memcpy(tbl.data(export_job.columnIdx),
+                   export_base + tbl_start * export_job.numBytesPerRow,
+                   export_job.numBytesPerRow * num_rows);
+        }
+    }
+#else
+    (void)buffer_idx;
+    (void)world_ids;
+#endif
+}
+
+void StateManager::copyOutExportedColumns(CountT buffer_idx,
+                                          Span<const int32_t> world_ids)
+{
+#ifdef MADRONA_MW_MODE
+    // Copy the selected worlds along with any world whose rows were
+    // moved by a selected world before it growing or shrinking
+    DynArray<bool> selected(num_worlds_);
+    selected.resize(num_worlds_, [](bool *v) { *v = false; });
+    for (int32_t world_idx : world_ids) {
+        selected[world_idx] = true;
+    }
+
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld > 0) {
+            continue;
+        }
+
+        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
+
+        VirtualRegion &export_mem =
+            buffer_idx == 0 ? export_job.mem : *export_job.backMem;
+        uint32_t &num_mapped_chunks = buffer_idx == 0 ?
+            export_job.numMappedChunks : export_job.numBackMappedChunks;
+
+        // Worlds that didn't run but are about to move may have inputs
+        // waiting in the export buffer, which would be overwritten by
+        // the rows moving in. Read them into their tables first, so they
+        // move along with the rows.
+        CountT cumulative_rows = 0;
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
+            CountT num_rows = tbl.numRows();
+
+            CountT tbl_start = cumulative_rows;
+            cumulative_rows += num_rows;
+
+            uint32_t prev_start = export_job.worldRowOffsets[world_idx];
+            if (selected[world_idx] || num_rows == 0 ||
+                    prev_start == uint32_t(tbl_start)) {
+                continue;
+            }
+
+            assert(export_job.worldRowOffsets[world_idx + 1] -
+                   prev_start == uint32_t(num_rows));
+
+            memcpy(tbl.data(export_job.columnIdx),
+                   (char *)export_mem.ptr() +
+                       (uint64_t)prev_start * export_job.numBytesPerRow,
+                   export_job.numBytesPerRow * num_rows);
+        }
+
+        CountT cumulative_copied_rows = 0;
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
+            CountT num_rows = tbl.numRows();
+
+            CountT tbl_start = cumulative_copied_rows;
+            cumulative_copied_rows += num_rows;
+
+            uint32_t prev_start = export_job.worldRowOffsets[world_idx];
+            bool moved = prev_start != uint32_t(tbl_start) ||
+                export_job.worldRowOffsets[world_idx + 1] - prev_start !=
+                    uint32_t(num_rows);
+            export_job.worldRowOffsets[world_idx] = uint32_t(tbl_start);
+
+            if (num_rows == 0 || (!moved && !selected[world_idx])) {
+                continue;
+            }
+
+            commitExportRows(export_mem, num_mapped_chunks,
+                (uint64_t)cumulative_copied_rows *
+                (uint64_t)export_job.numBytesPerRow);
+
+            memcpy((char *)export_mem.ptr() +
                        tbl_start * export_job.numBytesPerRow,
                    tbl.data(export_job.columnIdx),
                    export_job.numBytesPerRow * num_rows);
         }
+
+        export_job.worldRowOffsets[num_worlds_] =
+            uint32_t(cumulative_copied_rows);
+    }
+#else
+    (void)buffer_idx;
+    (void)world_ids;
+#endif
+}
+
+void StateManager::enableExportDoubleBuffering()
+{
+#ifdef MADRONA_MW_MODE
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.backMem.has_value()) {
+            continue;
+        }
+
+        if (export_job.numRowsPerWorld == 0) {
+            uint64_t map_size = 1'000'000'000 * export_job.numBytesPerRow;
+            export_job.backMem.emplace(map_size, 0, 1);
+            export_job.numBackMappedChunks = 0;
+            continue;
+        }
+
+        // Zero-copy columns start out the same in both buffers
+        uint64_t num_bytes = (uint64_t)num_worlds_ *
+            (uint64_t)export_job.numRowsPerWorld *
+            (uint64_t)export_job.numBytesPerRow;
+
+        export_job.backMem.emplace(num_bytes, 0, 1);
+        export_job.backMem->commitChunks(0, export_job.numMappedChunks);
+        export_job.numBackMappedChunks = export_job.numMappedChunks;
+
+        memcpy(export_job.backMem->ptr(), export_job.mem.ptr(), num_bytes);
+    }
+#endif
+}
+
+void StateManager::moveZeroCopyColumns(CountT buffer_idx)
+{
+#ifdef MADRONA_MW_MODE
+    if (buffer_idx == zero_copy_buffer_idx_) {
+        return;
+    }
+
+    for (ExportJob &export_job : export_jobs_) {
+        if (export_job.numRowsPerWorld == 0) {
+            continue;
+        }
+
+        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
+
+        char *dst_base = buffer_idx == 0 ?
+            (char *)export_job.mem.ptr() :
+            (char *)export_job.backMem->ptr();
+        uint64_t num_slice_bytes = (uint64_t)export_job.numRowsPerWorld *
+            (uint64_t)export_job.numBytesPerRow;
+
+        for (CountT world_idx = 0; world_idx < (CountT)num_worlds_;
+             world_idx++) {
+            Table &tbl = archetype.tblStorage.tbls[world_idx];
+            char *src = zeroCopySlice(export_job, uint32_t(world_idx));
+            char *dst = dst_base + world_idx * num_slice_bytes;
+
+            // Overflowed tables sync their slice themselves, but it may
+            // hold inputs written since the last step
+            CountT num_rows = std::min((CountT)tbl.numRows(),
+                                       (CountT)export_job.numRowsPerWorld);
+            memcpy(dst, src, (uint64_t)export_job.numBytesPerRow *
+                   (uint64_t)num_rows);
+
+            if (tbl.isExternalColumn(export_job.columnIdx)) {
+                tbl.setExternalColumn(export_job.columnIdx, dst,
+                                      export_job.numRowsPerWorld);
+            }
+        }
+    }
+
+    zero_copy_buffer_idx_ = buffer_idx;
+#else
+    (void)buffer_idx;
+#endif
+}
+
+void * StateManager::exportBuffer(void *export_ptr, CountT buffer_idx) const
+{
+#ifdef MADRONA_MW_MODE
+    if (buffer_idx == 0) {
+        return export_ptr;
+    }
+
+    for (const ExportJob &export_job : export_jobs_) {
+        if (export_job.mem.ptr() == export_ptr) {
+            assert(export_job.backMem.has_value());
+            return export_job.backMem->ptr();
+        }
     }
+#else
+    (void)buffer_idx;
 #endif
+
+    return export_ptr;
 }
 
 void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,)
@@ -636,12 +1493,615 @@ void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,)
             MADRONA_MW_COND(world_id,) 0);
         uint32_t num_entities = archetype.tblStorage.numRows(
             MADRONA_MW_COND(world_id));
-        entity_store_.bulkFree(cache.entity_cache_, entities, num_entities);
+        entityStore(MADRONA_MW_COND(world_id)).bulkFree(
+            entityCache(MADRONA_MW_COND(world_id,) cache),
+            entities, num_entities);
     }
 
     archetype.tblStorage.clear(MADRONA_MW_COND(world_id));
 }
 
+void StateManager::sortArchetype(MADRONA_MW_COND(uint32_t world_id,)
+                                 uint32_t archetype_id,
+                                 uint32_t component_id)
+{
+    ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+    TableStorage &tbl = archetype.tblStorage;
+
+    const CountT num_rows = tbl.numRows(MADRONA_MW_COND(world_id));
+    const uint32_t key_col_idx =
+        *archetype.columnLookup.lookup(component_id);
+    const uint32_t *keys_col =
+        tbl.column<uint32_t>(MADRONA_MW_COND(world_id,) key_col_idx);
+
+    // Tables are usually sorted every step, so most calls find them
+    // still in order
+    CountT first_unsorted = 1;
+    while (first_unsorted < num_rows &&
+           keys_col[first_unsorted - 1] <= keys_col[first_unsorted]) {
+        first_unsorted++;
+    }
+
+    if (first_unsorted >= num_rows) {
+        return;
+    }
+
+    const CountT num_columns =
+        user_component_offset_ + archetype.numComponents;
+
+    uint64_t max_column_bytes = 0;
+    for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+        max_column_bytes = std::max(max_column_bytes,
+                                    columnNumBytes(archetype, col_idx));
+    }
+
+    // Two key and row index buffers to ping pong between, followed by
+    // room to gather one column
+    uint64_t num_key_bytes = sizeof(uint32_t) * (uint64_t)num_rows;
+    uint64_t num_scratch_bytes =
+        4 * num_key_bytes + max_column_bytes * (uint64_t)num_rows;
+
+    bool use_tmp_alloc = utils::roundUpPow2(num_scratch_bytes, 256) <=
+        tmpAllocStats(MADRONA_MW_COND(world_id)).blockBytes;
+    char *scratch = use_tmp_alloc ?
+        (char *)tmpAlloc(MADRONA_MW_COND(world_id,) num_scratch_bytes) :
+        (char *)rawAlloc(num_scratch_bytes);
+
+    uint32_t *keys = (uint32_t *)scratch;
+    uint32_t *alt_keys = keys + num_rows;
+    uint32_t *rows = alt_keys + num_rows;
+    uint32_t *alt_rows = rows + num_rows;
+    char *column_scratch = (char *)(alt_rows + num_rows);
+
+    // LSD radix sort with 8 bit digits. All 4 histograms are built in one
+    // pass, and passes where every key has the same digit are skipped.
+    constexpr CountT num_passes = 4;
+    constexpr uint32_t num_buckets = 256;
+    std::array<std::array<uint32_t, num_buckets>, num_passes> histograms {};
+
+    for (CountT i = 0; i < num_rows; i++) {
+        uint32_t key = keys_col[i];
+        keys[i] = key;
+        rows[i] = uint32_t(i);
+
+        for (CountT pass = 0; pass < num_passes; pass++) {
+            histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    for (CountT pass = 0; pass < num_passes; pass++) {
+        const uint32_t shift = uint32_t(pass * 8);
+        std::array<uint32_t, num_buckets> &histogram = histograms[pass];
+
+        if (histogram[(keys[0] >> shift) & 0xFF] == (uint32_t)num_rows) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < num_buckets; bucket++) {
+            uint32_t count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += count;
+        }
+
+        for (CountT i = 0; i < num_rows; i++) {
+            uint32_t key = keys[i];
+            uint32_t dst = histogram[(key >> shift) & 0xFF]++;
+            alt_keys[dst] = key;
+            alt_rows[dst] = rows[i];
+        }
+
+        std::swap(keys, alt_keys);
+        std::swap(rows, alt_rows);
+    }
+
+    // rows[i] is now the current row of the entity that belongs at row i.
+    // Gather every column into scratch and copy it back in place.
+    for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+#ifdef MADRONA_MW_MODE
+        // Every row of a world's table holds the same WorldID
+        if (col_idx == 1) {
+            continue;
+        }
+#endif
+
+        uint64_t num_bytes = columnNumBytes(archetype, col_idx);
+        char *col = tbl.column<char>(MADRONA_MW_COND(world_id,) col_idx);
+
+        for (CountT i = 0; i < num_rows; i++) {
+            memcpy(column_scratch + i * num_bytes,
+                   col + (uint64_t)rows[i] * num_bytes, num_bytes);
+        }
+
+        memcpy(col, column_scratch, num_bytes * (uint64_t)num_rows);
+    }
+
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+    Entity *entities = tbl.column<Entity>(MADRONA_MW_COND(world_id,) 0);
+    for (CountT i = 0; i < num_rows; i++) {
+        Entity e = entities[i];
+        if (e.id == Entity::none().id) {
+            continue;
+        }
+
+        entity_store.setRow(e, uint32_t(i));
+    }
+
+    Table *change_tbl = tbl.changeTable(MADRONA_MW_COND(world_id));
+    if (change_tbl != nullptr && change_tbl->hasTrackedColumns()) {
+        for (CountT col_idx = user_component_offset_; col_idx < num_columns;
+             col_idx++) {
+            change_tbl->markChanged(uint32_t(col_idx), 0, uint32_t(num_rows));
+        }
+    }
+
+    if (!use_tmp_alloc) {
+        rawDealloc(scratch);
+    }
+}
+
+
+uint64_t StateManager::columnNumBytes(const ArchetypeStore &archetype,
+                                      CountT col_idx) const
+{
+    uint32_t type_id;
+    if (col_idx == 0) {
+        type_id = 0;
+    }
+#ifdef MADRONA_MW_MODE
+    else if (col_idx == 1) {
+        type_id = componentID<WorldID>().id;
+    }
+#endif
+    else {
+        type_id = archetype_components_[archetype.componentOffset +
+            col_idx - user_component_offset_].id;
+    }
+
+    return (uint64_t)component_infos_[type_id]->numBytes;
+}
+
+// Snapshot layout: SnapshotHeader, the world's entity ID map, then for
+// every registered archetype without a snapshot hook a SnapshotTable
+// followed by each column's rows, then for every snapshot hook its size
+// and data. Every section is padded to snapshot_align.
+namespace {
+
+struct SnapshotHeader {
+    uint64_t numBytes;
+    uint32_t numTables;
+    uint32_t numHooks;
+};
+
+struct SnapshotTable {
+    uint32_t archetypeID;
+    uint32_t numRows;
+};
+
+constexpr uint64_t snapshot_align = 16;
+
+inline uint64_t snapshotPad(uint64_t num_bytes)
+{
+    return utils::roundUpPow2(num_bytes, snapshot_align);
+}
+
+}
+
+void StateManager::registerSingletonSnapshot(SnapshotHook hook)
+{
+    snapshot_hooks_.push_back(hook);
+}
+
+bool StateManager::hasSnapshotHook(uint32_t archetype_id) const
+{
+    for (const SnapshotHook &hook : snapshot_hooks_) {
+        if (hook.archetypeID == archetype_id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t StateManager::worldSnapshotBytes(MADRONA_MW_COND(uint32_t world_id))
+{
+    uint64_t num_bytes = snapshotPad(sizeof(SnapshotHeader)) +
+        snapshotPad(entityStore(MADRONA_MW_COND(world_id)).snapshotBytes());
+
+    for (CountT archetype_idx = 0; archetype_idx < archetype_stores_.size();
+         archetype_idx++) {
+        if (!archetype_stores_[archetype_idx].has_value() ||
+                hasSnapshotHook(uint32_t(archetype_idx))) {
+            continue;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[archetype_idx];
+        uint64_t num_rows = (uint64_t)
+            archetype.tblStorage.numRows(MADRONA_MW_COND(world_id));
+        const CountT num_columns =
+            user_component_offset_ + archetype.numComponents;
+
+        num_bytes += snapshotPad(sizeof(SnapshotTable));
+        for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+            num_bytes += snapshotPad(
+                num_rows * columnNumBytes(archetype, col_idx));
+        }
+    }
+
+    for (const SnapshotHook &hook : snapshot_hooks_) {
+        num_bytes += snapshotPad(sizeof(uint64_t)) + snapshotPad(
+            hook.numBytes(singletonData(MADRONA_MW_COND(world_id,)
+                                        hook.archetypeID)));
+    }
+
+    return num_bytes;
+}
+
+void StateManager::saveWorldSnapshot(MADRONA_MW_COND(uint32_t world_id,)
+                                     const StateCache &cache,
+                                     void *dst)
+{
+    char *cur = (char *)dst + snapshotPad(sizeof(SnapshotHeader));
+    uint32_t num_tables = 0;
+
+    const EntityStore &entity_store =
+        entityStore(MADRONA_MW_COND(world_id));
+    entity_store.saveSnapshot(
+        entityCache(MADRONA_MW_COND(world_id,) cache), cur);
+    cur += snapshotPad(entity_store.snapshotBytes());
+
+    for (CountT archetype_idx = 0; archetype_idx < archetype_stores_.size();
+         archetype_idx++) {
+        if (!archetype_stores_[archetype_idx].has_value() ||
+                hasSnapshotHook(uint32_t(archetype_idx))) {
+            continue;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[archetype_idx];
+        TableStorage &tbl = archetype.tblStorage;
+
+        uint32_t num_rows = (uint32_t)tbl.numRows(MADRONA_MW_COND(world_id));
+        const CountT num_columns =
+            user_component_offset_ + archetype.numComponents;
+
+        *(SnapshotTable *)cur = SnapshotTable {
+            .archetypeID = uint32_t(archetype_idx),
+            .numRows = num_rows,
+        };
+        cur += snapshotPad(sizeof(SnapshotTable));
+        num_tables++;
+
+        for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+            uint64_t num_bytes =
+                (uint64_t)num_rows * columnNumBytes(archetype, col_idx);
+
+            memcpy(cur, tbl.column<char>(MADRONA_MW_COND(world_id,) col_idx),
+                   num_bytes);
+            cur += snapshotPad(num_bytes);
+        }
+    }
+
+    for (const SnapshotHook &hook : snapshot_hooks_) {
+        void *singleton =
+            singletonData(MADRONA_MW_COND(world_id,) hook.archetypeID);
+        uint64_t num_bytes = hook.numBytes(singleton);
+
+        *(uint64_t *)cur = num_bytes;
+        cur += snapshotPad(sizeof(uint64_t));
+
+        hook.save(singleton, cur);
+        cur += snapshotPad(num_bytes);
+    }
+
+    *(SnapshotHeader *)dst = SnapshotHeader {
+        .numBytes = uint64_t(cur - (char *)dst),
+        .numTables = num_tables,
+        .numHooks = uint32_t(snapshot_hooks_.size()),
+    };
+}
+
+void StateManager::restoreWorldSnapshot(MADRONA_MW_COND(uint32_t world_id,)
+                                        StateCache &cache,
+                                        const void *src)
+{
+    const SnapshotHeader &header = *(const SnapshotHeader *)src;
+    const char *cur = (const char *)src + snapshotPad(sizeof(SnapshotHeader));
+
+    assert(header.numHooks == (uint32_t)snapshot_hooks_.size());
+
+    // The ID map comes back as it was, so the restored rows' entities
+    // point at the rows they are restored to
+    EntityStore &entity_store = entityStore(MADRONA_MW_COND(world_id));
+    entity_store.loadSnapshot(
+        entityCache(MADRONA_MW_COND(world_id,) cache), cur);
+    cur += snapshotPad(entity_store.snapshotBytes());
+
+    for (uint32_t i = 0; i < header.numTables; i++) {
+        SnapshotTable snapshot_tbl = *(const SnapshotTable *)cur;
+        cur += snapshotPad(sizeof(SnapshotTable));
+
+        ArchetypeStore &archetype =
+            *archetype_stores_[snapshot_tbl.archetypeID];
+        TableStorage &tbl = archetype.tblStorage;
+        const CountT num_columns =
+            user_component_offset_ + archetype.numComponents;
+
+        tbl.clear(MADRONA_MW_COND(world_id));
+        if (snapshot_tbl.numRows > 0) {
+            tbl.addRows(MADRONA_MW_COND(world_id,) snapshot_tbl.numRows);
+        }
+
+        for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+            uint64_t num_bytes = (uint64_t)snapshot_tbl.numRows *
+                columnNumBytes(archetype, col_idx);
+
+            memcpy(tbl.column<char>(MADRONA_MW_COND(world_id,) col_idx), cur,
+                   num_bytes);
+            cur += snapshotPad(num_bytes);
+        }
+    }
+
+    for (const SnapshotHook &hook : snapshot_hooks_) {
+        uint64_t num_bytes = *(const uint64_t *)cur;
+        cur += snapshotPad(sizeof(uint64_t));
+
+        hook.load(singletonData(MADRONA_MW_COND(world_id,) hook.archetypeID),
+                  cur);
+        cur += snapshotPad(num_bytes);
+    }
+
+    assert(uint64_t(cur - (const char *)src) == header.numBytes);
+}
+
+#ifdef MADRONA_MW_MODE
+void StateManager::forkWorld(uint32_t src_world,
+                             Span<const int32_t> dst_worlds)
+{
+    // Singleton hooks only know how to save to and load from a blob, so
+    // stage the source's copies once for all the destinations
+    uint64_t hook_bytes = 0;
+    for (const SnapshotHook &hook : snapshot_hooks_) {
+        hook_bytes += snapshotPad(
+            hook.numBytes(singletonData(src_world, hook.archetypeID)));
+    }
+
+    char *hook_data = (char *)rawAlloc(std::max(hook_bytes, uint64_t(1)));
+    {
+        char *cur = hook_data;
+        for (const SnapshotHook &hook : snapshot_hooks_) {
+            void *singleton = singletonData(src_world, hook.archetypeID);
+            hook.save(singleton, cur);
+            cur += snapshotPad(hook.numBytes(singleton));
+        }
+    }
+
+    for (CountT i = 0; i < dst_worlds.size(); i++) {
+        uint32_t dst_world = uint32_t(dst_worlds[i]);
+        assert(dst_world != src_world);
+
+        // The destination's old entities simply go away with its ID space
+        entity_stores_[dst_world].copyFrom(entity_stores_[src_world],
+            entity_caches_[dst_world], entity_caches_[src_world]);
+
+        for (CountT archetype_idx = 0;
+             archetype_idx < archetype_stores_.size(); archetype_idx++) {
+            // Hooked singletons keep their row, which points at the
+            // destination's own memory, and are copied by the hook below
+            if (!archetype_stores_[archetype_idx].has_value() ||
+                    hasSnapshotHook(uint32_t(archetype_idx))) {
+                continue;
+            }
+
+            ArchetypeStore &archetype = *archetype_stores_[archetype_idx];
+            TableStorage &tbl = archetype.tblStorage;
+            const CountT num_columns =
+                user_component_offset_ + archetype.numComponents;
+
+            tbl.clear(dst_world);
+
+            CountT num_rows = tbl.numRows(src_world);
+            if (num_rows == 0) {
+                continue;
+            }
+
+            tbl.addRows(dst_world, num_rows);
+
+            WorldID *world_ids = tbl.column<WorldID>(dst_world, 1);
+            for (CountT row = 0; row < num_rows; row++) {
+                world_ids[row] = WorldID { (int32_t)dst_world };
+            }
+
+            for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+                if (col_idx == 1) {
+                    continue;
+                }
+
+                memcpy(tbl.column<char>(dst_world, col_idx),
+                       tbl.column<char>(src_world, col_idx),
+                       (uint64_t)num_rows *
+                           columnNumBytes(archetype, col_idx));
+            }
+        }
+
+        const char *cur = hook_data;
+        for (const SnapshotHook &hook : snapshot_hooks_) {
+            void *singleton = singletonData(dst_world, hook.archetypeID);
+            hook.load(singleton, cur);
+            cur += snapshotPad(hook.numBytes(singleton));
+        }
+    }
+
+    rawDealloc(hook_data);
+}
+#endif
+
+MemoryReport StateManager::memoryReport()
+{
+    using Usage = MemoryReport::Usage;
+
+    auto addUsage = [](Usage &dst, Usage o) {
+        dst.committedBytes += o.committedBytes;
+        dst.reservedBytes += o.reservedBytes;
+    };
+
+#ifdef MADRONA_MW_MODE
+    const CountT num_worlds = num_worlds_;
+#else
+    const CountT num_worlds = 1;
+#endif
+
+    MemoryReport report {
+        .archetypes = DynArray<MemoryReport::Archetype>(0),
+        .columns = DynArray<MemoryReport::Column>(0),
+        .worldCommittedBytes = DynArray<uint64_t>(num_worlds),
+        .entityStore = {},
+        .tmpAllocators = {},
+        .exportBuffers = {},
+        .singletons = {},
+        .total = {},
+    };
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        report.worldCommittedBytes.push_back(0);
+    }
+
+    for (CountT archetype_idx = 0; archetype_idx < archetype_stores_.size();
+         archetype_idx++) {
+        if (!archetype_stores_[archetype_idx].has_value()) {
+            continue;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[archetype_idx];
+        TableStorage &tbl_storage = archetype.tblStorage;
+        const CountT num_columns =
+            user_component_offset_ + archetype.numComponents;
+
+        MemoryReport::Archetype archetype_report {
+            .archetypeID = uint32_t(archetype_idx),
+            .numRows = 0,
+            .usage = {},
+            .columnOffset = uint32_t(report.columns.size()),
+            .numColumns = uint32_t(num_columns),
+        };
+
+        for (CountT i = 0; i < num_worlds; i++) {
+            archetype_report.numRows += (uint64_t)tbl_storage.numRows(
+                MADRONA_MW_COND(uint32_t(i)));
+        }
+
+        for (CountT col_idx = 0; col_idx < num_columns; col_idx++) {
+            uint32_t component_id;
+            if (col_idx == 0) {
+                component_id = 0;
+            }
+#ifdef MADRONA_MW_MODE
+            else if (col_idx == 1) {
+                component_id = componentID<WorldID>().id;
+            }
+#endif
+            else {
+                component_id = archetype_components_[
+                    archetype.componentOffset + col_idx -
+                    user_component_offset_].id;
+            }
+
+            MemoryReport::Column column_report {
+                .componentID = component_id,
+                .numBytesPerRow =
+                    (uint32_t)columnNumBytes(archetype, col_idx),
+                .usage = {},
+            };
+
+            auto addTable = [&](const Table &tbl, CountT world_idx) {
+                Table::ColumnMemory mem = tbl.columnMemory(uint32_t(col_idx));
+                addUsage(column_report.usage, Usage {
+                    .committedBytes = mem.committedBytes,
+                    .reservedBytes = mem.reservedBytes,
+                });
+
+                if (world_idx != -1) {
+                    report.worldCommittedBytes[world_idx] +=
+                        mem.committedBytes;
+                    return;
+                }
+
+                for (CountT i = 0; i < num_worlds; i++) {
+                    report.worldCommittedBytes[i] +=
+                        mem.committedBytes / num_worlds;
+                }
+            };
+
+#ifdef MADRONA_MW_MODE
+            if (tbl_storage.maxNumPerWorld == 0) {
+                for (CountT i = 0; i < num_worlds; i++) {
+                    addTable(tbl_storage.tbls[i], i);
+                }
+            } else {
+                addTable(tbl_storage.fixed.tbl, -1);
+            }
+#else
+            addTable(tbl_storage.tbl, 0);
+#endif
+
+            addUsage(archetype_report.usage, column_report.usage);
+            report.columns.push_back(column_report);
+        }
+
+        addUsage(report.total, archetype_report.usage);
+        report.archetypes.push_back(archetype_report);
+    }
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        const EntityStore &entity_store =
+            entityStore(MADRONA_MW_COND(uint32_t(i)));
+        Usage entity_usage {
+            .committedBytes = entity_store.numCommittedBytes(),
+            .reservedBytes = entity_store.numReservedBytes(),
+        };
+        addUsage(report.entityStore, entity_usage);
+
+        uint64_t num_tmp_bytes =
+            tmpAllocStats(MADRONA_MW_COND(uint32_t(i))).heldBytes;
+        addUsage(report.tmpAllocators, Usage {
+            .committedBytes = num_tmp_bytes,
+            .reservedBytes = num_tmp_bytes,
+        });
+
+        report.worldCommittedBytes[i] +=
+            entity_usage.committedBytes + num_tmp_bytes;
+
+        for (const SnapshotHook &hook : snapshot_hooks_) {
+            uint64_t num_bytes = hook.memoryBytes(singletonData(
+                MADRONA_MW_COND(uint32_t(i),) hook.archetypeID));
+            addUsage(report.singletons, Usage {
+                .committedBytes = num_bytes,
+                .reservedBytes = num_bytes,
+            });
+
+            report.worldCommittedBytes[i] += num_bytes;
+        }
+    }
+
+#ifdef MADRONA_MW_MODE
+    for (const ExportJob &export_job : export_jobs_) {
+        uint64_t chunk_size = export_job.mem.chunkSize();
+        addUsage(report.exportBuffers, Usage {
+            .committedBytes = chunk_size * (uint64_t)(
+                export_job.numMappedChunks + export_job.numBackMappedChunks),
+            .reservedBytes = export_job.mem.numReservedBytes() +
+                (export_job.backMem.has_value() ?
+                    export_job.backMem->numReservedBytes() : 0),
+        });
+    }
+#endif
+
+    addUsage(report.total, report.entityStore);
+    addUsage(report.total, report.tmpAllocators);
+    addUsage(report.total, report.exportBuffers);
+    addUsage(report.total, report.singletons);
+
+    return report;
+}
 
 void * StateManager::tmpAlloc(MADRONA_MW_COND(uint32_t world_id,)
                               uint64_t num_bytes)
@@ -662,6 +2122,31 @@ void StateManager::resetTmpAlloc(MADRONA_MW_COND(uint32_t world_id))
 #endif
 }
 
+StateManager::TmpAllocStats StateManager::tmpAllocStats(
+    MADRONA_MW_COND(uint32_t world_id)) const
+{
+#ifdef MADRONA_MW_MODE
+    const TmpAllocator &tmp_alloc = tmp_allocators_[world_id];
+#else
+    const TmpAllocator &tmp_alloc = tmp_allocator_;
+#endif
+
+    return TmpAllocStats {
+        .blockBytes = tmp_alloc.block_bytes_,
+        .heldBytes = tmp_alloc.num_held_bytes_,
+        .highWaterBytes = tmp_alloc.highWaterBytes(),
+    };
+}
+
+#ifdef MADRONA_MW_MODE
+void StateManager::reallocTmpAlloc(uint32_t world_id)
+{
+    // Blocks are allocated on first use, so this is enough for the next
+    // ones to come from the calling thread
+    tmp_allocators_[world_id].release();
+}
+#endif
+
 StateManager::QueryState StateManager::query_state_ = StateManager::QueryState();
 
 uint32_t StateManager::next_component_id_ = 0;
@@ -5,6 +5,9 @@
 
 #include "worker_init.hpp"
 
+#include <algorithm>
+#include <functional>
+
 namespace madrona {
 
 TaskGraphBuilder::TaskGraphBuilder(uint32_t taskgraph_id,
@@ -14,17 +17,18 @@ TaskGraphBuilder::TaskGraphBuilder(uint32_t taskgraph_id,
 #ifdef MADRONA_MW_MODE
       world_id_(init.worldID),
 #endif
+      parallel_for_(init.parallelFor),
+      node_tracer_(init.nodeTracer),
       taskgraph_id_(taskgraph_id),
       staged_(0),
       node_datas_(0),
       all_dependencies_(0)
-{
-    (void)taskgraph_id_;
-}
+{}
 
 TaskGraphNodeID TaskGraphBuilder::registerNode(
     uint32_t data_idx,
     void (*fn)(NodeBase *, Context *, TaskGraph *),
+    const char *name,
     Span<const TaskGraphNodeID> dependencies,
     Optional<TaskGraphNodeID> parent_node)
 {
@@ -37,8 +41,12 @@ TaskGraphNodeID TaskGraphBuilder::registerNode(
     staged_.push_back(StagedNode {
         .node = {
             .fn = fn,
+            .name = name,
             .dataIDX = data_idx,
             .numChildren = 0,
+            .numDependencies = 0,
+            .dependentOffset = 0,
+            .numDependents = 0,
         },
         .parentID = parent_node.has_value() ? int32_t(parent_node->id) : -1,
         .dependencyOffset = uint32_t(dependency_offset),
@@ -54,57 +62,140 @@ TaskGraph TaskGraphBuilder::build()
 {
     assert(staged_[0].numDependencies == 0);
 
-    HeapArray<TaskGraph::Node> sorted_nodes(staged_.size());
-    HeapArray<bool> queued(staged_.size());
-    HeapArray<int32_t> num_children(staged_.size());
+    const CountT num_nodes = staged_.size();
+    const CountT num_edges = all_dependencies_.size();
 
-    int32_t sorted_idx = 0;
-    auto enqueueInSorted = [&](const TaskGraph::Node &node) {
-        new (&sorted_nodes[sorted_idx++]) TaskGraph::Node(node);
-    };
+    // Invert the per node dependency lists into per node dependent lists
+    // (CSR layout) so Kahn's algorithm can release each node's dependents
+    // when it is emitted: O(E + V log V) overall.
+    HeapArray<uint32_t> num_unsorted_deps(num_nodes);
+    HeapArray<uint32_t> num_children(num_nodes);
+    HeapArray<uint32_t> dependent_offsets(num_nodes + 1);
+    HeapArray<uint32_t> staged_dependents(num_edges);
 
-    enqueueInSorted(staged_[0].node);
+    for (CountT i = 0; i < num_nodes; i++) {
+        num_unsorted_deps[i] = staged_[i].numDependencies;
+        num_children[i] = 0;
+        dependent_offsets[i] = 0;
+    }
+    dependent_offsets[num_nodes] = 0;
 
-    queued[0] = true;
+    for (CountT i = 0; i < num_nodes; i++) {
+        int32_t parent_id = staged_[i].parentID;
+        if (parent_id != -1) {
+            num_children[parent_id] += 1;
+        }
+    }
 
-    CountT num_remaining_nodes = staged_.size() - 1;
+    for (CountT i = 0; i < num_edges; i++) {
+        dependent_offsets[all_dependencies_[i].id + 1] += 1;
+    }
 
-    for (CountT i = 1; i < staged_.size(); i++) {
-        queued[i] = false;
-        num_children[i] = 0;
+    for (CountT i = 0; i < num_nodes; i++) {
+        dependent_offsets[i + 1] += dependent_offsets[i];
     }
 
-    for (CountT i = 0; i < staged_.size(); i++) {
-        auto &staged = staged_[i];
+    {
+        HeapArray<uint32_t> fill_offsets(num_nodes);
+        memcpy(fill_offsets.data(), dependent_offsets.data(),
+               sizeof(uint32_t) * num_nodes);
 
-        int32_t parent_id = staged.parentID;
-        if (parent_id != -1) {
-            num_children[parent_id] += 1;
+        for (CountT i = 0; i < num_nodes; i++) {
+            const StagedNode &staged = staged_[i];
+
+            for (CountT j = 0; j < (CountT)staged.numDependencies; j++) {
+                uint32_t dep_idx =
+                    all_dependencies_[staged.dependencyOffset + j].id;
+                staged_dependents[fill_offsets[dep_idx]++] = uint32_t(i);
+            }
         }
     }
 
-    while (num_remaining_nodes > 0) {
-        CountT cur_node_idx;
-        for (cur_node_idx = 0; queued[cur_node_idx]; cur_node_idx++) {}
+    // Ready nodes are emitted lowest registration index first (min-heap),
+    // so the serial execution order is the order nodes were added
+    // whenever that order is valid, and otherwise only moves the nodes
+    // that have to wait for a later registered dependency.
+    HeapArray<uint32_t> sorted_order(num_nodes);
+    HeapArray<uint32_t> sorted_idxs(num_nodes);
+    HeapArray<uint32_t> ready(num_nodes);
+    CountT num_ready = 0;
+    CountT num_sorted = 0;
+
+    auto pushReady = [&](uint32_t node_idx) {
+        ready[num_ready++] = node_idx;
+        std::push_heap(ready.data(), ready.data() + num_ready,
+                       std::greater<uint32_t>());
+    };
 
-        StagedNode &cur_staged = staged_[cur_node_idx];
+    for (CountT i = 0; i < num_nodes; i++) {
+        if (num_unsorted_deps[i] == 0) {
+            pushReady(uint32_t(i));
+        }
+    }
 
-        bool dependencies_satisfied = true;
-        for (CountT dep_offset = 0;
-             dep_offset < (CountT)cur_staged.numDependencies;
-             dep_offset++) {
-            uint32_t dep_node_idx =
-                all_dependencies_[cur_staged.dependencyOffset + dep_offset].id;
-            if (!queued[dep_node_idx]) {
-                dependencies_satisfied = false;
-                break;
+    while (num_ready > 0) {
+        std::pop_heap(ready.data(), ready.data() + num_ready,
+                      std::greater<uint32_t>());
+        uint32_t node_idx = ready[--num_ready];
+
+        sorted_idxs[node_idx] = uint32_t(num_sorted);
+        sorted_order[num_sorted++] = node_idx;
+
+        for (uint32_t i = dependent_offsets[node_idx];
+             i < dependent_offsets[node_idx + 1]; i++) {
+            uint32_t dependent_idx = staged_dependents[i];
+
+            if (--num_unsorted_deps[dependent_idx] == 0) {
+                pushReady(dependent_idx);
             }
         }
+    }
+
+    if (num_sorted != num_nodes) {
+        FATAL("TaskGraph has a dependency cycle");
+    }
+
+    HeapArray<TaskGraph::Node> sorted_nodes(num_nodes);
+    HeapArray<uint32_t> dependents(num_edges);
+    uint32_t cur_dependent_offset = 0;
+
+    CountT num_roots = 0;
+    for (CountT i = 0; i < num_nodes; i++) {
+        if (staged_[i].numDependencies == 0) {
+            num_roots += 1;
+        }
+    }
+
+    HeapArray<uint32_t> roots(num_roots);
+    CountT cur_root = 0;
+
+    for (CountT i = 0; i < num_nodes; i++) {
+        uint32_t staged_idx = sorted_order[i];
+        const StagedNode &staged = staged_[staged_idx];
+
+        uint32_t dependent_start = dependent_offsets[staged_idx];
+        uint32_t num_dependents =
+            dependent_offsets[staged_idx + 1] - dependent_start;
 
-        if (dependencies_satisfied) {
-            queued[cur_node_idx] = true;
-            enqueueInSorted(cur_staged.node);
-            num_remaining_nodes--;
+        for (uint32_t j = 0; j < num_dependents; j++) {
+            dependents[cur_dependent_offset + j] =
+                sorted_idxs[staged_dependents[dependent_start + j]];
+        }
+
+        new (&sorted_nodes[i]) TaskGraph::Node {
+            .fn = staged.node.fn,
+            .name = staged.node.name,
+            .dataIDX = staged.node.dataIDX,
+            .numChildren = num_children[staged_idx],
+            .numDependencies = staged.numDependencies,
+            .dependentOffset = cur_dependent_offset,
+            .numDependents = num_dependents,
+        };
+
+        cur_dependent_offset += num_dependents;
+
+        if (staged.numDependencies == 0) {
+            roots[cur_root++] = uint32_t(i);
         }
     }
 
@@ -113,7 +204,8 @@ TaskGraph TaskGraphBuilder::build()
            node_datas_.size() * sizeof(TaskGraph::NodeData));
 
     return TaskGraph(state_mgr_, state_cache_, MADRONA_MW_COND(world_id_,)
-        std::move(sorted_nodes), std::move(data_cpy));
+        parallel_for_, node_tracer_, taskgraph_id_, std::move(sorted_nodes),
+        std::move(dependents), std::move(roots), std::move(data_cpy));
 }
 
 struct TaskGraphManager::Impl {
@@ -151,22 +243,172 @@ HeapArray<TaskGraph> TaskGraphManager::constructGraphs()
 TaskGraph::TaskGraph(StateManager *state_mgr,
                      StateCache *state_cache,
                      MADRONA_MW_COND(uint32_t world_id,) 
+                     const ParallelForDispatcher *parallel_for,
+                     NodeTracer *node_tracer,
+                     uint32_t taskgraph_id,
                      HeapArray<Node> &&sorted_nodes,
+                     HeapArray<uint32_t> &&dependents,
+                     HeapArray<uint32_t> &&roots,
                      HeapArray<NodeData> &&node_datas)
     : state_mgr_(state_mgr),
       state_cache_(state_cache),
 #ifdef MADRONA_MW_MODE
       cur_world_id_(world_id),
 #endif
+      parallel_for_(parallel_for),
+      node_tracer_(node_tracer),
+      taskgraph_id_(taskgraph_id),
       sorted_nodes_(std::move(sorted_nodes)),
+      dependents_(std::move(dependents)),
+      roots_(std::move(roots)),
+      num_pending_dependencies_(sorted_nodes_.size()),
       node_datas_(std::move(node_datas))
-{}
+{
+    for (CountT i = 0; i < sorted_nodes_.size(); i++) {
+        num_pending_dependencies_.emplace(i, 0);
+    }
+}
+
+void TaskGraph::runNode(const Node &node, Context *ctx)
+{
+    NodeBase *node_data =
+        (NodeBase *)(&node_datas_[node.dataIDX].userData[0]);
+
+    if (node_tracer_ == nullptr) {
+        node.fn(node_data, ctx, this);
+        return;
+    }
+
+    uint64_t start = GetTimeStamp();
+    node.fn(node_data, ctx, this);
+    uint64_t end = GetTimeStamp();
+
+#ifdef MADRONA_MW_MODE
+    uint32_t world_id = cur_world_id_;
+#else
+    uint32_t world_id = 0;
+#endif
+
+    NodeTracer::record(node.name, world_id, taskgraph_id_, start, end);
+}
+
+struct TaskGraph::ConcurrentRun {
+    TaskGraph *graph;
+    Context *ctx;
+    TaskGroup group;
+};
 
 void TaskGraph::run(Context *ctx)
 {
-    for (const Node &node : sorted_nodes_) {
-        node.fn((NodeBase *)(&node_datas_[node.dataIDX].userData[0]),
-                ctx, this);
+#ifdef MADRONA_MW_MODE
+    state_mgr_->importOverflowedColumns(cur_world_id_);
+#endif
+
+    if (parallel_for_ != nullptr && parallel_for_->spawn != nullptr &&
+            sorted_nodes_.size() > 1) {
+        runConcurrent(ctx);
+    } else {
+        for (const Node &node : sorted_nodes_) {
+            runNode(node, ctx);
+        }
+    }
+
+#ifdef MADRONA_MW_MODE
+    state_mgr_->exportOverflowedColumns(cur_world_id_);
+#endif
+}
+
+void TaskGraph::runNodeAt(Context *ctx, CountT node_idx)
+{
+#ifdef MADRONA_MW_MODE
+    if (node_idx == 0) {
+        state_mgr_->importOverflowedColumns(cur_world_id_);
+    }
+#endif
+
+    runNode(sorted_nodes_[node_idx], ctx);
+
+#ifdef MADRONA_MW_MODE
+    if (node_idx == sorted_nodes_.size() - 1) {
+        state_mgr_->exportOverflowedColumns(cur_world_id_);
+    }
+#endif
+}
+
+void TaskGraph::runConcurrent(Context *ctx)
+{
+    const CountT num_nodes = sorted_nodes_.size();
+
+    for (CountT i = 0; i < num_nodes; i++) {
+        num_pending_dependencies_[i].store_relaxed(
+            sorted_nodes_[i].numDependencies);
+    }
+
+    // Each task runs one node, so numRemaining counts unfinished nodes
+    ConcurrentRun run_state {
+        .graph = this,
+        .ctx = ctx,
+        .group = {
+            .fn = runNodeTask,
+            .data = &run_state,
+            .numRemaining = num_nodes,
+        },
+    };
+
+    void *executor = parallel_for_->executor;
+
+    // Spawn the roots in reverse so this worker pops them in graph order
+    for (CountT i = roots_.size() - 1; i >= 0; i--) {
+        uint32_t root_idx = roots_[i];
+        parallel_for_->spawn(executor, &run_state.group,
+                             root_idx, root_idx + 1);
+    }
+
+    parallel_for_->waitGroup(executor, &run_state.group);
+}
+
+void TaskGraph::runNodeTask(void *data, CountT start, CountT)
+{
+    ConcurrentRun &run_state = *(ConcurrentRun *)data;
+    TaskGraph &graph = *run_state.graph;
+    const ParallelForDispatcher &dispatcher = *graph.parallel_for_;
+
+    CountT node_idx = start;
+    while (true) {
+        const Node &node = graph.sorted_nodes_[node_idx];
+        graph.runNode(node, run_state.ctx);
+
+        // Continue with the first dependent this node makes ready rather
+        // than round tripping it through the queue, spawn the rest
+        CountT next_idx = -1;
+        for (uint32_t i = 0; i < node.numDependents; i++) {
+            uint32_t dependent_idx =
+                graph.dependents_[node.dependentOffset + i];
+
+            // acq_rel so the last finishing dependency publishes the
+            // effects of every dependency to whoever runs the dependent
+            uint32_t num_pending = graph.num_pending_dependencies_[
+                dependent_idx].fetch_sub_acq_rel(1);
+
+            if (num_pending != 1) {
+                continue;
+            }
+
+            if (next_idx == -1) {
+                next_idx = dependent_idx;
+            } else {
+                dispatcher.spawn(dispatcher.executor, &run_state.group,
+                                 dependent_idx, dependent_idx + 1);
+            }
+        }
+
+        if (next_idx == -1) {
+            // The executor marks the task's last node finished
+            break;
+        }
+
+        run_state.group.numRemaining.fetch_sub_release(1);
+        node_idx = next_idx;
     }
 }
 
@@ -175,6 +417,13 @@ void TaskGraph::resetTmpAlloc()
     state_mgr_->resetTmpAlloc(MADRONA_MW_COND(cur_world_id_));
 }
 
+void TaskGraph::commitTransaction()
+{
+    state_mgr_->commitTransaction(MADRONA_MW_COND(cur_world_id_,)
+        *state_cache_,
+        state_mgr_->worldTransaction(MADRONA_MW_COND(cur_world_id_)));
+}
+
 TaskGraphNodeID ResetTmpAllocNode::addToGraph(
     StateManager &,
     TaskGraphBuilder &builder,
@@ -183,4 +432,12 @@ TaskGraphNodeID ResetTmpAllocNode::addToGraph(
     return builder.addDefaultNode<ResetTmpAllocNode>(dependencies);
 }
 
+TaskGraphNodeID CommitTransactionNode::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<CommitTransactionNode>(dependencies);
+}
+
 }
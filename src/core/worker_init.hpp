@@ -23,6 +23,8 @@ struct WorkerInit {
 #ifdef MADRONA_USE_TASK_GRAPH
     StateManager *stateMgr;
     StateCache *stateCache;
+    const ParallelForDispatcher *parallelFor;
+    NodeTracer *nodeTracer;
 #endif
 #ifdef MADRONA_MW_MODE
     uint32_t worldID;
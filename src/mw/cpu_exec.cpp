@@ -1,4 +1,6 @@
 #include <madrona/mw_cpu.hpp>
+#include <madrona/utils.hpp>
+#include <madrona/tracing.hpp>
 #include "../core/worker_init.hpp"
 
 #if defined(MADRONA_LINUX) or defined(MADRONA_MACOS)
@@ -7,24 +9,169 @@
 #include <windows.h>
 #endif
 
+#if defined(MADRONA_X64)
+#include <immintrin.h>
+#endif
+
 namespace madrona {
 
+namespace {
+
+// job is either the TaskGroup of one ParallelForNode table invocation or
+// of one concurrent TaskGraph::run. Both live on the stack of the worker
+// that created them, which doesn't return until numRemaining hits 0.
+struct RangeTask {
+    TaskGroup *job;
+    CountT start;
+    CountT end;
+};
+
+// Bounded deque of row ranges and taskgraph nodes owned by a single
+// worker. The owner pushes and pops at the bottom, other workers steal
+// from the top. Tasks are coarse (minRowsPerTask rows or more, or a whole
+// node), so a spinlock per queue is cheap relative to the work in each.
+struct alignas(MADRONA_CACHE_LINE) WorkStealingQueue {
+    static constexpr CountT maxTasks = 256;
+
+    SpinLock lock {};
+    CountT top = 0;
+    CountT bottom = 0;
+    RangeTask tasks[maxTasks];
+
+    inline bool push(RangeTask task);
+    inline bool pop(RangeTask *task);
+    inline bool steal(RangeTask *task);
+};
+
+bool WorkStealingQueue::push(RangeTask task)
+{
+    std::lock_guard lock_guard(lock);
+
+    if (bottom - top == maxTasks) {
+        return false;
+    }
+
+    tasks[bottom % maxTasks] = task;
+    bottom += 1;
+
+    return true;
+}
+
+bool WorkStealingQueue::pop(RangeTask *task)
+{
+    std::lock_guard lock_guard(lock);
+
+    if (bottom == top) {
+        return false;
+    }
+
+    bottom -= 1;
+    *task = tasks[bottom % maxTasks];
+
+    return true;
+}
+
+bool WorkStealingQueue::steal(RangeTask *task)
+{
+    // Don't contend with the owner or other thieves, just try elsewhere
+    if (!lock.tryLock()) {
+        return false;
+    }
+
+    bool found = bottom != top;
+    if (found) {
+        *task = tasks[top % maxTasks];
+        top += 1;
+    }
+
+    lock.unlock();
+
+    return found;
+}
+
+inline void runRangeTask(const RangeTask &task)
+{
+    TaskGroup *job = task.job;
+    job->fn(job->data, task.start, task.end);
+
+    // Release so the issuing worker sees this range's writes
+    job->numRemaining.fetch_sub_release(1);
+}
+
+inline void workerPause()
+{
+#if defined(MADRONA_X64)
+    _mm_pause();
+#elif defined(MADRONA_ARM)
+#if defined(MADRONA_GCC) or defined(MADRONA_CLANG)
+    asm volatile("yield");
+#elif defined(MADRONA_MSVC)
+    YieldProcessor();
+#endif
+#endif
+}
+
+thread_local CountT CUR_WORKER_IDX = -1;
+
+}
+
 struct ThreadPoolExecutor::Impl {
     HeapArray<std::thread> workers;
     alignas(MADRONA_CACHE_LINE) AtomicI32 workerWakeup;
     alignas(MADRONA_CACHE_LINE) AtomicI32 mainWakeup;
     ThreadPoolExecutor::Job *currentJobs;
     uint32_t numJobs;
-    alignas(MADRONA_CACHE_LINE) AtomicU32 nextJob;
+    uint32_t numJobsPerBatch;
+    // Workers claim and complete jobs in chunks of up to jobsPerChunk
+    // consecutive jobs of a batch. In NUMA mode each worker's whole range
+    // of a batch is one chunk.
+    uint32_t jobsPerChunk;
+    uint32_t numChunks;
+    uint32_t numChunksPerBatch;
+    uint32_t cfgJobsPerChunk;
+    alignas(MADRONA_CACHE_LINE) AtomicU32 nextChunk;
     alignas(MADRONA_CACHE_LINE) AtomicU32 numFinished;
+    alignas(MADRONA_CACHE_LINE) AtomicU32 numFinishedBatches;
+    alignas(MADRONA_CACHE_LINE) AtomicCount numActiveWorkers;
+    int32_t runGeneration;
+    bool intraWorldParallelism;
+    bool workStealing;
+    bool numaAware;
+    // Workers that stay awake for a whole run (work stealing or NUMA
+    // mode) are counted in numActiveWorkers
+    bool trackActiveWorkers;
+    CountT minRowsPerTask;
+    HeapArray<WorkStealingQueue> stealQueues;
+    ParallelForDispatcher parallelForDispatcher;
     StateManager stateMgr;
     HeapArray<StateCache> stateCaches;
     HeapArray<void *> exportPtrs;
+    HeapArray<void *> backExportPtrs;
+    bool doubleBufferExports;
+    CountT latestExportBuffer;
+    // Worlds stepped by the current run, if not all of them
+    Optional<Span<const int32_t>> activeWorlds;
+    Optional<NodeTracer> nodeTracer;
 
     static Impl * make(const ThreadPoolExecutor::Config &cfg);
     ~Impl();
-    void run(Job *jobs, CountT num_jobs);
+    void startJobs(Job *jobs, CountT num_jobs_per_batch, CountT num_batches);
+    void waitJobs();
+    void runAsync(Job *jobs, CountT num_jobs_per_batch, CountT num_batches,
+                  Optional<Span<const int32_t>> active_worlds);
+    void wait();
+    inline void waitForBatch(CountT worker_id, uint32_t batch_idx);
+    void runOwnedJobs(CountT worker_id);
+    inline void runChunk(uint32_t chunk_idx);
+    inline void finishChunk();
     void workerThread(CountT worker_id);
+    void workStealingThread(CountT worker_id);
+    bool stealTask(CountT worker_id, RangeTask *task);
+    void parallelFor(CountT num_items,
+                     void (*range_fn)(void *, CountT, CountT),
+                     void *range_data);
+    void spawn(TaskGroup *group, CountT start, CountT end);
+    void waitGroup(TaskGroup *group);
 };
 
 static CountT getNumCores()
@@ -97,28 +244,98 @@ static inline void pinThread([[maybe_unused]] CountT worker_id)
 ThreadPoolExecutor::Impl * ThreadPoolExecutor::Impl::make(
     const ThreadPoolExecutor::Config &cfg)
 {
+    CountT num_workers =
+        cfg.numWorkers == 0 ? getNumCores() : cfg.numWorkers;
+
+    bool work_stealing = cfg.intraWorldParallelism || cfg.nodeParallelism;
+    bool track_active_workers = work_stealing || cfg.numaAware;
+
     Impl *impl = new Impl {
-        .workers = HeapArray<std::thread>(
-            cfg.numWorkers == 0 ? getNumCores() : cfg.numWorkers),
+        .workers = HeapArray<std::thread>(num_workers),
         .workerWakeup = 0,
         .mainWakeup = 0,
         .currentJobs = nullptr,
         .numJobs = 0,
-        .nextJob = 0,
+        .numJobsPerBatch = 0,
+        .jobsPerChunk = 1,
+        .numChunks = 0,
+        .numChunksPerBatch = 0,
+        .cfgJobsPerChunk = cfg.jobsPerChunk,
+        .nextChunk = 0,
         .numFinished = 0,
-        .stateMgr = StateManager(cfg.numWorlds),
+        .numFinishedBatches = 0,
+        .numActiveWorkers = 0,
+        .runGeneration = 0,
+        .intraWorldParallelism = cfg.intraWorldParallelism,
+        .workStealing = work_stealing,
+        .numaAware = cfg.numaAware,
+        .trackActiveWorkers = track_active_workers,
+        .minRowsPerTask = std::max(CountT(cfg.minRowsPerTask), CountT(1)),
+        .stealQueues = HeapArray<WorkStealingQueue>(
+            work_stealing ? num_workers : 0),
+        .parallelForDispatcher = {},
+        .stateMgr = StateManager(cfg.numWorlds, cfg.numExportRowsPerWorld,
+                                 cfg.tmpAllocBlockBytes),
         .stateCaches = HeapArray<StateCache>(cfg.numWorlds),
         .exportPtrs = HeapArray<void *>(cfg.numExportedBuffers),
+        .backExportPtrs = HeapArray<void *>(cfg.numExportedBuffers),
+        .doubleBufferExports = cfg.doubleBufferExports,
+        .latestExportBuffer = 0,
+        .activeWorlds = Optional<Span<const int32_t>>::none(),
+        .nodeTracer = Optional<NodeTracer>::none(),
     };
 
+    if (cfg.nodeTraceEventsPerWorker > 0) {
+        impl->nodeTracer.emplace(num_workers, cfg.nodeTraceEventsPerWorker);
+    }
+
     for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
         impl->stateCaches.emplace(i);
     }
 
-    for (CountT i = 0; i < impl->workers.size(); i++) {
-        impl->workers.emplace(i, [](Impl *impl, CountT i) {
-            impl->workerThread(i);
-        }, impl, i);
+    if (work_stealing) {
+        for (CountT i = 0; i < num_workers; i++) {
+            impl->stealQueues.emplace(i);
+        }
+
+        impl->parallelForDispatcher = ParallelForDispatcher {
+            .parallelFor = [](void *executor, CountT num_items,
+                              void (*range_fn)(void *, CountT, CountT),
+                              void *range_data) {
+                ((Impl *)executor)->parallelFor(
+                    num_items, range_fn, range_data);
+            },
+            .spawn = nullptr,
+            .waitGroup = nullptr,
+            .executor = impl,
+        };
+
+        if (cfg.nodeParallelism) {
+            impl->parallelForDispatcher.spawn = [](
+                    void *executor, TaskGroup *group,
+                    CountT start, CountT end) {
+                ((Impl *)executor)->spawn(group, start, end);
+            };
+
+            impl->parallelForDispatcher.waitGroup = [](
+                    void *executor, TaskGroup *group) {
+                ((Impl *)executor)->waitGroup(group);
+            };
+        }
+    }
+
+    if (track_active_workers) {
+        for (CountT i = 0; i < num_workers; i++) {
+            impl->workers.emplace(i, [](Impl *impl, CountT i) {
+                impl->workStealingThread(i);
+            }, impl, i);
+        }
+    } else {
+        for (CountT i = 0; i < num_workers; i++) {
+            impl->workers.emplace(i, [](Impl *impl, CountT i) {
+                impl->workerThread(i);
+            }, impl, i);
+        }
     }
 
     return impl;
@@ -142,31 +359,312 @@ ThreadPoolExecutor::Impl::~Impl()
 
 ThreadPoolExecutor::~ThreadPoolExecutor() = default;
 
-void ThreadPoolExecutor::Impl::run(Job *jobs, CountT num_jobs)
+void ThreadPoolExecutor::Impl::startJobs(Job *jobs,
+                                         CountT num_jobs_per_batch,
+                                         CountT num_batches)
 {
-    stateMgr.copyInExportedColumns();
-
     currentJobs = jobs;
-    numJobs = uint32_t(num_jobs);
-    nextJob.store_relaxed(0);
+    numJobsPerBatch = uint32_t(num_jobs_per_batch);
+    numJobs = uint32_t(num_jobs_per_batch * num_batches);
+
+    const CountT num_workers = workers.size();
+    if (numaAware) {
+        numChunksPerBatch =
+            uint32_t(std::min(num_jobs_per_batch, num_workers));
+    } else {
+        if (cfgJobsPerChunk > 0) {
+            jobsPerChunk = cfgJobsPerChunk;
+        } else {
+            // Aim for a fixed number of grabs per worker per batch. Small
+            // batches degrade to one job per grab, where load balance
+            // matters more than contention.
+            constexpr CountT chunks_per_worker = 16;
+            jobsPerChunk = uint32_t(std::max(
+                num_jobs_per_batch / (num_workers * chunks_per_worker),
+                CountT(1)));
+        }
+
+        numChunksPerBatch = uint32_t(
+            utils::divideRoundUp(num_jobs_per_batch, CountT(jobsPerChunk)));
+    }
+    numChunks = numChunksPerBatch * uint32_t(num_batches);
+
+    nextChunk.store_relaxed(0);
     numFinished.store_relaxed(0);
-    workerWakeup.store_release(1);
+    numFinishedBatches.store_relaxed(0);
+
+    if (numJobs == 0) {
+        mainWakeup.store_relaxed(1);
+        return;
+    }
+
+    if (trackActiveWorkers) {
+        // Every worker participates in every run, to steal tasks or run
+        // the worlds it owns in NUMA mode
+        numActiveWorkers.store_relaxed(workers.size());
+    }
+
+    // Signalled by bumping the generation rather than a 0 / 1 flag that
+    // the workers clear: a worker can be preempted right before clearing
+    // the flag and then wipe out the wakeup of the next run.
+    runGeneration = runGeneration == INT32_MAX ? 1 : runGeneration + 1;
+    workerWakeup.store_release(runGeneration);
     workerWakeup.notify_all();
+}
 
+void ThreadPoolExecutor::Impl::waitJobs()
+{
     mainWakeup.wait<sync::acquire>(0);
     mainWakeup.store_relaxed(0);
 
-    stateMgr.copyOutExportedColumns();
+    if (trackActiveWorkers) {
+        // Workers may still be spinning in the steal loop after the last
+        // world finishes. Don't let the next run reset the shared job
+        // state out from under them.
+        while (numActiveWorkers.load_acquire() != 0) {
+            workerPause();
+        }
+    }
+}
+
+void ThreadPoolExecutor::Impl::runAsync(
+    Job *jobs,
+    CountT num_jobs_per_batch,
+    CountT num_batches,
+    Optional<Span<const int32_t>> active_worlds)
+{
+    // With double buffering, the other buffer still holds the results of
+    // the step before last for worlds that don't run, so every world is
+    // copied
+    if (doubleBufferExports) {
+        active_worlds.reset();
+    }
+    activeWorlds = active_worlds;
+
+    // Read inputs from the buffer holding the last step's results, which
+    // may have been modified by the user since. wait() writes the new
+    // results to the other buffer when double buffering.
+    if (activeWorlds.has_value()) {
+        stateMgr.copyInExportedColumns(latestExportBuffer, *activeWorlds);
+    } else {
+        stateMgr.copyInExportedColumns(latestExportBuffer);
+    }
+
+    // Zero-copy columns are written in place, so the step moves them to
+    // the other buffer first
+    if (doubleBufferExports) {
+        stateMgr.moveZeroCopyColumns(latestExportBuffer ^ 1);
+    }
+
+    startJobs(jobs, num_jobs_per_batch, num_batches);
+}
+
+void ThreadPoolExecutor::Impl::wait()
+{
+    waitJobs();
+
+    if (doubleBufferExports) {
+        latestExportBuffer ^= 1;
+    }
+
+    if (activeWorlds.has_value()) {
+        stateMgr.copyOutExportedColumns(latestExportBuffer, *activeWorlds);
+        activeWorlds.reset();
+    } else {
+        stateMgr.copyOutExportedColumns(latestExportBuffer);
+    }
+}
+
+void ThreadPoolExecutor::Impl::runChunk(uint32_t chunk_idx)
+{
+    uint32_t batch_idx = chunk_idx / numChunksPerBatch;
+    uint32_t chunk_offset = (chunk_idx % numChunksPerBatch) * jobsPerChunk;
+
+    uint32_t job_start = batch_idx * numJobsPerBatch + chunk_offset;
+    uint32_t job_end = batch_idx * numJobsPerBatch +
+        std::min(chunk_offset + jobsPerChunk, numJobsPerBatch);
+
+    for (uint32_t job_idx = job_start; job_idx < job_end; job_idx++) {
+        currentJobs[job_idx].fn(currentJobs[job_idx].data);
+    }
+
+    finishChunk();
+}
+
+void ThreadPoolExecutor::Impl::finishChunk()
+{
+    // This has to be acq_rel so the finishing thread has seen
+    // all the other threads' effects
+    uint32_t num_finished = numFinished.fetch_add_acq_rel(1) + 1;
+
+    if (num_finished == numChunks) {
+        mainWakeup.store_release(1);
+        mainWakeup.notify_one();
+    } else if (num_finished % numChunksPerBatch == 0) {
+        numFinishedBatches.store_release(num_finished / numChunksPerBatch);
+        numFinishedBatches.notify_all();
+    }
 }
 
 void ThreadPoolExecutor::run(Job *jobs, CountT num_jobs)
 {
-    impl_->run(jobs, num_jobs);
+    impl_->runAsync(jobs, num_jobs, 1, Optional<Span<const int32_t>>::none());
+    impl_->wait();
+}
+
+void ThreadPoolExecutor::runAsync(Job *jobs, CountT num_jobs_per_batch,
+                                  CountT num_batches)
+{
+    impl_->runAsync(jobs, num_jobs_per_batch, num_batches,
+                    Optional<Span<const int32_t>>::none());
+}
+
+void ThreadPoolExecutor::runAsync(Job *jobs, CountT num_jobs_per_batch,
+                                  CountT num_batches,
+                                  Span<const int32_t> world_ids)
+{
+    impl_->runAsync(jobs, num_jobs_per_batch, num_batches,
+                    Optional<Span<const int32_t>>::make(world_ids));
+}
+
+void ThreadPoolExecutor::wait()
+{
+    impl_->wait();
 }
 
 void * ThreadPoolExecutor::getExported(CountT slot) const
 {
-    return impl_->exportPtrs[slot];
+    return getExported(slot, impl_->latestExportBuffer);
+}
+
+void * ThreadPoolExecutor::getExported(CountT slot, CountT buffer_idx) const
+{
+    assert(buffer_idx == 0 || impl_->doubleBufferExports);
+
+    return buffer_idx == 0 ?
+        impl_->exportPtrs[slot] : impl_->backExportPtrs[slot];
+}
+
+CountT ThreadPoolExecutor::latestExportBuffer() const
+{
+    return impl_->latestExportBuffer;
+}
+
+NodeTracer * ThreadPoolExecutor::getNodeTracer() const
+{
+    return impl_->nodeTracer.has_value() ? &*impl_->nodeTracer : nullptr;
+}
+
+uint64_t ThreadPoolExecutor::worldSnapshotBytes(CountT world_idx) const
+{
+    return impl_->stateMgr.worldSnapshotBytes(uint32_t(world_idx));
+}
+
+void ThreadPoolExecutor::saveWorldSnapshot(CountT world_idx, void *dst) const
+{
+    impl_->stateMgr.saveWorldSnapshot(uint32_t(world_idx),
+        impl_->stateCaches[world_idx], dst);
+}
+
+void ThreadPoolExecutor::restoreWorldSnapshot(CountT world_idx,
+                                              const void *src)
+{
+    int32_t world_idx_i32 = int32_t(world_idx);
+    restoreWorldSnapshots(Span(&world_idx_i32, 1), &src);
+}
+
+void ThreadPoolExecutor::restoreWorldSnapshots(
+    Span<const int32_t> world_idxs,
+    const void * const *snapshots)
+{
+    StateManager &state_mgr = impl_->stateMgr;
+
+    // Pick up any changes made to the export buffers since the last step,
+    // the export buffers are then rewritten from the restored tables
+    state_mgr.copyInExportedColumns(impl_->latestExportBuffer);
+
+    for (CountT i = 0; i < world_idxs.size(); i++) {
+        uint32_t world_idx = uint32_t(world_idxs[i]);
+
+        state_mgr.importOverflowedColumns(world_idx);
+        state_mgr.restoreWorldSnapshot(world_idx,
+            impl_->stateCaches[world_idx], snapshots[i]);
+        state_mgr.exportOverflowedColumns(world_idx);
+    }
+
+    state_mgr.copyOutExportedColumns(impl_->latestExportBuffer);
+}
+
+StateManager::TmpAllocStats ThreadPoolExecutor::tmpAllocStats(
+    CountT world_idx) const
+{
+    return impl_->stateMgr.tmpAllocStats(uint32_t(world_idx));
+}
+
+MemoryReport ThreadPoolExecutor::memoryReport() const
+{
+    return impl_->stateMgr.memoryReport();
+}
+
+void ThreadPoolExecutor::forkWorld(CountT src_world_idx,
+                                   Span<const int32_t> dst_world_idxs)
+{
+    StateManager &state_mgr = impl_->stateMgr;
+
+    state_mgr.copyInExportedColumns(impl_->latestExportBuffer);
+    state_mgr.importOverflowedColumns(uint32_t(src_world_idx));
+
+    state_mgr.forkWorld(uint32_t(src_world_idx), dst_world_idxs);
+
+    for (int32_t dst_world_idx : dst_world_idxs) {
+        state_mgr.exportOverflowedColumns(uint32_t(dst_world_idx));
+    }
+
+    state_mgr.copyOutExportedColumns(impl_->latestExportBuffer);
+}
+
+void ThreadPoolExecutor::initializeWorlds(Job *jobs, CountT num_worlds)
+{
+    if (!impl_->numaAware) {
+        for (CountT i = 0; i < num_worlds; i++) {
+            jobs[i].fn(jobs[i].data);
+        }
+
+        return;
+    }
+
+    // Run each world's init on the worker that will own the world, so
+    // its tables, entity IDs and temporary allocator are first touched
+    // on that worker's NUMA node. Batch 0 reallocates the temporary
+    // allocators, batch 1 runs the init jobs.
+    struct TmpAllocJob {
+        StateManager *stateMgr;
+        uint32_t worldIdx;
+    };
+
+    HeapArray<TmpAllocJob> tmp_alloc_jobs(num_worlds);
+    HeapArray<Job> all_jobs(num_worlds * 2);
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        tmp_alloc_jobs[i] = TmpAllocJob {
+            .stateMgr = &impl_->stateMgr,
+            .worldIdx = uint32_t(i),
+        };
+
+        all_jobs[i] = Job {
+            .fn = [](void *data) {
+                auto tmp_alloc_job = (TmpAllocJob *)data;
+                tmp_alloc_job->stateMgr->reallocTmpAlloc(
+                    tmp_alloc_job->worldIdx);
+            },
+            .data = &tmp_alloc_jobs[i],
+        };
+
+        all_jobs[num_worlds + i] = jobs[i];
+    }
+
+    impl_->startJobs(all_jobs.data(), num_worlds, 2);
+    impl_->waitJobs();
 }
 
 void ThreadPoolExecutor::initializeContexts(
@@ -177,6 +675,9 @@ void ThreadPoolExecutor::initializeContexts(
         WorkerInit worker_init {
             &impl_->stateMgr,
             &impl_->stateCaches[world_idx],
+            impl_->workStealing ?
+                &impl_->parallelForDispatcher : nullptr,
+            impl_->nodeTracer.has_value() ? &*impl_->nodeTracer : nullptr,
             uint32_t(world_idx),
         };
 
@@ -191,47 +692,299 @@ ECSRegistry ThreadPoolExecutor::getECSRegistry()
 
 void ThreadPoolExecutor::initExport()
 {
-    impl_->stateMgr.copyOutExportedColumns();
+    impl_->stateMgr.copyOutExportedColumns(0);
+
+    // World init runs outside the taskgraph, so zero-copy columns that
+    // already overflowed need to be synced here
+    for (CountT i = 0; i < impl_->stateCaches.size(); i++) {
+        impl_->stateMgr.exportOverflowedColumns(uint32_t(i));
+    }
+
+    if (impl_->doubleBufferExports) {
+        impl_->stateMgr.enableExportDoubleBuffering();
+        impl_->stateMgr.copyOutExportedColumns(1);
+    }
+
+    for (CountT i = 0; i < impl_->exportPtrs.size(); i++) {
+        impl_->backExportPtrs[i] = impl_->stateMgr.exportBuffer(
+            impl_->exportPtrs[i], impl_->doubleBufferExports ? 1 : 0);
+    }
 }
 
 void ThreadPoolExecutor::Impl::workerThread(CountT worker_id)
 {
     pinThread(worker_id);
+    NodeTracer::attachWorker(
+        nodeTracer.has_value() ? &*nodeTracer : nullptr, worker_id);
 
+    int32_t last_generation = 0;
     while (true) {
-        workerWakeup.wait<sync::relaxed>(0);
+        workerWakeup.wait<sync::relaxed>(last_generation);
         int32_t ctrl = workerWakeup.load_acquire();
 
-        if (ctrl == 0) {
-            continue;
-        } else if (ctrl == -1) {
+        if (ctrl == -1) {
             break;
+        } else if (ctrl == last_generation) {
+            continue;
         }
 
+        last_generation = ctrl;
+
         while (true) {
-            uint32_t job_idx = nextJob.fetch_add_relaxed(1);
+            uint32_t chunk_idx = nextChunk.fetch_add_relaxed(1);
+
+            assert(chunk_idx < 0xFFFF'FFFF);
 
-            if (job_idx == numJobs) {
-                workerWakeup.store_relaxed(0);
+            if (chunk_idx >= numChunks) {
+                break;
+            }
+
+            // Jobs of the next batch can't start until every job of the
+            // previous batch is done
+            uint32_t batch_idx = chunk_idx / numChunksPerBatch;
+            uint32_t num_finished_batches;
+            while ((num_finished_batches =
+                    numFinishedBatches.load_acquire()) < batch_idx) {
+                numFinishedBatches.wait<sync::acquire>(num_finished_batches);
             }
 
-            assert(job_idx < 0xFFFF'FFFF);
+            runChunk(chunk_idx);
+        }
+    }
+}
+
+void ThreadPoolExecutor::Impl::workStealingThread(CountT worker_id)
+{
+    pinThread(worker_id);
+    CUR_WORKER_IDX = worker_id;
+    NodeTracer::attachWorker(
+        nodeTracer.has_value() ? &*nodeTracer : nullptr, worker_id);
+
+    int32_t last_generation = 0;
+    while (true) {
+        workerWakeup.wait<sync::relaxed>(last_generation);
+        int32_t ctrl = workerWakeup.load_acquire();
+
+        if (ctrl == -1) {
+            break;
+        } else if (ctrl == last_generation) {
+            continue;
+        }
+
+        last_generation = ctrl;
+
+        if (numaAware) {
+            runOwnedJobs(worker_id);
+            numActiveWorkers.fetch_sub_release(1);
+            continue;
+        }
+
+        while (true) {
+            // Prefer starting a new world over stealing rows from
+            // a world another worker is already running
+            if (nextChunk.load_relaxed() < numChunks) {
+                uint32_t chunk_idx = nextChunk.fetch_add_relaxed(1);
+
+                if (chunk_idx < numChunks) {
+                    waitForBatch(worker_id, chunk_idx / numChunksPerBatch);
+
+                    runChunk(chunk_idx);
 
-            if (job_idx >= numJobs) {
+                    continue;
+                }
+            }
+
+            if (numFinished.load_acquire() == numChunks) {
                 break;
             }
 
+            RangeTask task;
+            if (stealTask(worker_id, &task)) {
+                runRangeTask(task);
+            } else {
+                workerPause();
+            }
+        }
+
+        numActiveWorkers.fetch_sub_release(1);
+    }
+}
+
+void ThreadPoolExecutor::Impl::waitForBatch(CountT worker_id,
+                                            uint32_t batch_idx)
+{
+    if (!workStealing) {
+        uint32_t num_finished_batches;
+        while ((num_finished_batches =
+                numFinishedBatches.load_acquire()) < batch_idx) {
+            numFinishedBatches.wait<sync::acquire>(num_finished_batches);
+        }
+
+        return;
+    }
+
+    while (numFinishedBatches.load_acquire() < batch_idx) {
+        RangeTask task;
+        if (stealTask(worker_id, &task)) {
+            runRangeTask(task);
+        } else {
+            workerPause();
+        }
+    }
+}
+
+void ThreadPoolExecutor::Impl::runOwnedJobs(CountT worker_id)
+{
+    // Job i of every batch always runs on the same worker, so the world
+    // state it touches stays in that worker's caches and NUMA node.
+    // Workers own contiguous ranges of jobs.
+    const CountT num_workers = workers.size();
+    uint32_t own_start =
+        uint32_t(worker_id * CountT(numJobsPerBatch) / num_workers);
+    uint32_t own_end =
+        uint32_t((worker_id + 1) * CountT(numJobsPerBatch) / num_workers);
+
+    uint32_t num_batches = numJobs / numJobsPerBatch;
+    for (uint32_t batch_idx = 0;
+         batch_idx < num_batches && own_start != own_end; batch_idx++) {
+        waitForBatch(worker_id, batch_idx);
+
+        uint32_t batch_offset = batch_idx * numJobsPerBatch;
+        for (uint32_t i = own_start; i < own_end; i++) {
+            uint32_t job_idx = batch_offset + i;
             currentJobs[job_idx].fn(currentJobs[job_idx].data);
+        }
+
+        finishChunk();
+    }
 
-            // This has to be acq_rel so the finishing thread has seen
-            // all the other threads' effects
-            uint32_t prev_finished =
-                numFinished.fetch_add_acq_rel(1);
+    if (!workStealing) {
+        return;
+    }
 
-            if (prev_finished == numJobs - 1) {
-                mainWakeup.store_release(1);
-                mainWakeup.notify_one();
-            }
+    // Help with the other workers' ranges and nodes until the run is done
+    while (numFinished.load_acquire() != numChunks) {
+        RangeTask task;
+        if (stealTask(worker_id, &task)) {
+            runRangeTask(task);
+        } else {
+            workerPause();
+        }
+    }
+}
+
+bool ThreadPoolExecutor::Impl::stealTask(CountT worker_id, RangeTask *task)
+{
+    const CountT num_queues = stealQueues.size();
+    for (CountT i = 1; i < num_queues; i++) {
+        CountT victim = (worker_id + i) % num_queues;
+
+        if (stealQueues[victim].steal(task)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPoolExecutor::Impl::parallelFor(
+    CountT num_items,
+    void (*range_fn)(void *, CountT, CountT),
+    void *range_data)
+{
+    const CountT worker_id = CUR_WORKER_IDX;
+    const CountT num_workers = workers.size();
+
+    if (!intraWorldParallelism || num_items <= minRowsPerTask ||
+            num_workers == 1 || worker_id == -1) {
+        range_fn(range_data, 0, num_items);
+        return;
+    }
+
+    // A few ranges per worker gives thieves something to take
+    // without making each range too small to amortize the steal
+    CountT num_tasks = std::min(
+        utils::divideRoundUp(num_items, minRowsPerTask), num_workers * 4);
+    CountT rows_per_task = utils::divideRoundUp(num_items, num_tasks);
+    num_tasks = utils::divideRoundUp(num_items, rows_per_task);
+
+    TaskGroup job {
+        .fn = range_fn,
+        .data = range_data,
+        .numRemaining = num_tasks,
+    };
+
+    WorkStealingQueue &queue = stealQueues[worker_id];
+
+    // Range 0 is run directly below, the rest are exposed to thieves.
+    // If the queue is full just run the range inline.
+    for (CountT task_idx = num_tasks - 1; task_idx > 0; task_idx--) {
+        RangeTask task {
+            .job = &job,
+            .start = task_idx * rows_per_task,
+            .end = std::min((task_idx + 1) * rows_per_task, num_items),
+        };
+
+        if (!queue.push(task)) {
+            runRangeTask(task);
+        }
+    }
+
+    runRangeTask(RangeTask {
+        .job = &job,
+        .start = 0,
+        .end = std::min(rows_per_task, num_items),
+    });
+
+    RangeTask task;
+    while (queue.pop(&task)) {
+        runRangeTask(task);
+    }
+
+    // Remaining ranges were stolen. Help with other worlds' ranges
+    // rather than idling while they finish.
+    while (job.numRemaining.load_acquire() != 0) {
+        if (stealTask(worker_id, &task)) {
+            runRangeTask(task);
+        } else {
+            workerPause();
+        }
+    }
+}
+
+void ThreadPoolExecutor::Impl::spawn(TaskGroup *group,
+                                     CountT start, CountT end)
+{
+    const CountT worker_id = CUR_WORKER_IDX;
+    RangeTask task {
+        .job = group,
+        .start = start,
+        .end = end,
+    };
+
+    if (worker_id == -1 || !stealQueues[worker_id].push(task)) {
+        runRangeTask(task);
+    }
+}
+
+void ThreadPoolExecutor::Impl::waitGroup(TaskGroup *group)
+{
+    const CountT worker_id = CUR_WORKER_IDX;
+
+    // Off the worker pool spawn runs every task inline
+    if (worker_id == -1) {
+        assert(group->numRemaining.load_acquire() == 0);
+        return;
+    }
+
+    WorkStealingQueue &queue = stealQueues[worker_id];
+
+    RangeTask task;
+    while (group->numRemaining.load_acquire() != 0) {
+        if (queue.pop(&task) || stealTask(worker_id, &task)) {
+            runRangeTask(task);
+        } else {
+            workerPause();
         }
     }
 }
@@ -22,10 +22,20 @@ public:
     Entity makeEntity();
     inline Entity makeEntity(uint32_t archetype_id);
 
+    template <typename ArchetypeT>
+    inline Span<const Entity> makeEntities(CountT num_entities);
+    inline Span<const Entity> makeEntities(uint32_t archetype_id,
+                                           CountT num_entities);
+
     template <typename ArchetypeT>
     Loc makeTemporary();
     inline Loc makeTemporary(uint32_t archetype_id);
 
+    template <typename ArchetypeT>
+    inline Loc makeTemporaries(CountT num_temporaries);
+    inline Loc makeTemporaries(uint32_t archetype_id,
+                               CountT num_temporaries);
+
     inline void destroyEntity(Entity e);
 
     inline Loc loc(Entity e) const;
@@ -48,6 +58,14 @@ public:
     template <typename ComponentT>
     ComponentT & getDirect(int32_t column_idx, Loc loc);
 
+    // The GPU backend doesn't track changes, Changed<ComponentT> filters
+    // visit every entity
+    template <typename ComponentT>
+    inline void markChanged(Entity) {}
+
+    template <typename ComponentT>
+    inline void markChanged(Loc) {}
+
     template <typename SingletonT>
     SingletonT & singleton();
 
@@ -30,6 +30,20 @@ Entity Context::makeEntity(uint32_t archetype_id)
     return state_mgr->makeEntityNow(world_id_, archetype_id);
 }
 
+template <typename ArchetypeT>
+Span<const Entity> Context::makeEntities(CountT num_entities)
+{
+    uint32_t archetype_id = TypeTracker::typeID<ArchetypeT>();
+    return makeEntities(archetype_id, num_entities);
+}
+
+Span<const Entity> Context::makeEntities(uint32_t archetype_id,
+                                         CountT num_entities)
+{
+    StateManager *state_mgr = mwGPU::getStateManager();
+    return state_mgr->makeEntities(world_id_, archetype_id, num_entities);
+}
+
 template <typename ArchetypeT>
 Loc Context::makeTemporary()
 {
@@ -43,6 +57,20 @@ Loc Context::makeTemporary(uint32_t archetype_id)
     return state_mgr->makeTemporary(world_id_, archetype_id);
 }
 
+template <typename ArchetypeT>
+Loc Context::makeTemporaries(CountT num_temporaries)
+{
+    uint32_t archetype_id = TypeTracker::typeID<ArchetypeT>();
+    return makeTemporaries(archetype_id, num_temporaries);
+}
+
+Loc Context::makeTemporaries(uint32_t archetype_id, CountT num_temporaries)
+{
+    StateManager *state_mgr = mwGPU::getStateManager();
+    return state_mgr->makeTemporaries(world_id_, archetype_id,
+                                      num_temporaries);
+}
+
 void Context::destroyEntity(Entity e)
 {
     return mwGPU::getStateManager()->destroyEntityNow(e);
@@ -17,6 +17,7 @@
 #include <madrona/sync.hpp>
 #include <madrona/query.hpp>
 #include <madrona/optional.hpp>
+#include <madrona/span.hpp>
 #include <madrona/type_tracker.hpp>
 #include <madrona/memory.hpp>
 
@@ -70,6 +71,10 @@ public:
     template <typename SingletonT>
     void registerSingleton();
 
+    // World snapshots aren't supported by the GPU backend yet
+    template <typename SingletonT>
+    inline void registerSingletonSnapshot() {}
+
     template <typename BundleT>
     void registerBundle();
 
@@ -94,7 +99,14 @@ public:
 
     void destroyEntityNow(Entity e);
 
+    // Rows are reserved with a single atomic add, entity IDs are still
+    // acquired one at a time
+    Span<const Entity> makeEntities(WorldID world_id, uint32_t archetype_id,
+                                    CountT num_entities);
+
     Loc makeTemporary(WorldID world_id, uint32_t archetype_id);
+    Loc makeTemporaries(WorldID world_id, uint32_t archetype_id,
+                        CountT num_temporaries);
 
     template <typename ArchetypeT>
     void clearTemporaries();
@@ -227,6 +227,20 @@ template <typename ContextT, auto Fn, typename ...ComponentTs>
 using ParallelForNode =
     CustomParallelForNode<ContextT, Fn, 1, 1, ComponentTs...>;
 
+// Rows of a GPU table belong to different worlds, so every entity is
+// passed to Fn as its own block
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+inline void chunkNodeRowEntry(
+    ContextT &ctx,
+    typename QueryComponent<ComponentTs>::Type &...components)
+{
+    Fn(ctx, CountT(1), Span(&components, 1)...);
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+using ParallelForChunkNode = CustomParallelForNode<ContextT,
+    chunkNodeRowEntry<ContextT, Fn, ComponentTs...>, 1, 1, ComponentTs...>;
+
 struct ClearTmpNodeBase : NodeBase {
     ClearTmpNodeBase(uint32_t archetype_id);
 
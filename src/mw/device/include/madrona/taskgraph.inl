@@ -170,7 +170,8 @@ CustomParallelForNode<ContextT, Fn, threads_per_invocation,
 CustomParallelForNode()
     : NodeBase {},
       query_ref_([]() {
-          auto query = mwGPU::getStateManager()->query<ComponentTs...>();
+          auto query = mwGPU::getStateManager()->query<
+              typename QueryComponent<ComponentTs>::Type...>();
           QueryRef *query_ref = query.getSharedRef();
           query_ref->numReferences.fetch_add_relaxed(1);
 
@@ -216,7 +217,7 @@ void CustomParallelForNode<ContextT, Fn,
             //Fn(ctx, ((ComponentTs *)raw_ptrs)[tbl_offset] ...);
 
             cuda::std::tuple typed_ptrs {
-                (ComponentTs *)raw_ptrs
+                (typename QueryComponent<ComponentTs>::Type *)raw_ptrs
                 ...
             };
 
@@ -250,7 +251,7 @@ void CustomParallelForNode<ContextT, Fn,
             //Fn(ctx, ((ComponentTs *)raw_ptrs)[tbl_offset] ...);
 
             cuda::std::tuple typed_ptrs {
-                (ComponentTs *)raw_ptrs
+                (typename QueryComponent<ComponentTs>::Type *)raw_ptrs
                 ...
             };
 
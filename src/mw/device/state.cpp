@@ -518,6 +518,78 @@ Entity StateManager::makeEntityNow(WorldID world_id, uint32_t archetype_id)
     return e;
 }
 
+Span<const Entity> StateManager::makeEntities(WorldID world_id,
+                                              uint32_t archetype_id,
+                                              CountT num_entities)
+{
+    auto &archetype = *archetypes_[archetype_id];
+    archetype.needsSort = true;
+    Table &tbl = archetype.tbl;
+
+    int32_t first_row = tbl.numRows.fetch_add_relaxed(int32_t(num_entities));
+    int32_t last_row = first_row + int32_t(num_entities) - 1;
+
+    // growTable maps at most one doubling at a time
+    while (last_row >= tbl.mappedRows) {
+        growTable(tbl, last_row);
+    }
+
+    Entity *entity_column = (Entity *)tbl.columns[0] + first_row;
+    WorldID *world_column = (WorldID *)tbl.columns[1] + first_row;
+
+    for (CountT i = 0; i < num_entities; i++) {
+        int32_t entity_slot_idx = getEntitySlot(entity_store_);
+
+        EntityStore::EntitySlot &entity_slot =
+            entity_store_.entities[entity_slot_idx];
+
+        entity_slot.loc = Loc {
+            archetype_id,
+            first_row + int32_t(i),
+        };
+
+        entity_column[i] = Entity {
+            entity_slot.gen,
+            entity_slot_idx,
+        };
+        world_column[i] = world_id;
+    }
+
+    return Span<const Entity>(entity_column, num_entities);
+}
+
+Loc StateManager::makeTemporaries(WorldID world_id,
+                                  uint32_t archetype_id,
+                                  CountT num_temporaries)
+{
+    auto &archetype = *archetypes_[archetype_id];
+
+    Table &tbl = archetype.tbl;
+    archetype.needsSort = true;
+
+    int32_t first_row =
+        tbl.numRows.fetch_add_relaxed(int32_t(num_temporaries));
+    int32_t last_row = first_row + int32_t(num_temporaries) - 1;
+
+    while (last_row >= tbl.mappedRows) {
+        growTable(tbl, last_row);
+    }
+
+    // Same sentinel as makeTemporary
+    Entity *entity_column = (Entity *)tbl.columns[0] + first_row;
+    WorldID *world_column = (WorldID *)tbl.columns[1] + first_row;
+
+    for (CountT i = 0; i < num_temporaries; i++) {
+        entity_column[i] = Entity::none();
+        world_column[i] = world_id;
+    }
+
+    return Loc {
+        archetype_id,
+        first_row,
+    };
+}
+
 Loc StateManager::makeTemporary(WorldID world_id,
                                 uint32_t archetype_id)
 {
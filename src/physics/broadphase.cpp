@@ -15,24 +15,36 @@ BVH::BVH(const ObjectManager *obj_mgr,
          CountT max_leaves,
          float leaf_velocity_expansion,
          float leaf_accel_expansion)
+    // The static and dynamic trees together can need up to 2 more nodes
+    // than a single tree over all the leaves
     : nodes_((Node *)rawAlloc(sizeof(Node) *
-                            numInternalNodes(max_leaves))),
+                            (numInternalNodes(max_leaves) + 2))),
       num_nodes_(0),
-      num_allocated_nodes_(numInternalNodes(max_leaves)),
+      num_allocated_nodes_(numInternalNodes(max_leaves) + 2),
       leaf_entities_((Entity *)rawAlloc(sizeof(Entity) * max_leaves)),
       obj_mgr_(obj_mgr), // FIXME, get rid of this
       leaf_obj_ids_((ObjectID *)
                        rawAlloc(sizeof(ObjectID) * max_leaves)),
       leaf_aabbs_((AABB *)rawAlloc(sizeof(AABB) * max_leaves)),
+      leaf_fat_aabbs_((AABB *)rawAlloc(sizeof(AABB) * max_leaves)),
       leaf_transforms_(
           (LeafTransform *)rawAlloc(sizeof(LeafTransform) * max_leaves)),
       leaf_parents_((uint32_t *)rawAlloc(sizeof(uint32_t) * max_leaves)),
       sorted_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      leaf_static_((uint8_t *)rawAlloc(sizeof(uint8_t) * max_leaves)),
       num_leaves_(0),
       num_allocated_leaves_(max_leaves),
       leaf_velocity_expansion_(leaf_velocity_expansion),
       leaf_accel_expansion_(leaf_accel_expansion),
-      force_rebuild_(true)
+      force_rebuild_(true),
+      num_static_leaves_(0),
+      num_static_nodes_(0),
+      static_dirty_(0),
+      moved_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      num_moved_leaves_(0),
+      rebuild_cost_(0.f),
+      num_rebuilds_(0),
+      num_reinsertions_(0)
 {}
 
 CountT BVH::numInternalNodes(CountT num_leaves) const
@@ -46,10 +58,42 @@ CountT BVH::numInternalNodes(CountT num_leaves) const
 
 void BVH::rebuild()
 {
-    int32_t num_internal_nodes = numInternalNodes(num_leaves_.load_relaxed());
-    num_nodes_ = num_internal_nodes;
+    // Partition the leaves so sorted_leaves_ holds the static leaves
+    // followed by the dynamic ones
+    int32_t num_leaves = num_leaves_.load_relaxed();
+    int32_t num_static = 0;
+    for (int32_t i = 0; i < num_leaves; i++) {
+        num_static += leaf_static_[i];
+    }
+
+    int32_t static_offset = 0;
+    int32_t dynamic_offset = num_static;
+    for (int32_t i = 0; i < num_leaves; i++) {
+        if (leaf_static_[i]) {
+            sorted_leaves_[static_offset++] = i;
+        } else {
+            sorted_leaves_[dynamic_offset++] = i;
+        }
+    }
+
+    num_static_leaves_ = num_static;
+    num_static_nodes_ = buildTree(0, 0, num_static);
+    num_nodes_ = buildTree(num_static_nodes_, num_static,
+                           num_leaves - num_static);
     assert(num_nodes_ <= num_allocated_nodes_);
 
+    static_dirty_.store_relaxed(0);
+    num_moved_leaves_.store_relaxed(0);
+    rebuild_cost_ = refitDynamicTree();
+    num_rebuilds_ += 1;
+}
+
+// Builds a tree over sorted_leaves_[leaf_offset, leaf_offset + num_leaves)
+// with its root at node_offset. Returns the end of the nodes it used.
+int32_t BVH::buildTree(int32_t node_offset,
+                       int32_t leaf_offset,
+                       int32_t num_leaves)
+{
     struct StackEntry {
         int32_t nodeID;
         int32_t parentID;
@@ -61,11 +105,11 @@ void BVH::rebuild()
     stack[0] = StackEntry {
         sentinel_,
         sentinel_,
-        0,
-        int32_t(num_leaves_.load_relaxed()),
+        leaf_offset,
+        num_leaves,
     };
 
-    int32_t cur_node_offset = 0;
+    int32_t cur_node_offset = node_offset;
     CountT stack_size = 1;
 
     while (stack_size > 0) {
@@ -81,7 +125,7 @@ void BVH::rebuild()
                 if (i < entry.numObjs) {
                     int32_t leaf_id = sorted_leaves_[entry.offset + i];
 
-                    const auto &aabb = leaf_aabbs_[leaf_id];
+                    const auto &aabb = leaf_fat_aabbs_[leaf_id];
                     leaf_parents_[leaf_id] =
                         ((uint32_t)node_id << 2) | (uint32_t)i;
 
@@ -111,6 +155,7 @@ void BVH::rebuild()
             Node &node = nodes_[node_id];
             for (CountT i = 0; i < 4; i++) {
                 node.clearChild(i);
+                node.setChildAABB(i, AABB::invalid());
             }
             node.parentID = entry.parentID;
 
@@ -119,7 +164,8 @@ void BVH::rebuild()
                     int32_t base, int32_t num_elems) {
 
                 auto get_center = [this, base](int32_t offset) {
-                    AABB aabb = leaf_aabbs_[sorted_leaves_[base + offset]];
+                    AABB aabb =
+                        leaf_fat_aabbs_[sorted_leaves_[base + offset]];
 
                     return (aabb.pMin + aabb.pMax) / 2.f;
                 };
@@ -435,6 +481,8 @@ void BVH::rebuild()
         }
     }
 #endif
+
+    return cur_node_offset;
 }
 
 static inline AABB expandAABBWithMotion(
@@ -468,20 +516,178 @@ void BVH::updateLeafPosition(LeafID leaf_id,
                              const Quat &rot,
                              const Diag3x3 &scale,
                              const Vector3 &linear_vel,
-                             const AABB &obj_aabb)
+                             const AABB &obj_aabb,
+                             bool is_static)
 {
+    LeafTransform &leaf_txfm = leaf_transforms_[leaf_id.id];
+    bool was_static = leaf_static_[leaf_id.id] != 0;
+
+    if (is_static && was_static) {
+        bool moved =
+            leaf_txfm.pos.x != pos.x || leaf_txfm.pos.y != pos.y ||
+            leaf_txfm.pos.z != pos.z ||
+            leaf_txfm.rot.w != rot.w || leaf_txfm.rot.x != rot.x ||
+            leaf_txfm.rot.y != rot.y || leaf_txfm.rot.z != rot.z ||
+            leaf_txfm.scale.d0 != scale.d0 ||
+            leaf_txfm.scale.d1 != scale.d1 ||
+            leaf_txfm.scale.d2 != scale.d2;
+
+        if (!moved) {
+            return;
+        }
+
+        static_dirty_.store_relaxed(1);
+    } else if (is_static != was_static) {
+        leaf_static_[leaf_id.id] = is_static ? 1 : 0;
+        static_dirty_.store_relaxed(1);
+    }
+
     AABB world_aabb = obj_aabb.applyTRS(pos, rot, scale);
     AABB expanded_aabb = expandAABBWithMotion(world_aabb, linear_vel,
                                               leaf_velocity_expansion_,
                                               leaf_accel_expansion_);
 
     leaf_aabbs_[leaf_id.id] = expanded_aabb;
-    leaf_transforms_[leaf_id.id] = {
+    leaf_txfm = {
         pos,
         rot,
         scale,
     };
-    sorted_leaves_[leaf_id.id] = leaf_id.id;
+
+    // Static leaves and leaves changing trees are placed by the rebuild
+    AABB &fat_aabb = leaf_fat_aabbs_[leaf_id.id];
+    if (is_static || was_static) {
+        fat_aabb = expanded_aabb;
+        return;
+    }
+
+    // Dynamic leaves keep their place in the tree while their fat AABB
+    // contains this step's motion and isn't far larger than a fresh one
+    AABB new_fat_aabb = AABB::merge(expanded_aabb,
+        expandAABBWithMotion(world_aabb, linear_vel,
+            fat_velocity_scale_ * leaf_velocity_expansion_,
+            leaf_accel_expansion_));
+
+    if (fat_aabb.contains(expanded_aabb) && fat_aabb.surfaceArea() <=
+            fat_area_ratio_ * new_fat_aabb.surfaceArea()) {
+        return;
+    }
+
+    fat_aabb = new_fat_aabb;
+
+    int32_t moved_idx = num_moved_leaves_.fetch_add_relaxed(1);
+    if (moved_idx < num_allocated_leaves_) {
+        moved_leaves_[moved_idx] = leaf_id.id;
+    }
+}
+
+namespace {
+
+struct BVHSnapshotHeader {
+    int32_t numNodes;
+    int32_t numLeaves;
+    int32_t forceRebuild;
+    int32_t numStaticLeaves;
+    int32_t numStaticNodes;
+    int32_t staticDirty;
+    int32_t numMovedLeaves;
+    float rebuildCost;
+};
+
+}
+
+uint64_t BVH::snapshotBytes() const
+{
+    uint64_t num_leaves = (uint64_t)num_leaves_.load_relaxed();
+    uint64_t num_moved = (uint64_t)std::min(
+        num_moved_leaves_.load_relaxed(), num_allocated_leaves_);
+
+    return sizeof(BVHSnapshotHeader) +
+        sizeof(Node) * (uint64_t)num_nodes_ +
+        num_leaves * (sizeof(Entity) + sizeof(ObjectID) + 2 * sizeof(AABB) +
+            sizeof(LeafTransform) + sizeof(uint32_t) + sizeof(int32_t) +
+            sizeof(uint8_t)) +
+        num_moved * sizeof(int32_t);
+}
+
+uint64_t BVH::memoryBytes() const
+{
+    return sizeof(Node) * (uint64_t)num_allocated_nodes_ +
+        (uint64_t)num_allocated_leaves_ * (sizeof(Entity) + sizeof(ObjectID) +
+            2 * sizeof(AABB) + sizeof(LeafTransform) + sizeof(uint32_t) +
+            2 * sizeof(int32_t) + sizeof(uint8_t));
+}
+
+void BVH::saveSnapshot(void *dst) const
+{
+    int32_t num_leaves = num_leaves_.load_relaxed();
+    int32_t num_moved = std::min(num_moved_leaves_.load_relaxed(),
+                                 num_allocated_leaves_);
+
+    BVHSnapshotHeader header {
+        .numNodes = int32_t(num_nodes_),
+        .numLeaves = num_leaves,
+        .forceRebuild = force_rebuild_ ? 1 : 0,
+        .numStaticLeaves = num_static_leaves_,
+        .numStaticNodes = num_static_nodes_,
+        .staticDirty = static_dirty_.load_relaxed(),
+        .numMovedLeaves = num_moved_leaves_.load_relaxed(),
+        .rebuildCost = rebuild_cost_,
+    };
+
+    char *cur = (char *)dst;
+    auto save = [&](const void *src, uint64_t num_bytes) {
+        memcpy(cur, src, num_bytes);
+        cur += num_bytes;
+    };
+
+    save(&header, sizeof(BVHSnapshotHeader));
+    save(nodes_, sizeof(Node) * num_nodes_);
+    save(leaf_entities_, sizeof(Entity) * num_leaves);
+    save(leaf_obj_ids_, sizeof(ObjectID) * num_leaves);
+    save(leaf_aabbs_, sizeof(AABB) * num_leaves);
+    save(leaf_fat_aabbs_, sizeof(AABB) * num_leaves);
+    save(leaf_transforms_, sizeof(LeafTransform) * num_leaves);
+    save(leaf_parents_, sizeof(uint32_t) * num_leaves);
+    save(sorted_leaves_, sizeof(int32_t) * num_leaves);
+    save(leaf_static_, sizeof(uint8_t) * num_leaves);
+    save(moved_leaves_, sizeof(int32_t) * num_moved);
+}
+
+void BVH::loadSnapshot(const void *src)
+{
+    BVHSnapshotHeader header;
+    memcpy(&header, src, sizeof(BVHSnapshotHeader));
+
+    assert(header.numNodes <= num_allocated_nodes_);
+    assert(header.numLeaves <= num_allocated_leaves_);
+
+    num_nodes_ = header.numNodes;
+    num_leaves_.store_relaxed(header.numLeaves);
+    force_rebuild_ = header.forceRebuild != 0;
+    num_static_leaves_ = header.numStaticLeaves;
+    num_static_nodes_ = header.numStaticNodes;
+    static_dirty_.store_relaxed(header.staticDirty);
+    num_moved_leaves_.store_relaxed(header.numMovedLeaves);
+    rebuild_cost_ = header.rebuildCost;
+
+    const char *cur = (const char *)src + sizeof(BVHSnapshotHeader);
+    auto load = [&](void *dst, uint64_t num_bytes) {
+        memcpy(dst, cur, num_bytes);
+        cur += num_bytes;
+    };
+
+    load(nodes_, sizeof(Node) * num_nodes_);
+    load(leaf_entities_, sizeof(Entity) * header.numLeaves);
+    load(leaf_obj_ids_, sizeof(ObjectID) * header.numLeaves);
+    load(leaf_aabbs_, sizeof(AABB) * header.numLeaves);
+    load(leaf_fat_aabbs_, sizeof(AABB) * header.numLeaves);
+    load(leaf_transforms_, sizeof(LeafTransform) * header.numLeaves);
+    load(leaf_parents_, sizeof(uint32_t) * header.numLeaves);
+    load(sorted_leaves_, sizeof(int32_t) * header.numLeaves);
+    load(leaf_static_, sizeof(uint8_t) * header.numLeaves);
+    load(moved_leaves_, sizeof(int32_t) *
+         std::min(header.numMovedLeaves, num_allocated_leaves_));
 }
 
 AABB BVH::expandLeaf(LeafID leaf_id,
@@ -549,6 +755,11 @@ MADRONA_ALWAYS_INLINE static inline float atomicMaxF(float *addr, float value)
 
 void BVH::refitLeaf(LeafID leaf_id, const AABB &leaf_aabb)
 {
+    // Static leaves only move if the static tree is marked for a rebuild
+    if (leaf_static_[leaf_id.id] && !static_dirty_.load_relaxed()) {
+        return;
+    }
+
     uint32_t leaf_parent = leaf_parents_[leaf_id.id];
 
     int32_t node_idx = int32_t(leaf_parent >> 2_u32);
@@ -646,13 +857,134 @@ void BVH::refitLeaf(LeafID leaf_id, const AABB &leaf_aabb)
     }
 }
 
+// Surface area that treats the inverted bounds of empty children as 0
+static inline float childArea(const AABB &aabb)
+{
+    if (aabb.pMin.x > aabb.pMax.x) {
+        return 0.f;
+    }
+
+    return aabb.surfaceArea();
+}
+
+void BVH::reinsertLeaf(int32_t leaf_idx)
+{
+    uint32_t leaf_parent = leaf_parents_[leaf_idx];
+    int32_t old_node_idx = int32_t(leaf_parent >> 2_u32);
+    int32_t old_sub_idx = int32_t(leaf_parent & 3);
+
+    Node &old_node = nodes_[old_node_idx];
+    old_node.clearChild(old_sub_idx);
+    old_node.setChildAABB(old_sub_idx, AABB::invalid());
+
+    // Descend the dynamic tree along the children that grow the least and
+    // place the leaf in the deepest node on the way with a free child
+    const AABB &leaf_aabb = leaf_fat_aabbs_[leaf_idx];
+
+    int32_t insert_node_idx = old_node_idx;
+    int32_t node_idx = num_static_nodes_;
+    while (node_idx != sentinel_) {
+        const Node &node = nodes_[node_idx];
+
+        int32_t next_node_idx = sentinel_;
+        float min_growth = FLT_MAX;
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i)) {
+                insert_node_idx = node_idx;
+                continue;
+            }
+
+            if (node.isLeaf(i)) {
+                continue;
+            }
+
+            AABB child_aabb = node.childAABB(i);
+            float growth = childArea(AABB::merge(child_aabb, leaf_aabb)) -
+                childArea(child_aabb);
+
+            if (growth < min_growth) {
+                min_growth = growth;
+                next_node_idx = node.children[i];
+            }
+        }
+
+        node_idx = next_node_idx;
+    }
+
+    Node &insert_node = nodes_[insert_node_idx];
+    CountT sub_idx = 0;
+    while (insert_node.hasChild(sub_idx)) {
+        sub_idx++;
+    }
+
+    insert_node.setLeaf(sub_idx, leaf_idx);
+    insert_node.setChildAABB(sub_idx, leaf_aabb);
+    leaf_parents_[leaf_idx] =
+        ((uint32_t)insert_node_idx << 2) | (uint32_t)sub_idx;
+}
+
+// buildTree numbers nodes depth first, so every child node comes after
+// its parent and one reverse pass refits each node once. Returns the
+// tree's SAH cost: the summed surface area of all children relative to
+// the root's.
+float BVH::refitDynamicTree()
+{
+    float total_area = 0.f;
+    for (int32_t node_idx = int32_t(num_nodes_) - 1;
+         node_idx >= num_static_nodes_; node_idx--) {
+        Node &node = nodes_[node_idx];
+
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i)) {
+                continue;
+            }
+
+            AABB child_aabb;
+            if (node.isLeaf(i)) {
+                child_aabb = leaf_fat_aabbs_[node.leafIDX(i)];
+            } else {
+                child_aabb = nodes_[node.children[i]].mergedAABB();
+            }
+
+            node.setChildAABB(i, child_aabb);
+            total_area += childArea(child_aabb);
+        }
+    }
+
+    float root_area = childArea(nodes_[num_static_nodes_].mergedAABB());
+    if (root_area == 0.f) {
+        return 0.f;
+    }
+
+    return total_area / root_area;
+}
+
 void BVH::updateTree()
 {
-    if (force_rebuild_) {
+    int32_t num_moved = num_moved_leaves_.load_relaxed();
+
+    if (force_rebuild_ || static_dirty_.load_relaxed() ||
+            num_moved > num_allocated_leaves_) {
         force_rebuild_ = false;
         rebuild();
+        return;
+    }
+
+    if (num_moved == 0) {
+        return;
+    }
+
+    num_moved_leaves_.store_relaxed(0);
+
+    for (int32_t i = 0; i < num_moved; i++) {
+        reinsertLeaf(moved_leaves_[i]);
+    }
+    num_reinsertions_ += uint32_t(num_moved);
+
+    float cost = refitDynamicTree();
+    if (cost > rebuild_cost_ratio_ * rebuild_cost_) {
+        rebuild();
     }
-    //rebuild();
 }
 
 Entity BVH::traceRay(Vector3 o,
@@ -666,8 +998,11 @@ Entity BVH::traceRay(Vector3 o,
     Diag3x3 inv_d = Diag3x3::fromVec(d).inv();
 
     int32_t stack[32];
-    stack[0] = 0;
+    stack[0] = num_static_nodes_;
     CountT stack_size = 1;
+    if (num_static_leaves_ > 0) {
+        stack[stack_size++] = 0;
+    }
 
     Entity closest_hit_entity = Entity::none();
     Vector3 closest_hit_normal;
@@ -675,41 +1010,28 @@ Entity BVH::traceRay(Vector3 o,
     while (stack_size > 0) { 
         int32_t node_idx = stack[--stack_size];
         const Node &node = nodes_[node_idx];
-        for (int i = 0; i < 4; i++) {
-            if (!node.hasChild(i)) {
-                continue; // Technically this could be break?
-            };
 
-            madrona::math::AABB child_aabb {
-                /* .pMin = */ {
-                    node.minX[i],
-                    node.minY[i],
-                    node.minZ[i],
-                },
-                /* .pMax = */ {
-                    node.maxX[i],
-                    node.maxY[i],
-                    node.maxZ[i],
-                },
-            };
+        uint32_t hit_mask = node.rayMask(o, inv_d, t_max);
+        for (int i = 0; i < 4; i++) {
+            if ((hit_mask & (1u << i)) == 0) {
+                continue;
+            }
 
-            if (child_aabb.rayIntersects(o, inv_d, 0.f, t_max)) {
-                if (node.isLeaf(i)) {
-                    int32_t leaf_idx = node.leafIDX(i);
-                    
-                    float hit_t;
-                    Vector3 leaf_hit_normal;
-                    bool leaf_hit = traceRayIntoLeaf(
-                        leaf_idx, o, d, 0.f, t_max, &hit_t, &leaf_hit_normal);
-
-                    if (leaf_hit) {
-                        t_max = hit_t;
-                        closest_hit_entity = leaf_entities_[leaf_idx];
-                        closest_hit_normal = leaf_hit_normal;
-                    }
-                } else {
-                    stack[stack_size++] = node.children[i];
+            if (node.isLeaf(i)) {
+                int32_t leaf_idx = node.leafIDX(i);
+                
+                float hit_t;
+                Vector3 leaf_hit_normal;
+                bool leaf_hit = traceRayIntoLeaf(
+                    leaf_idx, o, d, 0.f, t_max, &hit_t, &leaf_hit_normal);
+
+                if (leaf_hit) {
+                    t_max = hit_t;
+                    closest_hit_entity = leaf_entities_[leaf_idx];
+                    closest_hit_normal = leaf_hit_normal;
                 }
+            } else {
+                stack[stack_size++] = node.children[i];
             }
         }
     }
@@ -889,6 +1211,113 @@ bool BVH::traceRayIntoLeaf(int32_t leaf_idx,
     }
 }
 
+SweepAndPrune::SweepAndPrune(CountT max_leaves)
+    : sorted_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      min_x_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      max_x_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      min_y_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      max_y_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      min_z_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      max_z_((float *)rawAlloc(sizeof(float) * (max_leaves + simd_padding_))),
+      leaf_static_((uint8_t *)rawAlloc(sizeof(uint8_t) * max_leaves)),
+      num_leaves_(0),
+      num_allocated_leaves_(max_leaves)
+{}
+
+void SweepAndPrune::update(const BVH &bvh)
+{
+    int32_t num_bvh_leaves = (int32_t)bvh.numLeaves();
+    assert(num_bvh_leaves <= num_allocated_leaves_);
+
+    // Leaves are only ever cleared all at once, so drop the ones past the
+    // BVH's count and append the newly reserved ones in index order
+    if (num_bvh_leaves < num_leaves_) {
+        int32_t num_kept = 0;
+        for (int32_t i = 0; i < num_leaves_; i++) {
+            if (sorted_leaves_[i] < num_bvh_leaves) {
+                sorted_leaves_[num_kept++] = sorted_leaves_[i];
+            }
+        }
+        num_leaves_ = num_kept;
+    }
+
+    for (int32_t leaf_idx = num_leaves_; leaf_idx < num_bvh_leaves;
+         leaf_idx++) {
+        sorted_leaves_[leaf_idx] = leaf_idx;
+    }
+    num_leaves_ = num_bvh_leaves;
+
+    for (int32_t i = 0; i < num_leaves_; i++) {
+        min_x_[i] = bvh.getLeafAABB(LeafID { sorted_leaves_[i] }).pMin.x;
+    }
+
+    // Insertion sort, which only does work for leaves that passed each
+    // other since the last update
+    for (int32_t i = 1; i < num_leaves_; i++) {
+        float key = min_x_[i];
+        int32_t leaf_idx = sorted_leaves_[i];
+
+        int32_t j = i;
+        while (j > 0 && min_x_[j - 1] > key) {
+            min_x_[j] = min_x_[j - 1];
+            sorted_leaves_[j] = sorted_leaves_[j - 1];
+            j--;
+        }
+
+        min_x_[j] = key;
+        sorted_leaves_[j] = leaf_idx;
+    }
+
+    for (int32_t i = 0; i < num_leaves_; i++) {
+        LeafID leaf_id { sorted_leaves_[i] };
+        AABB aabb = bvh.getLeafAABB(leaf_id);
+
+        max_x_[i] = aabb.pMax.x;
+        min_y_[i] = aabb.pMin.y;
+        max_y_[i] = aabb.pMax.y;
+        min_z_[i] = aabb.pMin.z;
+        max_z_[i] = aabb.pMax.z;
+        leaf_static_[i] = bvh.isStaticLeaf(leaf_id) ? 1 : 0;
+    }
+
+    for (int32_t i = num_leaves_; i < num_leaves_ + simd_padding_; i++) {
+        min_x_[i] = INFINITY;
+        max_x_[i] = -INFINITY;
+        min_y_[i] = INFINITY;
+        max_y_[i] = -INFINITY;
+        min_z_[i] = INFINITY;
+        max_z_[i] = -INFINITY;
+    }
+}
+
+uint64_t SweepAndPrune::snapshotBytes() const
+{
+    return sizeof(int32_t) + sizeof(int32_t) * (uint64_t)num_leaves_;
+}
+
+void SweepAndPrune::saveSnapshot(void *dst) const
+{
+    memcpy(dst, &num_leaves_, sizeof(int32_t));
+    memcpy((char *)dst + sizeof(int32_t), sorted_leaves_,
+           sizeof(int32_t) * num_leaves_);
+}
+
+void SweepAndPrune::loadSnapshot(const void *src)
+{
+    memcpy(&num_leaves_, src, sizeof(int32_t));
+    assert(num_leaves_ <= num_allocated_leaves_);
+
+    memcpy(sorted_leaves_, (const char *)src + sizeof(int32_t),
+           sizeof(int32_t) * num_leaves_);
+}
+
+uint64_t SweepAndPrune::memoryBytes() const
+{
+    return (uint64_t)num_allocated_leaves_ *
+            (sizeof(int32_t) + sizeof(uint8_t)) +
+        sizeof(float) * 6 * (uint64_t)(num_allocated_leaves_ + simd_padding_);
+}
+
 inline void updateLeafPositionsEntry(
     Context &ctx,
     const LeafID &leaf_id,
@@ -896,13 +1325,15 @@ inline void updateLeafPositionsEntry(
     const Rotation &rot,
     const Scale &scale,
     const ObjectID &obj_id,
-    const Velocity &vel)
+    const Velocity &vel,
+    const ResponseType &response_type)
 {
     BVH &bvh = ctx.singleton<BVH>();
     ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
     AABB obj_aabb = obj_mgr.rigidBodyAABBs[obj_id.idx];
 
-    bvh.updateLeafPosition(leaf_id, pos, rot, scale, vel.linear, obj_aabb);
+    bvh.updateLeafPosition(leaf_id, pos, rot, scale, vel.linear, obj_aabb,
+                           response_type == ResponseType::Static);
 }
 
 // FIXME currently unused
@@ -921,10 +1352,55 @@ inline void updateBVHEntry(Context &, BVH &bvh)
     bvh.updateTree();
 }
 
-inline void refitEntry(Context &ctx, LeafID leaf_id)
+// Emits a narrowphase check for every pair of primitives in the two
+// entities. a is always the entity with the lower ID.
+static inline void addCandidateCollisions(Context &ctx,
+                                          const ObjectManager &obj_mgr,
+                                          Entity e,
+                                          Loc e_loc,
+                                          Entity other,
+                                          Loc other_loc)
 {
-    BVH &bvh = ctx.singleton<BVH>();
-    bvh.refitLeaf(leaf_id, bvh.getLeafAABB(leaf_id));
+    Loc a_loc = e.id < other.id ? e_loc : other_loc;
+    Loc b_loc = e.id < other.id ? other_loc : e_loc;
+
+    ObjectID a_obj = ctx.getDirect<ObjectID>(RGDCols::ObjectID, a_loc);
+    CountT a_num_prims = obj_mgr.rigidBodyPrimitiveCounts[a_obj.idx];
+
+    // We don't expand the primitive AABBs by movement (only object
+    // AABBs) so we just unconditionally emit narrowphase checks
+    // between each pair of primitives in the entity. Narrowphase
+    // will check transformed AABBs.
+
+    ObjectID b_obj = ctx.getDirect<ObjectID>(RGDCols::ObjectID, b_loc);
+    CountT b_num_prims =
+        obj_mgr.rigidBodyPrimitiveCounts[b_obj.idx];
+
+    CountT total_narrowphase_checks = a_num_prims * b_num_prims;
+
+    Loc candidates_start =
+        ctx.makeTemporaries<CandidateTemporary>(
+            total_narrowphase_checks);
+
+    for (CountT prim_check_idx = 0;
+         prim_check_idx < total_narrowphase_checks;
+         prim_check_idx++) {
+        CountT a_prim_idx = prim_check_idx / b_num_prims;
+        CountT b_prim_idx = prim_check_idx % b_num_prims;
+
+        Loc candidate_loc {
+            candidates_start.archetype,
+            candidates_start.row + int32_t(prim_check_idx),
+        };
+        CandidateCollision &candidate =
+            ctx.getDirect<CandidateCollision>(
+                RGDCols::CandidateCollision, candidate_loc);
+
+        candidate.a = a_loc;
+        candidate.b = b_loc;
+        candidate.aPrim = a_prim_idx;
+        candidate.bPrim = b_prim_idx;
+    }
 }
 
 inline void findIntersectingEntry(
@@ -932,63 +1408,58 @@ inline void findIntersectingEntry(
     const Entity &e,
     LeafID leaf_id)
 {
+    if (ctx.singleton<PhysicsSystemState>().broadphase !=
+            PhysicsSystem::Broadphase::BVH) {
+        return;
+    }
+
     BVH &bvh = ctx.singleton<BVH>();
-    ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
 
-    // FIXME: should have a flag for passing this
-    // directly into the system
-    Loc a_loc = ctx.loc(e);
-    bool a_is_static = 
-        ctx.getDirect<ResponseType>(RGDCols::ResponseType, a_loc) ==
-        ResponseType::Static;
+    // Static leaves never search: static pairs don't collide and pairs
+    // with a dynamic leaf are found when the dynamic leaf searches both
+    // trees
+    if (bvh.isStaticLeaf(leaf_id)) {
+        return;
+    }
 
-    ObjectID a_obj = ctx.getDirect<ObjectID>(RGDCols::ObjectID, a_loc);
+    ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
 
-    CountT a_num_prims = obj_mgr.rigidBodyPrimitiveCounts[a_obj.idx];
+    Loc e_loc = ctx.loc(e);
 
     bvh.findLeafIntersecting(leaf_id, [&](Entity intersecting_entity) {
-        if (e.id < intersecting_entity.id) {
-            Loc b_loc = ctx.loc(intersecting_entity);
-
-            // FIXME: Change this so static objects are kept in a separate BVH
-            // and this check can be removed.
-            if (a_is_static &&
-                ctx.getDirect<ResponseType>(RGDCols::ResponseType, b_loc) ==
-                    ResponseType::Static) {
-                return;
-            }
-
-            // We don't expand the primitive AABBs by movement (only object
-            // AABBs) so we just unconditionally emit narrowphase checks
-            // between each pair of primitives in the entity. Narrowphase
-            // will check transformed AABBs.
-            
-            ObjectID b_obj = ctx.getDirect<ObjectID>(RGDCols::ObjectID, b_loc);
-            CountT b_num_prims =
-                obj_mgr.rigidBodyPrimitiveCounts[b_obj.idx];
-
-            // FIXME: would be nice to be able to make N temporaries all at
-            // once
-            
-            CountT total_narrowphase_checks = a_num_prims * b_num_prims;
-
-            for (CountT prim_check_idx = 0;
-                 prim_check_idx < total_narrowphase_checks;
-                 prim_check_idx++) {
-                CountT a_prim_idx = prim_check_idx / b_num_prims;
-                CountT b_prim_idx = prim_check_idx % b_num_prims;
-
-                Loc candidate_loc = ctx.makeTemporary<CandidateTemporary>();
-                CandidateCollision &candidate =
-                    ctx.getDirect<CandidateCollision>(
-                        RGDCols::CandidateCollision, candidate_loc);
-
-                candidate.a = a_loc;
-                candidate.b = b_loc;
-                candidate.aPrim = a_prim_idx;
-                candidate.bPrim = b_prim_idx;
-            }
+        Loc other_loc = ctx.loc(intersecting_entity);
+        LeafID other_leaf =
+            ctx.getDirect<LeafID>(RGDCols::LeafID, other_loc);
+
+        // Dynamic pairs are found from both sides, so only the lower ID
+        // emits them
+        bool other_is_static = bvh.isStaticLeaf(other_leaf);
+        if (!other_is_static && e.id >= intersecting_entity.id) {
+            return;
         }
+
+        addCandidateCollisions(ctx, obj_mgr, e, e_loc,
+                               intersecting_entity, other_loc);
+    });
+}
+
+inline void sweepAndPruneEntry(Context &ctx, SweepAndPrune &sap)
+{
+    if (ctx.singleton<PhysicsSystemState>().broadphase !=
+            PhysicsSystem::Broadphase::SweepAndPrune) {
+        return;
+    }
+
+    const BVH &bvh = ctx.singleton<BVH>();
+    ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+
+    sap.update(bvh);
+    sap.findOverlappingPairs([&](LeafID a, LeafID b) {
+        Entity a_entity = bvh.getLeafEntity(a);
+        Entity b_entity = bvh.getLeafEntity(b);
+
+        addCandidateCollisions(ctx, obj_mgr, a_entity, ctx.loc(a_entity),
+                               b_entity, ctx.loc(b_entity));
     });
 }
 
@@ -1003,25 +1474,35 @@ TaskGraphNodeID setupBVHTasks(
             Rotation,
             Scale,
             ObjectID,
-            Velocity>>(deps);
+            Velocity,
+            ResponseType>>(deps);
 
     auto bvh_update = builder.addToGraph<ParallelForNode<Context,
         broadphase::updateBVHEntry, broadphase::BVH>>({update_leaves});
 
-    // FIXME Unfortunately need to call refit here, because update
-    // won't necessarily do anything
-    auto refit = builder.addToGraph<ParallelForNode<Context,
-        broadphase::refitEntry, broadphase::LeafID>>({bvh_update});
-
-    return refit;
+    return bvh_update;
 }
 
 TaskGraphNodeID setupPreIntegrationTasks(
     TaskGraphBuilder &builder,
     Span<const TaskGraphNodeID> deps)
 {
+    // Only the broadphase picked in PhysicsSystem::init does any work.
+    // Both create temporaries, so they run one after the other.
+    auto sweep_and_prune = builder.addToGraph<ParallelForNode<Context,
+        broadphase::sweepAndPruneEntry, broadphase::SweepAndPrune>>(deps);
+
+#ifdef MADRONA_GPU_MODE
     auto find_intersects = builder.addToGraph<ParallelForNode<Context,
-        broadphase::findIntersectingEntry, Entity, LeafID>>(deps);
+        broadphase::findIntersectingEntry, Entity, LeafID>>(
+            {sweep_and_prune});
+#else
+    // findIntersectingEntry creates temporaries, which isn't safe to do
+    // concurrently within a world on the CPU backend
+    auto find_intersects = builder.addToGraph<SerialForNode<Context,
+        broadphase::findIntersectingEntry, Entity, LeafID>>(
+            {sweep_and_prune});
+#endif
 
     return find_intersects;
 }
@@ -1035,7 +1516,7 @@ TaskGraphNodeID setupPostIntegrationTasks(
         expandLeavesEntry, LeafID, Velocity>>({deps});
 #endif
 
-    // FIXME: can we avoid doing a full tree refit here?
+    // Only leaves that left their fat AABB during the step are reinserted
     auto update_leaves =
         builder.addToGraph<ParallelForNode<Context, updateLeafPositionsEntry,
             LeafID, 
@@ -1043,12 +1524,13 @@ TaskGraphNodeID setupPostIntegrationTasks(
             Rotation,
             Scale,
             ObjectID,
-            Velocity>>(deps);
+            Velocity,
+            ResponseType>>(deps);
 
-    auto refit = builder.addToGraph<ParallelForNode<Context,
-        broadphase::refitEntry, broadphase::LeafID>>({update_leaves});
+    auto bvh_update = builder.addToGraph<ParallelForNode<Context,
+        broadphase::updateBVHEntry, broadphase::BVH>>({update_leaves});
 
-    return refit;
+    return bvh_update;
 }
 
 }
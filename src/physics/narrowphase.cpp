@@ -656,6 +656,16 @@ struct SATResult {
     SATContact contact;
 };
 
+// Separations are compared with some tolerance, so nearly parallel faces
+// resting on each other keep producing a full face manifold from the same
+// reference face instead of flipping between face and edge contacts, or
+// between the two hulls' faces, from one step to the next. Values from
+// Dirk Gregorius, "The Separating Axis Test between Convex Polyhedra"
+// (GDC 2013).
+constexpr inline float sat_rel_edge_tolerance = 0.90f;
+constexpr inline float sat_rel_face_tolerance = 0.98f;
+constexpr inline float sat_abs_tolerance = 0.0025f;
+
 static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
                               const HullState &a, const HullState &b)
 {
@@ -698,11 +708,15 @@ static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
 
     PROF_START(sat_finish_ctr, narrowphaseSATFinishClocks);
 
-    bool bIsFaceContactA = faceQueryA.separation > edgeQuery.separation;
-    bool bIsFaceContactB = faceQueryB.separation > edgeQuery.separation;
+    float max_face_separation =
+        fmaxf(faceQueryA.separation, faceQueryB.separation);
+    bool is_edge_contact = edgeQuery.separation >
+        sat_rel_edge_tolerance * max_face_separation + sat_abs_tolerance;
 
-    if (bIsFaceContactA || bIsFaceContactB) {
-        bool a_is_ref = faceQueryA.separation >= faceQueryB.separation;
+    if (!is_edge_contact) {
+        bool a_is_ref = faceQueryB.separation <=
+            sat_rel_face_tolerance * faceQueryA.separation +
+            sat_abs_tolerance;
 
         Plane ref_plane = a_is_ref ? faceQueryA.plane : faceQueryB.plane;
         CountT ref_face_idx =
@@ -810,7 +824,7 @@ static Manifold buildFaceContactManifold(
 
         // Find point C which maximizes area of triangle ABC
         float max_tri_area = 0.0f;
-        bool max_tri_sign = 0.f;
+        float max_tri_sign = 1.f;
         for (CountT i = 1; i < num_contacts; i++) {
             Vector3 cur_contact = contacts[i];
             math::Vector3 bc = cur_contact - manifold.contactPoints[1];
@@ -832,10 +846,13 @@ static Manifold buildFaceContactManifold(
         if (max_tri_sign == -1.f) {
             ba = -ba;
             std::swap(manifold.contactPoints[0], manifold.contactPoints[1]);
+            std::swap(manifold.penetrationDepths[0],
+                      manifold.penetrationDepths[1]);
         }
 
         // Select point Q that adds the most area to ABC
-        // Need to check ABQ (BA x AQ), BCQ (CB x QC), and CAQ (AC x QA)
+        // Need to check ABQ (BA x QA), BCQ (CB x QC), and CAQ (AC x QA),
+        // each negative when Q lies outside that edge
 
         Vector3 cb = manifold.contactPoints[2] - manifold.contactPoints[1];
         Vector3 ac = manifold.contactPoints[0] - manifold.contactPoints[2];
@@ -844,12 +861,12 @@ static Manifold buildFaceContactManifold(
         for (CountT i = 1; i < num_contacts; i++) {
             Vector3 cur_contact = contacts[i];
 
-            Vector3 aq = manifold.contactPoints[0] - cur_contact;
+            Vector3 qa = cur_contact - manifold.contactPoints[0];
             Vector3 qc = cur_contact - manifold.contactPoints[2];
 
-            float abq_area = contact_normal.dot(cross(ba, aq));
+            float abq_area = contact_normal.dot(cross(ba, qa));
             float bcq_area = contact_normal.dot(cross(cb, qc));
-            float caq_area = contact_normal.dot(cross(aq, ac));
+            float caq_area = contact_normal.dot(cross(ac, qa));
 
             float q_min_area = fminf(abq_area, fminf(bcq_area, caq_area));
             if (q_min_area < most_neg_area) {
@@ -860,8 +877,13 @@ static Manifold buildFaceContactManifold(
             }
         }
 
-        assert(max_dist_sq != 0.f && max_tri_area != 0.f &&
-               most_neg_area != 0.f);
+        assert(max_dist_sq != 0.f && max_tri_area != 0.f);
+
+        // Every other point is inside ABC, for instance when clipping left
+        // duplicate vertices
+        if (most_neg_area == 0.f) {
+            manifold.numContactPoints = 3;
+        }
     }
 
     for (CountT i = 0; i < (CountT)manifold.numContactPoints; i++) {
@@ -1948,7 +1970,9 @@ TaskGraphNodeID setupTasks(
     auto narrowphase = builder.addToGraph<CustomParallelForNode<Context,
         runNarrowphaseSystem, 32, 32, CandidateCollision>>(deps);
 #else
-    auto narrowphase = builder.addToGraph<ParallelForNode<Context,
+    // Contacts are created as temporaries, see
+    // broadphase::setupPreIntegrationTasks
+    auto narrowphase = builder.addToGraph<SerialForNode<Context,
         runNarrowphaseSystem, CandidateCollision>>(deps);
 #endif
 
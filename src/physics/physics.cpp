@@ -75,7 +75,8 @@ static void initPhysicsState(Context &ctx,
                              CountT num_substeps,
                              Vector3 gravity,
                              uint32_t contact_archetype_id,
-                             uint32_t joint_archetype_id)
+                             uint32_t joint_archetype_id,
+                             PhysicsSystem::Broadphase broadphase_type)
 {
     float h = delta_t / (float)num_substeps;
     float g_mag = gravity.length();
@@ -88,6 +89,7 @@ static void initPhysicsState(Context &ctx,
         .restitutionThreshold = 2.f * g_mag * h,
         .contactArchetypeID = contact_archetype_id,
         .jointArchetypeID = joint_archetype_id,
+        .broadphase = broadphase_type,
     };
 }
 
@@ -99,7 +101,8 @@ void init(Context &ctx,
           CountT num_substeps,
           math::Vector3 gravity,
           CountT max_dynamic_objects,
-          Solver solver)
+          Solver solver,
+          Broadphase broadphase_type)
 {
     broadphase::BVH &bvh = ctx.singleton<broadphase::BVH>();
 
@@ -110,6 +113,13 @@ void init(Context &ctx,
         obj_mgr, max_dynamic_objects, 2.f * delta_t,
         max_inst_accel * delta_t * delta_t);
 
+    // Only allocate the sweep and prune lists if they're used
+    broadphase::SweepAndPrune &sap =
+        ctx.singleton<broadphase::SweepAndPrune>();
+    new (&sap) broadphase::SweepAndPrune(
+        broadphase_type == Broadphase::SweepAndPrune ?
+            max_dynamic_objects : 0);
+
     uint32_t contact_archetype_id, joint_archetype_id;
     switch (solver) {
     case Solver::XPBD: {
@@ -125,14 +135,14 @@ void init(Context &ctx,
 
     initPhysicsState(
         ctx, delta_t, num_substeps, gravity,
-        contact_archetype_id, joint_archetype_id);
+        contact_archetype_id, joint_archetype_id, broadphase_type);
 
     switch (solver) {
     case Solver::XPBD: {
         xpbd::init(ctx);
     } break;
     case Solver::TGS: {
-        tgs::init(ctx);
+        tgs::init(ctx, max_dynamic_objects);
     } break;
     default: MADRONA_UNREACHABLE();
     }
@@ -315,11 +325,18 @@ void registerTypes(ECSRegistry &registry,
     registry.registerComponent<ExternalTorque>();
 
     registry.registerSingleton<broadphase::BVH>();
+    registry.registerSingletonSnapshot<broadphase::BVH>();
+    registry.registerSingleton<broadphase::SweepAndPrune>();
+    registry.registerSingletonSnapshot<broadphase::SweepAndPrune>();
 
     registry.registerComponent<CollisionEvent>();
     registry.registerArchetype<CollisionEventTemporary>();
 
     registry.registerComponent<CandidateCollision>();
+    // Not ArchetypeFlags::VirtualColumns, nor Contact: clear() keeps the
+    // rows allocated, so these only reallocate until they reach their
+    // peak size, and the extra mappings per world run into
+    // vm.max_map_count with a few thousand worlds.
     registry.registerArchetype<CandidateTemporary>();
 
     registry.registerComponent<JointConstraint>();
@@ -12,6 +12,7 @@ struct PhysicsSystemState {
     float restitutionThreshold;
     uint32_t contactArchetypeID;
     uint32_t jointArchetypeID;
+    PhysicsSystem::Broadphase broadphase;
 };
 
 struct CandidateTemporary : Archetype<CandidateCollision> {};
@@ -41,6 +42,7 @@ TaskGraphNodeID setupTasks(
 }
 
 namespace RGDCols {
+    constexpr inline CountT Entity = 0;
     constexpr inline CountT Position = 2;
     constexpr inline CountT Rotation = 3;
     constexpr inline CountT Scale = 4;
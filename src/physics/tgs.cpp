@@ -9,8 +9,55 @@
 
 namespace madrona::phys::tgs {
 
-struct Contact : Archetype<ContactConstraint> {};
-struct Joint : Archetype<JointConstraint> {};
+using namespace base;
+using namespace math;
+
+// Per manifold solver data, filled in by prepareContacts. Jacobians and
+// effective masses are fixed for the step, using the world space anchors
+// and inertia at its start: rAxN is rA x n and angNA is the angular
+// velocity change of A per unit normal impulse. The body space anchors
+// track the current separation across substeps.
+//
+// Friction acts once per manifold, at the centre of its points: two
+// tangent directions plus a twist about the normal, all bounded by the
+// manifold's total normal impulse.
+struct TGSContactState {
+    Vector3 localA[4];
+    Vector3 localB[4];
+    Vector3 rAxN[4];
+    Vector3 rBxN[4];
+    Vector3 angNA[4];
+    Vector3 angNB[4];
+    float normalMass[4];
+    float normalImpulse[4];
+    float maxNormalImpulse[4];
+    float relativeVelocity[4];
+    Vector3 tangents[2];
+    Vector3 cAxT[2];
+    Vector3 cBxT[2];
+    Vector3 angTA[2];
+    Vector3 angTB[2];
+    float tangentMass[2];
+    float tangentImpulse[2];
+    Vector3 angTwistA;
+    Vector3 angTwistB;
+    float twistMass;
+    float twistImpulse;
+    float twistRadius;
+    float invMassA;
+    float invMassB;
+    float friction;
+};
+
+// Impulses accumulated by each joint axis. Joints are rebuilt every step
+// without any persistent identity, so these only carry across substeps.
+struct TGSJointState {
+    Vector3 linearImpulse;
+    Vector3 angularImpulse;
+};
+
+struct Contact : Archetype<ContactConstraint, TGSContactState> {};
+struct Joint : Archetype<JointConstraint, TGSJointState> {};
 
 // Any per-body solver state would go in components in this bundle
 // (check XPBDRigidBodyState for example).
@@ -18,15 +65,225 @@ struct TGSRigidBodyState : Bundle<
 > {};
 
 struct SolverState {
-    Query<JointConstraint> jointQuery;
-    Query<ContactConstraint> contactQuery;
+    Query<JointConstraint, TGSJointState> jointQuery;
+    Query<ContactConstraint, TGSContactState> contactQuery;
 };
 
-using namespace base;
-using namespace math;
+// Contact impulses from the end of the previous step, keyed by body pair,
+// used to warm start the contacts narrowphase finds for the current step.
+// Narrowphase may pick either body of a pair as the reference, so entries
+// are found in either order and keep their points in both bodies' spaces.
+// Entries are stamped with the step that stored them, so the table never
+// needs to be cleared: anything with an older stamp is an empty slot.
+class ContactCache {
+public:
+    struct Entry {
+        Entity ref;
+        Entity alt;
+        uint32_t step;
+        int32_t numPoints;
+        Vector3 normal;
+        Vector3 localPoints[4];
+        Vector3 altLocalPoints[4];
+        float normalImpulses[4];
+        Vector3 frictionImpulse;
+        float twistImpulse;
+    };
+
+    ContactCache(CountT max_objects);
+
+    // Invalidates everything stored so far; call before storing a step
+    void nextStep();
+    void store(const Entry &entry);
+
+    // Returns the entry stored for this pair with a normal close to
+    // normal, or nullptr. swapped is set if the entry was stored with
+    // ref and alt the other way around (and the opposite normal).
+    const Entry * find(Entity ref, Entity alt, Vector3 normal,
+                       bool *swapped) const;
+
+    uint64_t snapshotBytes() const;
+    void saveSnapshot(void *dst) const;
+    void loadSnapshot(const void *src);
+
+    uint64_t memoryBytes() const;
+
+private:
+    struct SnapshotHeader {
+        uint32_t step;
+        int32_t numStored;
+    };
+
+    inline uint32_t slot(Entity ref, Entity alt) const;
+
+    Entry *entries_;
+    uint32_t mask_;
+    uint32_t step_;
+    int32_t num_stored_;
+    int32_t max_stored_;
+};
+
+// Contact and joint softness. Damping ratios and the joint stiffness are
+// Box2D v3's defaults. Contacts are stiffer than its 30Hz so tall stacks
+// don't lean under the weight above them, but the stiffness is capped at
+// a quarter of the substep rate, which keeps few substeps stable.
+constexpr inline float contact_hertz = 120.f;
+constexpr inline float contact_damping_ratio = 10.f;
+constexpr inline float joint_hertz = 60.f;
+constexpr inline float joint_damping_ratio = 2.f;
+
+// Caps the speed at which overlapping bodies are pushed apart
+constexpr inline float max_push_out_velocity = 3.f;
+
+// Penetration left uncorrected. Narrowphase only runs once per step and
+// only reports overlapping pairs, so resting contacts need to stay
+// slightly overlapped to be found again next step.
+constexpr inline float linear_slop = 0.005f;
+
+// Restitution coefficient, fixed like XPBD's until materials carry one.
+// Only applied to points approaching faster than the system's
+// restitutionThreshold.
+constexpr inline float restitution = 0.3f;
+
+// Cached contact points further apart than this (in the reference body's
+// space) or with normals further apart than the dot product threshold
+// are treated as new contacts
+constexpr inline float warm_start_match_distance = 0.05f;
+constexpr inline float warm_start_normal_threshold = 0.95f;
+
+ContactCache::ContactCache(CountT max_objects)
+    : entries_(nullptr),
+      mask_(0),
+      step_(1),
+      num_stored_(0),
+      max_stored_(0)
+{
+    // Room for about two manifolds per body at half load
+    uint32_t capacity = 16;
+    while (capacity < 4 * (uint64_t)max_objects) {
+        capacity *= 2;
+    }
+
+    entries_ = (Entry *)rawAlloc(sizeof(Entry) * capacity);
+    for (uint32_t i = 0; i < capacity; i++) {
+        entries_[i].step = 0;
+    }
+
+    mask_ = capacity - 1;
+    max_stored_ = (int32_t)(capacity / 2);
+}
+
+uint32_t ContactCache::slot(Entity ref, Entity alt) const
+{
+    // Both orders of a pair hash to the same slot
+    uint32_t lo = (uint32_t)std::min(ref.id, alt.id);
+    uint32_t hi = (uint32_t)std::max(ref.id, alt.id);
+
+    uint32_t h = lo * 0x9E3779B1u;
+    h ^= hi * 0x85EBCA77u;
+    h ^= h >> 15;
+
+    return h & mask_;
+}
+
+void ContactCache::nextStep()
+{
+    step_ += 1;
+    num_stored_ = 0;
+}
+
+void ContactCache::store(const Entry &entry)
+{
+    // Contacts past the load limit simply aren't warm started next step
+    if (num_stored_ >= max_stored_) {
+        return;
+    }
+
+    uint32_t idx = slot(entry.ref, entry.alt);
+    while (entries_[idx].step == step_) {
+        idx = (idx + 1) & mask_;
+    }
+
+    entries_[idx] = entry;
+    entries_[idx].step = step_;
+    num_stored_ += 1;
+}
+
+const ContactCache::Entry * ContactCache::find(
+    Entity ref, Entity alt, Vector3 normal, bool *swapped) const
+{
+    uint32_t idx = slot(ref, alt);
+    while (entries_[idx].step == step_) {
+        const Entry &entry = entries_[idx];
+        if (entry.ref == ref && entry.alt == alt &&
+                dot(entry.normal, normal) > warm_start_normal_threshold) {
+            *swapped = false;
+            return &entry;
+        }
+
+        if (entry.ref == alt && entry.alt == ref &&
+                -dot(entry.normal, normal) > warm_start_normal_threshold) {
+            *swapped = true;
+            return &entry;
+        }
+
+        idx = (idx + 1) & mask_;
+    }
+
+    return nullptr;
+}
+
+uint64_t ContactCache::snapshotBytes() const
+{
+    return sizeof(SnapshotHeader) + sizeof(Entry) * (uint64_t)num_stored_;
+}
+
+void ContactCache::saveSnapshot(void *dst) const
+{
+    SnapshotHeader header {
+        .step = step_,
+        .numStored = num_stored_,
+    };
+    memcpy(dst, &header, sizeof(SnapshotHeader));
+
+    Entry *out = (Entry *)((char *)dst + sizeof(SnapshotHeader));
+    for (uint32_t i = 0; i <= mask_; i++) {
+        if (entries_[i].step == step_) {
+            memcpy(out++, &entries_[i], sizeof(Entry));
+        }
+    }
+}
+
+void ContactCache::loadSnapshot(const void *src)
+{
+    SnapshotHeader header;
+    memcpy(&header, src, sizeof(SnapshotHeader));
+
+    for (uint32_t i = 0; i <= mask_; i++) {
+        entries_[i].step = 0;
+    }
+
+    step_ = header.step;
+    num_stored_ = 0;
+
+    const char *entries = (const char *)src + sizeof(SnapshotHeader);
+    for (int32_t i = 0; i < header.numStored; i++) {
+        Entry entry;
+        memcpy(&entry, entries + sizeof(Entry) * i, sizeof(Entry));
+        store(entry);
+    }
+}
+
+uint64_t ContactCache::memoryBytes() const
+{
+    return sizeof(Entry) * ((uint64_t)mask_ + 1);
+}
 
 void registerTypes(ECSRegistry &registry)
 {
+    registry.registerComponent<TGSContactState>();
+    registry.registerComponent<TGSJointState>();
+
     registry.registerArchetype<Joint>();
     registry.registerArchetype<Contact>();
 
@@ -39,14 +296,18 @@ void registerTypes(ECSRegistry &registry)
     registry.registerBundleAlias<SolverBundleAlias, TGSRigidBodyState>();
 
     registry.registerSingleton<SolverState>();
+    registry.registerSingleton<ContactCache>();
+    registry.registerSingletonSnapshot<ContactCache>();
 }
 
-void init(Context &ctx)
+void init(Context &ctx, CountT max_objects)
 {
     new (&ctx.singleton<SolverState>()) SolverState {
-        .jointQuery = ctx.query<JointConstraint>(),
-        .contactQuery = ctx.query<ContactConstraint>(),
+        .jointQuery = ctx.query<JointConstraint, TGSJointState>(),
+        .contactQuery = ctx.query<ContactConstraint, TGSContactState>(),
     };
+
+    new (&ctx.singleton<ContactCache>()) ContactCache(max_objects);
 }
 
 void getSolverArchetypeIDs(uint32_t *contact_archetype_id,
@@ -56,38 +317,676 @@ void getSolverArchetypeIDs(uint32_t *contact_archetype_id,
     *joint_archetype_id = TypeTracker::typeID<Joint>();
 }
 
+// Soft constraint coefficients for a spring of the given stiffness and
+// damping ratio, applied over a substep of length h
+struct Softness {
+    float biasRate;
+    float massScale;
+    float impulseScale;
+};
+
+static inline Softness makeSoft(float hertz, float zeta, float h)
+{
+    if (hertz == 0.f) {
+        return { 0.f, 1.f, 0.f };
+    }
+
+    float omega = 2.f * pi * hertz;
+    float a1 = 2.f * zeta + h * omega;
+    float a2 = h * omega * a1;
+    float a3 = 1.f / (1.f + a2);
+
+    return {
+        .biasRate = omega / a1,
+        .massScale = a2 * a3,
+        .impulseScale = a3,
+    };
+}
+
+static inline Vector3 multDiag(Vector3 diag, Vector3 v)
+{
+    return Vector3 {
+        diag.x * v.x,
+        diag.y * v.y,
+        diag.z * v.z,
+    };
+}
+
+// Applies the body space diagonal inverse inertia tensor to a world
+// space vector
+static inline Vector3 applyInvInertia(Quat q, Vector3 inv_I, Vector3 v)
+{
+    return q.rotateVec(multDiag(inv_I, q.inv().rotateVec(v)));
+}
+
+// Inverse inertia tensor in world space, held fixed for the step
+static inline Mat3x3 worldInvInertia(Quat q, Vector3 inv_I)
+{
+    Mat3x3 rot = Mat3x3::fromQuat(q);
+    return (rot * Diag3x3::fromVec(inv_I)) * rot.transpose();
+}
+
+static inline float invOrZero(float k)
+{
+    return k > 0.f ? 1.f / k : 0.f;
+}
+
+static inline float effectiveMass(Quat q1, Quat q2,
+                                  float inv_m1, float inv_m2,
+                                  Vector3 inv_I1, Vector3 inv_I2,
+                                  Vector3 r1, Vector3 r2,
+                                  Vector3 dir)
+{
+    Vector3 r1_x_dir = cross(r1, dir);
+    Vector3 r2_x_dir = cross(r2, dir);
+
+    float k = inv_m1 + inv_m2 +
+        dot(r1_x_dir, applyInvInertia(q1, inv_I1, r1_x_dir)) +
+        dot(r2_x_dir, applyInvInertia(q2, inv_I2, r2_x_dir));
+
+    return k > 0.f ? 1.f / k : 0.f;
+}
+
+static inline void getInverseMass(Context &ctx,
+                                  const ObjectManager &obj_mgr,
+                                  Loc loc,
+                                  float *inv_m,
+                                  Vector3 *inv_I)
+{
+    ResponseType resp_type = ctx.getDirect<ResponseType>(
+        RGDCols::ResponseType, loc);
+
+    if (resp_type == ResponseType::Static) {
+        *inv_m = 0.f;
+        *inv_I = Vector3::zero();
+        return;
+    }
+
+    ObjectID obj_id = ctx.getDirect<ObjectID>(RGDCols::ObjectID, loc);
+    const RigidBodyMetadata &metadata = obj_mgr.metadata[obj_id.idx];
+
+    *inv_m = metadata.mass.invMass;
+    *inv_I = metadata.mass.invInertiaTensor;
+}
+
+// Any two unit vectors perpendicular to n and each other
+static inline void computeTangents(Vector3 n, Vector3 *t1, Vector3 *t2)
+{
+    Vector3 axis = fabsf(n.x) < 0.57735f ?
+        Vector3 { 1, 0, 0 } : Vector3 { 0, 1, 0 };
+
+    *t1 = normalize(cross(n, axis));
+    *t2 = cross(n, *t1);
+}
+
+inline void prepareContacts(Context &ctx,
+                            const ContactConstraint &contact,
+                            TGSContactState &state)
+{
+    const ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+    const ContactCache &cache = ctx.singleton<ContactCache>();
+
+    Vector3 x1 = ctx.getDirect<Position>(RGDCols::Position, contact.ref);
+    Vector3 x2 = ctx.getDirect<Position>(RGDCols::Position, contact.alt);
+    Quat q1 = ctx.getDirect<Rotation>(RGDCols::Rotation, contact.ref);
+    Quat q2 = ctx.getDirect<Rotation>(RGDCols::Rotation, contact.alt);
+    Velocity vel1 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.ref);
+    Velocity vel2 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.alt);
+
+    float inv_m1, inv_m2;
+    Vector3 inv_I1, inv_I2;
+    getInverseMass(ctx, obj_mgr, contact.ref, &inv_m1, &inv_I1);
+    getInverseMass(ctx, obj_mgr, contact.alt, &inv_m2, &inv_I2);
+
+    Mat3x3 inv_I1_world = worldInvInertia(q1, inv_I1);
+    Mat3x3 inv_I2_world = worldInvInertia(q2, inv_I2);
+
+    state.invMassA = inv_m1;
+    state.invMassB = inv_m2;
+
+    ObjectID obj_id1 = ctx.getDirect<ObjectID>(
+        RGDCols::ObjectID, contact.ref);
+    ObjectID obj_id2 = ctx.getDirect<ObjectID>(
+        RGDCols::ObjectID, contact.alt);
+
+    state.friction = 0.5f * (obj_mgr.metadata[obj_id1.idx].friction.muS +
+                             obj_mgr.metadata[obj_id2.idx].friction.muS);
+
+    Vector3 n = contact.normal;
+    Quat to_local1 = q1.inv();
+    Quat to_local2 = q2.inv();
+
+    Vector3 center1 = Vector3::zero();
+    Vector3 center2 = Vector3::zero();
+    Vector3 r1s[4];
+
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        // Each point lies on the reference body, penetration depth along
+        // the normal into the other
+        Vector3 p1 = contact.points[i].xyz();
+        Vector3 p2 = p1 - n * contact.points[i].w;
+
+        Vector3 r1 = p1 - x1;
+        Vector3 r2 = p2 - x2;
+
+        state.localA[i] = to_local1.rotateVec(r1);
+        state.localB[i] = to_local2.rotateVec(r2);
+
+        Vector3 r1_x_n = cross(r1, n);
+        Vector3 r2_x_n = cross(r2, n);
+        state.rAxN[i] = r1_x_n;
+        state.rBxN[i] = r2_x_n;
+        state.angNA[i] = inv_I1_world * r1_x_n;
+        state.angNB[i] = inv_I2_world * r2_x_n;
+
+        state.normalMass[i] = invOrZero(inv_m1 + inv_m2 +
+            dot(r1_x_n, state.angNA[i]) + dot(r2_x_n, state.angNB[i]));
+
+        state.normalImpulse[i] = 0.f;
+        state.maxNormalImpulse[i] = 0.f;
+        state.relativeVelocity[i] = dot(vel2.linear - vel1.linear, n) +
+            dot(vel2.angular, r2_x_n) - dot(vel1.angular, r1_x_n);
+
+        r1s[i] = r1;
+        center1 += r1;
+        center2 += r2;
+    }
+
+    float inv_num_points = 1.f / (float)contact.numPoints;
+    center1 *= inv_num_points;
+    center2 *= inv_num_points;
+
+    // Twist friction acts as if the normal force were spread evenly at
+    // the points' average distance from the centre
+    float twist_radius = 0.f;
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        Vector3 offset = r1s[i] - center1;
+        offset -= dot(offset, n) * n;
+        twist_radius += offset.length();
+    }
+    state.twistRadius = twist_radius * inv_num_points;
+
+    computeTangents(n, &state.tangents[0], &state.tangents[1]);
+    for (CountT j = 0; j < 2; j++) {
+        Vector3 t = state.tangents[j];
+
+        Vector3 c1_x_t = cross(center1, t);
+        Vector3 c2_x_t = cross(center2, t);
+        state.cAxT[j] = c1_x_t;
+        state.cBxT[j] = c2_x_t;
+        state.angTA[j] = inv_I1_world * c1_x_t;
+        state.angTB[j] = inv_I2_world * c2_x_t;
+
+        state.tangentMass[j] = invOrZero(inv_m1 + inv_m2 +
+            dot(c1_x_t, state.angTA[j]) + dot(c2_x_t, state.angTB[j]));
+        state.tangentImpulse[j] = 0.f;
+    }
+
+    state.angTwistA = inv_I1_world * n;
+    state.angTwistB = inv_I2_world * n;
+    state.twistMass = invOrZero(
+        dot(n, state.angTwistA) + dot(n, state.angTwistB));
+    state.twistImpulse = 0.f;
+
+    bool swapped;
+    const ContactCache::Entry *cached = cache.find(
+        ctx.getDirect<Entity>(RGDCols::Entity, contact.ref),
+        ctx.getDirect<Entity>(RGDCols::Entity, contact.alt),
+        n, &swapped);
+
+    if (cached == nullptr) {
+        return;
+    }
+
+    // With the bodies swapped, the same physical impulses push along the
+    // opposite normal from the other body: normal and twist impulses keep
+    // their sign, the friction impulse flips
+    const Vector3 *cached_points =
+        swapped ? cached->altLocalPoints : cached->localPoints;
+    Vector3 friction_impulse =
+        swapped ? -cached->frictionImpulse : cached->frictionImpulse;
+
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        CountT closest = -1;
+        float closest_dist2 =
+            warm_start_match_distance * warm_start_match_distance;
+        for (CountT j = 0; j < cached->numPoints; j++) {
+            float dist2 =
+                (cached_points[j] - state.localA[i]).length2();
+            if (dist2 < closest_dist2) {
+                closest = j;
+                closest_dist2 = dist2;
+            }
+        }
+
+        if (closest != -1) {
+            state.normalImpulse[i] = cached->normalImpulses[closest];
+        }
+    }
+
+    state.tangentImpulse[0] = dot(friction_impulse, state.tangents[0]);
+    state.tangentImpulse[1] = dot(friction_impulse, state.tangents[1]);
+    state.twistImpulse = cached->twistImpulse;
+}
+
+inline void prepareJoints(Context &,
+                          TGSJointState &state)
+{
+    state.linearImpulse = Vector3::zero();
+    state.angularImpulse = Vector3::zero();
+}
+
+// Velocities of a contact's two bodies, updated in registers while its
+// constraints are solved
+struct ContactBodies {
+    Vector3 v1;
+    Vector3 omega1;
+    Vector3 v2;
+    Vector3 omega2;
+};
+
+static inline float normalVelocity(const ContactBodies &b,
+                                   const TGSContactState &state,
+                                   Vector3 n,
+                                   CountT i)
+{
+    return dot(b.v2 - b.v1, n) +
+        dot(b.omega2, state.rBxN[i]) - dot(b.omega1, state.rAxN[i]);
+}
+
+static inline void applyNormalImpulse(ContactBodies &b,
+                                      const TGSContactState &state,
+                                      Vector3 n,
+                                      CountT i,
+                                      float impulse)
+{
+    b.v1 -= (impulse * state.invMassA) * n;
+    b.omega1 -= impulse * state.angNA[i];
+    b.v2 += (impulse * state.invMassB) * n;
+    b.omega2 += impulse * state.angNB[i];
+}
+
+static inline void applyFrictionImpulse(ContactBodies &b,
+                                        const TGSContactState &state,
+                                        Vector3 n,
+                                        float impulse0,
+                                        float impulse1,
+                                        float twist_impulse)
+{
+    Vector3 P = impulse0 * state.tangents[0] + impulse1 * state.tangents[1];
+
+    b.v1 -= state.invMassA * P;
+    b.omega1 -= impulse0 * state.angTA[0] + impulse1 * state.angTA[1] +
+        twist_impulse * state.angTwistA;
+    b.v2 += state.invMassB * P;
+    b.omega2 += impulse0 * state.angTB[0] + impulse1 * state.angTB[1] +
+        twist_impulse * state.angTwistB;
+}
+
+static inline void warmStartContact(Context &ctx,
+                                    const ContactConstraint &contact,
+                                    const TGSContactState &state)
+{
+    Velocity &vel1 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.ref);
+    Velocity &vel2 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.alt);
+
+    ContactBodies b {
+        vel1.linear, vel1.angular, vel2.linear, vel2.angular };
+
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        applyNormalImpulse(b, state, contact.normal, i,
+                           state.normalImpulse[i]);
+    }
+
+    applyFrictionImpulse(b, state, contact.normal, state.tangentImpulse[0],
+                         state.tangentImpulse[1], state.twistImpulse);
+
+    vel1 = Velocity { b.v1, b.omega1 };
+    vel2 = Velocity { b.v2, b.omega2 };
+}
+
+static inline void solveContact(Context &ctx,
+                                const ContactConstraint &contact,
+                                TGSContactState &state,
+                                Softness soft,
+                                float inv_h,
+                                bool use_bias)
+{
+    Velocity &vel1 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.ref);
+    Velocity &vel2 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.alt);
+    Vector3 x1 = ctx.getDirect<Position>(RGDCols::Position, contact.ref);
+    Vector3 x2 = ctx.getDirect<Position>(RGDCols::Position, contact.alt);
+    Mat3x3 rot1 = Mat3x3::fromQuat(
+        ctx.getDirect<Rotation>(RGDCols::Rotation, contact.ref));
+    Mat3x3 rot2 = Mat3x3::fromQuat(
+        ctx.getDirect<Rotation>(RGDCols::Rotation, contact.alt));
+
+    ContactBodies b {
+        vel1.linear, vel1.angular, vel2.linear, vel2.angular };
+
+    Vector3 n = contact.normal;
+
+    // Friction first, bounded by the previous normal impulses, so the last
+    // impulses applied are the non-penetration ones
+    float total_normal_impulse = 0.f;
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        total_normal_impulse += state.normalImpulse[i];
+    }
+
+    {
+        float max_friction = state.friction * total_normal_impulse;
+
+        float vt[2];
+        for (CountT j = 0; j < 2; j++) {
+            vt[j] = dot(b.v2 - b.v1, state.tangents[j]) +
+                dot(b.omega2, state.cBxT[j]) - dot(b.omega1, state.cAxT[j]);
+        }
+
+        float old0 = state.tangentImpulse[0];
+        float old1 = state.tangentImpulse[1];
+        float new0 = old0 - state.tangentMass[0] * vt[0];
+        float new1 = old1 - state.tangentMass[1] * vt[1];
+
+        // Clamp to the friction circle rather than per direction
+        float len2 = new0 * new0 + new1 * new1;
+        if (len2 > max_friction * max_friction) {
+            float scale = max_friction / sqrtf(len2);
+            new0 *= scale;
+            new1 *= scale;
+        }
+
+        float max_twist = max_friction * state.twistRadius;
+        float wn = dot(b.omega2 - b.omega1, n);
+        float old_twist = state.twistImpulse;
+        float new_twist = fminf(fmaxf(
+            old_twist - state.twistMass * wn, -max_twist), max_twist);
+
+        state.tangentImpulse[0] = new0;
+        state.tangentImpulse[1] = new1;
+        state.twistImpulse = new_twist;
+
+        applyFrictionImpulse(b, state, n, new0 - old0, new1 - old1,
+                             new_twist - old_twist);
+    }
+
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        // Current separation from the substep's positions, negative when
+        // penetrating
+        Vector3 p1 = rot1 * state.localA[i] + x1;
+        Vector3 p2 = rot2 * state.localB[i] + x2;
+        float s = dot(p2 - p1, n);
+
+        float bias = 0.f;
+        float mass_scale = 1.f;
+        float impulse_scale = 0.f;
+        if (s > 0.f) {
+            // Speculative: allow closing the gap within this substep
+            bias = s * inv_h;
+        } else if (use_bias) {
+            bias = fmaxf(soft.biasRate * fminf(s + linear_slop, 0.f),
+                         -max_push_out_velocity);
+            mass_scale = soft.massScale;
+            impulse_scale = soft.impulseScale;
+        }
+
+        float vn = normalVelocity(b, state, n, i);
+
+        float impulse = -state.normalMass[i] * mass_scale * (vn + bias) -
+            impulse_scale * state.normalImpulse[i];
+
+        float new_impulse = fmaxf(state.normalImpulse[i] + impulse, 0.f);
+        impulse = new_impulse - state.normalImpulse[i];
+        state.normalImpulse[i] = new_impulse;
+        state.maxNormalImpulse[i] =
+            fmaxf(state.maxNormalImpulse[i], new_impulse);
+
+        applyNormalImpulse(b, state, n, i, impulse);
+    }
+
+    vel1 = Velocity { b.v1, b.omega1 };
+    vel2 = Velocity { b.v2, b.omega2 };
+}
+
+// Points that were approaching fast at the start of the step and pushed
+// back on during it leave with a fraction of their approach speed
+static inline void restituteContact(Context &ctx,
+                                    const ContactConstraint &contact,
+                                    TGSContactState &state,
+                                    float threshold)
+{
+    Velocity &vel1 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.ref);
+    Velocity &vel2 = ctx.getDirect<Velocity>(RGDCols::Velocity, contact.alt);
+
+    ContactBodies b {
+        vel1.linear, vel1.angular, vel2.linear, vel2.angular };
+
+    Vector3 n = contact.normal;
+
+    for (CountT i = 0; i < contact.numPoints; i++) {
+        if (state.relativeVelocity[i] > -threshold ||
+                state.maxNormalImpulse[i] == 0.f) {
+            continue;
+        }
+
+        float vn = normalVelocity(b, state, n, i);
+
+        float impulse = -state.normalMass[i] *
+            (vn + restitution * state.relativeVelocity[i]);
+
+        float new_impulse = fmaxf(state.normalImpulse[i] + impulse, 0.f);
+        impulse = new_impulse - state.normalImpulse[i];
+        state.normalImpulse[i] = new_impulse;
+
+        applyNormalImpulse(b, state, n, i, impulse);
+    }
+
+    vel1 = Velocity { b.v1, b.omega1 };
+    vel2 = Velocity { b.v2, b.omega2 };
+}
+
+// Velocity level view of the two bodies a joint connects
+struct JointBodies {
+    Velocity *vel1;
+    Velocity *vel2;
+    Vector3 x1;
+    Vector3 x2;
+    Quat q1;
+    Quat q2;
+    float invM1;
+    float invM2;
+    Vector3 invI1;
+    Vector3 invI2;
+};
+
+static inline JointBodies getJointBodies(Context &ctx,
+                                         const ObjectManager &obj_mgr,
+                                         const JointConstraint &joint)
+{
+    Loc l1 = ctx.loc(joint.e1);
+    Loc l2 = ctx.loc(joint.e2);
+
+    JointBodies bodies;
+    bodies.vel1 = &ctx.getDirect<Velocity>(RGDCols::Velocity, l1);
+    bodies.vel2 = &ctx.getDirect<Velocity>(RGDCols::Velocity, l2);
+    bodies.x1 = ctx.getDirect<Position>(RGDCols::Position, l1);
+    bodies.x2 = ctx.getDirect<Position>(RGDCols::Position, l2);
+    bodies.q1 = ctx.getDirect<Rotation>(RGDCols::Rotation, l1);
+    bodies.q2 = ctx.getDirect<Rotation>(RGDCols::Rotation, l2);
+
+    getInverseMass(ctx, obj_mgr, l1, &bodies.invM1, &bodies.invI1);
+    getInverseMass(ctx, obj_mgr, l2, &bodies.invM2, &bodies.invI2);
+
+    return bodies;
+}
+
+static inline void warmStartJoint(Context &ctx,
+                                  const ObjectManager &obj_mgr,
+                                  const JointConstraint &joint,
+                                  const TGSJointState &state)
+{
+    JointBodies b = getJointBodies(ctx, obj_mgr, joint);
+
+    Vector3 r1 = b.q1.rotateVec(joint.r1);
+    Vector3 r2 = b.q2.rotateVec(joint.r2);
+
+    Vector3 P = state.linearImpulse;
+    Vector3 L = state.angularImpulse;
+
+    b.vel1->linear -= b.invM1 * P;
+    b.vel1->angular += applyInvInertia(b.q1, b.invI1, L - cross(r1, P));
+    b.vel2->linear += b.invM2 * P;
+    b.vel2->angular -= applyInvInertia(b.q2, b.invI2, L - cross(r2, P));
+}
+
+// Drives the rotation error C (measured about axis, with d/dt C equal to
+// dot(omega1 - omega2, axis)) to zero
+static inline void solveJointAngularAxis(JointBodies &b,
+                                         Vector3 &omega1,
+                                         Vector3 &omega2,
+                                         Vector3 &accumulated,
+                                         Vector3 axis,
+                                         float C,
+                                         Softness soft)
+{
+    Vector3 I1_axis = applyInvInertia(b.q1, b.invI1, axis);
+    Vector3 I2_axis = applyInvInertia(b.q2, b.invI2, axis);
+
+    float k = dot(axis, I1_axis) + dot(axis, I2_axis);
+    if (k == 0.f) {
+        return;
+    }
+
+    float Cdot = dot(omega1 - omega2, axis);
+    float impulse = -soft.massScale * (Cdot + soft.biasRate * C) / k -
+        soft.impulseScale * dot(accumulated, axis);
+
+    accumulated += impulse * axis;
+    omega1 += impulse * I1_axis;
+    omega2 -= impulse * I2_axis;
+}
+
+static inline void solveJoint(Context &ctx,
+                              const ObjectManager &obj_mgr,
+                              const JointConstraint &joint,
+                              TGSJointState &state,
+                              Softness soft)
+{
+    JointBodies b = getJointBodies(ctx, obj_mgr, joint);
+
+    Vector3 v1 = b.vel1->linear;
+    Vector3 omega1 = b.vel1->angular;
+    Vector3 v2 = b.vel2->linear;
+    Vector3 omega2 = b.vel2->angular;
+
+    Vector3 target = Vector3::zero();
+
+    switch (joint.type) {
+    case JointConstraint::Type::Fixed: {
+        JointConstraint::Fixed fixed_data = joint.fixed;
+
+        Quat orientation1 = (b.q1 * fixed_data.attachRot1).normalize();
+        Quat orientation2 = (b.q2 * fixed_data.attachRot2).normalize();
+
+        Quat diff = orientation1 * orientation2.inv();
+        if (diff.w < 0.f) {
+            diff = -1.f * diff;
+        }
+
+        Vector3 theta = 2.f * Vector3 { diff.x, diff.y, diff.z };
+
+        for (CountT i = 0; i < 3; i++) {
+            Vector3 axis = Vector3::zero();
+            axis[i] = 1.f;
+
+            solveJointAngularAxis(b, omega1, omega2, state.angularImpulse,
+                                  axis, theta[i], soft);
+        }
+
+        target = fixed_data.separation * orientation1.rotateVec(math::fwd);
+    } break;
+    case JointConstraint::Type::Hinge: {
+        JointConstraint::Hinge hinge_data = joint.hinge;
+
+        Vector3 a1 = b.q1.rotateVec(hinge_data.a1Local);
+        Vector3 a2 = b.q2.rotateVec(hinge_data.a2Local);
+
+        // Only rotation off the hinge axis is constrained
+        Vector3 theta = cross(a2, a1);
+
+        Vector3 perp1, perp2;
+        computeTangents(a1, &perp1, &perp2);
+
+        solveJointAngularAxis(b, omega1, omega2, state.angularImpulse,
+                              perp1, dot(theta, perp1), soft);
+        solveJointAngularAxis(b, omega1, omega2, state.angularImpulse,
+                              perp2, dot(theta, perp2), soft);
+    } break;
+    default: MADRONA_UNREACHABLE();
+    }
+
+    Vector3 r1 = b.q1.rotateVec(joint.r1);
+    Vector3 r2 = b.q2.rotateVec(joint.r2);
+
+    Vector3 C = (b.x2 + r2) - (b.x1 + r1) - target;
+
+    for (CountT i = 0; i < 3; i++) {
+        Vector3 axis = Vector3::zero();
+        axis[i] = 1.f;
+
+        float mass = effectiveMass(b.q1, b.q2, b.invM1, b.invM2,
+                                   b.invI1, b.invI2, r1, r2, axis);
+
+        Vector3 dv = (v2 + cross(omega2, r2)) - (v1 + cross(omega1, r1));
+
+        float impulse = -mass * soft.massScale *
+            (dv[i] + soft.biasRate * C[i]) -
+            soft.impulseScale * state.linearImpulse[i];
+
+        state.linearImpulse[i] += impulse;
+
+        Vector3 P = impulse * axis;
+        v1 -= b.invM1 * P;
+        omega1 -= applyInvInertia(b.q1, b.invI1, cross(r1, P));
+        v2 += b.invM2 * P;
+        omega2 += applyInvInertia(b.q2, b.invI2, cross(r2, P));
+    }
+
+    *b.vel1 = Velocity { v1, omega1 };
+    *b.vel2 = Velocity { v2, omega2 };
+}
+
 static inline void solveJoints(Context &ctx,
                                SolverState &solver,
                                bool use_bias)
 {
-    (void)ctx;
-    (void)solver;
-    (void)use_bias;
+    const ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+    const auto &physics_sys = ctx.singleton<PhysicsSystemState>();
+
+    // The relax pass removes the velocity added by the bias
+    Softness soft = use_bias ?
+        makeSoft(joint_hertz, joint_damping_ratio, physics_sys.h) :
+        Softness { 0.f, 1.f, 0.f };
+
+    ctx.iterateQuery(solver.jointQuery,
+    [&](JointConstraint &joint, TGSJointState &state) {
+        solveJoint(ctx, obj_mgr, joint, state, soft);
+    });
 }
 
 static inline void solveContacts(Context &ctx,
                                  SolverState &solver,
                                  bool use_bias)
 {
-    ctx.iterateQuery(solver.contactQuery, [&](ContactConstraint &contact) {
-        // Solve contact
-        (void)contact;
-        (void)use_bias;
-    });
-}
+    const auto &physics_sys = ctx.singleton<PhysicsSystemState>();
+    float h = physics_sys.h;
 
-inline void prepareContacts(Context &ctx,
-                            ContactConstraint constraint)
-{
-    (void)ctx;
-    (void)constraint;
-}
+    Softness soft = makeSoft(
+        fminf(contact_hertz, 0.25f / h), contact_damping_ratio, h);
 
-inline void prepareJoints(Context &ctx,
-                          JointConstraint constraint)
-{
-    (void)ctx;
-    (void)constraint;
+    ctx.iterateQuery(solver.contactQuery,
+    [&](ContactConstraint &contact, TGSContactState &state) {
+        solveContact(ctx, contact, state, soft, 1.f / h, use_bias);
+    });
 }
 
 inline void integrateVelocities(Context &ctx,
@@ -143,29 +1042,32 @@ inline void integrateVelocities(Context &ctx,
     vel.angular = omega;
 }
 
-inline void warmStartContacts(Context &ctx,
-                              ContactConstraint constraint)
+// Reapplies the impulses accumulated so far, so each substep's solve only
+// has to find a correction. Joints go first to match the solve order.
+static inline void warmStart(Context &ctx,
+                             SolverState &solver)
 {
-    (void)ctx;
-    (void)constraint;
-}
+    const ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
 
-inline void warmStartJoints(Context &ctx,
-                            JointConstraint constraint)
-{
-    (void)ctx;
-    (void)constraint;
-}
+    ctx.iterateQuery(solver.jointQuery,
+    [&](JointConstraint &joint, TGSJointState &state) {
+        warmStartJoint(ctx, obj_mgr, joint, state);
+    });
 
-inline void solveJointsBiased(Context &ctx,
-                              SolverState &solver)
-{
-    solveJoints(ctx, solver, true);
+    ctx.iterateQuery(solver.contactQuery,
+    [&](ContactConstraint &contact, TGSContactState &state) {
+        warmStartContact(ctx, contact, state);
+    });
 }
 
-inline void solveContactsBiased(Context &ctx,
-                                SolverState &solver)
+// Constraints are warm started and solved within a single node per world,
+// instead of one node per pass: the passes are serial anyway, and with
+// small worlds the per node overhead is a large part of a substep.
+inline void solveBiased(Context &ctx,
+                        SolverState &solver)
 {
+    warmStart(ctx, solver);
+    solveJoints(ctx, solver, true);
     solveContacts(ctx, solver, true);
 }
 
@@ -194,16 +1096,62 @@ inline void integratePositions(Context &ctx,
     rot = q;
 }
 
-inline void solveJointsUnbiased(Context &ctx,
-                                SolverState &solver)
+// Removes the velocity the biased solve added to push bodies apart
+inline void relax(Context &ctx,
+                  SolverState &solver)
 {
     solveJoints(ctx, solver, false);
+    solveContacts(ctx, solver, false);
 }
 
-inline void solveContactsUnbiased(Context &ctx,
-                                  SolverState &solver)
+static inline void applyRestitution(Context &ctx,
+                                    SolverState &solver)
 {
-    solveContacts(ctx, solver, false);
+    const auto &physics_sys = ctx.singleton<PhysicsSystemState>();
+    float threshold = physics_sys.restitutionThreshold;
+
+    ctx.iterateQuery(solver.contactQuery,
+    [&](ContactConstraint &contact, TGSContactState &state) {
+        restituteContact(ctx, contact, state, threshold);
+    });
+}
+
+// Saves the final impulses of this step's contacts so next step's
+// prepareContacts can warm start from them
+static inline void storeContactImpulses(Context &ctx,
+                                        SolverState &solver)
+{
+    ContactCache &cache = ctx.singleton<ContactCache>();
+    cache.nextStep();
+
+    ctx.iterateQuery(solver.contactQuery,
+    [&](ContactConstraint &contact, TGSContactState &state) {
+        ContactCache::Entry entry;
+        entry.ref = ctx.getDirect<Entity>(RGDCols::Entity, contact.ref);
+        entry.alt = ctx.getDirect<Entity>(RGDCols::Entity, contact.alt);
+        entry.numPoints = contact.numPoints;
+        entry.normal = contact.normal;
+
+        for (CountT i = 0; i < contact.numPoints; i++) {
+            entry.localPoints[i] = state.localA[i];
+            entry.altLocalPoints[i] = state.localB[i];
+            entry.normalImpulses[i] = state.normalImpulse[i];
+        }
+
+        entry.frictionImpulse =
+            state.tangentImpulse[0] * state.tangents[0] +
+            state.tangentImpulse[1] * state.tangents[1];
+        entry.twistImpulse = state.twistImpulse;
+
+        cache.store(entry);
+    });
+}
+
+inline void finishContacts(Context &ctx,
+                           SolverState &solver)
+{
+    applyRestitution(ctx, solver);
+    storeContactImpulses(ctx, solver);
 }
 
 TaskGraphNodeID setupTGSSolverTasks(
@@ -211,6 +1159,8 @@ TaskGraphNodeID setupTGSSolverTasks(
     TaskGraphNodeID broadphase,
     CountT num_substeps)
 {
+    // Unlike XPBD, narrowphase only runs once per step. Substeps track
+    // the change in separation of each contact point instead.
     auto run_narrowphase = narrowphase::setupTasks(builder, {broadphase});
     auto clear_broadphase = builder.addToGraph<
         ClearTmpNode<CandidateTemporary>>({run_narrowphase});
@@ -236,14 +1186,15 @@ TaskGraphNodeID setupTGSSolverTasks(
 
     cur_node = builder.addToGraph<ParallelForNode<Context,
         prepareContacts,
-            ContactConstraint
+            ContactConstraint,
+            TGSContactState
         >>({cur_node});
 
     cur_node = builder.addToGraph<ParallelForNode<Context,
         prepareJoints,
-            JointConstraint
+            TGSJointState
         >>({cur_node});
-            
+
     for (CountT i = 0; i < num_substeps; i++) {
         cur_node = builder.addToGraph<ParallelForNode<Context,
             integrateVelocities,
@@ -256,22 +1207,7 @@ TaskGraphNodeID setupTGSSolverTasks(
             >>({cur_node});
 
         cur_node = builder.addToGraph<ParallelForNode<Context,
-            warmStartContacts,
-                ContactConstraint
-            >>({cur_node});
-
-        cur_node = builder.addToGraph<ParallelForNode<Context,
-            warmStartContacts,
-                ContactConstraint
-            >>({cur_node});
-         
-        cur_node = builder.addToGraph<ParallelForNode<Context,
-            solveJointsBiased,
-                SolverState
-            >>({cur_node});
-
-        cur_node = builder.addToGraph<ParallelForNode<Context,
-            solveContactsBiased,
+            solveBiased,
                 SolverState
             >>({cur_node});
 
@@ -283,18 +1219,18 @@ TaskGraphNodeID setupTGSSolverTasks(
             >>({cur_node});
 
         cur_node = builder.addToGraph<ParallelForNode<Context,
-            solveJointsUnbiased,
-                SolverState
-            >>({cur_node});
-
-        cur_node = builder.addToGraph<ParallelForNode<Context,
-            solveContactsUnbiased,
+            relax,
                 SolverState
             >>({cur_node});
     }
 
-    // For now, we don't have any persistent contacts support, so clear
-    // the contacts (free the memory).
+    cur_node = builder.addToGraph<ParallelForNode<Context,
+        finishContacts,
+            SolverState
+        >>({cur_node});
+
+    // Contacts are rebuilt by narrowphase each step; their impulses live
+    // on in the ContactCache
     auto clear_contacts = builder.addToGraph<
         ClearTmpNode<Contact>>({cur_node});
 
@@ -1,5 +1,6 @@
 #include <madrona/py/bindings.hpp>
 #include <madrona/crash.hpp>
+#include <madrona/state.hpp>
 
 #include <nanobind/eval.h>
 
@@ -366,6 +367,53 @@ void setupMadronaSubmodule(nb::module_ parent_mod)
                 JAXModule::imp(), iface);
         })
     ;
+
+    nb::class_<MemoryReport>(m, "MemoryReport")
+        .def("to_dict", [](const MemoryReport &report) {
+            auto usageToDict = [](MemoryReport::Usage usage) {
+                nb::dict d;
+                d["committed_bytes"] = usage.committedBytes;
+                d["reserved_bytes"] = usage.reservedBytes;
+                return d;
+            };
+
+            nb::list archetypes;
+            for (const MemoryReport::Archetype &archetype :
+                    report.archetypes) {
+                nb::list columns;
+                for (CountT i = 0; i < (CountT)archetype.numColumns; i++) {
+                    const MemoryReport::Column &column =
+                        report.columns[archetype.columnOffset + i];
+
+                    nb::dict column_dict = usageToDict(column.usage);
+                    column_dict["component_id"] = column.componentID;
+                    column_dict["bytes_per_row"] = column.numBytesPerRow;
+                    columns.append(column_dict);
+                }
+
+                nb::dict archetype_dict = usageToDict(archetype.usage);
+                archetype_dict["archetype_id"] = archetype.archetypeID;
+                archetype_dict["num_rows"] = archetype.numRows;
+                archetype_dict["columns"] = columns;
+                archetypes.append(archetype_dict);
+            }
+
+            nb::list world_bytes;
+            for (uint64_t num_bytes : report.worldCommittedBytes) {
+                world_bytes.append(num_bytes);
+            }
+
+            nb::dict d;
+            d["archetypes"] = archetypes;
+            d["world_committed_bytes"] = world_bytes;
+            d["entity_store"] = usageToDict(report.entityStore);
+            d["tmp_allocators"] = usageToDict(report.tmpAllocators);
+            d["export_buffers"] = usageToDict(report.exportBuffers);
+            d["singletons"] = usageToDict(report.singletons);
+            d["total"] = usageToDict(report.total);
+            return d;
+        })
+    ;
 }
 
 }
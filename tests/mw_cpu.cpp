@@ -0,0 +1,911 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+#include <madrona/sync.hpp>
+
+using namespace madrona;
+
+namespace {
+
+struct Value {
+    uint32_t v;
+};
+
+// Number of times a row was visited since the last VerifyVisits run
+struct Visits {
+    uint32_t count;
+};
+
+struct Row : Archetype<Value, Visits> {};
+
+// Singleton for the nodes that run once per world
+struct WorldSingleton {};
+
+// Singleton that owns memory outside of its row, like the physics BVH
+struct History {
+    uint32_t *values;
+    uint32_t numValues;
+
+    uint64_t snapshotBytes() const
+    {
+        return sizeof(uint32_t) * numValues;
+    }
+
+    void saveSnapshot(void *dst) const
+    {
+        memcpy(dst, values, snapshotBytes());
+    }
+
+    void loadSnapshot(const void *src)
+    {
+        memcpy(values, src, snapshotBytes());
+    }
+};
+
+constexpr uint32_t num_history_values = 16;
+
+enum class TestGraph : uint32_t {
+    Blocks,
+    ChangedBlocks,
+    MarkEnds,
+    VerifyVisits,
+    Step,
+    Grow,
+    Smoke,
+    LateRoot,
+    Fused,
+    NumGraphs,
+};
+
+struct TestConfig {
+    CountT baseRows;
+};
+
+struct TestInit {};
+
+class TestContext;
+
+struct TestWorld : WorldBase {
+    CountT numRows;
+    Entity firstRow;
+    Entity lastRow;
+
+    // Written by blocks that may run concurrently
+    AtomicU32 numBlocks;
+    AtomicU32 numShortBlocks;
+    AtomicU32 numBadBlocks;
+
+    // Written by VerifyVisits, which runs serially
+    uint32_t numVisited;
+    uint32_t numRevisited;
+
+    // Runs of the Fused graph's first node, across all worlds, seen by
+    // this world's second node
+    uint32_t numFirstNodeRuns;
+
+    HeapArray<uint32_t> historyValues;
+    History *history;
+
+    TestWorld(TestContext &ctx, const TestConfig &cfg, const TestInit &);
+
+    static void registerTypes(ECSRegistry &registry, const TestConfig &);
+    static void setupTasks(TaskGraphManager &mgr, const TestConfig &);
+};
+
+class TestContext : public CustomContext<TestContext, TestWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+using TestExecutor =
+    TaskGraphExecutor<TestContext, TestWorld, TestConfig, TestInit>;
+
+constexpr CountT block_rows = ParallelForChunkNode<
+    TestContext, nullptr, Visits>::chunkRows;
+
+// Every world has a different number of rows, so each ends in a short
+// block of a different size
+TestWorld::TestWorld(TestContext &ctx, const TestConfig &cfg,
+                     const TestInit &)
+    : WorldBase(ctx),
+      numRows(cfg.baseRows + ctx.worldID().idx * 37),
+      firstRow(Entity::none()),
+      lastRow(Entity::none()),
+      numBlocks(0),
+      numShortBlocks(0),
+      numBadBlocks(0),
+      numVisited(0),
+      numRevisited(0),
+      numFirstNodeRuns(0),
+      historyValues(num_history_values),
+      history(&ctx.singleton<History>())
+{
+    history->values = historyValues.data();
+    history->numValues = num_history_values;
+    for (uint32_t i = 0; i < num_history_values; i++) {
+        history->values[i] = 0;
+    }
+
+    for (CountT i = 0; i < numRows; i++) {
+        Entity e = ctx.makeEntity<Row>();
+        ctx.get<Value>(e).v = (uint32_t)i;
+        ctx.get<Visits>(e).count = 0;
+
+        if (i == 0) {
+            firstRow = e;
+        }
+        lastRow = e;
+    }
+}
+
+void TestWorld::registerTypes(ECSRegistry &registry, const TestConfig &)
+{
+    registry.registerComponent<Value>();
+    registry.registerComponent<Visits>();
+    registry.registerSingleton<WorldSingleton>();
+    registry.registerSingleton<History>();
+    registry.registerSingletonSnapshot<History>();
+
+    registry.registerArchetype<Row>(
+        ComponentMetadataSelector<Value>(ComponentFlags::TrackChanges |
+                                         ComponentFlags::ExportMemory),
+        ArchetypeFlags::None);
+
+    registry.exportColumn<Row, Value>(0);
+}
+
+static void checkBlock(TestContext &ctx, CountT num_rows, Span<Visits> visits)
+{
+    TestWorld &world = ctx.data();
+
+    world.numBlocks.fetch_add_relaxed(1);
+    if (num_rows < block_rows) {
+        world.numShortBlocks.fetch_add_relaxed(1);
+    }
+
+    if (num_rows > block_rows || visits.size() != num_rows ||
+            (uintptr_t)visits.data() % MADRONA_CACHE_LINE != 0) {
+        world.numBadBlocks.fetch_add_relaxed(1);
+    }
+}
+
+static void visitBlock(TestContext &ctx, CountT num_rows, Span<Visits> visits)
+{
+    checkBlock(ctx, num_rows, visits);
+
+    for (CountT i = 0; i < num_rows; i++) {
+        visits[i].count += 1;
+    }
+}
+
+static void visitChangedBlock(TestContext &ctx, CountT num_rows,
+                              Span<const Value>, Span<Visits> visits)
+{
+    visitBlock(ctx, num_rows, visits);
+}
+
+static void markEnds(TestContext &ctx, WorldSingleton &)
+{
+    TestWorld &world = ctx.data();
+    ctx.markChanged<Value>(world.firstRow);
+    ctx.markChanged<Value>(world.lastRow);
+}
+
+static void verifyVisits(TestContext &ctx, Visits &visits)
+{
+    TestWorld &world = ctx.data();
+    world.numVisited += visits.count;
+    if (visits.count > 1) {
+        world.numRevisited += 1;
+    }
+
+    visits.count = 0;
+}
+
+static void stepValue(TestContext &, Value &value)
+{
+    value.v += 1;
+}
+
+static void growWorld(TestContext &ctx, WorldSingleton &)
+{
+    TestWorld &world = ctx.data();
+
+    Entity e = ctx.makeEntity<Row>();
+    ctx.get<Value>(e).v = (uint32_t)world.numRows;
+    ctx.get<Visits>(e).count = 0;
+
+    world.lastRow = e;
+    world.numRows += 1;
+}
+
+AtomicU32 num_first_node_runs(0);
+
+static void countFirstNode(TestContext &, WorldSingleton &)
+{
+    num_first_node_runs.fetch_add_relaxed(1);
+}
+
+static void recordFirstNodeRuns(TestContext &ctx, WorldSingleton &)
+{
+    ctx.data().numFirstNodeRuns = num_first_node_runs.load_relaxed();
+}
+
+static void mixValue(TestContext &, Value &value, const Visits &visits)
+{
+    value.v = value.v * 3 + visits.count;
+}
+
+void TestWorld::setupTasks(TaskGraphManager &mgr, const TestConfig &)
+{
+    mgr.init(TestGraph::Blocks).addToGraph<ParallelForChunkNode<
+        TestContext, visitBlock, Visits>>({});
+
+    mgr.init(TestGraph::ChangedBlocks).addToGraph<ParallelForChunkNode<
+        TestContext, visitChangedBlock, Changed<const Value>, Visits>>({});
+
+    mgr.init(TestGraph::MarkEnds).addToGraph<ParallelForNode<
+        TestContext, markEnds, WorldSingleton>>({});
+
+    mgr.init(TestGraph::VerifyVisits).addToGraph<SerialForNode<
+        TestContext, verifyVisits, Visits>>({});
+
+    mgr.init(TestGraph::Step).addToGraph<ParallelForNode<
+        TestContext, stepValue, Value>>({});
+
+    mgr.init(TestGraph::Grow).addToGraph<ParallelForNode<
+        TestContext, growWorld, WorldSingleton>>({});
+
+    // Two independent branches that join, for nodeParallelism
+    TaskGraphBuilder &smoke = mgr.init(TestGraph::Smoke);
+    auto step = smoke.addToGraph<ParallelForNode<
+        TestContext, stepValue, Value>>({});
+    auto visit = smoke.addToGraph<ParallelForChunkNode<
+        TestContext, visitBlock, Visits>>({});
+    smoke.addToGraph<ParallelForNode<
+        TestContext, mixValue, Value, Visits>>({step, visit});
+
+    // A root registered after a node with a dependency, so the roots
+    // aren't all at the start of the topological order
+    TaskGraphBuilder &late_root = mgr.init(TestGraph::LateRoot);
+    auto first_step = late_root.addToGraph<ParallelForNode<
+        TestContext, stepValue, Value>>({});
+    late_root.addToGraph<ParallelForNode<
+        TestContext, stepValue, Value>>({first_step});
+    late_root.addToGraph<ParallelForChunkNode<
+        TestContext, visitBlock, Visits>>({});
+
+    TaskGraphBuilder &fused = mgr.init(TestGraph::Fused);
+    auto count = fused.addToGraph<ParallelForNode<
+        TestContext, countFirstNode, WorldSingleton>>({});
+    fused.addToGraph<ParallelForNode<
+        TestContext, recordFirstNodeRuns, WorldSingleton>>({count});
+}
+
+// Serial, and split into stealable ranges that start and end in the
+// middle of blocks
+ThreadPoolExecutor::Config chunkTestConfig(CountT variant)
+{
+    ThreadPoolExecutor::Config cfg {
+        .numWorlds = 3,
+        .numExportedBuffers = 1,
+        .numWorkers = 2,
+    };
+
+    if (variant == 1) {
+        cfg.intraWorldParallelism = true;
+        cfg.minRowsPerTask = 100;
+    } else if (variant == 2) {
+        cfg.intraWorldParallelism = true;
+        cfg.minRowsPerTask = 1;
+    }
+
+    return cfg;
+}
+
+constexpr CountT num_chunk_test_variants = 3;
+
+void resetBlockCounts(TestWorld &world)
+{
+    world.numBlocks.store_relaxed(0);
+    world.numShortBlocks.store_relaxed(0);
+    world.numBadBlocks.store_relaxed(0);
+    world.numVisited = 0;
+    world.numRevisited = 0;
+}
+
+// Start of each world's rows in the packed Value export
+HeapArray<CountT> exportOffsets(TestExecutor &exec, CountT num_worlds)
+{
+    HeapArray<CountT> offsets(num_worlds + 1);
+    offsets[0] = 0;
+    for (CountT i = 0; i < num_worlds; i++) {
+        offsets[i + 1] = offsets[i] + exec.getWorldData(i).numRows;
+    }
+
+    return offsets;
+}
+
+}
+
+TEST(ParallelForChunkNode, VisitsEveryRowOnce)
+{
+    for (CountT variant = 0; variant < num_chunk_test_variants; variant++) {
+        ThreadPoolExecutor::Config cfg = chunkTestConfig(variant);
+        HeapArray<TestInit> inits(cfg.numWorlds);
+        TestExecutor exec(cfg, TestConfig { 1000 }, inits.data(),
+                          (CountT)TestGraph::NumGraphs);
+
+        for (CountT step = 0; step < 3; step++) {
+            for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+                resetBlockCounts(exec.getWorldData(i));
+            }
+
+            exec.runTaskGraph(TestGraph::Blocks);
+            exec.runTaskGraph(TestGraph::VerifyVisits);
+
+            for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+                TestWorld &world = exec.getWorldData(i);
+                CountT num_blocks = utils::divideRoundUp(
+                    world.numRows, block_rows);
+
+                EXPECT_EQ(world.numVisited, (uint32_t)world.numRows)
+                    << "variant " << variant << ", world " << i;
+                EXPECT_EQ(world.numRevisited, 0u);
+                EXPECT_EQ(world.numBlocks.load_relaxed(),
+                          (uint32_t)num_blocks);
+                EXPECT_EQ(world.numShortBlocks.load_relaxed(),
+                          world.numRows % block_rows == 0 ? 0u : 1u);
+                EXPECT_EQ(world.numBadBlocks.load_relaxed(), 0u);
+            }
+        }
+    }
+}
+
+TEST(ParallelForChunkNode, ChangedBlocks)
+{
+    constexpr CountT change_rows = Table::changeChunkRows;
+
+    for (CountT variant = 0; variant < num_chunk_test_variants; variant++) {
+        ThreadPoolExecutor::Config cfg = chunkTestConfig(variant);
+        HeapArray<TestInit> inits(cfg.numWorlds);
+        TestExecutor exec(cfg, TestConfig { 1000 }, inits.data(),
+                          (CountT)TestGraph::NumGraphs);
+
+        auto runChanged = [&]() {
+            for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+                resetBlockCounts(exec.getWorldData(i));
+            }
+
+            exec.runTaskGraph(TestGraph::ChangedBlocks);
+            exec.runTaskGraph(TestGraph::VerifyVisits);
+        };
+
+        // New rows count as changed, then nothing changes
+        runChanged();
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            TestWorld &world = exec.getWorldData(i);
+            EXPECT_EQ(world.numVisited, (uint32_t)world.numRows);
+            EXPECT_EQ(world.numRevisited, 0u);
+        }
+
+        runChanged();
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            EXPECT_EQ(exec.getWorldData(i).numVisited, 0u);
+        }
+
+        // Only the change chunks holding the first and last rows are
+        // visited, each row once, in blocks that are never longer than a
+        // full block
+        exec.runTaskGraph(TestGraph::MarkEnds);
+        runChanged();
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            TestWorld &world = exec.getWorldData(i);
+            CountT last_chunk_start =
+                (world.numRows - 1) / change_rows * change_rows;
+
+            EXPECT_EQ(world.numVisited, (uint32_t)(change_rows +
+                world.numRows - last_chunk_start))
+                << "variant " << variant << ", world " << i;
+            EXPECT_EQ(world.numRevisited, 0u);
+            EXPECT_EQ(world.numBlocks.load_relaxed(), 2u);
+            EXPECT_EQ(world.numBadBlocks.load_relaxed(), 0u);
+        }
+
+        runChanged();
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            EXPECT_EQ(exec.getWorldData(i).numVisited, 0u);
+        }
+    }
+}
+
+TEST(TaskGraphExecutor, RestoreWorldSnapshot)
+{
+    ThreadPoolExecutor::Config cfg = chunkTestConfig(0);
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    auto setHistory = [&](CountT world_idx, uint32_t base) {
+        History &history = *exec.getWorldData(world_idx).history;
+        for (uint32_t i = 0; i < history.numValues; i++) {
+            history.values[i] = base + i;
+        }
+    };
+
+    setHistory(0, 100);
+    setHistory(1, 200);
+    exec.runTaskGraph(TestGraph::Blocks);
+
+    HeapArray<char> snapshot(exec.worldSnapshotBytes(0));
+    exec.saveWorldSnapshot(0, snapshot.data());
+
+    setHistory(0, 300);
+    exec.runTaskGraph(TestGraph::Blocks);
+    exec.runTaskGraph(TestGraph::Blocks);
+
+    exec.restoreWorldSnapshot(0, snapshot.data());
+
+    for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        resetBlockCounts(exec.getWorldData(i));
+    }
+    exec.runTaskGraph(TestGraph::VerifyVisits);
+
+    // World 0 is back to one visit per row, the others keep theirs
+    for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        TestWorld &world = exec.getWorldData(i);
+        EXPECT_EQ(world.numVisited,
+                  uint32_t(world.numRows * (i == 0 ? 1 : 3)));
+    }
+
+    // The hook loads into each world's own memory rather than the row
+    // pointing at memory saved with the snapshot
+    for (CountT i = 0; i < 2; i++) {
+        TestWorld &world = exec.getWorldData(i);
+        EXPECT_EQ(world.history->values, world.historyValues.data());
+
+        for (uint32_t j = 0; j < num_history_values; j++) {
+            EXPECT_EQ(world.historyValues[j], (i == 0 ? 100 : 200) + j);
+        }
+    }
+
+    // Restoring twice from the same snapshot works the same
+    exec.runTaskGraph(TestGraph::Blocks);
+    exec.restoreWorldSnapshot(0, snapshot.data());
+    resetBlockCounts(exec.getWorldData(0));
+    exec.runTaskGraph(TestGraph::VerifyVisits);
+    EXPECT_EQ(exec.getWorldData(0).numVisited,
+              (uint32_t)exec.getWorldData(0).numRows);
+}
+
+TEST(TaskGraphExecutor, MemoryReport)
+{
+    ThreadPoolExecutor::Config cfg = chunkTestConfig(0);
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    MemoryReport report = exec.memoryReport();
+    EXPECT_EQ(report.worldCommittedBytes.size(), (CountT)cfg.numWorlds);
+
+    // History has no memoryBytes, so its snapshot size is counted
+    EXPECT_EQ(report.singletons.committedBytes,
+              cfg.numWorlds * num_history_values * sizeof(uint32_t));
+    EXPECT_GE(report.total.committedBytes,
+              report.singletons.committedBytes +
+              report.entityStore.committedBytes);
+}
+
+namespace {
+
+enum class SmokeRun {
+    Run,
+    RunAsync,
+    Subsets,
+};
+
+struct SmokeVariant {
+    const char *name;
+    ThreadPoolExecutor::Config cfg;
+    SmokeRun mode;
+};
+
+struct SmokeResult {
+    DynArray<uint32_t> values;
+    DynArray<CountT> numRows;
+    DynArray<uint32_t> numVisited;
+};
+
+// Runs every task graph for a few steps, reading back each world's
+// exported values after every step
+SmokeResult runSmoke(const SmokeVariant &variant)
+{
+    const ThreadPoolExecutor::Config &cfg = variant.cfg;
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    SmokeResult result {
+        .values = DynArray<uint32_t>(0),
+        .numRows = DynArray<CountT>(0),
+        .numVisited = DynArray<uint32_t>(0),
+    };
+
+    // Worlds run out of order and across two calls per graph
+    int32_t first_worlds[] = { 2, 0 };
+    int32_t second_worlds[] = { 1 };
+
+    for (CountT step = 0; step < 4; step++) {
+        switch (variant.mode) {
+        case SmokeRun::Run: {
+            exec.run();
+        } break;
+        case SmokeRun::RunAsync: {
+            exec.runAsync();
+            exec.wait();
+        } break;
+        case SmokeRun::Subsets: {
+            for (uint32_t i = 0; i < (uint32_t)TestGraph::NumGraphs; i++) {
+                exec.runTaskGraph(i, Span<const int32_t>(first_worlds, 2));
+                exec.runTaskGraph(i, Span<const int32_t>(second_worlds, 1));
+            }
+        } break;
+        }
+
+        const Value *exported = (const Value *)exec.getExported(0);
+        CountT world_start = 0;
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            TestWorld &world = exec.getWorldData(i);
+            CountT num_exported = world.numRows;
+
+            // Zero-copy exports hold a fixed slice per world and drop the
+            // rows past its end
+            if (cfg.numExportRowsPerWorld > 0) {
+                world_start = i * cfg.numExportRowsPerWorld;
+                num_exported = std::min(num_exported,
+                                        (CountT)cfg.numExportRowsPerWorld);
+            }
+
+            for (CountT j = 0; j < num_exported; j++) {
+                result.values.push_back(exported[world_start + j].v);
+            }
+            world_start += world.numRows;
+
+            result.numRows.push_back(world.numRows);
+            result.numVisited.push_back(world.numVisited);
+        }
+    }
+
+    return result;
+}
+
+ThreadPoolExecutor::Config smokeConfig(uint32_t num_workers)
+{
+    return ThreadPoolExecutor::Config {
+        .numWorlds = 3,
+        .numExportedBuffers = 1,
+        .numWorkers = num_workers,
+    };
+}
+
+// Runs variant and a single worker, serial run with the same export
+// layout, and checks they leave every world in the same state
+void expectMatchesSerial(const SmokeVariant &variant)
+{
+    SmokeVariant serial { "serial", smokeConfig(1), SmokeRun::Run };
+    serial.cfg.numExportRowsPerWorld = variant.cfg.numExportRowsPerWorld;
+
+    SmokeResult expected = runSmoke(serial);
+    SmokeResult result = runSmoke(variant);
+
+    ASSERT_EQ(result.values.size(), expected.values.size()) << variant.name;
+    for (CountT i = 0; i < expected.values.size(); i++) {
+        ASSERT_EQ(result.values[i], expected.values[i])
+            << variant.name << ", value " << i;
+    }
+
+    ASSERT_EQ(result.numRows.size(), expected.numRows.size());
+    for (CountT i = 0; i < expected.numRows.size(); i++) {
+        EXPECT_EQ(result.numRows[i], expected.numRows[i]) << variant.name;
+        EXPECT_EQ(result.numVisited[i], expected.numVisited[i])
+            << variant.name;
+    }
+}
+
+// World 2 starts past the end of its zero-copy slice and world 1 grows
+// past it during the run
+constexpr uint32_t zero_copy_rows = 340;
+
+}
+
+TEST(TaskGraphExecutor, WorkStealingMatchesSerial)
+{
+    // Tasks small enough that every graph is split and stolen from, and
+    // large enough that ranges end in the middle of blocks
+    for (uint32_t min_rows : { 1u, 16u }) {
+        SmokeVariant variant {
+            "work stealing", smokeConfig(2), SmokeRun::Run };
+        variant.cfg.intraWorldParallelism = true;
+        variant.cfg.minRowsPerTask = min_rows;
+
+        expectMatchesSerial(variant);
+    }
+}
+
+TEST(TaskGraphExecutor, NodeParallelismRunsLateRoots)
+{
+    ThreadPoolExecutor::Config cfg = smokeConfig(2);
+    cfg.nodeParallelism = true;
+
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    exec.runTaskGraph(TestGraph::LateRoot);
+    exec.runTaskGraph(TestGraph::VerifyVisits);
+
+    // Both steps and the root registered after them all ran
+    const Value *exported = (const Value *)exec.getExported(0);
+    HeapArray<CountT> offsets = exportOffsets(exec, cfg.numWorlds);
+    for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        TestWorld &world = exec.getWorldData(i);
+        EXPECT_EQ(world.numVisited, (uint32_t)world.numRows);
+
+        for (CountT j = offsets[i]; j < offsets[i + 1]; j++) {
+            EXPECT_EQ(exported[j].v, uint32_t(j - offsets[i] + 2));
+        }
+    }
+}
+
+TEST(TaskGraphExecutor, NodeParallelismMatchesSerial)
+{
+    SmokeVariant variant {
+        "node parallelism", smokeConfig(2), SmokeRun::Run };
+    variant.cfg.nodeParallelism = true;
+
+    expectMatchesSerial(variant);
+}
+
+TEST(TaskGraphExecutor, DoubleBufferedExportsKeepLastStep)
+{
+    // Copied and zero-copy exports
+    for (uint32_t num_export_rows : { 0u, zero_copy_rows }) {
+        ThreadPoolExecutor::Config cfg = smokeConfig(2);
+        cfg.doubleBufferExports = true;
+        cfg.numExportRowsPerWorld = num_export_rows;
+
+        HeapArray<TestInit> inits(cfg.numWorlds);
+        TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                          (CountT)TestGraph::NumGraphs);
+
+        HeapArray<CountT> offsets = exportOffsets(exec, cfg.numWorlds);
+
+        // Checks the exported rows of every world in buffer_idx, calling
+        // expected(world, row)
+        auto checkBuffer = [&](CountT buffer_idx, auto &&expected) {
+            Value *exported = (Value *)exec.getExported(0, buffer_idx);
+            for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+                CountT start = offsets[i];
+                CountT num_rows = offsets[i + 1] - offsets[i];
+                if (num_export_rows > 0) {
+                    start = i * num_export_rows;
+                    num_rows = std::min(num_rows, (CountT)num_export_rows);
+                }
+
+                for (CountT j = 0; j < num_rows; j++) {
+                    ASSERT_EQ(exported[start + j].v, expected(i, j))
+                        << num_export_rows << " export rows, world " << i
+                        << ", row " << j;
+                }
+            }
+        };
+
+        exec.runTaskGraph(TestGraph::Step);
+        CountT first = exec.latestExportBuffer();
+        exec.runTaskGraph(TestGraph::Step);
+        CountT second = exec.latestExportBuffer();
+        ASSERT_NE(first, second);
+
+        // The first step's results survive the second
+        checkBuffer(first, [](CountT, CountT j) { return uint32_t(j + 1); });
+        checkBuffer(second, [](CountT, CountT j) { return uint32_t(j + 2); });
+
+        // Inputs are read from the latest buffer, which then keeps them
+        // while the step writes to the other one
+        Value *inputs = (Value *)exec.getExported(0, second);
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            CountT start = num_export_rows > 0 ?
+                i * num_export_rows : offsets[i];
+            CountT num_rows = offsets[i + 1] - offsets[i];
+            if (num_export_rows > 0) {
+                num_rows = std::min(num_rows, (CountT)num_export_rows);
+            }
+
+            for (CountT j = 0; j < num_rows; j++) {
+                inputs[start + j].v = uint32_t(1000 * (i + 1));
+            }
+        }
+
+        exec.runTaskGraph(TestGraph::Step);
+        EXPECT_EQ(exec.latestExportBuffer(), first);
+
+        checkBuffer(second, [](CountT i, CountT) {
+            return uint32_t(1000 * (i + 1));
+        });
+        checkBuffer(first, [](CountT i, CountT) {
+            return uint32_t(1000 * (i + 1) + 1);
+        });
+    }
+
+    SmokeVariant variant {
+        "double buffered", smokeConfig(2), SmokeRun::RunAsync };
+    variant.cfg.doubleBufferExports = true;
+    expectMatchesSerial(variant);
+
+    variant.cfg.numExportRowsPerWorld = zero_copy_rows;
+    expectMatchesSerial(variant);
+}
+
+TEST(TaskGraphExecutor, ZeroCopyExports)
+{
+    ThreadPoolExecutor::Config cfg = smokeConfig(2);
+    cfg.numExportRowsPerWorld = zero_copy_rows;
+
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    Value *exported = (Value *)exec.getExported(0);
+
+    // Inputs land in each world's slice, including world 2, which
+    // starts out past the end of its slice
+    auto writeInputs = [&]() {
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            CountT num_rows = std::min(exec.getWorldData(i).numRows,
+                                       (CountT)zero_copy_rows);
+            for (CountT j = 0; j < num_rows; j++) {
+                exported[i * zero_copy_rows + j].v =
+                    uint32_t(1000 * (i + 1) + j);
+            }
+        }
+    };
+
+    auto checkOutputs = [&]() {
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            CountT num_rows = std::min(exec.getWorldData(i).numRows,
+                                       (CountT)zero_copy_rows);
+            for (CountT j = 0; j < num_rows; j++) {
+                ASSERT_EQ(exported[i * zero_copy_rows + j].v,
+                          uint32_t(1000 * (i + 1) + j + 1))
+                    << "world " << i << ", row " << j;
+            }
+        }
+    };
+
+    writeInputs();
+    exec.runTaskGraph(TestGraph::Step);
+    checkOutputs();
+
+    // World 1 grows past the end of its slice, world 0 stays in it
+    for (CountT i = 0; i < 4; i++) {
+        exec.runTaskGraph(TestGraph::Grow);
+    }
+    EXPECT_EQ(exec.getWorldData(0).numRows, 304);
+    EXPECT_EQ(exec.getWorldData(1).numRows, 341);
+
+    writeInputs();
+    exec.runTaskGraph(TestGraph::Step);
+    checkOutputs();
+
+    for (SmokeRun mode : { SmokeRun::Run, SmokeRun::Subsets }) {
+        SmokeVariant variant { "zero-copy", smokeConfig(2), mode };
+        variant.cfg.numExportRowsPerWorld = zero_copy_rows;
+        expectMatchesSerial(variant);
+    }
+}
+
+TEST(TaskGraphExecutor, WorldFusedRunsNodeMajor)
+{
+    for (bool world_fused : { false, true }) {
+        ThreadPoolExecutor::Config cfg = smokeConfig(1);
+        cfg.worldFusedExecution = world_fused;
+
+        HeapArray<TestInit> inits(cfg.numWorlds);
+        TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                          (CountT)TestGraph::NumGraphs);
+
+        num_first_node_runs.store_relaxed(0);
+        exec.runTaskGraph(TestGraph::Fused);
+
+        // Fused, every world runs the first node before any world runs
+        // the second. Otherwise the single worker runs world by world.
+        for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+            EXPECT_EQ(exec.getWorldData(i).numFirstNodeRuns,
+                      world_fused ? cfg.numWorlds : uint32_t(i + 1))
+                << "world " << i;
+        }
+    }
+
+    for (uint32_t jobs_per_chunk : { 0u, 1u }) {
+        SmokeVariant variant { "world fused", smokeConfig(2), SmokeRun::Run };
+        variant.cfg.worldFusedExecution = true;
+        variant.cfg.jobsPerChunk = jobs_per_chunk;
+        expectMatchesSerial(variant);
+    }
+}
+
+TEST(TaskGraphExecutor, RunWorldSubset)
+{
+    ThreadPoolExecutor::Config cfg = chunkTestConfig(0);
+    HeapArray<TestInit> inits(cfg.numWorlds);
+    TestExecutor exec(cfg, TestConfig { 300 }, inits.data(),
+                      (CountT)TestGraph::NumGraphs);
+
+    Value *exported = (Value *)exec.getExported(0);
+    HeapArray<CountT> offsets = exportOffsets(exec, cfg.numWorlds);
+
+    // Inputs are written for every world, but only world 1 runs, so the
+    // other worlds' inputs must be left in the export buffer untouched
+    for (CountT i = 0; i < offsets[cfg.numWorlds]; i++) {
+        exported[i].v = 1000;
+    }
+
+    int32_t world_1[] = { 1 };
+    exec.runTaskGraph(TestGraph::Step, Span<const int32_t>(world_1, 1));
+
+    for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        for (CountT j = offsets[i]; j < offsets[i + 1]; j++) {
+            EXPECT_EQ(exported[j].v, i == 1 ? 1001u : 1000u)
+                << "world " << i << ", row " << j - offsets[i];
+        }
+    }
+
+    // Worlds 0 and 2 then pick up the inputs written before world 1 ran
+    int32_t worlds_0_2[] = { 0, 2 };
+    exec.runTaskGraph(TestGraph::Step, Span<const int32_t>(worlds_0_2, 2));
+
+    for (CountT j = 0; j < offsets[cfg.numWorlds]; j++) {
+        EXPECT_EQ(exported[j].v, 1001u) << "row " << j;
+    }
+
+    // Growing world 0 moves the rows of the worlds after it in the export
+    // buffer, which must then be rewritten even though they didn't run.
+    // The inputs written for them move along rather than being replaced
+    // by their tables' values.
+    for (CountT i = 0; i < offsets[cfg.numWorlds]; i++) {
+        exported[i].v = 2000;
+    }
+
+    int32_t world_0[] = { 0 };
+    exec.runTaskGraph(TestGraph::Grow, Span<const int32_t>(world_0, 1));
+    offsets = exportOffsets(exec, cfg.numWorlds);
+
+    for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        for (CountT j = offsets[i]; j < offsets[i + 1]; j++) {
+            bool new_row = i == 0 && j == offsets[1] - 1;
+            EXPECT_EQ(exported[j].v,
+                      new_row ? (uint32_t)(j - offsets[0]) : 2000u)
+                << "world " << i << ", row " << j - offsets[i];
+        }
+    }
+
+    exec.runTaskGraph(TestGraph::Step, Span<const int32_t>(world_1, 1));
+    for (CountT j = offsets[1]; j < offsets[2]; j++) {
+        EXPECT_EQ(exported[j].v, 2001u);
+    }
+
+    for (uint32_t num_export_rows : { 0u, zero_copy_rows }) {
+        SmokeVariant variant { "subsets", smokeConfig(2), SmokeRun::Subsets };
+        variant.cfg.numExportRowsPerWorld = num_export_rows;
+        expectMatchesSerial(variant);
+    }
+}
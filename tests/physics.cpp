@@ -0,0 +1,913 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+#include <madrona/physics.hpp>
+#include <madrona/physics_assets.hpp>
+#include <madrona/physics_loader.hpp>
+
+#include <algorithm>
+
+using namespace madrona;
+using namespace madrona::base;
+using namespace madrona::math;
+using namespace madrona::phys;
+
+namespace {
+
+enum ObjectIDs : int32_t {
+    Ball = 0,
+    Ground = 1,
+    Box = 2,
+};
+
+constexpr CountT num_balls = 6;
+constexpr float ball_radius = 0.5f;
+
+struct BodyIdx {
+    int32_t idx;
+};
+
+struct Body : Archetype<RigidBody, BodyIdx> {};
+
+struct SimConfig {
+    ObjectManager *objMgr;
+};
+
+struct SimInit {};
+
+class Engine;
+
+struct SimWorld : WorldBase {
+    // Pushes the balls upwards every step when set
+    bool launch;
+    Vector3 positions[num_balls];
+
+    SimWorld(Engine &ctx, const SimConfig &cfg, const SimInit &);
+
+    static void registerTypes(ECSRegistry &registry, const SimConfig &);
+    static void setupTasks(TaskGraphManager &mgr, const SimConfig &);
+};
+
+class Engine : public CustomContext<Engine, SimWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+using SimExecutor = TaskGraphExecutor<Engine, SimWorld, SimConfig, SimInit>;
+
+Entity makeBody(Context &ctx, Vector3 pos, ObjectIDs obj,
+                ResponseType response_type, int32_t idx,
+                Quat rot = Quat { 1, 0, 0, 0 })
+{
+    Entity e = ctx.makeEntity<Body>();
+    ctx.get<Position>(e) = pos;
+    ctx.get<Rotation>(e) = rot;
+    ctx.get<Scale>(e) = Diag3x3 { 1, 1, 1 };
+    ctx.get<ObjectID>(e) = ObjectID { obj };
+    ctx.get<ResponseType>(e) = response_type;
+    ctx.get<Velocity>(e) = { Vector3::zero(), Vector3::zero() };
+    ctx.get<ExternalForce>(e) = Vector3::zero();
+    ctx.get<ExternalTorque>(e) = Vector3::zero();
+    ctx.get<BodyIdx>(e) = BodyIdx { idx };
+    ctx.get<broadphase::LeafID>(e) =
+        PhysicsSystem::registerEntity(ctx, e, ObjectID { obj });
+
+    return e;
+}
+
+// A slightly leaning column of balls that topples onto the ground, so
+// the broadphase has to keep finding ball pairs as they move
+SimWorld::SimWorld(Engine &ctx, const SimConfig &cfg, const SimInit &)
+    : WorldBase(ctx),
+      launch(false),
+      positions {}
+{
+    PhysicsSystem::init(ctx, cfg.objMgr, 1.f / 60.f, 4,
+                        Vector3 { 0, 0, -9.8f }, num_balls + 1);
+
+    makeBody(ctx, Vector3::zero(), Ground, ResponseType::Static,
+             num_balls);
+
+    for (CountT i = 0; i < num_balls; i++) {
+        Vector3 pos {
+            0.1f * float(i),
+            0.f,
+            ball_radius + 2.05f * ball_radius * float(i),
+        };
+        makeBody(ctx, pos, Ball, ResponseType::Dynamic, int32_t(i));
+    }
+}
+
+void SimWorld::registerTypes(ECSRegistry &registry, const SimConfig &)
+{
+    base::registerTypes(registry);
+    PhysicsSystem::registerTypes(registry);
+
+    registry.registerComponent<BodyIdx>();
+    registry.registerArchetype<Body>();
+}
+
+static void launchBody(Engine &ctx, const ResponseType &response_type,
+                       ExternalForce &force)
+{
+    if (ctx.data().launch && response_type == ResponseType::Dynamic) {
+        force = Vector3 { 0, 0, 40.f };
+    }
+}
+
+static void recordBody(Engine &ctx, const BodyIdx &body_idx,
+                       const Position &pos)
+{
+    if (body_idx.idx < num_balls) {
+        ctx.data().positions[body_idx.idx] = pos;
+    }
+}
+
+void SimWorld::setupTasks(TaskGraphManager &mgr, const SimConfig &)
+{
+    TaskGraphBuilder &builder = mgr.init(0);
+
+    auto launch = builder.addToGraph<ParallelForNode<Engine,
+        launchBody, ResponseType, ExternalForce>>({});
+    auto broadphase = PhysicsSystem::setupBroadphaseTasks(builder, {launch});
+    auto step = PhysicsSystem::setupPhysicsStepTasks(
+        builder, {broadphase}, 4);
+    auto record = builder.addToGraph<ParallelForNode<Engine,
+        recordBody, BodyIdx, Position>>({step});
+    PhysicsSystem::setupCleanupTasks(builder, {record});
+}
+
+struct Assets {
+    PhysicsLoader loader;
+    ObjectManager *objMgr;
+
+    Assets()
+        : loader(ExecMode::CPU, 3),
+          objMgr(nullptr)
+    {
+        SourceCollisionPrimitive ball_prim {
+            .type = CollisionPrimitive::Type::Sphere,
+            .sphere = { .radius = ball_radius },
+        };
+
+        // A unit cube
+        Vector3 box_positions[8];
+        for (CountT i = 0; i < 8; i++) {
+            box_positions[i] = Vector3 {
+                (i & 1) ? 0.5f : -0.5f,
+                (i & 2) ? 0.5f : -0.5f,
+                (i & 4) ? 0.5f : -0.5f,
+            };
+        }
+
+        // Counter clockwise seen from outside, -x, +x, -y, +y, -z, +z
+        uint32_t box_indices[] = {
+            0, 4, 6, 2,
+            1, 3, 7, 5,
+            0, 1, 5, 4,
+            2, 6, 7, 3,
+            0, 2, 3, 1,
+            4, 5, 7, 6,
+        };
+
+        uint32_t box_face_counts[] = { 4, 4, 4, 4, 4, 4 };
+
+        imp::SourceMesh box_mesh {
+            .positions = box_positions,
+            .normals = nullptr,
+            .tangentAndSigns = nullptr,
+            .uvs = nullptr,
+            .indices = box_indices,
+            .faceCounts = box_face_counts,
+            .faceMaterials = nullptr,
+            .numVertices = 8,
+            .numFaces = 6,
+            .materialIDX = 0,
+        };
+
+        SourceCollisionPrimitive box_prim {
+            .type = CollisionPrimitive::Type::Hull,
+            .hullInput = { .hullIDX = 0 },
+        };
+
+        SourceCollisionPrimitive plane_prim {
+            .type = CollisionPrimitive::Type::Plane,
+            .plane = {},
+        };
+
+        RigidBodyFrictionData friction {
+            .muS = 0.5f,
+            .muD = 0.5f,
+        };
+
+        // Indexed by ObjectIDs
+        SourceCollisionObject objs[] = {
+            {
+                .prims = Span<const SourceCollisionPrimitive>(&ball_prim, 1),
+                .invMass = 1.f,
+                .friction = friction,
+            },
+            {
+                .prims = Span<const SourceCollisionPrimitive>(&plane_prim, 1),
+                .invMass = 0.f,
+                .friction = friction,
+            },
+            {
+                .prims = Span<const SourceCollisionPrimitive>(&box_prim, 1),
+                .invMass = 1.f,
+                .friction = friction,
+            },
+        };
+
+        StackAlloc tmp_alloc;
+        RigidBodyAssets assets;
+        CountT num_bytes;
+        void *buffer = RigidBodyAssets::processRigidBodyAssets(
+            Span<const imp::SourceMesh>(&box_mesh, 1),
+            Span<const SourceCollisionObject>(objs, 3),
+            false, tmp_alloc, &assets, &num_bytes);
+        EXPECT_NE(buffer, nullptr);
+
+        loader.loadRigidBodies(assets);
+        free(buffer);
+
+        objMgr = &loader.getObjectManager();
+    }
+};
+
+// Boxes resting on the ground: a column of boxes, and a box turned 45
+// degrees on top of another, whose face contact clips to an octagon
+// that narrowphase has to reduce to four points
+constexpr CountT column_height = 4;
+constexpr CountT num_stack_boxes = column_height + 2;
+
+class StackEngine;
+
+struct StackWorld : WorldBase {
+    Vector3 startPositions[num_stack_boxes];
+    Vector3 positions[num_stack_boxes];
+    Quat rotations[num_stack_boxes];
+
+    StackWorld(StackEngine &ctx, const SimConfig &cfg, const SimInit &);
+
+    static void registerTypes(ECSRegistry &registry, const SimConfig &);
+    static void setupTasks(TaskGraphManager &mgr, const SimConfig &);
+};
+
+class StackEngine : public CustomContext<StackEngine, StackWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+using StackExecutor =
+    TaskGraphExecutor<StackEngine, StackWorld, SimConfig, SimInit>;
+
+StackWorld::StackWorld(StackEngine &ctx, const SimConfig &cfg,
+                       const SimInit &)
+    : WorldBase(ctx),
+      startPositions {},
+      positions {},
+      rotations {}
+{
+    PhysicsSystem::init(ctx, cfg.objMgr, 1.f / 60.f, 4,
+                        Vector3 { 0, 0, -9.8f }, num_stack_boxes + 1);
+
+    makeBody(ctx, Vector3::zero(), Ground, ResponseType::Static,
+             num_stack_boxes);
+
+    for (CountT i = 0; i < column_height; i++) {
+        startPositions[i] = Vector3 { 0, 0, 0.5f + float(i) };
+    }
+    startPositions[column_height] = Vector3 { 3, 0, 0.5f };
+    startPositions[column_height + 1] = Vector3 { 3, 0, 1.5f };
+
+    for (CountT i = 0; i < num_stack_boxes; i++) {
+        Quat rot = i == num_stack_boxes - 1 ?
+            Quat::angleAxis(math::pi / 4.f, math::up) :
+            Quat { 1, 0, 0, 0 };
+
+        makeBody(ctx, startPositions[i], Box, ResponseType::Dynamic,
+                 int32_t(i), rot);
+    }
+}
+
+void StackWorld::registerTypes(ECSRegistry &registry, const SimConfig &)
+{
+    base::registerTypes(registry);
+    PhysicsSystem::registerTypes(registry);
+
+    registry.registerComponent<BodyIdx>();
+    registry.registerArchetype<Body>();
+}
+
+static void recordBox(StackEngine &ctx, const BodyIdx &body_idx,
+                      const Position &pos, const Rotation &rot)
+{
+    if (body_idx.idx < num_stack_boxes) {
+        ctx.data().positions[body_idx.idx] = pos;
+        ctx.data().rotations[body_idx.idx] = rot;
+    }
+}
+
+void StackWorld::setupTasks(TaskGraphManager &mgr, const SimConfig &)
+{
+    TaskGraphBuilder &builder = mgr.init(0);
+
+    auto broadphase = PhysicsSystem::setupBroadphaseTasks(builder, {});
+    auto step = PhysicsSystem::setupPhysicsStepTasks(
+        builder, {broadphase}, 4);
+    auto record = builder.addToGraph<ParallelForNode<StackEngine,
+        recordBox, BodyIdx, Position, Rotation>>({step});
+    PhysicsSystem::setupCleanupTasks(builder, {record});
+}
+
+// Unit boxes that only run the broadphase, which is checked against brute
+// force every step. Bodies [0, num_dynamic_boxes) are dynamic and slide
+// back and forth along x, so their order along x keeps changing, and every
+// third step one of them jumps to a new spot. The rest are static.
+constexpr CountT num_dynamic_boxes = 24;
+constexpr CountT num_static_boxes = 8;
+constexpr CountT num_broadphase_boxes = num_dynamic_boxes + num_static_boxes;
+constexpr CountT num_checks_per_step = 8;
+constexpr float broadphase_delta_t = 1.f / 60.f;
+
+struct BroadphaseConfig {
+    ObjectManager *objMgr;
+    PhysicsSystem::Broadphase broadphase;
+    // Every fourth step, one static box jumps to a new spot
+    bool moveStatics;
+    // Instead of jumping, the dynamic boxes are pulled in towards the origin
+    // over gather_steps steps. Every box leaves its fat AABB each step and
+    // the reinserted dynamic tree degrades until its SAH cost forces rebuilds.
+    bool gather;
+};
+
+constexpr uint32_t gather_start = 10;
+constexpr uint32_t gather_steps = 10;
+
+// Differences from brute force, which should all stay 0, and counts that
+// show the checks had something to find
+struct BroadphaseErrors {
+    uint32_t missingPairs;
+    uint32_t extraPairs;
+    uint32_t staticPairs;
+    uint32_t unorderedPairs;
+    uint32_t queryErrors;
+    uint32_t rayErrors;
+
+    uint32_t numPairs;
+    uint32_t numStaticPairs;
+    uint32_t numQueryHits;
+    uint32_t numRayHits;
+    // Steps where the boxes' order along x changed, so an incremental sort
+    // of the leaves had to move some of them
+    uint32_t numReorderedSteps;
+};
+
+class BroadphaseEngine;
+
+struct BroadphaseWorld : WorldBase {
+    bool moveStatics;
+    bool gather;
+    uint32_t step;
+    Entity boxes[num_broadphase_boxes];
+    Vector3 basePositions[num_broadphase_boxes];
+    // Candidates emitted this step, as (a, b) box indices
+    DynArray<uint32_t> candidates;
+    // Every step's candidates as (a << 32 | b), sorted within each step and
+    // ended by ~0, for comparing the pairs found by different broadphases
+    DynArray<uint64_t> pairLog;
+    // Box indices sorted by their leaf AABB's pMin.x on the last step
+    uint32_t xOrder[num_broadphase_boxes];
+    BroadphaseErrors errors;
+    // BVH::numRebuilds and numReinsertions after the last step
+    uint32_t numRebuilds;
+    uint32_t numReinsertions;
+
+    BroadphaseWorld(BroadphaseEngine &ctx, const BroadphaseConfig &cfg,
+                    const SimInit &);
+
+    static void registerTypes(ECSRegistry &registry,
+                              const BroadphaseConfig &);
+    static void setupTasks(TaskGraphManager &mgr, const BroadphaseConfig &);
+};
+
+class BroadphaseEngine
+    : public CustomContext<BroadphaseEngine, BroadphaseWorld> {
+public:
+    using CustomContext::CustomContext;
+};
+
+using BroadphaseExecutor = TaskGraphExecutor<BroadphaseEngine,
+    BroadphaseWorld, BroadphaseConfig, SimInit>;
+
+// Pseudo random value in [0, 1), the same for every world and executor
+float hashUnit(uint32_t a, uint32_t b)
+{
+    uint32_t h = a * 0x9E37'79B9_u32 ^ (b + 0x7F4A'7C15_u32) * 0x85EB'CA6B_u32;
+    h ^= h >> 16;
+    h *= 0x7FEB'352D_u32;
+    h ^= h >> 15;
+    h *= 0x846C'A68B_u32;
+    h ^= h >> 16;
+
+    return float(h >> 8) / float(1 << 24);
+}
+
+Vector3 randomBoxPosition(uint32_t a, uint32_t b)
+{
+    return Vector3 {
+        -8.f + 16.f * hashUnit(a, 3 * b),
+        -4.f + 8.f * hashUnit(a, 3 * b + 1),
+        4.f * hashUnit(a, 3 * b + 2),
+    };
+}
+
+BroadphaseWorld::BroadphaseWorld(BroadphaseEngine &ctx,
+                                 const BroadphaseConfig &cfg,
+                                 const SimInit &)
+    : WorldBase(ctx),
+      moveStatics(cfg.moveStatics),
+      gather(cfg.gather),
+      step(0),
+      boxes {},
+      basePositions {},
+      candidates(0),
+      pairLog(0),
+      xOrder {},
+      errors {},
+      numRebuilds(0),
+      numReinsertions(0)
+{
+    PhysicsSystem::init(ctx, cfg.objMgr, broadphase_delta_t, 1,
+                        Vector3::zero(), num_broadphase_boxes,
+                        PhysicsSystem::Solver::XPBD, cfg.broadphase);
+
+    for (CountT i = 0; i < num_broadphase_boxes; i++) {
+        basePositions[i] = randomBoxPosition(0, uint32_t(i));
+
+        boxes[i] = makeBody(ctx, basePositions[i], Box,
+            i < num_dynamic_boxes ?
+                ResponseType::Dynamic : ResponseType::Static,
+            int32_t(i));
+    }
+}
+
+void BroadphaseWorld::registerTypes(ECSRegistry &registry,
+                                    const BroadphaseConfig &)
+{
+    base::registerTypes(registry);
+    PhysicsSystem::registerTypes(registry);
+
+    registry.registerComponent<BodyIdx>();
+    registry.registerArchetype<Body>();
+}
+
+static void moveBox(BroadphaseEngine &ctx, const BodyIdx &body_idx,
+                    Position &pos, Velocity &vel)
+{
+    BroadphaseWorld &world = ctx.data();
+    uint32_t step = world.step;
+    uint32_t idx = uint32_t(body_idx.idx);
+    Vector3 &base = world.basePositions[idx];
+
+    if (idx >= num_dynamic_boxes) {
+        uint32_t static_idx = idx - num_dynamic_boxes;
+        if (world.moveStatics && step % 4 == 2 &&
+                static_idx == step / 4 % num_static_boxes) {
+            base = randomBoxPosition(step, idx + 100);
+        }
+
+        pos = base;
+        return;
+    }
+
+    if (world.gather) {
+        float t = std::clamp(
+            (float(step) - float(gather_start)) / float(gather_steps),
+            0.f, 1.f);
+        base = (1.f - 0.9f * t) * randomBoxPosition(0, idx);
+    } else if (step % 3 == 0 && idx == step / 3 % num_dynamic_boxes) {
+        base = randomBoxPosition(step, idx + 200);
+    }
+
+    // Slides by up to half a box per step, which mostly stays inside the
+    // fat AABB grown from the velocity
+    constexpr float amplitude = 2.f;
+    constexpr float frequency = 0.25f;
+    float angle = frequency * float(step) + 6.28f * hashUnit(idx, 7);
+
+    pos = base + Vector3 { amplitude * sinf(angle), 0, 0 };
+    vel.linear = Vector3 {
+        amplitude * frequency * cosf(angle) / broadphase_delta_t, 0, 0 };
+}
+
+static void recordCandidate(BroadphaseEngine &ctx,
+                            const CandidateCollision &candidate)
+{
+    BroadphaseWorld &world = ctx.data();
+    uint32_t a = uint32_t(ctx.get<BodyIdx>(candidate.a).idx);
+    uint32_t b = uint32_t(ctx.get<BodyIdx>(candidate.b).idx);
+
+    world.candidates.push_back(a);
+    world.candidates.push_back(b);
+}
+
+// Compares the candidates, findIntersecting and traceRay against tests of
+// every box
+static void checkBroadphase(BroadphaseEngine &ctx, broadphase::BVH &bvh)
+{
+    BroadphaseWorld &world = ctx.data();
+    BroadphaseErrors &errors = world.errors;
+    uint32_t step = world.step++;
+    world.numRebuilds = bvh.numRebuilds();
+    world.numReinsertions = bvh.numReinsertions();
+
+    AABB aabbs[num_broadphase_boxes];
+    for (CountT i = 0; i < num_broadphase_boxes; i++) {
+        aabbs[i] = bvh.getLeafAABB(
+            ctx.get<broadphase::LeafID>(world.boxes[i]));
+    }
+
+    auto isStatic = [](CountT i) { return i >= num_dynamic_boxes; };
+
+    uint32_t x_order[num_broadphase_boxes];
+    for (CountT i = 0; i < num_broadphase_boxes; i++) {
+        x_order[i] = uint32_t(i);
+    }
+    std::stable_sort(x_order, x_order + num_broadphase_boxes,
+        [&](uint32_t a, uint32_t b) {
+            return aabbs[a].pMin.x < aabbs[b].pMin.x;
+        });
+
+    if (step > 0 && !std::equal(x_order, x_order + num_broadphase_boxes,
+                                world.xOrder)) {
+        errors.numReorderedSteps += 1;
+    }
+    std::copy_n(x_order, num_broadphase_boxes, world.xOrder);
+
+    // Candidate pairs: a bitmask of the boxes paired with each box
+    uint64_t found[num_broadphase_boxes] = {};
+    CountT log_start = world.pairLog.size();
+    for (CountT i = 0; i < world.candidates.size(); i += 2) {
+        uint32_t a = world.candidates[i];
+        uint32_t b = world.candidates[i + 1];
+        world.pairLog.push_back(uint64_t(a) << 32 | b);
+
+        if (world.boxes[a].id >= world.boxes[b].id) {
+            errors.unorderedPairs += 1;
+        }
+
+        if (isStatic(a) && isStatic(b)) {
+            errors.staticPairs += 1;
+        }
+
+        uint32_t lo = std::min(a, b);
+        uint32_t hi = std::max(a, b);
+        if ((found[lo] & (1_u64 << hi)) != 0) {
+            errors.extraPairs += 1;
+        }
+        found[lo] |= 1_u64 << hi;
+    }
+    world.candidates.clear();
+
+    std::sort(world.pairLog.data() + log_start,
+              world.pairLog.data() + world.pairLog.size());
+    world.pairLog.push_back(~0_u64);
+
+    for (CountT i = 0; i < num_broadphase_boxes; i++) {
+        for (CountT j = i + 1; j < num_broadphase_boxes; j++) {
+            bool expected = !(isStatic(i) && isStatic(j)) &&
+                aabbs[i].overlaps(aabbs[j]);
+            bool was_found = (found[i] & (1_u64 << j)) != 0;
+
+            if (expected && !was_found) {
+                errors.missingPairs += 1;
+            } else if (!expected && was_found) {
+                errors.extraPairs += 1;
+            }
+
+            if (expected) {
+                errors.numPairs += 1;
+                errors.numStaticPairs += isStatic(j) ? 1 : 0;
+            }
+        }
+    }
+
+    for (CountT i = 0; i < num_checks_per_step; i++) {
+        // AABB queries of a few box sizes
+        Vector3 center = randomBoxPosition(step, uint32_t(i) + 300);
+        float half_extent = 0.5f + 2.f * hashUnit(step, uint32_t(i) + 400);
+        AABB query {
+            .pMin = center - Vector3::all(half_extent),
+            .pMax = center + Vector3::all(half_extent),
+        };
+
+        uint64_t hits = 0;
+        bvh.findIntersecting(query, [&](Entity e) {
+            hits |= 1_u64 << ctx.get<BodyIdx>(e).idx;
+        });
+
+        uint64_t expected_hits = 0;
+        for (CountT j = 0; j < num_broadphase_boxes; j++) {
+            if (query.overlaps(aabbs[j])) {
+                expected_hits |= 1_u64 << j;
+            }
+        }
+
+        errors.queryErrors += hits != expected_hits ? 1 : 0;
+        errors.numQueryHits += expected_hits != 0 ? 1 : 0;
+
+        // Rays from above into the boxes, against the exact unit cubes
+        Vector3 ray_o = randomBoxPosition(step, uint32_t(i) + 500);
+        ray_o.z = 12.f;
+        Vector3 ray_d = normalize(
+            randomBoxPosition(step, uint32_t(i) + 600) - ray_o);
+
+        float expected_t = FLT_MAX;
+        CountT expected_box = -1;
+        for (CountT j = 0; j < num_broadphase_boxes; j++) {
+            Vector3 box_pos = ctx.get<Position>(world.boxes[j]);
+
+            float t_near = 0.f;
+            float t_far = FLT_MAX;
+            for (CountT axis = 0; axis < 3; axis++) {
+                float t0 = (box_pos[axis] - 0.5f - ray_o[axis]) /
+                    ray_d[axis];
+                float t1 = (box_pos[axis] + 0.5f - ray_o[axis]) /
+                    ray_d[axis];
+                t_near = fmaxf(t_near, fminf(t0, t1));
+                t_far = fminf(t_far, fmaxf(t0, t1));
+            }
+
+            if (t_near <= t_far && t_near < expected_t) {
+                expected_t = t_near;
+                expected_box = j;
+            }
+        }
+
+        float hit_t;
+        Vector3 hit_normal;
+        Entity hit = bvh.traceRay(ray_o, ray_d, &hit_t, &hit_normal);
+
+        if (expected_box == -1) {
+            errors.rayErrors += hit != Entity::none() ? 1 : 0;
+        } else {
+            errors.rayErrors += hit == Entity::none() ||
+                fabsf(hit_t - expected_t) > 1e-3f ? 1 : 0;
+            errors.numRayHits += 1;
+        }
+    }
+}
+
+void BroadphaseWorld::setupTasks(TaskGraphManager &mgr,
+                                 const BroadphaseConfig &)
+{
+    TaskGraphBuilder &builder = mgr.init(0);
+
+    auto move = builder.addToGraph<ParallelForNode<BroadphaseEngine,
+        moveBox, BodyIdx, Position, Velocity>>({});
+    auto broadphase = PhysicsSystem::setupBroadphaseTasks(builder, {move});
+    auto overlap = PhysicsSystem::setupStandaloneBroadphaseOverlapTasks(
+        builder, {broadphase});
+    auto record = builder.addToGraph<SerialForNode<BroadphaseEngine,
+        recordCandidate, CandidateCollision>>({overlap});
+    auto check = builder.addToGraph<ParallelForNode<BroadphaseEngine,
+        checkBroadphase, broadphase::BVH>>({record});
+    PhysicsSystem::setupStandaloneBroadphaseCleanupTasks(builder, {check});
+}
+
+}
+
+TEST(PhysicsSystem, ForkWorld)
+{
+    Assets assets;
+
+    auto execConfig = [](uint32_t num_worlds) {
+        return ThreadPoolExecutor::Config {
+            .numWorlds = num_worlds,
+            .numExportedBuffers = 0,
+            .numWorkers = 2,
+        };
+    };
+
+    HeapArray<SimInit> inits(3);
+    SimExecutor ref(execConfig(1), SimConfig { assets.objMgr },
+                    inits.data(), 1);
+    SimExecutor exec(execConfig(3), SimConfig { assets.objMgr },
+                     inits.data(), 1);
+
+    for (CountT i = 0; i < 20; i++) {
+        ref.run();
+        exec.run();
+    }
+
+    // Fork the falling column into worlds 1 and 2, then only launch the
+    // balls of world 1. Each world must keep stepping on its own
+    // broadphase state: world 0 and its untouched fork must both follow
+    // the world that was never forked.
+    int32_t dst_worlds[] = { 1, 2 };
+    exec.forkWorld(0, Span<const int32_t>(dst_worlds, 2));
+    exec.getWorldData(1).launch = true;
+
+    for (CountT i = 0; i < 60; i++) {
+        ref.run();
+        exec.run();
+    }
+
+    const SimWorld &ref_world = ref.getWorldData(0);
+    for (CountT world_idx : { 0, 2 }) {
+        const SimWorld &world = exec.getWorldData(world_idx);
+
+        for (CountT i = 0; i < num_balls; i++) {
+            EXPECT_FLOAT_EQ(world.positions[i].x, ref_world.positions[i].x)
+                << "world " << world_idx << ", ball " << i;
+            EXPECT_FLOAT_EQ(world.positions[i].y, ref_world.positions[i].y);
+            EXPECT_FLOAT_EQ(world.positions[i].z, ref_world.positions[i].z);
+        }
+    }
+
+    // The column has toppled onto the ground rather than through it
+    for (CountT i = 0; i < num_balls; i++) {
+        EXPECT_GT(ref_world.positions[i].z, 0.f);
+        EXPECT_GT(exec.getWorldData(1).positions[i].z,
+                  ref_world.positions[i].z + 1.f);
+    }
+}
+
+TEST(PhysicsSystem, BoxStacksStayUpright)
+{
+    Assets assets;
+
+    HeapArray<SimInit> inits(1);
+    StackExecutor exec(ThreadPoolExecutor::Config {
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, SimConfig { assets.objMgr }, inits.data(), 1);
+
+    for (CountT i = 0; i < 300; i++) {
+        exec.run();
+    }
+
+    // Every box stays where it was stacked, upright, and only sinks into
+    // the one below by the solver's slop
+    const StackWorld &world = exec.getWorldData(0);
+    for (CountT i = 0; i < num_stack_boxes; i++) {
+        Vector3 delta = world.positions[i] - world.startPositions[i];
+
+        EXPECT_LT(sqrtf(delta.x * delta.x + delta.y * delta.y), 0.01f)
+            << "box " << i;
+        EXPECT_LT(fabsf(delta.z), 0.05f) << "box " << i;
+        EXPECT_GT(world.rotations[i].rotateVec(math::up).z, 0.999f)
+            << "box " << i;
+    }
+}
+
+static void assertNoBroadphaseErrors(const BroadphaseErrors &errors,
+                                     CountT step)
+{
+    ASSERT_EQ(errors.missingPairs, 0u) << "step " << step;
+    ASSERT_EQ(errors.extraPairs, 0u) << "step " << step;
+    ASSERT_EQ(errors.staticPairs, 0u) << "step " << step;
+    ASSERT_EQ(errors.unorderedPairs, 0u) << "step " << step;
+    ASSERT_EQ(errors.queryErrors, 0u) << "step " << step;
+    ASSERT_EQ(errors.rayErrors, 0u) << "step " << step;
+}
+
+TEST(PhysicsSystem, DualTreeBroadphaseMatchesBruteForce)
+{
+    Assets assets;
+
+    HeapArray<SimInit> inits(1);
+    BroadphaseExecutor exec(ThreadPoolExecutor::Config {
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, BroadphaseConfig {
+        .objMgr = assets.objMgr,
+        .broadphase = PhysicsSystem::Broadphase::BVH,
+        .moveStatics = true,
+        .gather = false,
+    }, inits.data(), 1);
+
+    for (CountT i = 0; i < 60; i++) {
+        exec.run();
+
+        ASSERT_NO_FATAL_FAILURE(
+            assertNoBroadphaseErrors(exec.getWorldData(0).errors, i));
+    }
+
+    // Pairs with static boxes were found, and most queries and rays hit
+    // something
+    const BroadphaseErrors &errors = exec.getWorldData(0).errors;
+    EXPECT_GT(errors.numPairs, 60u);
+    EXPECT_GT(errors.numStaticPairs, 10u);
+    EXPECT_GT(errors.numQueryHits, 60u * num_checks_per_step / 2);
+    EXPECT_GT(errors.numRayHits, 60u * num_checks_per_step / 8);
+}
+
+TEST(PhysicsSystem, DynamicTreeReinsertsAndRebuilds)
+{
+    Assets assets;
+
+    HeapArray<SimInit> inits(1);
+    BroadphaseExecutor exec(ThreadPoolExecutor::Config {
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, BroadphaseConfig {
+        .objMgr = assets.objMgr,
+        .broadphase = PhysicsSystem::Broadphase::BVH,
+        .moveStatics = false,
+        .gather = true,
+    }, inits.data(), 1);
+
+    // Before the gather only the first update's forced build has run, so
+    // the pairs found up to here came from reinserted and refit leaves
+    for (CountT i = 0; i < (CountT)gather_start; i++) {
+        exec.run();
+
+        ASSERT_NO_FATAL_FAILURE(
+            assertNoBroadphaseErrors(exec.getWorldData(0).errors, i));
+        EXPECT_EQ(exec.getWorldData(0).numRebuilds, 1u) << "step " << i;
+    }
+
+    uint32_t num_reinsertions = exec.getWorldData(0).numReinsertions;
+    EXPECT_GT(num_reinsertions, 0u);
+
+    for (CountT i = gather_start; i < 40; i++) {
+        exec.run();
+
+        ASSERT_NO_FATAL_FAILURE(
+            assertNoBroadphaseErrors(exec.getWorldData(0).errors, i));
+    }
+
+    // Every dynamic box escaped its fat AABB on each gather step, and the
+    // tree's SAH cost climbed past the rebuild threshold at least once
+    const BroadphaseWorld &world = exec.getWorldData(0);
+    EXPECT_GE(world.numReinsertions - num_reinsertions,
+              gather_steps * num_dynamic_boxes);
+    EXPECT_GT(world.numRebuilds, 1u);
+    EXPECT_GT(world.errors.numPairs, 40u);
+}
+
+TEST(PhysicsSystem, SweepAndPruneMatchesBVHPairs)
+{
+    Assets assets;
+
+    ThreadPoolExecutor::Config exec_cfg {
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    };
+
+    auto worldConfig = [&](PhysicsSystem::Broadphase broadphase) {
+        return BroadphaseConfig {
+            .objMgr = assets.objMgr,
+            .broadphase = broadphase,
+            .moveStatics = true,
+            .gather = false,
+        };
+    };
+
+    HeapArray<SimInit> inits(1);
+    BroadphaseExecutor bvh(exec_cfg,
+        worldConfig(PhysicsSystem::Broadphase::BVH), inits.data(), 1);
+    BroadphaseExecutor sap(exec_cfg,
+        worldConfig(PhysicsSystem::Broadphase::SweepAndPrune),
+        inits.data(), 1);
+
+    for (CountT i = 0; i < 60; i++) {
+        bvh.run();
+        sap.run();
+
+        // Both check static-static filtering and a < b by entity ID
+        ASSERT_NO_FATAL_FAILURE(
+            assertNoBroadphaseErrors(bvh.getWorldData(0).errors, i));
+        ASSERT_NO_FATAL_FAILURE(
+            assertNoBroadphaseErrors(sap.getWorldData(0).errors, i));
+    }
+
+    // Same (a, b) pairs, in the same order within each pair, on every step
+    const DynArray<uint64_t> &bvh_log = bvh.getWorldData(0).pairLog;
+    const DynArray<uint64_t> &sap_log = sap.getWorldData(0).pairLog;
+    ASSERT_EQ(bvh_log.size(), sap_log.size());
+    for (CountT i = 0; i < bvh_log.size(); i++) {
+        ASSERT_EQ(bvh_log[i], sap_log[i]) << "log entry " << i;
+    }
+
+    const BroadphaseErrors &errors = sap.getWorldData(0).errors;
+    EXPECT_GT(errors.numPairs, 60u);
+    EXPECT_GT(errors.numStaticPairs, 10u);
+    EXPECT_GT(errors.numReorderedSteps, 30u);
+}
@@ -10,7 +10,11 @@
 #include <madrona/state.hpp>
 #include <madrona/registry.hpp>
 
+#include <algorithm>
 #include <array>
+#include <thread>
+#include <utility>
+#include <vector>
 
 using namespace madrona;
 
@@ -269,3 +273,624 @@ TEST(State, Reset)
         EXPECT_TRUE(state.get<Component1>(e).valid());
     }
 }
+
+TEST(State, SortArchetype)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype2>();
+
+    int num_entities = 10'000;
+
+    DynArray<Entity> entities(num_entities);
+    uint32_t rand_state = 1;
+    for (int i = 0; i < num_entities; i++) {
+        rand_state = rand_state * 1664525 + 1013904223;
+
+        Entity e = state.makeEntityNow<Archetype2>(cache);
+        state.get<Component1>(e).value().v = rand_state;
+        state.get<Component2>(e).value().x = rand_state ^ 5;
+
+        entities.push_back(e);
+    }
+
+    for (int i = 0; i < num_entities; i += 3) {
+        state.destroyEntityNow(cache, entities[i]);
+    }
+
+    state.sortArchetype<Archetype2, Component1>();
+
+    uint32_t prev_v = 0;
+    state.iterateQuery(state.query<Component1, Component2>(),
+        [&](Component1 &c1, Component2 &c2) {
+            EXPECT_LE(prev_v, c1.v);
+            EXPECT_EQ(c1.v ^ 5, c2.x);
+            prev_v = c1.v;
+        });
+
+    for (int i = 0; i < num_entities; i++) {
+        EXPECT_EQ(state.get<Component1>(entities[i]).valid(), i % 3 != 0);
+
+        if (i % 3 != 0) {
+            EXPECT_EQ(state.get<Component1>(entities[i]).value().v ^ 5,
+                      state.get<Component2>(entities[i]).value().x);
+        }
+    }
+
+    state.resetTmpAlloc();
+}
+
+TEST(State, VirtualColumns)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype2>(
+        ComponentMetadataSelector<Component1>(ComponentFlags::None),
+        ArchetypeFlags::VirtualColumns);
+
+    Entity first = state.makeEntityNow<Archetype2>(cache);
+    state.get<Component1>(first).value().v = 7;
+
+    Component1 *first_ptr = &state.get<Component1>(first).value();
+    EXPECT_EQ((uintptr_t)first_ptr % MADRONA_CACHE_LINE, 0u);
+
+    // Each column is staggered a cache line further into its range, so the
+    // same row of different columns sits at different 4 KiB page offsets
+    uintptr_t c1_offset = (uintptr_t)first_ptr % 4096;
+    uintptr_t c2_offset =
+        (uintptr_t)&state.get<Component2>(first).value() % 4096;
+    uintptr_t c3_offset =
+        (uintptr_t)&state.get<Component3>(first).value() % 4096;
+    EXPECT_NE(c1_offset, c2_offset);
+    EXPECT_NE(c1_offset, c3_offset);
+    EXPECT_NE(c2_offset, c3_offset);
+
+    int num_entities = 100'000;
+
+    DynArray<Entity> entities(num_entities);
+    for (int i = 0; i < num_entities; i++) {
+        Entity e = state.makeEntityNow<Archetype2>(cache);
+        state.get<Component1>(e).value().v = i;
+        state.get<Component3>(e).value().v = (unsigned char)i;
+
+        entities.push_back(e);
+    }
+
+    // Growth commits new pages rather than moving the columns
+    EXPECT_EQ(&state.get<Component1>(first).value(), first_ptr);
+    EXPECT_EQ(first_ptr->v, 7u);
+
+    for (int i = 0; i < num_entities; i += 2) {
+        state.destroyEntityNow(cache, entities[i]);
+    }
+
+    for (int i = 1; i < num_entities; i += 2) {
+        EXPECT_EQ(state.get<Component1>(entities[i]).value().v, (uint32_t)i);
+        EXPECT_EQ(state.get<Component3>(entities[i]).value().v,
+                  (unsigned char)i);
+    }
+}
+
+TEST(State, Transaction)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerComponent<ComponentBig>();
+    registry.registerArchetype<Archetype1>();
+    registry.registerArchetype<Archetype2>();
+    registry.registerArchetype<Archetype3>();
+
+    Entity existing = state.makeEntityNow<Archetype2>(cache);
+    state.get<Component1>(existing).value().v = 1;
+
+    Entity doomed = state.makeEntityNow<Archetype2>(cache);
+
+    Transaction txn = state.makeTransaction();
+
+    // Enough entries to span several blocks
+    int num_entities = 5'000;
+    for (int i = 0; i < num_entities; i++) {
+        state.makeEntity<Archetype2>(txn, Component1 { uint32_t(i) },
+                                     Component2 { uint32_t(2 * i), 0, 0 },
+                                     Component3 { (unsigned char)i });
+
+        if (i % 10 == 0) {
+            state.makeEntity<Archetype3>(txn);
+        }
+    }
+
+    state.setComponent(txn, existing, Component1 { 7 });
+    state.setComponent(txn, existing, Component1 { 8 });
+    state.destroyEntity(txn, doomed);
+    state.setComponent(txn, doomed, Component1 { 9 });
+
+    EXPECT_FALSE(txn.empty());
+    EXPECT_EQ(state.get<Component1>(existing).value().v, 1u);
+
+    state.commitTransaction(cache, txn);
+
+    EXPECT_TRUE(txn.empty());
+    EXPECT_EQ(state.get<Component1>(existing).value().v, 8u);
+    EXPECT_FALSE(state.get<Component1>(doomed).valid());
+
+    // Destroying doomed moves the last new entity into its row, so only
+    // check that every new entity showed up once with the right values
+    DynArray<bool> seen(num_entities);
+    for (int i = 0; i < num_entities; i++) {
+        seen.push_back(false);
+    }
+
+    state.iterateQuery(state.query<Entity, Component1, Component2,
+                                   Component3>(),
+        [&](Entity e, Component1 &c1, Component2 &c2, Component3 &c3) {
+            if (e == existing) {
+                return;
+            }
+
+            ASSERT_LT(c1.v, (uint32_t)num_entities);
+            EXPECT_FALSE(seen[c1.v]);
+            seen[c1.v] = true;
+
+            EXPECT_EQ(c2.x, 2 * c1.v);
+            EXPECT_EQ(c3.v, (unsigned char)c1.v);
+            EXPECT_EQ(&state.get<Component1>(e).value(), &c1);
+        });
+
+    for (int i = 0; i < num_entities; i++) {
+        EXPECT_TRUE(seen[i]);
+    }
+
+    int num_archetype3 = 0;
+    state.iterateQuery(state.query<ComponentBig>(), [&](ComponentBig &) {
+        num_archetype3++;
+    });
+    EXPECT_EQ(num_archetype3, num_entities / 10);
+
+    // Committing an empty transaction does nothing
+    state.commitTransaction(cache, txn);
+
+    Transaction moved(std::move(txn));
+    EXPECT_TRUE(txn.empty());
+    EXPECT_TRUE(moved.empty());
+
+    state.resetTmpAlloc();
+}
+
+TEST(State, BulkCreation)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype1>();
+    registry.registerArchetype<Archetype2>();
+
+    Entity single = state.makeEntityNow<Archetype2>(cache);
+
+    int num_entities = 1'000;
+    Span<const Entity> bulk =
+        state.makeEntities<Archetype2>(cache, num_entities);
+    ASSERT_EQ(bulk.size(), num_entities);
+
+    DynArray<Entity> entities(num_entities);
+    for (int i = 0; i < num_entities; i++) {
+        Entity e = bulk[i];
+        EXPECT_NE(e, single);
+
+        Loc loc = state.getLoc(e);
+        EXPECT_TRUE(loc.valid());
+        EXPECT_EQ(loc.row, i + 1);
+
+        state.get<Component1>(e).value().v = i;
+        entities.push_back(e);
+    }
+
+    for (int i = 0; i < num_entities; i += 2) {
+        state.destroyEntityNow(cache, entities[i]);
+    }
+
+    for (int i = 1; i < num_entities; i += 2) {
+        EXPECT_EQ(state.get<Component1>(entities[i]).value().v, (uint32_t)i);
+    }
+
+    Loc tmp_start = state.makeTemporaries<Archetype1>(100);
+    Loc tmp_next = state.makeTemporary<Archetype1>();
+    EXPECT_EQ(tmp_start.row, 0);
+    EXPECT_EQ(tmp_next.row, 100);
+
+    int num_temporaries = 0;
+    state.iterateQuery(state.query<Entity, Component1>(),
+        [&](Entity e, Component1 &) {
+            if (e == Entity::none()) {
+                num_temporaries++;
+            }
+        });
+    EXPECT_EQ(num_temporaries, 101);
+
+    state.clear<Archetype1>(cache, true);
+}
+
+TEST(State, ChangeTracking)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype2>(
+        ComponentMetadataSelector<Component1>(ComponentFlags::TrackChanges),
+        ArchetypeFlags::None);
+
+    uint32_t num_entities = 1'000;
+    Span<const Entity> entities =
+        state.makeEntities<Archetype2>(cache, num_entities);
+    Entity changed = entities[500];
+
+    auto query = state.query<Component1, Component2>();
+
+    uint32_t last_version = 0;
+    auto countChanged = [&](uint32_t changed_mask, uint32_t write_mask) {
+        ChangeFilter filter {
+            .sinceVersion = last_version,
+            .changedMask = changed_mask,
+            .writeMask = write_mask,
+        };
+        last_version = state.advanceChangeVersion();
+
+        uint32_t num_visited = 0;
+        state.iterateArchetypes(query, filter,
+            [&](CountT num_rows, Component1 *, Component2 *) {
+                num_visited += (uint32_t)num_rows;
+            });
+
+        return num_visited;
+    };
+
+    // New rows count as changed
+    EXPECT_EQ(countChanged(1, 0), num_entities);
+    EXPECT_EQ(countChanged(1, 0), 0u);
+
+    // Only the chunk holding the changed row is visited
+    state.markChanged<Component1>(changed);
+    uint32_t num_in_chunk = 0;
+    ChangeFilter filter { last_version, 1, 0 };
+    last_version = state.advanceChangeVersion();
+    state.iterateArchetypes(query, filter,
+        [&](CountT num_rows, Component1 *c1, Component2 *) {
+            num_in_chunk += (uint32_t)num_rows;
+            EXPECT_EQ(c1 - &state.get<Component1>(entities[0]).value(),
+                      500 / Table::changeChunkRows * Table::changeChunkRows);
+        });
+    EXPECT_EQ(num_in_chunk, Table::changeChunkRows);
+    EXPECT_EQ(countChanged(1, 0), 0u);
+
+    // Writing queries mark every row they visit
+    EXPECT_EQ(countChanged(0, 1), num_entities);
+    EXPECT_EQ(countChanged(1, 0), num_entities);
+    EXPECT_EQ(countChanged(1, 0), 0u);
+
+    // Filtering on an untracked column visits everything
+    EXPECT_EQ(countChanged(2, 0), num_entities);
+
+    // A query that filters on the component it writes, the way for nodes
+    // do, doesn't revisit its own writes, but earlier filters see them
+    uint32_t writer_version = last_version;
+    auto runWriter = [&]() {
+        ChangeFilter filter {
+            .sinceVersion = writer_version,
+            .changedMask = 1,
+            .writeMask = 1,
+        };
+        writer_version = state.advanceChangeVersion();
+        filter.writeVersion = writer_version;
+
+        uint32_t num_visited = 0;
+        state.iterateArchetypes(query, filter,
+            [&](CountT num_rows, Component1 *, Component2 *) {
+                num_visited += (uint32_t)num_rows;
+            });
+
+        return num_visited;
+    };
+
+    state.markChanged<Component1>(entities[0]);
+    EXPECT_EQ(runWriter(), Table::changeChunkRows);
+    EXPECT_EQ(runWriter(), 0u);
+    EXPECT_EQ(countChanged(1, 0), Table::changeChunkRows);
+    EXPECT_EQ(countChanged(1, 0), 0u);
+
+    // Destroying an entity moves the last row into its place
+    state.destroyEntityNow(cache, changed);
+    EXPECT_EQ(countChanged(1, 0), Table::changeChunkRows);
+}
+
+TEST(State, ColumnAlignment)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype2>();
+
+    auto query = state.query<Component1, Component2, Component3>();
+
+    for (int i = 0; i < 5; i++) {
+        state.makeEntities<Archetype2>(cache, 100 << i);
+
+        state.iterateArchetypes(query,
+            [&](CountT, Component1 *c1, Component2 *c2, Component3 *c3) {
+                EXPECT_EQ((uintptr_t)c1 % MADRONA_CACHE_LINE, 0u);
+                EXPECT_EQ((uintptr_t)c2 % MADRONA_CACHE_LINE, 0u);
+                EXPECT_EQ((uintptr_t)c3 % MADRONA_CACHE_LINE, 0u);
+            });
+    }
+}
+
+TEST(State, Snapshot)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype1>();
+    registry.registerArchetype<Archetype2>();
+
+    DynArray<Entity> kept(0);
+    for (uint32_t i = 0; i < 1000; i++) {
+        Entity e = state.makeEntityNow<Archetype2>(cache);
+        state.get<Component1>(e).value().v = i;
+        state.get<Component2>(e).value() = Component2 { i, i + 1, i + 2 };
+        kept.push_back(e);
+    }
+
+    Entity a1 = state.makeEntityNow<Archetype1>(cache);
+    state.get<Component1>(a1).value().v = 7;
+
+    HeapArray<char> snapshot(state.worldSnapshotBytes());
+    state.saveWorldSnapshot(cache, snapshot.data());
+
+    // Move rows around, destroy entities the restore must bring back and
+    // add entities it must drop again
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        state.get<Component1>(kept[i]).value().v = 0;
+    }
+    state.destroyEntityNow(cache, kept[0]);
+    state.destroyEntityNow(cache, kept[500]);
+    state.makeEntityNow<Archetype2>(cache);
+    state.makeEntityNow<Archetype2>(cache);
+    state.get<Component1>(a1).value().v = 8;
+
+    HeapArray<char> modified(state.worldSnapshotBytes());
+    state.saveWorldSnapshot(cache, modified.data());
+
+    state.restoreWorldSnapshot(cache, snapshot.data());
+
+    auto countRows = [&]() {
+        uint32_t num_rows = 0;
+        state.iterateQuery(state.query<Component1>(),
+            [&](Component1 &) { num_rows++; });
+        return num_rows;
+    };
+
+    EXPECT_EQ(countRows(), 1001u);
+    EXPECT_EQ(state.get<Component1>(a1).value().v, 7u);
+    for (uint32_t i = 0; i < 1000; i++) {
+        EXPECT_TRUE(state.getLoc(kept[i]).valid());
+        EXPECT_EQ(state.get<Component1>(kept[i]).value().v, i);
+        EXPECT_EQ(state.get<Component2>(kept[i]).value().z, i + 2);
+    }
+
+    // The restored ID map hands out IDs without disturbing restored
+    // entities, and the world can be restored again after changing it
+    DynArray<Entity> extra(0);
+    for (uint32_t i = 0; i < 10; i++) {
+        Entity e = state.makeEntityNow<Archetype1>(cache);
+        state.get<Component1>(e).value().v = 5000 + i;
+        extra.push_back(e);
+    }
+    state.destroyEntityNow(cache, extra[3]);
+
+    EXPECT_EQ(countRows(), 1001u + 9u);
+    for (uint32_t i = 0; i < 10; i++) {
+        if (i != 3) {
+            EXPECT_EQ(state.get<Component1>(extra[i]).value().v, 5000 + i);
+        }
+    }
+    for (uint32_t i = 0; i < 1000; i++) {
+        EXPECT_EQ(state.get<Component1>(kept[i]).value().v, i);
+    }
+
+    state.restoreWorldSnapshot(cache, modified.data());
+
+    EXPECT_EQ(countRows(), 1000u + 1u);
+    EXPECT_EQ(state.get<Component1>(a1).value().v, 8u);
+    EXPECT_FALSE(state.getLoc(kept[0]).valid());
+    EXPECT_FALSE(state.getLoc(kept[500]).valid());
+    for (uint32_t i = 1; i < 1000; i++) {
+        if (i == 500) {
+            continue;
+        }
+
+        EXPECT_EQ(state.get<Component1>(kept[i]).value().v,
+                  i % 2 == 0 ? 0 : i);
+        EXPECT_EQ(state.get<Component2>(kept[i]).value().x, i);
+    }
+}
+
+TEST(State, TmpAlloc)
+{
+    StateManager state;
+
+    StateManager::TmpAllocStats stats = state.tmpAllocStats();
+    const uint64_t block_bytes = stats.blockBytes;
+    EXPECT_EQ(stats.heldBytes, 0u);
+
+    void *a = state.tmpAlloc(1000);
+    void *b = state.tmpAlloc(1000);
+    EXPECT_EQ((uintptr_t)a % 256, 0u);
+    EXPECT_EQ((char *)b - (char *)a, 1024);
+
+    stats = state.tmpAllocStats();
+    EXPECT_EQ(stats.heldBytes, block_bytes);
+    EXPECT_EQ(stats.highWaterBytes, 2048u);
+
+    // The block is kept for the next interval
+    state.resetTmpAlloc();
+    EXPECT_EQ(state.tmpAllocStats().heldBytes, block_bytes);
+
+    // A spike gets its own oversized block
+    state.tmpAlloc(2 * block_bytes);
+    state.tmpAlloc(16);
+    stats = state.tmpAllocStats();
+    EXPECT_EQ(stats.heldBytes, 3 * block_bytes);
+    EXPECT_EQ(stats.highWaterBytes, 2 * block_bytes + 256);
+
+    // After a quieter interval only what it used is kept
+    state.resetTmpAlloc();
+    state.tmpAlloc(16);
+    state.resetTmpAlloc();
+    EXPECT_EQ(state.tmpAllocStats().heldBytes, block_bytes);
+
+    state.resetTmpAlloc();
+    EXPECT_EQ(state.tmpAllocStats().heldBytes, 0u);
+    EXPECT_EQ(state.tmpAllocStats().highWaterBytes, 2 * block_bytes + 256);
+}
+
+TEST(State, TmpAllocThreads)
+{
+    StateManager state;
+
+    constexpr CountT num_threads = 4;
+    constexpr CountT num_allocs = 500;
+
+    // Sizes from 4 KiB to 256 KiB, so blocks fill up while other threads
+    // are still allocating from them
+    std::vector<std::pair<uintptr_t, uint64_t>> allocs[num_threads];
+    std::vector<std::thread> threads;
+    for (CountT t = 0; t < num_threads; t++) {
+        threads.emplace_back([&state, &allocs, t]() {
+            for (CountT i = 0; i < num_allocs; i++) {
+                uint64_t num_bytes =
+                    uint64_t((i * 7919 + t * 104729) % 64 + 1) * 4096;
+                void *ptr = state.tmpAlloc(num_bytes);
+                allocs[t].emplace_back((uintptr_t)ptr, num_bytes);
+            }
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<std::pair<uintptr_t, uint64_t>> all;
+    uint64_t total_bytes = 0;
+    for (CountT t = 0; t < num_threads; t++) {
+        for (auto [ptr, num_bytes] : allocs[t]) {
+            all.emplace_back(ptr, num_bytes);
+            total_bytes += num_bytes;
+        }
+    }
+
+    std::sort(all.begin(), all.end());
+    for (size_t i = 1; i < all.size(); i++) {
+        EXPECT_GE(all[i].first, all[i - 1].first + all[i - 1].second);
+    }
+
+    StateManager::TmpAllocStats stats = state.tmpAllocStats();
+    EXPECT_EQ(stats.highWaterBytes, total_bytes);
+    EXPECT_GE(stats.heldBytes, total_bytes);
+
+    state.resetTmpAlloc();
+}
+
+TEST(State, MemoryReport)
+{
+    StateManager state;
+    StateCache cache;
+    ECSRegistry registry(&state, nullptr);
+    registry.registerComponent<Component1>();
+    registry.registerComponent<Component2>();
+    registry.registerComponent<Component3>();
+    registry.registerArchetype<Archetype1>();
+    registry.registerArchetype<Archetype2>();
+
+    for (uint32_t i = 0; i < 5000; i++) {
+        state.makeEntityNow<Archetype2>(cache);
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        state.makeEntityNow<Archetype1>(cache);
+    }
+    state.tmpAlloc(16);
+
+    MemoryReport report = state.memoryReport();
+
+    uint32_t a1_id = state.archetypeID<Archetype1>().id;
+    uint32_t a2_id = state.archetypeID<Archetype2>().id;
+
+    uint64_t total_committed = 0;
+    uint64_t world_committed = 0;
+    uint32_t num_found = 0;
+    for (const MemoryReport::Archetype &archetype : report.archetypes) {
+        uint64_t archetype_committed = 0;
+        for (uint32_t i = 0; i < archetype.numColumns; i++) {
+            const MemoryReport::Column &column =
+                report.columns[archetype.columnOffset + i];
+            EXPECT_GE(column.usage.committedBytes,
+                      archetype.numRows * column.numBytesPerRow);
+            EXPECT_GE(column.usage.reservedBytes,
+                      column.usage.committedBytes);
+            archetype_committed += column.usage.committedBytes;
+        }
+        EXPECT_EQ(archetype.usage.committedBytes, archetype_committed);
+        total_committed += archetype_committed;
+
+        if (archetype.archetypeID == a1_id) {
+            EXPECT_EQ(archetype.numRows, 10u);
+            // Entity and Component1
+            EXPECT_EQ(archetype.numColumns, 2u);
+            num_found++;
+        } else if (archetype.archetypeID == a2_id) {
+            EXPECT_EQ(archetype.numRows, 5000u);
+            EXPECT_EQ(archetype.numColumns, 4u);
+            EXPECT_EQ(report.columns[archetype.columnOffset + 2].componentID,
+                      state.componentID<Component2>().id);
+            num_found++;
+        }
+    }
+    EXPECT_EQ(num_found, 2u);
+
+    EXPECT_GE(report.entityStore.committedBytes, 5010 * sizeof(uint64_t));
+    EXPECT_EQ(report.tmpAllocators.committedBytes,
+              state.tmpAllocStats().heldBytes);
+
+    total_committed += report.entityStore.committedBytes +
+        report.tmpAllocators.committedBytes +
+        report.exportBuffers.committedBytes +
+        report.singletons.committedBytes;
+    EXPECT_EQ(report.total.committedBytes, total_committed);
+
+    ASSERT_EQ(report.worldCommittedBytes.size(), 1);
+    for (uint64_t num_bytes : report.worldCommittedBytes) {
+        world_committed += num_bytes;
+    }
+    EXPECT_EQ(world_committed, total_committed);
+}